@@ -0,0 +1,44 @@
+#include <Box2D/Particle/b2ParticleBenchmark.h>
+
+// The benchmarks of ParticleBenchmark for the plugin, on the particle system of
+// Interface.cpp. Only exported if ELEMENTALPHYSICS_BENCHMARKS is defined.
+#ifdef ELEMENTALPHYSICS_BENCHMARKS
+
+#define EXPORT extern "C" __declspec(dllexport)
+
+extern ParticleSystem* pPartSys;
+
+EXPORT int32 FindContactsScalingTest(int32 maxCount, int32 runs, float32* times, int32 timesCapacity)
+{
+	return ParticleBenchmark(*pPartSys).FindContactsScaling(maxCount, runs, times, timesCapacity);
+}
+EXPORT float32 ContactSearchTest(bool grid, int32 particleCnt, int32 layers, int32 runs)
+{
+	return ParticleBenchmark(*pPartSys).ContactSearch(grid, particleCnt, layers, runs);
+}
+EXPORT float32 NeighbourListTest(float32 skin, int32 iterations, int32 runs)
+{
+	return ParticleBenchmark(*pPartSys).NeighbourList(skin, iterations, runs);
+}
+EXPORT float32 FreeRangesTest(int32 groupCnt, int32 steps, int32 runs)
+{
+	return ParticleBenchmark(*pPartSys).FreeRanges(groupCnt, steps, runs);
+}
+EXPORT float32 IntegrateTest(bool fused, int32 particleCnt, int32 runs)
+{
+	return ParticleBenchmark(*pPartSys).Integrate(fused, particleCnt, runs);
+}
+EXPORT float32 SortProxiesTest(bool wide, int32 runs)
+{
+	return ParticleBenchmark(*pPartSys).SortProxies(wide, runs);
+}
+EXPORT float32 ComputeDepthTest(int32 particleCnt, int32 runs)
+{
+	return ParticleBenchmark(*pPartSys).ComputeDepth(particleCnt, runs);
+}
+EXPORT bool DeterministicTest(int32 matIdx, int32 particleCnt, int32 steps, int32 threadCntA, int32 threadCntB)
+{
+	return ParticleBenchmark(*pPartSys).Deterministic(matIdx, particleCnt, steps, threadCntA, threadCntB);
+}
+
+#endif
@@ -1,10 +1,15 @@
 #pragma once
 
-#include <amp.h>
 #include <Box2D/Common/b2Math.h>
 #include <Box2D/Common/b2Timer.h>
 #include <Box2D/Common/Global.h>
+#include <mutex>
+#include <vector>
+#ifndef AMP_CPU_BACKEND
+#include <amp.h>
 #include <d3d11.h>
+#include <ppl.h>
+#endif
 
 template <int N>
 inline int32 getNextMultiple(const int32 value)
@@ -19,15 +24,22 @@ inline int32 getTileCnt(const int32 value)
 
 namespace amp
 {
+#ifdef AMP_CPU_BACKEND
+	// no D3D11 device on this backend, spD11AccelView is only defined by the plugin
+	static inline ampAccelView d11AccelView() { return ampAccelView(); }
+#else
 	static inline ampAccelView d11AccelView() { return *spD11AccelView; }
+#endif
 	static inline ampAccelView accelView() { return ampAccel(ampAccel::default_accelerator).default_view; }
 	static inline ampAccelView cpuAccelView() { return ampAccel(ampAccel::cpu_accelerator).default_view; }
 
-	static void CheckCompatibilty()
+	static inline void CheckCompatibilty()
 	{
+#ifndef AMP_CPU_BACKEND
 		auto accelerators = Concurrency::accelerator::get_all();
 		if (accelerators.size() == 0)
 			throw ERROR;
+#endif
 	}
 
 	class CopyFuture
@@ -39,24 +51,88 @@ namespace amp
 		void wait() { if (m_future.valid()) m_future.wait(); }
 	};
 
-	static int32 getTileCount(const int32 size)
+	// Bump allocator for the transient arrays of the kernels. The views stay
+	// valid until the next Reset, which runs at the start of the step and of
+	// each of its iterations. Allocations that don't fit get an array of their
+	// own, and the next Reset grows the block to what the iteration needed, so
+	// steady steps don't allocate at all.
+	// Passes that run concurrently share the arena through the mutex.
+	class ScratchArena
+	{
+	private:
+		ampAccelView m_accelView;
+		ampArray<uint32> m_block;
+		std::vector<ampArray<uint32>> m_overflow;
+		int32 m_used;		// in words of the block
+		int32 m_needed;		// words of the block and of the overflow
+		int32 m_allocCnt;
+		std::mutex m_mutex;
+
+	public:
+		ScratchArena(const ampAccelView& accelView, const int32 words = 1 << 16) :
+			m_accelView(accelView), m_block(words, accelView),
+			m_used(0), m_needed(0), m_allocCnt(1) {}
+
+		template<typename T> ampArrayView<T> Alloc(int32 cnt)
+		{
+			static_assert(sizeof(T) % sizeof(uint32) == 0, "scratch elements are made of words");
+			const int32 typeWords = sizeof(T) / sizeof(uint32);
+			cnt = b2Max(cnt, 1);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			const int32 start = getNextMultiple<typeWords>(m_used);
+			if (start + cnt * typeWords <= m_block.extent[0])
+			{
+				m_needed += start + cnt * typeWords - m_used;
+				m_used = start + cnt * typeWords;
+				return m_block.reinterpret_as<T>().section(start / typeWords, cnt);
+			}
+			m_overflow.emplace_back(cnt * typeWords, m_accelView);
+			m_needed += cnt * typeWords;
+			m_allocCnt++;
+			return m_overflow.back().reinterpret_as<T>().section(0, cnt);
+		}
+
+		void Reset()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_overflow.empty())
+			{
+				m_block = ampArray<uint32>(m_needed + m_needed / 2, m_accelView);
+				m_overflow.clear();
+				m_allocCnt++;
+			}
+			m_used = 0;
+			m_needed = 0;
+		}
+
+		/// Device allocations so far, including the block.
+		int32 GetAllocationCount() const { return m_allocCnt; }
+	};
+	// the arena of accelView(), which all kernels run on
+	inline ScratchArena& scratch()
+	{
+		static ScratchArena arena(accelView());
+		return arena;
+	}
+
+	static inline int32 getTileCount(const int32 size)
 	{
 		return ((size + TILE_SIZE - 1) / TILE_SIZE);
 	}
-	static int32 getTilable(const int32 size)
+	static inline int32 getTilable(const int32 size)
 	{
 		return getTileCount(size) * TILE_SIZE;
 	}
-	static int32 getTilable(const int32 size, int32& tileCnt)
+	static inline int32 getTilable(const int32 size, int32& tileCnt)
 	{
 		tileCnt = getTileCount(size);
 		return tileCnt * TILE_SIZE;
 	}
-	static ampExtent getTilableExtent(const int32 size)
+	static inline ampExtent getTilableExtent(const int32 size)
 	{
 		return ampExtent(getTilable(size));
 	}
-	static ampExtent getTilableExtent(const int32 size, int32& tileCnt)
+	static inline ampExtent getTilableExtent(const int32 size, int32& tileCnt)
 	{
 		return ampExtent(getTilable(size, tileCnt));
 	}
@@ -186,7 +262,7 @@ namespace amp
 	static void fill(ampArray<T>& a, const T& value, const int32 size = 0)
 	{
 		const ampExtent e = size ? ampExtent(size) : a.extent;
-		Concurrency::parallel_for_each(e, [=, &a](ampIdx idx) restrict(amp)
+		Concurrency::parallel_for_each(e, [=, &a](ampIdx idx) AMP_RESTRICT
 		{
 			a[idx] = value;
 		});
@@ -195,7 +271,7 @@ namespace amp
 	static void fill(ampArrayView<T>& av, const T& value, const int32 size)
 	{
 		const ampExtent e = size ? ampExtent(size) : av.extent;
-		Concurrency::parallel_for_each(e, [=](ampIdx idx) restrict(amp)
+		Concurrency::parallel_for_each(e, [=](ampIdx idx) AMP_RESTRICT
 		{
 			av[idx] = value;
 		});
@@ -205,7 +281,7 @@ namespace amp
 	{
 		const int32 size = end - start;
 		if (size <= 0) return;
-		Concurrency::parallel_for_each(ampExtent(size), [=, &a](ampIdx idx) restrict(amp)
+		Concurrency::parallel_for_each(ampExtent(size), [=, &a](ampIdx idx) AMP_RESTRICT
 		{
 			a[start + idx] = value;
 		});
@@ -214,7 +290,7 @@ namespace amp
 	static void fill(ampArray2D<T>& a, const T& value, int32 sizeY = 0, int32 sizeX = 0)
 	{
 		const ampExtent2D e(sizeY ? sizeY : a.extent[0], sizeX ? sizeX : a.extent[1]);
-		Concurrency::parallel_for_each(e, [=, &a](ampIdx2D idx) restrict(amp)
+		Concurrency::parallel_for_each(e, [=, &a](ampIdx2D idx) AMP_RESTRICT
 		{
 			a[idx] = value;
 		});
@@ -222,7 +298,7 @@ namespace amp
 	template <typename T>
 	static void fill(ampArrayView<T>& av, const T& value)
 	{
-		Concurrency::parallel_for_each(av.extent, [=](ampIdx idx) restrict(amp)
+		Concurrency::parallel_for_each(av.extent, [=](ampIdx idx) AMP_RESTRICT
 		{
 			av[idx] = value;
 		});
@@ -282,21 +358,50 @@ namespace amp
 		a = ampArray<T>(size, a.accelerator_view, a.associated_accelerator_view);
 	}
 
+	// Sets the threads of the cpu backend, 0 for one per core. The accelerator
+	// schedules its own threads, so it has no effect there.
+	static inline void setThreadCount(const int32 cnt)
+	{
+#ifdef AMP_CPU_BACKEND
+		ampcpu::detail::ThreadPool::get().setThreadCnt(cnt);
+#else
+		(void)cnt;
+#endif
+	}
+
+	// Runs cnt independent host tasks concurrently on a work-stealing pool.
+	// Kernels launched from the tasks share the accelerator (or the cpu pool).
+	template <typename F>
+	static void runTasks(const int32 cnt, const F& function)
+	{
+		if (cnt <= 0) return;
+		if (cnt == 1) { function(0); return; }
+#ifdef AMP_CPU_BACKEND
+		ampcpu::detail::ThreadPool::get().runTasks(cnt, function);
+#else
+		Concurrency::parallel_for(0, cnt, [&](const int32 i) { function(i); });
+#endif
+	}
+
 	template <typename F>
 	static void forEach(const int32 cnt, const F& function)
 	{
 		if (!cnt) return;
-		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+#ifdef AMP_CPU_BACKEND
+		ampcpu::detail::parallelFor(cnt, function);
+#else
+		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 		{
 			if (const int32 i = tIdx.global[0]; i < cnt)
 				function(i);
 		});
+#endif
 	}
 	template <int T1, int T2, typename F>
 	static void forEach2D(const int32 cntY, const int32 cntX, const F& function)
 	{
 		if (!cntY || !cntX) return;
-		Concurrency::parallel_for_each(ampExtent2D(cntY, cntX).tile<T1, T2>().pad(), [=](ampTiledIdx2D<T1, T2> tIdx) restrict(amp)
+		Concurrency::parallel_for_each(ampExtent2D(cntY, cntX).tile<T1, T2>().pad(), [=](ampTiledIdx2D<T1, T2> tIdx) AMP_RESTRICT
 		{
 			const ampIdx2D idx = tIdx.global;
 			const int32 i1 = idx[0];
@@ -309,7 +414,7 @@ namespace amp
 	//static void forEach2DTiled(const int32 cntY, const int32 cntX, const F& function)
 	//{
 	//	if (!cntY || !cntX) return;
-	//	Concurrency::parallel_for_each(ampExtent2D(cntY, cntX).tile<T1, T2>().pad(), [=](ampTiledIdx2D<T1, T2> tIdx) restrict(amp)
+	//	Concurrency::parallel_for_each(ampExtent2D(cntY, cntX).tile<T1, T2>().pad(), [=](ampTiledIdx2D<T1, T2> tIdx) AMP_RESTRICT
 	//	{
 	//		const ampIdx2D idx = tIdx.global;
 	//		const int32 i1 = idx[0];
@@ -323,44 +428,68 @@ namespace amp
 	{
 		if (const int32 cnt = end - start; cnt > 0)
 		{
-			Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+#ifdef AMP_CPU_BACKEND
+			ampcpu::detail::parallelFor(cnt, [&](const int32 i) { function(start + i); });
+#else
+			Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 			{
 				const int32 i = tIdx.global[0] + start;
 				if (i < end)
 					function(i);
 			});
+#endif
 		}
 	}
 	template <typename F>
 	static void forEachTiled(const int32 cnt, const F& function)
 	{
 		if (!cnt) return;
-		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+#ifdef AMP_CPU_BACKEND
+		ampcpu::detail::parallelFor(getTilable(cnt), [&](const int32 gi)
+		{
+			if (const int32 li = gi % TILE_SIZE; li < cnt)
+				function(gi, gi / TILE_SIZE, li);
+		});
+#else
+		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 		{
 			if (tIdx.local[0] < cnt)
 				function(tIdx.global[0], tIdx.tile[0], tIdx.local[0]);
 		});
+#endif
 	}
 	template <typename F>
 	static void forEachTiledWithBarrier(const int32 cnt, const F& function)
 	{
 		if (!cnt) return;
-		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 		{
 			function(tIdx);
 		});
 	}
 
-	static uint32 reduceFlags(const ampArrayView<const uint32>& a, const int32 cnt)
+	static inline uint32 reduceFlags(const ampArrayView<const uint32>& a, const int32 cnt)
 	{
 		if (!cnt) return 0;
-		ampArrayView<uint32> flagBits(32);
+#ifdef AMP_CPU_BACKEND
+		std::atomic<uint32> cpuFlags = 0;
+		const int32 chunkCnt = getTileCount(cnt);
+		ampcpu::detail::ThreadPool::get().run(chunkCnt, [&](const int32 c)
+		{
+			uint32 chunkFlags = 0;
+			for (int32 i = c * TILE_SIZE, end = b2Min(cnt, i + TILE_SIZE); i < end; i++)
+				chunkFlags |= a[i];
+			cpuFlags.fetch_or(chunkFlags);
+		});
+		return cpuFlags;
+#else
+		ampArrayView<uint32> flagBits = scratch().Alloc<uint32>(32);
 		fill(flagBits, 0u);
-		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+		Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 		{
 			const int32 gi = tIdx.global[0];
 			const int32 li = tIdx.local[0];
-			tile_static int32 lFlagBits[32];
+			AMP_TILE_STATIC int32 lFlagBits[32];
 			if (li < 32)
 				lFlagBits[li] = 0;
 			tIdx.barrier.wait_with_tile_static_memory_fence();
@@ -379,6 +508,7 @@ namespace amp
 			if (flagBits[i])
 				particleFlags |= 1 << i;
 		return particleFlags;
+#endif
 	}
 
 	//template<typename T>
@@ -386,12 +516,12 @@ namespace amp
 	//{
 	//	ampArrayView<uint32> sorted(1);
 	//	fill(sorted, 1u);
-	//	Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+	//	Concurrency::parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 	//	{
 	//		const int32 gi = tIdx.global[0];
 	//		const int32 li = tIdx.local[0];
 	//		if (gi + 1 >= cnt) return;
-	//		tile_static int32 lValues[TILE_SIZE + 1];
+	//		AMP_TILE_STATIC int32 lValues[TILE_SIZE + 1];
 	//		const int32 nextValue = lValues[li + 1] = av[gi + 1];
 	//		if (li == 0) lValues[li] = av[gi];
 	//		tIdx.barrier.wait_with_tile_static_memory_fence();
@@ -408,7 +538,7 @@ namespace amp
 		ampArray<uint32> cntSums(cnts, m_gpuAccelView);
 		for (uint32 stride = 2, halfStride = 1; stride <= sizeMax; halfStride = stride, stride *= 2)
 		{
-			Concurrency::parallel_for_each(ampExtent(sizeMax / stride), [=, &cntSums](ampIdx idx) restrict(amp)
+			Concurrency::parallel_for_each(ampExtent(sizeMax / stride), [=, &cntSums](ampIdx idx) AMP_RESTRICT
 			{
 				const uint32 i = (idx[0] + 1) * stride - 1;
 				cntSums[i] += cntSums[i - halfStride];
@@ -416,7 +546,7 @@ namespace amp
 		}
 		uint32 reducedCnt;
 		ampCopyFuture reducedCntPromise = copyAsync(cntSums, sizeMax - 1, reducedCnt);
-		forEach(size, [=, &cntSums, &cnts](const int32 i) restrict(amp)
+		forEach(size, [=, &cntSums, &cnts](const int32 i) AMP_RESTRICT
 		{
 			const uint32 cnt = cnts(i);
 			if (!cnt) return;
@@ -436,7 +566,7 @@ namespace amp
 		return reducedCnt;
 	}*/
 
-	//template<int32 TileSize> static bool lastInTile(const ampTiledIdx<TileSize>& tIdx) restrict(amp)
+	//template<int32 TileSize> static bool lastInTile(const ampTiledIdx<TileSize>& tIdx) AMP_RESTRICT
 	//{
 	//	return tIdx.local[0] == (TileSize - 1);
 	//}
@@ -450,12 +580,12 @@ namespace amp
 	//		if (!cnt) cnt = src.extent.size();
 	//		const auto computeDomain = tileAndPad<TileSize>(cnt);
 	//		ampArray<T> tileSums(computeDomain.size() / TileSize);
-	//		parallel_for_each(computeDomain, [=, &tileSums](ampTiledIdx<TileSize> tIdx) restrict(amp)
+	//		parallel_for_each(computeDomain, [=, &tileSums](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
 	//		{
 	//			const uint32 gi = tIdx.global[0], li = tIdx.local[0];
 	//			const bool inRange = gi < cnt;
 
-	//			tile_static T lPrefixSums[TileSize][2];
+	//			AMP_TILE_STATIC T lPrefixSums[TileSize][2];
 	//			const T origVal = inRange ? src[gi] : 0;
 	//			lPrefixSums[li][0] = origVal;
 	//			tIdx.barrier.wait_with_tile_static_memory_fence();
@@ -490,7 +620,7 @@ namespace amp
 	//		for (uint32 i = 0; i < iterations; i++)
 	//		{
 	//			const uint32 pow2i = _prefix_sum_detail::pow2(i);
-	//			parallel_for_each(computeDomain, [=, &prefixSumsR, &prefixSumsW](ampTiledIdx<TileSize> tIdx) restrict(amp)
+	//			parallel_for_each(computeDomain, [=, &prefixSumsR, &prefixSumsW](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
 	//			{
 	//				const int32 gi = tIdx.global[0];
 	//				if (gi > cnt) return;
@@ -502,7 +632,7 @@ namespace amp
 	//		}
 	//		ampCopyFuture fut = copyAsync(prefixSumsW, cnt - 1, sum);
 
-	//		parallel_for_each(computeDomain, [=, &prefixSumsR, &prefixSumsW](ampTiledIdx<TileSize> tIdx) restrict(amp)
+	//		parallel_for_each(computeDomain, [=, &prefixSumsR, &prefixSumsW](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
 	//		{
 	//			const int32 gi = tIdx.global[0];
 	//			prefixSumsR[gi] = (gi == 0) ? 0 : prefixSumsW[gi - 1];
@@ -539,7 +669,7 @@ namespace amp
 	//	float32 t2 = t.Restart();
 
 	//	Concurrency::parallel_for_each(ampExtent(cnt).tile<TILE_SIZE>().pad(),
-	//		[=, &lPrefixSums, &tPrefixSums, &ttPrefixSums](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+	//		[=, &lPrefixSums, &tPrefixSums, &ttPrefixSums](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 	//	{
 	//		const int32 gi = tIdx.global[0];
 	//		if (gi < cnt)
@@ -559,7 +689,7 @@ namespace amp
 	{
 		template <int TileSize, typename T>
 		static void tilewiseScan(const ampArrayView<const T>& input,
-			ampArray<T>& tilewiseScans, ampArray<T>& tileSums, int32 cnt)
+			const ampArrayView<T>& tilewiseScans, const ampArrayView<T>& tileSums, int32 cnt)
 		{
 			ampArrayView<T> tileSumsView(tileSums);
 			ampArrayView<T> tilewiseScansView(tilewiseScans);
@@ -567,7 +697,7 @@ namespace amp
 			const int32 threadCnt = tileCnt * TileSize;
 
 			parallel_for_each(tileAndPad<TileSize>(cnt),
-				[=](ampTiledIdx<TileSize> tIdx) restrict(amp)
+				[=](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
 			{
 				//const int32 gi = tIdx.global[0];
 				//T sum;
@@ -579,7 +709,7 @@ namespace amp
 				const int32 gi = tIdx.global[0];
 				const bool inRange = gi < cnt;
 
-				tile_static T tile[TileSize];
+				AMP_TILE_STATIC T tile[TileSize];
 				// if (inRange) tile[li] = val;
 				T val = tile[li] = inRange ? input[gi] : T(0);
 
@@ -601,22 +731,25 @@ namespace amp
 			});
 		}
 
+		template <int TileSize, typename T>
+		static void scanTiled(const ampArrayView<const T>& input, const ampArrayView<T>& output, int32 cnt);
+
 		// Compute prefix of prefix
 		template <int TileSize, typename T>
 		static void prefixScan(const ampArrayView<T>& a, int32 cnt)
 		{
-			ampArray<T> atemp(cnt);
+			ampArrayView<T> atemp = scratch().Alloc<T>(cnt);
 			_scan_detail::scanTiled<TileSize>(ampArrayView<const T>(a), atemp, cnt);
 			Concurrency::copy(atemp, a);
 		}
 
 		template <int TileSize, typename T>
-		static void scanTiled(const ampArrayView<const T>& input, ampArray<T>& output, int32 cnt)
+		static void scanTiled(const ampArrayView<const T>& input, const ampArrayView<T>& output, int32 cnt)
 		{
 			const int32 tileCnt = (cnt + TileSize - 1) / TileSize;
 
 			// Compute tile-wise scans and reductions
-			ampArray<T> tileSumScan(tileCnt);
+			ampArrayView<T> tileSumScan = scratch().Alloc<T>(tileCnt);
 			_scan_detail::tilewiseScan<TileSize>(ampArrayView<const T>(input), output, tileSumScan, cnt);
 
 			// recurse if necessary
@@ -627,7 +760,7 @@ namespace amp
 				if (cnt > 0)
 				{
 					ampArrayView<T> outputView(output);
-					parallel_for_each(ampExtent(cnt), [=, &tileSumScan](ampIdx idx) restrict(amp)
+					parallel_for_each(ampExtent(cnt), [=](ampIdx idx) AMP_RESTRICT
 					{
 						const int32 tileIdx = idx[0] / TileSize;
 						outputView[idx] = (tileIdx == 0) ?
@@ -639,11 +772,109 @@ namespace amp
 		}
 	}
 
+#ifdef AMP_CPU_BACKEND
+	namespace _cpu_detail
+	{
+		// Exclusive scan in chunks: sum every chunk, scan the chunk sums, then walk the chunks again.
+		template<typename T, typename F>
+		static T scan(const ampArrayView<const T>& src, const int32 cnt, const F& function)
+		{
+			ampcpu::detail::ThreadPool& pool = ampcpu::detail::ThreadPool::get();
+			const int32 chunkCnt = b2Min(cnt, pool.threadCnt() * 4);
+			const int32 chunkSize = (cnt + chunkCnt - 1) / chunkCnt;
+			std::vector<T> chunkSums(chunkCnt + 1, T(0));
+			pool.run(chunkCnt, [&](const int32 c)
+			{
+				T sum = 0;
+				for (int32 i = c * chunkSize, end = b2Min(cnt, i + chunkSize); i < end; i++)
+					sum += src[i];
+				chunkSums[c + 1] = sum;
+			});
+			for (int32 c = 0; c < chunkCnt; c++)
+				chunkSums[c + 1] += chunkSums[c];
+			pool.run(chunkCnt, [&](const int32 c)
+			{
+				T prefix = chunkSums[c];
+				for (int32 i = c * chunkSize, end = b2Min(cnt, i + chunkSize); i < end; i++)
+				{
+					const T val = src[i];
+					function(i, prefix);
+					prefix += val;
+				}
+			});
+			return chunkSums[chunkCnt];
+		}
+
+		// LSD radix sort with 8 bit digits. Every chunk scatters its elements
+		// in order, so each pass is stable. Sorts by the low keyBits bits of
+		// tag - base, tags below base count as base. A pass whose digit is
+		// equal in all keys doesn't scatter.
+		static void radixSort(Proxy* a, Proxy* temp, std::vector<int32>& offsets,
+			const int32 size, const uint32 base, const uint32 keyBits)
+		{
+			ampcpu::detail::ThreadPool& pool = ampcpu::detail::ThreadPool::get();
+			const int32 chunkCnt = b2Min(b2Max(size / TILE_SIZE, 1), pool.threadCnt() * 4);
+			const int32 chunkSize = (size + chunkCnt - 1) / chunkCnt;
+			offsets.resize(chunkCnt * 256);
+			Proxy* src = a;
+			Proxy* dst = temp;
+			const auto key = [base](const Proxy& p) { return p.tag < base ? 0u : p.tag - base; };
+			for (uint32 shift = 0; shift < keyBits; shift += 8)
+			{
+				std::fill(offsets.begin(), offsets.end(), 0);
+				pool.run(chunkCnt, [&](const int32 c)
+				{
+					int32* cnts = &offsets[c * 256];
+					for (int32 i = c * chunkSize, end = b2Min(size, i + chunkSize); i < end; i++)
+						cnts[(key(src[i]) >> shift) & 0xFF]++;
+				});
+				int32 sum = 0;
+				bool sorted = false;
+				for (int32 d = 0; d < 256; d++)
+				{
+					const int32 digitStart = sum;
+					for (int32 c = 0; c < chunkCnt; c++)
+					{
+						int32& offset = offsets[c * 256 + d];
+						const int32 digitCnt = offset;
+						offset = sum;
+						sum += digitCnt;
+					}
+					sorted |= sum - digitStart == size;
+				}
+				if (sorted) continue;
+				pool.run(chunkCnt, [&](const int32 c)
+				{
+					int32* chunkOffsets = &offsets[c * 256];
+					for (int32 i = c * chunkSize, end = b2Min(size, i + chunkSize); i < end; i++)
+					{
+						const Proxy p = src[i];
+						dst[chunkOffsets[(key(p) >> shift) & 0xFF]++] = p;
+					}
+				});
+				std::swap(src, dst);
+			}
+			if (src != a)
+				std::copy(src, src + size, a);
+		}
+		static void radixSort(const ampArrayView<Proxy>& a, const int32 size)
+		{
+			std::vector<Proxy> temp(size);
+			std::vector<int32> offsets;
+			radixSort(a.data(), temp.data(), offsets, size, 0, 32);
+		}
+	}
+#endif
+
 	template<typename T, typename F>
 	static int32 scan(const ampArrayView<const T>& src, const int32 cnt, const F& function)
 	{
+#ifdef AMP_CPU_BACKEND
+		if (cnt <= 0) return 0;
+		return _cpu_detail::scan(src, cnt, function);
+#else
 		Timer t = Timer();
-		ampArray<T> dst(cnt);
+		ampArrayView<T> dst = scratch().Alloc<T>(cnt);
 		//Timer t = Timer();
 		_scan_detail::scanTiled<TILE_SIZE>(src, dst, cnt);
 
@@ -651,7 +882,7 @@ namespace amp
 		ampCopyFuture sumFut = copyAsync(dst, cnt - 1, sum);
 		//float32 t0 = t.Restart();
 
-		parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=, &dst](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+		parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 		{
 			const int32 gi = tIdx.global[0];
 			if (gi < cnt)
@@ -661,6 +892,7 @@ namespace amp
 		sumFut.wait();
 		float32 t1 = t.Stop();
 		return sum;
+#endif
 	}
 
 	//template<typename T, typename F>
@@ -683,7 +915,7 @@ namespace amp
 
 	//		ampArrayView<const T> tileSumScanView(tileSums);
 	//		ampArrayView<const T> tile2SumView(tile2Sums);
-	//		parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+	//		parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 	//		{
 	//			const int32 gi = tIdx.global[0];
 	//			if (gi >= cnt || !src[gi]) return;
@@ -706,7 +938,7 @@ namespace amp
 	//	T lastTileSum;
 	//	ampCopyFuture lastTileSumFut = copyAsync(tileSums, tileCnt - 1, lastTileSum);
 
-	//	parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+	//	parallel_for_each(tileAndPad<TILE_SIZE>(cnt), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 	//	{
 	//		const int32 gi = tIdx.global[0];
 	//		if (gi < cnt)
@@ -719,14 +951,16 @@ namespace amp
 
 	namespace _prefix_sum_detail
 	{
-		static inline uint32 pow2(uint32 x) restrict(amp) { return 1u << x; }
+#ifndef AMP_CPU_BACKEND
+		static inline uint32 pow2(uint32 x) AMP_RESTRICT { return 1u << x; }
+#endif
 		static inline uint32 pow2(uint32 x) { return 1u << x; }
 
 		template<int TileSize>
-		static uint32 tileSum(uint32 x, ampTiledIdx<TileSize>& tIdx) restrict(amp)
+		static uint32 tileSum(uint32 x, ampTiledIdx<TileSize>& tIdx) AMP_RESTRICT
 		{
 			uint32 li = tIdx.local[0];
-			tile_static uint32 lSums[TileSize][2];
+			AMP_TILE_STATIC uint32 lSums[TileSize][2];
 
 			lSums[li][0] = x;
 			tIdx.barrier.wait_with_tile_static_memory_fence();
@@ -747,11 +981,11 @@ namespace amp
 
 
 		template<typename T, int TileSize>
-		static T tilePrefixSumWithoutOrig(T val, ampTiledIdx<TileSize> tIdx, T& sum) restrict(amp)
+		static T tilePrefixSumWithoutOrig(T val, ampTiledIdx<TileSize> tIdx, T& sum) AMP_RESTRICT
 		{
 			const uint32 li = tIdx.local[0];
 
-			tile_static T tile[TileSize];
+			AMP_TILE_STATIC T tile[TileSize];
 			tile[li] = val;
 
 			for (uint32 offset = 2, half = 1; half <= TileSize; half = offset, offset *= 2)
@@ -771,11 +1005,11 @@ namespace amp
 		}
 
 		template<typename T, int TileSize>
-		static T tilePrefixSum(T val, ampTiledIdx<TileSize> tIdx, T& sum) restrict(amp)
+		static T tilePrefixSum(T val, ampTiledIdx<TileSize> tIdx, T& sum) AMP_RESTRICT
 		{
 			const uint32 li = tIdx.local[0];
 
-			tile_static T tile[TileSize];
+			AMP_TILE_STATIC T tile[TileSize];
 			const T origVal = tile[li] = val;
 
 			for (uint32 offset = 2, half = 1; half <= TileSize; half = offset, offset *= 2)
@@ -817,7 +1051,7 @@ namespace amp
 		}
 
 		template<int TileSize>
-		static uint32 tilePrefixSum(uint32 x, ampTiledIdx<TileSize> tIdx) restrict(amp)
+		static uint32 tilePrefixSum(uint32 x, ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
 		{
 			uint32 ll = 0;
 			return tilePrefixSum(x, tIdx, ll);
@@ -826,19 +1060,19 @@ namespace amp
 
 	namespace _radix_sort_detail
 	{
-		static uint32 getBits(uint32 x, uint32 numbits, uint32 bitoffset) restrict(amp)
+		static uint32 getBits(uint32 x, uint32 numbits, uint32 bitoffset) AMP_RESTRICT
 		{
 			return (x >> bitoffset) & ~(~0u << numbits);
 		}
 
 		template<int TileSize>
 		static void calcIntermSums(const uint32 bitoffset, const ampArrayView<const Proxy>& intermArr,
-			ampArray<uint32>& intermSums, ampArray<uint32>& intermPrefixSums)
+			const ampArrayView<uint32>& intermSums, const ampArrayView<uint32>& intermPrefixSums)
 		{
 			const uint32 QuarterTile = TileSize / 4;
 			const auto computeDomain = intermArr.extent.tile<TileSize>().pad();
 			const uint32 tileCnt = computeDomain.size() / TileSize;
-			Concurrency::parallel_for_each(computeDomain, [=, &intermSums](ampTiledIdx<TileSize> tIdx) restrict(amp)
+			Concurrency::parallel_for_each(computeDomain, [=](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
 			{
 				const bool inbound = (tIdx.global[0] < intermArr.extent[0]);
 				uint32 num = (inbound) ? _radix_sort_detail::getBits(intermArr[tIdx.global[0]].tag, 2, bitoffset) :
@@ -853,7 +1087,7 @@ namespace amp
 
 			const uint32 tileCnt4 = tileCnt * 4;
 			const uint32 numiter = (tileCnt / QuarterTile) + ((tileCnt % QuarterTile == 0) ? 0 : 1);
-			Concurrency::parallel_for_each(ampExtent(TileSize).tile<TileSize>(), [=, &intermPrefixSums, &intermSums](ampTiledIdx<TileSize> tIdx) restrict(amp)
+			Concurrency::parallel_for_each(ampExtent(TileSize).tile<TileSize>(), [=](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
 			{
 				uint32 lastVal0 = 0;
 				uint32 lastVal1 = 0;
@@ -873,11 +1107,11 @@ namespace amp
 		template<int TileSize>
 		static void radixSortStep(const uint32 bitoffset,
 			const ampArrayView<const Proxy>& src, const ampArrayView<Proxy>& dest,
-			ampArray<uint32>& intermPrefixSums)
+			const ampArrayView<const uint32>& intermPrefixSums)
 		{
 			const auto computeDomain = src.extent.tile<TileSize>().pad();
 			const uint32 tileCnt = computeDomain.size() / TileSize;
-			Concurrency::parallel_for_each(computeDomain, [=, &intermPrefixSums](ampTiledIdx<TileSize> tidx) restrict(amp)
+			Concurrency::parallel_for_each(computeDomain, [=](ampTiledIdx<TileSize> tidx) AMP_RESTRICT
 			{
 				const int32 gi = tidx.global[0];
 				const bool inbounds = (gi < src.extent[0]);
@@ -891,13 +1125,123 @@ namespace amp
 				}
 			});
 		}
+
+		// 8 bit digits of tag - base, tags below base count as base.
+		static const uint32 DigitBits = 8;
+		static const uint32 DigitCnt = 1 << DigitBits;
+
+		static uint32 getDigit(const Proxy& p, const uint32 base, const uint32 shift) AMP_RESTRICT
+		{
+			return ((p.tag < base ? 0 : p.tag - base) >> shift) & (DigitCnt - 1);
+		}
+
+		// Counts the digits of each tile, tileHists is digit major.
+		template<int TileSize>
+		static void countDigits(const uint32 base, const uint32 shift, const int32 size,
+			const ampArrayView<const Proxy>& src, ampArray<uint32>& tileHists)
+		{
+			const uint32 tileCnt = getTileCnt<TileSize>(size);
+			Concurrency::parallel_for_each(tileAndPad<TileSize>(size), [=, &tileHists](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
+			{
+				const uint32 li = tIdx.local[0];
+				const int32 gi = tIdx.global[0];
+				AMP_TILE_STATIC uint32 hist[DigitCnt];
+				for (uint32 d = li; d < DigitCnt; d += TileSize)
+					hist[d] = 0;
+				tIdx.barrier.wait_with_tile_static_memory_fence();
+				if (gi < size)
+					Concurrency::atomic_fetch_inc(&hist[getDigit(src[gi], base, shift)]);
+				tIdx.barrier.wait_with_tile_static_memory_fence();
+				for (uint32 d = li; d < DigitCnt; d += TileSize)
+					tileHists[d * tileCnt + tIdx.tile[0]] = hist[d];
+			});
+		}
+
+		// One tile per digit turns its row of tileHists into an exclusive scan
+		// and writes the digit's total to digitSums.
+		template<int TileSize>
+		static void scanDigits(const int32 size, ampArray<uint32>& tileHists, ampArray<uint32>& digitSums)
+		{
+			const uint32 tileCnt = getTileCnt<TileSize>(size);
+			Concurrency::parallel_for_each(ampExtent(DigitCnt * TileSize).tile<TileSize>(),
+				[=, &tileHists, &digitSums](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
+			{
+				const uint32 li = tIdx.local[0];
+				const uint32 row = tIdx.tile[0] * tileCnt;
+				uint32 carry = 0;
+				for (uint32 start = 0; start < tileCnt; start += TileSize)
+				{
+					const uint32 t = start + li;
+					uint32 sum;
+					const uint32 scan = _prefix_sum_detail::tilePrefixSum(
+						t < tileCnt ? tileHists[row + t] : 0u, tIdx, sum);
+					if (t < tileCnt) tileHists[row + t] = carry + scan;
+					carry += sum;
+					tIdx.barrier.wait_with_tile_static_memory_fence();
+				}
+				if (li == 0) digitSums[tIdx.tile[0]] = carry;
+			});
+		}
+
+		// Sorts each tile by digit in tile_static memory with one stable split
+		// per bit, then writes every element to the start of its digit, plus the
+		// counts of the earlier tiles, plus its rank within the tile.
+		template<int TileSize>
+		static void scatterDigits(const uint32 base, const uint32 shift, const int32 size,
+			const ampArrayView<const Proxy>& src, const ampArrayView<Proxy>& dest,
+			const ampArray<uint32>& tileHists, const ampArray<uint32>& digitSums)
+		{
+			static_assert(TileSize == DigitCnt, "one thread per digit");
+			const uint32 tileCnt = getTileCnt<TileSize>(size);
+			Concurrency::parallel_for_each(tileAndPad<TileSize>(size),
+				[=, &tileHists, &digitSums](ampTiledIdx<TileSize> tIdx) AMP_RESTRICT
+			{
+				const uint32 li = tIdx.local[0];
+				const int32 gi = tIdx.global[0];
+				const int32 validCnt = size - tIdx.tile[0] * TileSize;
+				AMP_TILE_STATIC uint32 digitStart[DigitCnt];
+				AMP_TILE_STATIC uint32 localStart[DigitCnt];
+				AMP_TILE_STATIC Proxy sorted[TileSize];
+				AMP_TILE_STATIC uint32 digits[TileSize];
+
+				uint32 total;
+				digitStart[li] = _prefix_sum_detail::tilePrefixSum(digitSums[li], tIdx, total)
+					+ tileHists[li * tileCnt + tIdx.tile[0]];
+				tIdx.barrier.wait_with_tile_static_memory_fence();
+
+				// padding sorts behind the elements of the tile
+				Proxy p = gi < size ? src[gi] : Proxy(INVALID_IDX, 0xffffffff);
+				uint32 d = gi < size ? getDigit(p, base, shift) : DigitCnt - 1;
+				for (uint32 bit = 0; bit < DigitBits; bit++)
+				{
+					const uint32 one = (d >> bit) & 1;
+					uint32 zeroCnt;
+					const uint32 zerosBefore = _prefix_sum_detail::tilePrefixSum(1 - one, tIdx, zeroCnt);
+					const uint32 pos = one ? zeroCnt + li - zerosBefore : zerosBefore;
+					tIdx.barrier.wait_with_tile_static_memory_fence();
+					sorted[pos] = p;
+					digits[pos] = d;
+					tIdx.barrier.wait_with_tile_static_memory_fence();
+					p = sorted[li];
+					d = digits[li];
+				}
+				if (li == 0 || digits[li - 1] != d)
+					localStart[d] = li;
+				tIdx.barrier.wait_with_tile_static_memory_fence();
+				if ((int32)li < validCnt)
+					dest[digitStart[d] + li - localStart[d]] = p;
+			});
+		}
 	}
-	static void radixSort(ampArrayView<Proxy>& a, const uint32 size)
+	static inline void radixSort(ampArrayView<Proxy>& a, const uint32 size)
 	{
+#ifdef AMP_CPU_BACKEND
+		_cpu_detail::radixSort(a, size);
+#else
 		const int32 tileCnt = getTileCnt<TILE_SIZE>(size);
-		ampArray<Proxy> intermArr(size);
-		ampArray<uint32> intermSums(tileCnt * 4);
-		ampArray<uint32> intermPrefixSums(tileCnt * 4);
+		ampArrayView<Proxy> intermArr = scratch().Alloc<Proxy>(size);
+		ampArrayView<uint32> intermSums = scratch().Alloc<uint32>(tileCnt * 4);
+		ampArrayView<uint32> intermPrefixSums = scratch().Alloc<uint32>(tileCnt * 4);
 
 		ampArrayView<Proxy> av = a.section(0, size);
 		for (uint32 i = 0; i < 16; i++)
@@ -909,86 +1253,323 @@ namespace amp
 			_radix_sort_detail::calcIntermSums<TILE_SIZE>(bitoffset, src, intermSums, intermPrefixSums);
 			_radix_sort_detail::radixSortStep<TILE_SIZE>(bitoffset, src, dest, intermPrefixSums);
 		}
+#endif
+	}
+
+	// Scratch of the 8 bit radix sort, kept so that sorting doesn't allocate.
+	struct RadixSortBuffers
+	{
+		ampArray<Proxy> interm;
+		ampArray<uint32> tileHists;
+		ampArray<uint32> digitSums;
+		std::vector<int32> chunkOffsets;
+
+		RadixSortBuffers(const ampAccelView& accelView) :
+			interm(TILE_SIZE, accelView),
+			tileHists(_radix_sort_detail::DigitCnt, accelView),
+			digitSums(_radix_sort_detail::DigitCnt, accelView)
+		{}
+
+		void Reserve(const int32 size)
+		{
+			if (size > interm.extent[0])
+				resize(interm, size * 2);
+			const int32 histCnt = getTileCnt<TILE_SIZE>(size) * _radix_sort_detail::DigitCnt;
+			if (histCnt > tileHists.extent[0])
+				resize(tileHists, histCnt * 2);
+		}
+	};
+
+	// Number of bits a radix sort has to look at if all tags are in [lower, upper].
+	static inline uint32 radixSortKeyBits(const uint32 lower, const uint32 upper)
+	{
+		uint32 bits = 0;
+		for (uint32 span = upper - lower; span; span >>= 1)
+			bits++;
+		return bits;
+	}
+
+	// Stable LSD radix sort with 8 bit digits. Only the low keyBits bits of
+	// tag - base are sorted, tags below base count as base. The CPU backend
+	// skips the passes over digits that are equal in all keys, the GPU would
+	// have to read the digit sums back for it.
+	static inline void radixSort(ampArrayView<Proxy>& a, const uint32 size, RadixSortBuffers& buffers,
+		const uint32 base = 0, const uint32 keyBits = 32)
+	{
+		if (size <= 1 || !keyBits) return;
+		buffers.Reserve(size);
+#ifdef AMP_CPU_BACKEND
+		_cpu_detail::radixSort(a.data(), buffers.interm.data(), buffers.chunkOffsets, size, base, keyBits);
+#else
+		ampArrayView<Proxy> av = a.section(0, size);
+		ampArrayView<Proxy> interm = ampArrayView<Proxy>(buffers.interm).section(0, size);
+		uint32 pass = 0;
+		for (uint32 shift = 0; shift < keyBits; shift += _radix_sort_detail::DigitBits, pass++)
+		{
+			const ampArrayView<Proxy>& src = (pass % 2 == 0) ? av : interm;
+			const ampArrayView<Proxy>& dest = (pass % 2 == 0) ? interm : av;
+			_radix_sort_detail::countDigits<TILE_SIZE>(base, shift, size, src, buffers.tileHists);
+			_radix_sort_detail::scanDigits<TILE_SIZE>(size, buffers.tileHists, buffers.digitSums);
+			_radix_sort_detail::scatterDigits<TILE_SIZE>(base, shift, size, src, dest,
+				buffers.tileHists, buffers.digitSums);
+		}
+		if (pass % 2)
+			interm.copy_to(av);
+#endif
+	}
+
+	// The values an item adds to its targets, at most N.
+	template<int32 N, typename T> struct TargetValues
+	{
+		uint32 targets[N];
+		T values[N];
+		int32 cnt;
+
+		void Add(const uint32 target, const T& value) AMP_RESTRICT
+		{
+			targets[cnt] = target;
+			values[cnt++] = value;
+		}
+	};
+
+	// Sums up the values of the runs of equal tags in order, sorted by tag, and calls
+	// apply(tag, sum) once per run. Every tile sums its part of a run with the same
+	// tree, a segmented scan from the back, and the first record of the run adds the
+	// sums of the tiles the run goes on in, in tile order. So the sums don't depend
+	// on the number of threads. Runs with the tag INVALID_IDX are skipped.
+	template<typename T, typename F>
+	static void reduceRuns(const ampArrayView<const Proxy>& order, const ampArrayView<const T>& values,
+		const int32 cnt, const F& apply)
+	{
+		if (cnt <= 0) return;
+		ampArrayView<T> tileSums = scratch().Alloc<T>(cnt);
+#ifdef AMP_CPU_BACKEND
+		// the same tree without the barriers, the threads of a tile in turn
+		ampcpu::detail::ThreadPool::get().run(getTileCount(cnt), [&](const int32 t)
+		{
+			const int32 first = t * TILE_SIZE;
+			const int32 n = b2Min(cnt - first, TILE_SIZE);
+			T sums[TILE_SIZE];
+			for (int32 li = 0; li < n; li++)
+				sums[li] = values[order[first + li].idx];
+			for (int32 s = 1; s < n; s *= 2)
+				for (int32 li = 0; li + s < n; li++)
+					if (order[first + li + s].tag == order[first + li].tag)
+						sums[li] += sums[li + s];
+			for (int32 li = 0; li < n; li++)
+				if (li == 0 || order[first + li - 1].tag != order[first + li].tag)
+					tileSums[first + li] = sums[li];
+		});
+#else
+		forEachTiledWithBarrier(cnt, [=](const ampTiledIdx<TILE_SIZE>& tIdx) AMP_RESTRICT
+		{
+			const int32 gi = tIdx.global[0];
+			const int32 li = tIdx.local[0];
+			const int32 n = b2Min(cnt - tIdx.tile[0] * TILE_SIZE, TILE_SIZE);
+			AMP_TILE_STATIC uint32 tags[TILE_SIZE];
+			AMP_TILE_STATIC T sums[TILE_SIZE];
+			if (li < n)
+			{
+				tags[li] = order[gi].tag;
+				sums[li] = values[order[gi].idx];
+			}
+			for (int32 s = 1; s < n; s *= 2)
+			{
+				tIdx.barrier.wait_with_tile_static_memory_fence();
+				const bool add = li + s < n && tags[li + s] == tags[li];
+				T next;
+				if (add) next = sums[li + s];
+				tIdx.barrier.wait_with_tile_static_memory_fence();
+				if (add) sums[li] += next;
+			}
+			tIdx.barrier.wait_with_tile_static_memory_fence();
+			if (li < n && (li == 0 || tags[li - 1] != tags[li]))
+				tileSums[gi] = sums[li];
+		});
+#endif
+		forEach(cnt, [=](const int32 k) AMP_RESTRICT
+		{
+			const uint32 tag = order[k].tag;
+			if (tag == (uint32)INVALID_IDX || (k > 0 && order[k - 1].tag == tag)) return;
+			T sum = tileSums[k];
+			for (int32 t = k / TILE_SIZE + 1; t * TILE_SIZE < cnt && order[t * TILE_SIZE].tag == tag; t++)
+				sum += tileSums[t * TILE_SIZE];
+			apply(tag, sum);
+		});
+	}
+
+	// Sums up the values of each target in record order. order[k] holds the record
+	// and its target and is sorted by the low keyBits bits of the targets with a
+	// stable sort, then reduceRuns calls apply(target, sum, false). Records without a
+	// target have the tag INVALID_IDX, all key bits of which are set, so they sort
+	// behind the targets if keyBits is radixSortKeyBits(0, targetCnt).
+	template<typename T, typename F>
+	static void reduceByTarget(ampArrayView<Proxy>& order, const ampArrayView<const T>& values,
+		const int32 cnt, RadixSortBuffers& buffers, const uint32 keyBits, const F& apply)
+	{
+		if (cnt <= 0) return;
+		radixSort(order, cnt, buffers, 0, keyBits);
+		reduceRuns(ampArrayView<const Proxy>(order), values, cnt, [=](const uint32 target, const T& sum) AMP_RESTRICT
+		{
+			apply(target, sum, false);
+		});
+	}
+
+	// Runs record(i, values) for each item and applies the values it added with
+	// apply(target, value, atomic). If ordered, the values of each target are summed
+	// up in item order and applied once, so the result doesn't depend on the number
+	// of threads. The targets are below 1 << keyBits then, see reduceByTarget.
+	template<int32 N, typename T, typename F1, typename F2>
+	static void forEachTarget(const int32 cnt, const F1& record, const F2& apply, const bool ordered,
+		RadixSortBuffers& buffers, const uint32 keyBits)
+	{
+		if (cnt <= 0) return;
+		if (!ordered)
+		{
+			forEach(cnt, [=](const int32 i) AMP_RESTRICT
+			{
+				TargetValues<N, T> values;
+				values.cnt = 0;
+				record(i, values);
+				for (int32 j = 0; j < values.cnt; j++)
+					apply(values.targets[j], values.values[j], true);
+			});
+			return;
+		}
+		const int32 recordCnt = cnt * N;
+		ampArrayView<Proxy> order = scratch().Alloc<Proxy>(recordCnt);
+		ampArrayView<T> recordValues = scratch().Alloc<T>(recordCnt);
+		forEach(cnt, [=](const int32 i) AMP_RESTRICT
+		{
+			TargetValues<N, T> values;
+			values.cnt = 0;
+			record(i, values);
+			for (int32 j = 0; j < N; j++)
+			{
+				const int32 k = i * N + j;
+				if (j < values.cnt)
+				{
+					order[k].Set(k, values.targets[j]);
+					recordValues[k] = values.values[j];
+				}
+				else
+					order[k].Set(k, INVALID_IDX);
+			}
+		});
+		reduceByTarget(order, ampArrayView<const T>(recordValues), recordCnt, buffers, keyBits, apply);
 	}
 
-	static void uninitialize()
+	static inline void uninitialize()
 	{
 		concurrency::amp_uninitialize();
 	}
 
-	static inline uint32 atomicAdd(uint32& dest, const uint32 add) restrict(amp)
+	static inline uint32 atomicAdd(uint32& dest, const uint32 add) AMP_RESTRICT
 	{
 		return Concurrency::atomic_fetch_add(&dest, add);
 	}
-	static inline int32 atomicAdd(int32& dest, const int32 add) restrict(amp)
+	static inline int32 atomicAdd(int32& dest, const int32 add) AMP_RESTRICT
 	{
 		return Concurrency::atomic_fetch_add(&dest, add);
 	}
 
-	inline void atomicAdd(float32& dest, const float32 add) restrict(amp)
+	// C++ AMP only swaps and compares uint32, so the floats go through their bits there.
+	// The CPU backend works on the float itself, no float is accessed as an integer.
+	inline bool atomicCompareExchange(float32& dest, float32& expected, const float32 value) AMP_RESTRICT
+	{
+#ifdef AMP_CPU_BACKEND
+		return Concurrency::atomic_compare_exchange(&dest, &expected, value);
+#else
+		uint32 expectedBits = Concurrency::direct3d::asuint(expected);
+		const bool exchanged = Concurrency::atomic_compare_exchange((uint32*)&dest, &expectedBits,
+			Concurrency::direct3d::asuint(value));
+		expected = Concurrency::direct3d::asfloat(expectedBits);
+		return exchanged;
+#endif
+	}
+	// only for values that are not negative, whose bits order like them
+	inline float32 atomicMin(float32& dest, const float32 value) AMP_RESTRICT
+	{
+#ifdef AMP_CPU_BACKEND
+		return Concurrency::atomic_fetch_min(&dest, value);
+#else
+		return Concurrency::direct3d::asfloat(
+			Concurrency::atomic_fetch_min((uint32*)&dest, Concurrency::direct3d::asuint(value)));
+#endif
+	}
+	inline void atomicAdd(float32& dest, const float32 add) AMP_RESTRICT
 	{
 		float32 expected = dest;
-		float32 newValue = expected + add;
-		while (!Concurrency::atomic_compare_exchange((uint32*)& dest, (uint32*)& expected, reinterpret_cast<uint32&>(newValue)))
-			newValue = expected + add;
+		while (!atomicCompareExchange(dest, expected, expected + add)) {}
 	}
-	inline void atomicSub(float32& dest, const float32 sub) restrict(amp)
+	inline void atomicSub(float32& dest, const float32 sub) AMP_RESTRICT
 	{
 		float32 expected = dest;
-		float32 newValue = expected - sub;
-		while (!Concurrency::atomic_compare_exchange((uint32*)& dest, (uint32*)& expected, reinterpret_cast<uint32&>(newValue)))
-			newValue = expected - sub;
+		while (!atomicCompareExchange(dest, expected, expected - sub)) {}
 	}
-	inline void atomicAdd(Vec2& dest, const Vec2& add) restrict(amp)
+	inline void atomicAdd(Vec2& dest, const Vec2& add) AMP_RESTRICT
 	{
 		atomicAdd(dest.x, add.x);
 		atomicAdd(dest.y, add.y);
 	}
-	inline void atomicSub(Vec2& dest, const Vec2& sub) restrict(amp)
+	inline void atomicSub(Vec2& dest, const Vec2& sub) AMP_RESTRICT
 	{
 		atomicSub(dest.x, sub.x);
 		atomicSub(dest.y, sub.y);
 	}
-	inline void atomicAdd(Vec3& dest, const Vec2& add) restrict(amp)
+	inline void atomicAdd(Vec3& dest, const Vec2& add) AMP_RESTRICT
 	{
 		atomicAdd(dest.x, add.x);
 		atomicAdd(dest.y, add.y);
 	}
-	inline void atomicSub(Vec3& dest, const Vec2& sub) restrict(amp)
+	inline void atomicSub(Vec3& dest, const Vec2& sub) AMP_RESTRICT
 	{
 		atomicSub(dest.x, sub.x);
 		atomicSub(dest.y, sub.y);
 	}
-	inline void atomicAdd(Vec3& dest, const Vec3& add) restrict(amp)
+	inline void atomicAdd(Vec3& dest, const Vec3& add) AMP_RESTRICT
 	{
 		atomicAdd(dest.x, add.x);
 		atomicAdd(dest.y, add.y);
 		atomicAdd(dest.z, add.z);
 	}
-	inline void atomicSub(Vec3& dest, const Vec3& sub) restrict(amp)
+	inline void atomicSub(Vec3& dest, const Vec3& sub) AMP_RESTRICT
 	{
 		atomicSub(dest.x, sub.x);
 		atomicSub(dest.y, sub.y);
 		atomicSub(dest.z, sub.z);
 	}
+	// plain add / sub if the caller has exclusive access, e.g. to the particles of a contact color
+	template <typename T1, typename T2>
+	inline void add(T1& dest, const T2& add, const bool atomic) AMP_RESTRICT
+	{
+		if (atomic) atomicAdd(dest, add);
+		else dest += add;
+	}
+	template <typename T1, typename T2>
+	inline void sub(T1& dest, const T2& sub, const bool atomic) AMP_RESTRICT
+	{
+		if (atomic) atomicSub(dest, sub);
+		else dest -= sub;
+	}
 
-	inline bool atomicAddFlag(uint32& dest, const uint32 flag) restrict(amp)
+	inline bool atomicAddFlag(uint32& dest, const uint32 flag) AMP_RESTRICT
 	{
 		if (dest & flag) return false;
 		return Concurrency::atomic_compare_exchange(&dest, &dest, dest | flag);
 	}
 
-	inline Vec2 toNormal(float32 f) restrict(amp)
+	inline Vec2 toNormal(float32 f) AMP_RESTRICT
 	{
 		return Vec2(ampSin(f), ampCos(f));
 	}
 
 	// returns value before increment
-	inline int32 atomicInc(int32& dest) restrict(amp)
+	inline int32 atomicInc(int32& dest) AMP_RESTRICT
 	{
 		return Concurrency::atomic_fetch_inc(&dest);
 	}
-	inline int32 atomicInc(int32& dest, const int32 max) restrict(amp)
+	inline int32 atomicInc(int32& dest, const int32 max) AMP_RESTRICT
 	{
 		if (dest >= max) return 0;
 		int32 expected = dest;
@@ -1013,7 +1594,7 @@ namespace amp
 		amp::CopyFuture copyFuture;
 
 		Array(const ampAccelView& accelView, int32 cap = 1) :
-			minCap(cap), buf(nullptr), arr(cap, accelView), d11Arr(cap, accelView) {}
+			buf(nullptr), d11Arr(cap, accelView), minCap(cap), arr(cap, accelView) {}
 
 		void SetD11Arr(ID3D11Buffer* buf)
 		{
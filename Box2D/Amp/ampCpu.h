@@ -0,0 +1,836 @@
+#pragma once
+
+// CPU execution backend.
+// Emulates the subset of C++ AMP that ampAlgorithms.h and the particle pipeline use,
+// so the same kernels run on a thread pool on platforms without amp.h / d3d11.h.
+// Selected at compile time by defining AMP_CPU_BACKEND (see b2Settings.h).
+//
+// - Flat extents are split into chunks and run on all cores.
+// - Tiled extents run one tile per worker at a time. The threads of a tile are
+//   executed as fibers on that worker, which gives real tile barriers, and
+//   AMP_TILE_STATIC memory becomes thread_local memory shared by the tile.
+//   A tile without barriers runs on a single fiber, so the cost is one switch per tile.
+// - Atomics map to the compiler's 32 bit word intrinsics, copies are plain memory copies.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#ifdef _WIN32
+#include <intrin.h>
+#include <windows.h>
+#else
+#include <ucontext.h>
+#endif
+
+struct ID3D11Buffer;
+
+namespace ampcpu
+{
+	namespace detail
+	{
+		// Runs function(i) for all i in [0, cnt) on every core. The calling thread takes part.
+		// Several launches may be in flight at once (e.g. from concurrently scheduled passes):
+		// idle workers pick items from any queued job, and a launching thread that ran out of
+		// items of its own job helps with other kernels until its job is complete.
+		// Tasks (runTasks) are host functions which may launch kernels themselves, kernels
+		// launched from inside a kernel run inline.
+		class ThreadPool
+		{
+		private:
+			using Task = void (*)(const void* ctx, int32_t i);
+
+			struct Job
+			{
+				const void* ctx;
+				Task task;
+				int32_t cnt;
+				bool isKernel;
+				std::atomic<int32_t> next{ 0 };
+				int32_t attached = 0;		// threads working on this job, guarded by m_mutex
+			};
+
+			std::vector<std::thread> m_threads;
+			std::mutex m_mutex;
+			std::condition_variable m_wake;
+			std::condition_variable m_done;
+			std::vector<Job*> m_jobs;		// jobs with unclaimed items
+			bool m_quit = false;
+
+			static bool& inKernel() { static thread_local bool kernel = false; return kernel; }
+
+			Job* findJob(const bool kernelsOnly) const
+			{
+				for (Job* job : m_jobs)
+					if (!kernelsOnly || job->isKernel) return job;
+				return nullptr;
+			}
+			// Claims items of the job until none are left. The lock is released meanwhile.
+			void work(Job& job, std::unique_lock<std::mutex>& lock)
+			{
+				job.attached++;
+				lock.unlock();
+				bool& kernel = inKernel();
+				const bool wasKernel = kernel;
+				kernel = job.isKernel;
+				for (int32_t i = job.next.fetch_add(1); i < job.cnt; i = job.next.fetch_add(1))
+					job.task(job.ctx, i);
+				kernel = wasKernel;
+				lock.lock();
+				job.attached--;
+				const auto it = std::find(m_jobs.begin(), m_jobs.end(), &job);
+				if (it != m_jobs.end()) m_jobs.erase(it);
+				m_done.notify_all();
+			}
+			void workerMain()
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				for (;;)
+				{
+					m_wake.wait(lock, [&] { return m_quit || !m_jobs.empty(); });
+					if (m_quit) return;
+					work(*m_jobs.front(), lock);
+				}
+			}
+			template <typename F>
+			void launch(const int32_t cnt, const F& function, const bool isKernel)
+			{
+				Job job;
+				job.ctx = &function;
+				job.task = [](const void* ctx, int32_t i) { (*static_cast<const F*>(ctx))(i); };
+				job.cnt = cnt;
+				job.isKernel = isKernel;
+
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_jobs.push_back(&job);
+				m_wake.notify_all();
+				work(job, lock);
+				// the job may still be executed by other threads, help with other kernels meanwhile
+				while (job.attached)
+				{
+					if (Job* other = findJob(true))
+						work(*other, lock);
+					else
+						m_done.wait(lock);
+				}
+			}
+
+			void start(uint32_t cnt)
+			{
+				if (!cnt) cnt = std::thread::hardware_concurrency();
+				m_quit = false;
+				for (uint32_t i = 1; i < cnt; i++)
+					m_threads.emplace_back([this] { workerMain(); });
+			}
+			void stop()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_quit = true;
+				}
+				m_wake.notify_all();
+				for (std::thread& t : m_threads) t.join();
+				m_threads.clear();
+			}
+
+		public:
+			ThreadPool() { start(0); }
+			~ThreadPool() { stop(); }
+			static ThreadPool& get() { static ThreadPool pool; return pool; }
+
+			// Restarts the pool with cnt threads, the calling one included, 0 for
+			// one per core. Only call it while no kernel runs.
+			void setThreadCnt(const int32_t cnt)
+			{
+				stop();
+				start(cnt > 0 ? (uint32_t)cnt : 0);
+			}
+
+			int32_t threadCnt() const { return (int32_t)m_threads.size() + 1; }
+
+			template <typename F>
+			void run(const int32_t cnt, const F& function)
+			{
+				if (cnt <= 0) return;
+				// nested launches (from inside a kernel) and single items run inline
+				if (cnt == 1 || m_threads.empty() || inKernel())
+				{
+					bool& kernel = inKernel();
+					const bool wasKernel = kernel;
+					kernel = true;
+					for (int32_t i = 0; i < cnt; i++) function(i);
+					kernel = wasKernel;
+					return;
+				}
+				launch(cnt, function, true);
+			}
+			// Runs independent host tasks concurrently. Kernels launched by a task are parallel.
+			template <typename F>
+			void runTasks(const int32_t cnt, const F& function)
+			{
+				if (cnt <= 0) return;
+				if (cnt == 1 || m_threads.empty() || inKernel())
+				{
+					for (int32_t i = 0; i < cnt; i++) function(i);
+					return;
+				}
+				launch(cnt, function, false);
+			}
+		};
+
+		// Splits [0, cnt) into a few chunks per core.
+		template <typename F>
+		static void parallelFor(const int32_t cnt, const F& function)
+		{
+			if (cnt <= 0) return;
+			ThreadPool& pool = ThreadPool::get();
+			const int32_t chunkCnt = std::min(cnt, pool.threadCnt() * 4);
+			const int32_t chunkSize = (cnt + chunkCnt - 1) / chunkCnt;
+			pool.run(chunkCnt, [&](int32_t c)
+			{
+				const int32_t end = std::min(cnt, (c + 1) * chunkSize);
+				for (int32_t i = c * chunkSize; i < end; i++)
+					function(i);
+			});
+		}
+
+		// One fiber executes tile threads until one of them waits at the barrier.
+		class Fiber
+		{
+		private:
+			static const size_t StackSize = 128 * 1024;
+#ifdef _WIN32
+			void* m_fiber;
+			static void*& schedulerFiber() { static thread_local void* fiber = nullptr; return fiber; }
+			static void WINAPI entry(void*) { main(); }
+		public:
+			explicit Fiber() : m_fiber(CreateFiber(StackSize, &Fiber::entry, nullptr)) {}
+			~Fiber() { DeleteFiber(m_fiber); }
+			static void initThread()
+			{
+				if (!schedulerFiber())
+					schedulerFiber() = IsThreadAFiber() ? GetCurrentFiber() : ConvertThreadToFiber(nullptr);
+			}
+			void resume() { SwitchToFiber(m_fiber); }
+			void yield() { SwitchToFiber(schedulerFiber()); }
+#else
+			ucontext_t m_ctx;
+			std::unique_ptr<char[]> m_stack;
+			static ucontext_t& schedulerCtx() { static thread_local ucontext_t ctx; return ctx; }
+			static void entry() { main(); }
+		public:
+			explicit Fiber() : m_stack(new char[StackSize])
+			{
+				getcontext(&m_ctx);
+				m_ctx.uc_stack.ss_sp = m_stack.get();
+				m_ctx.uc_stack.ss_size = StackSize;
+				m_ctx.uc_link = nullptr;
+				makecontext(&m_ctx, &Fiber::entry, 0);
+			}
+			static void initThread() {}
+			void resume() { swapcontext(&schedulerCtx(), &m_ctx); }
+			void yield() { swapcontext(&m_ctx, &schedulerCtx()); }
+#endif
+			bool parked = false;
+
+		private:
+			static void main();
+		};
+
+		// Per worker thread. Runs the threads of one tile with barrier support.
+		class TileScheduler
+		{
+		public:
+			using Invoke = void (*)(const void* kernel, int32_t tile, int32_t local);
+
+		private:
+			std::vector<std::unique_ptr<Fiber>> m_fibers;
+			std::vector<Fiber*> m_free;
+			std::vector<Fiber*> m_parked;
+			std::vector<Fiber*> m_resumed;
+
+			Fiber* acquire()
+			{
+				if (m_free.empty())
+				{
+					m_fibers.emplace_back(new Fiber());
+					return m_fibers.back().get();
+				}
+				Fiber* f = m_free.back();
+				m_free.pop_back();
+				return f;
+			}
+			void resume(Fiber* f)
+			{
+				running = f;
+				f->resume();
+				if (f->parked) m_parked.push_back(f);
+				else m_free.push_back(f);
+			}
+
+		public:
+			const void* kernel = nullptr;
+			Invoke invoke = nullptr;
+			int32_t tile = 0;
+			int32_t threadCnt = 0;
+			int32_t next = 0;
+			Fiber* running = nullptr;
+
+			static TileScheduler& current() { static thread_local TileScheduler s; return s; }
+
+			void runTile(const void* k, Invoke inv, const int32_t t, const int32_t cnt)
+			{
+				Fiber::initThread();
+				kernel = k;
+				invoke = inv;
+				tile = t;
+				threadCnt = cnt;
+				next = 0;
+				while (next < threadCnt)
+					resume(acquire());
+				// every thread of the tile has now finished or waits at the same barrier
+				while (!m_parked.empty())
+				{
+					m_resumed.swap(m_parked);
+					for (Fiber* f : m_resumed)
+						resume(f);
+					m_resumed.clear();
+				}
+			}
+			void barrier()
+			{
+				running->parked = true;
+				running->yield();
+			}
+		};
+
+		inline void Fiber::main()
+		{
+			TileScheduler& s = TileScheduler::current();
+			for (;;)
+			{
+				while (s.next < s.threadCnt)
+				{
+					const int32_t local = s.next++;
+					s.invoke(s.kernel, s.tile, local);
+				}
+				s.running->parked = false;
+				s.running->yield();
+			}
+		}
+	}
+
+	enum access_type { access_type_none, access_type_read, access_type_write, access_type_read_write, access_type_auto };
+	enum queuing_mode { queuing_mode_immediate, queuing_mode_automatic };
+
+	template <int N>
+	class index
+	{
+	private:
+		int32_t m_i[N];
+	public:
+		static const int rank = N;
+		index() { for (int32_t d = 0; d < N; d++) m_i[d] = 0; }
+		explicit index(int32_t i0) { static_assert(N == 1, "rank"); m_i[0] = i0; }
+		index(int32_t i0, int32_t i1) { static_assert(N == 2, "rank"); m_i[0] = i0; m_i[1] = i1; }
+
+		int32_t operator[](int32_t d) const { return m_i[d]; }
+		int32_t& operator[](int32_t d) { return m_i[d]; }
+
+		friend index operator+(const index& a, const index& b) { index r; for (int32_t d = 0; d < N; d++) r.m_i[d] = a.m_i[d] + b.m_i[d]; return r; }
+		friend index operator+(const index& a, int32_t b) { index r; for (int32_t d = 0; d < N; d++) r.m_i[d] = a.m_i[d] + b; return r; }
+		friend index operator+(int32_t a, const index& b) { return b + a; }
+		friend bool operator==(const index& a, const index& b) { for (int32_t d = 0; d < N; d++) if (a.m_i[d] != b.m_i[d]) return false; return true; }
+	};
+
+	template <int D0, int D1 = 0> class tiled_extent;
+
+	template <int N>
+	class extent
+	{
+	private:
+		int32_t m_e[N];
+	public:
+		static const int rank = N;
+		extent() { for (int32_t d = 0; d < N; d++) m_e[d] = 0; }
+		explicit extent(int32_t e0) { static_assert(N == 1, "rank"); m_e[0] = e0; }
+		extent(int32_t e0, int32_t e1) { static_assert(N == 2, "rank"); m_e[0] = e0; m_e[1] = e1; }
+
+		int32_t operator[](int32_t d) const { return m_e[d]; }
+		int32_t& operator[](int32_t d) { return m_e[d]; }
+		int32_t size() const { int32_t s = 1; for (int32_t d = 0; d < N; d++) s *= m_e[d]; return s; }
+
+		template <int T0> tiled_extent<T0> tile() const { static_assert(N == 1, "rank"); return tiled_extent<T0>(*this); }
+		template <int T0, int T1> tiled_extent<T0, T1> tile() const { static_assert(N == 2, "rank"); return tiled_extent<T0, T1>(*this); }
+	};
+
+	template <int D0, int D1>
+	class tiled_extent : public extent<D1 ? 2 : 1>
+	{
+	public:
+		using Base = extent<D1 ? 2 : 1>;
+		static const int tile_dim0 = D0;
+		static const int tile_dim1 = D1;
+		static const int tile_size = D1 ? D0 * D1 : D0;
+
+		tiled_extent() {}
+		explicit tiled_extent(const Base& e) : Base(e) {}
+
+		tiled_extent pad() const
+		{
+			tiled_extent r(*this);
+			r[0] = (r[0] + D0 - 1) / D0 * D0;
+			if constexpr (D1 != 0) r[1] = (r[1] + D1 - 1) / D1 * D1;
+			return r;
+		}
+		int32_t tileCnt() const { return this->size() / tile_size; }
+	};
+
+	class tile_barrier
+	{
+	public:
+		void wait() const { detail::TileScheduler::current().barrier(); }
+		void wait_with_all_memory_fence() const { wait(); }
+		void wait_with_global_memory_fence() const { wait(); }
+		void wait_with_tile_static_memory_fence() const { wait(); }
+	};
+
+	template <int D0, int D1 = 0>
+	class tiled_index
+	{
+	public:
+		static const int rank = D1 ? 2 : 1;
+		index<rank> global;
+		index<rank> local;
+		index<rank> tile;
+		index<rank> tile_origin;
+		tile_barrier barrier;
+	};
+
+	class accelerator;
+
+	class accelerator_view
+	{
+	public:
+		int32_t id = 0;
+		accelerator get_accelerator() const;
+		void wait() const {}
+		void flush() const {}
+		friend bool operator==(const accelerator_view& a, const accelerator_view& b) { return a.id == b.id; }
+		friend bool operator!=(const accelerator_view& a, const accelerator_view& b) { return a.id != b.id; }
+	};
+
+	class accelerator
+	{
+	public:
+		static constexpr const wchar_t* default_accelerator = L"default";
+		static constexpr const wchar_t* cpu_accelerator = L"cpu";
+
+		std::wstring device_path;
+		accelerator_view default_view;
+
+		accelerator() : device_path(default_accelerator) {}
+		explicit accelerator(const std::wstring& path) : device_path(path) {}
+
+		static std::vector<accelerator> get_all() { return { accelerator() }; }
+		static bool set_default(const std::wstring&) { return true; }
+		bool set_default_cpu_access_type(access_type) { return true; }
+	};
+	inline accelerator accelerator_view::get_accelerator() const { return accelerator(); }
+
+	class completion_future
+	{
+	private:
+		std::shared_future<void> m_future;
+	public:
+		completion_future() {}
+		explicit completion_future(std::shared_future<void> f) : m_future(std::move(f)) {}
+		static completion_future ready()
+		{
+			std::promise<void> p;
+			p.set_value();
+			return completion_future(p.get_future().share());
+		}
+		bool valid() const { return m_future.valid(); }
+		void wait() const { if (m_future.valid()) m_future.wait(); }
+		void get() const { if (m_future.valid()) m_future.get(); }
+	};
+
+	template <typename T, int N = 1> class array_view;
+
+	template <typename T, int N = 1>
+	class array
+	{
+	private:
+		std::shared_ptr<T[]> m_data;
+
+		void allocate(const ampcpu::extent<N>& e)
+		{
+			extent = e;
+			// raw like device memory, elements are never constructed or destroyed
+			m_data.reset(static_cast<T*>(::operator new[](std::max(1, e.size()) * sizeof(T))),
+				[](T* p) { ::operator delete[](p); });
+		}
+
+	public:
+		static const int rank = N;
+		ampcpu::extent<N> extent;
+		ampcpu::accelerator_view accelerator_view;
+		ampcpu::accelerator_view associated_accelerator_view;
+
+		explicit array(int32_t e0) { allocate(ampcpu::extent<N>(e0)); }
+		array(int32_t e0, const ampcpu::accelerator_view& av) : accelerator_view(av) { allocate(ampcpu::extent<N>(e0)); }
+		array(int32_t e0, const ampcpu::accelerator_view& av, const ampcpu::accelerator_view& assoc)
+			: accelerator_view(av), associated_accelerator_view(assoc) { allocate(ampcpu::extent<N>(e0)); }
+		array(int32_t e0, int32_t e1) { allocate(ampcpu::extent<N>(e0, e1)); }
+		array(int32_t e0, int32_t e1, const ampcpu::accelerator_view& av) : accelerator_view(av) { allocate(ampcpu::extent<N>(e0, e1)); }
+		explicit array(const ampcpu::extent<N>& e) { allocate(e); }
+		array(const ampcpu::extent<N>& e, const ampcpu::accelerator_view& av) : accelerator_view(av) { allocate(e); }
+		array(const array& o) : accelerator_view(o.accelerator_view), associated_accelerator_view(o.associated_accelerator_view)
+		{
+			allocate(o.extent);
+			std::copy_n(o.data(), extent.size(), data());
+		}
+		array(array&& o) = default;
+		array& operator=(const array& o)
+		{
+			if (this == &o) return *this;
+			accelerator_view = o.accelerator_view;
+			associated_accelerator_view = o.associated_accelerator_view;
+			allocate(o.extent);
+			std::copy_n(o.data(), extent.size(), data());
+			return *this;
+		}
+		array& operator=(array&& o) = default;
+
+		T* data() const { return m_data.get(); }
+		bool contiguous() const { return true; }
+		const std::shared_ptr<T[]>& storage() const { return m_data; }
+		ampcpu::extent<N> get_extent() const { return extent; }
+
+		T& operator[](const index<N>& i) const
+		{
+			if constexpr (N == 1) return m_data[i[0]];
+			else return m_data[i[0] * extent[1] + i[1]];
+		}
+		decltype(auto) operator[](int32_t i) const
+		{
+			if constexpr (N == 1) return (m_data[i]);
+			else return array_view<T, 1>(ampcpu::extent<1>(extent[1]), m_data.get() + i * extent[1], m_data);
+		}
+		T& operator()(int32_t i) const { static_assert(N == 1, "rank"); return m_data[i]; }
+		T& operator()(int32_t i0, int32_t i1) const { static_assert(N == 2, "rank"); return m_data[i0 * extent[1] + i1]; }
+
+		array_view<T, 1> section(int32_t start, int32_t size) const
+		{
+			static_assert(N == 1, "rank");
+			return array_view<T, 1>(ampcpu::extent<1>(size), m_data.get() + start, m_data);
+		}
+		array_view<T, 2> section(int32_t start0, int32_t start1, int32_t size0, int32_t size1) const
+		{
+			static_assert(N == 2, "rank");
+			return array_view<T, 2>(ampcpu::extent<2>(size0, size1), m_data.get() + start0 * extent[1] + start1, m_data, extent[1]);
+		}
+		template <typename U> array_view<U, 1> reinterpret_as() const
+		{
+			static_assert(N == 1, "rank");
+			const int32_t size = (int32_t)(extent.size() * sizeof(T) / sizeof(U));
+			return array_view<U, 1>(ampcpu::extent<1>(size), reinterpret_cast<U*>(m_data.get()), m_data);
+		}
+
+		template <typename D> void copy_to(D&& dst) const;
+	};
+
+	template <typename T, int N>
+	class array_view
+	{
+	private:
+		using NonConstT = std::remove_const_t<T>;
+		template <typename, int> friend class array_view;
+
+		T* m_ptr = nullptr;
+		std::shared_ptr<void> m_keep;
+		int32_t m_stride = 0;
+
+	public:
+		static const int rank = N;
+		ampcpu::extent<N> extent;
+
+		array_view() {}
+		array_view(const ampcpu::extent<N>& e, T* ptr, std::shared_ptr<void> keep = nullptr, int32_t stride = 0)
+			: m_ptr(ptr), m_keep(std::move(keep)), m_stride(stride ? stride : (N == 2 ? e[N - 1] : 0)), extent(e) {}
+
+		// owning view, as with array_view<T>(size) in C++ AMP
+		explicit array_view(int32_t e0)
+		{
+			static_assert(N == 1, "rank");
+			std::shared_ptr<NonConstT[]> data(new NonConstT[std::max(1, e0)]());
+			m_ptr = data.get();
+			m_keep = data;
+			extent = ampcpu::extent<1>(e0);
+		}
+		// view over host memory
+		array_view(int32_t e0, T* ptr) : m_ptr(ptr), extent(e0) { static_assert(N == 1, "rank"); }
+		template <typename C, typename = decltype(std::declval<C&>().data())>
+		array_view(int32_t e0, C& container) : m_ptr(container.data()), extent(e0) { static_assert(N == 1, "rank"); }
+
+		array_view(array<NonConstT, N>& a) : m_ptr(a.data()), m_keep(a.storage()), extent(a.extent)
+		{
+			if constexpr (N == 2) m_stride = a.extent[1];
+		}
+		array_view(const array<NonConstT, N>& a) : m_ptr(a.data()), m_keep(a.storage()), extent(a.extent)
+		{
+			if constexpr (N == 2) m_stride = a.extent[1];
+		}
+		template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T> && !std::is_same_v<U, T>>>
+		array_view(const array_view<U, N>& o) : m_ptr(o.m_ptr), m_keep(o.m_keep), m_stride(o.m_stride), extent(o.extent) {}
+
+		T* data() const { return m_ptr; }
+		const std::shared_ptr<void>& storage() const { return m_keep; }
+		bool contiguous() const { return N == 1 || m_stride == extent[N - 1]; }
+		ampcpu::extent<N> get_extent() const { return extent; }
+
+		T& operator[](const index<N>& i) const
+		{
+			if constexpr (N == 1) return m_ptr[i[0]];
+			else return m_ptr[i[0] * m_stride + i[1]];
+		}
+		decltype(auto) operator[](int32_t i) const
+		{
+			if constexpr (N == 1) return (m_ptr[i]);
+			else return array_view<T, 1>(ampcpu::extent<1>(extent[1]), m_ptr + i * m_stride, m_keep);
+		}
+		T& operator()(int32_t i) const { static_assert(N == 1, "rank"); return m_ptr[i]; }
+		T& operator()(int32_t i0, int32_t i1) const { static_assert(N == 2, "rank"); return m_ptr[i0 * m_stride + i1]; }
+
+		array_view section(int32_t start, int32_t size) const
+		{
+			static_assert(N == 1, "rank");
+			return array_view(ampcpu::extent<1>(size), m_ptr + start, m_keep);
+		}
+		array_view section(const index<N>& origin, const ampcpu::extent<N>& e) const
+		{
+			if constexpr (N == 1) return array_view(e, m_ptr + origin[0], m_keep);
+			else return array_view(e, m_ptr + origin[0] * m_stride + origin[1], m_keep, m_stride);
+		}
+		array_view section(int32_t start0, int32_t start1, int32_t size0, int32_t size1) const
+		{
+			static_assert(N == 2, "rank");
+			return array_view(ampcpu::extent<2>(size0, size1), m_ptr + start0 * m_stride + start1, m_keep, m_stride);
+		}
+
+		void synchronize() const {}
+		void refresh() const {}
+		void discard_data() const {}
+
+		template <typename D> void copy_to(D&& dst) const;
+	};
+
+	namespace detail
+	{
+		template <typename T> struct IsContainer : std::false_type {};
+		template <typename T, int N> struct IsContainer<array<T, N>> : std::true_type {};
+		template <typename T, int N> struct IsContainer<array_view<T, N>> : std::true_type {};
+
+		template <typename C>
+		inline int32_t sizeOf(const C& c)
+		{
+			if (!c.contiguous()) throw std::runtime_error("ampcpu: copy of a strided section");
+			return c.extent.size();
+		}
+	}
+
+	template <typename S, typename D>
+	void copy(const S& src, D&& dst)
+	{
+		const int32_t cnt = detail::sizeOf(src);
+		if constexpr (detail::IsContainer<std::decay_t<D>>::value)
+			std::copy_n(src.data(), std::min(cnt, detail::sizeOf(dst)), dst.data());
+		else
+			std::copy_n(src.data(), cnt, dst);
+	}
+	template <typename InputIt, typename D>
+	void copy(InputIt first, InputIt last, D&& dst)
+	{
+		std::copy(first, last, dst.data());
+	}
+	template <typename S, typename D>
+	completion_future copy_async(const S& src, D&& dst)
+	{
+		copy(src, std::forward<D>(dst));
+		return completion_future::ready();
+	}
+	template <typename InputIt, typename D>
+	completion_future copy_async(InputIt first, InputIt last, D&& dst)
+	{
+		copy(first, last, std::forward<D>(dst));
+		return completion_future::ready();
+	}
+
+	template <typename T, int N> template <typename D>
+	void array<T, N>::copy_to(D&& dst) const { ampcpu::copy(*this, std::forward<D>(dst)); }
+	template <typename T, int N> template <typename D>
+	void array_view<T, N>::copy_to(D&& dst) const { ampcpu::copy(*this, std::forward<D>(dst)); }
+
+	template <typename F>
+	void parallel_for_each(const extent<1>& e, const F& kernel)
+	{
+		detail::parallelFor(e[0], [&](int32_t i) { kernel(index<1>(i)); });
+	}
+	template <typename F>
+	void parallel_for_each(const extent<2>& e, const F& kernel)
+	{
+		const int32_t e1 = e[1];
+		detail::parallelFor(e.size(), [&](int32_t i) { kernel(index<2>(i / e1, i % e1)); });
+	}
+	template <int D0, int D1, typename F>
+	void parallel_for_each(const tiled_extent<D0, D1>& e, const F& kernel)
+	{
+		using Ext = tiled_extent<D0, D1>;
+		struct Launch { const F* kernel; Ext e; };
+		const Launch launch{ &kernel, e };
+		const detail::TileScheduler::Invoke invoke = [](const void* l, int32_t tile, int32_t local)
+		{
+			const Launch& launch = *static_cast<const Launch*>(l);
+			tiled_index<D0, D1> tIdx;
+			if constexpr (D1 == 0)
+			{
+				tIdx.tile = index<1>(tile);
+				tIdx.local = index<1>(local);
+				tIdx.tile_origin = index<1>(tile * D0);
+			}
+			else
+			{
+				const int32_t tilesX = launch.e[1] / D1;
+				tIdx.tile = index<2>(tile / tilesX, tile % tilesX);
+				tIdx.local = index<2>(local / D1, local % D1);
+				tIdx.tile_origin = index<2>(tIdx.tile[0] * D0, tIdx.tile[1] * D1);
+			}
+			tIdx.global = tIdx.tile_origin + tIdx.local;
+			(*launch.kernel)(tIdx);
+		};
+		detail::ThreadPool::get().run(e.tileCnt(), [&](int32_t tile)
+		{
+			detail::TileScheduler::current().runTile(&launch, invoke, tile, Ext::tile_size);
+		});
+	}
+	template <typename E, typename F>
+	void parallel_for_each(const accelerator_view&, const E& e, const F& kernel) { parallel_for_each(e, kernel); }
+
+	template <typename It, typename C>
+	void parallel_sort(It first, It last, const C& compare) { std::sort(first, last, compare); }
+	template <typename It>
+	void parallel_sort(It first, It last) { std::sort(first, last); }
+
+	namespace detail
+	{
+		// C++ AMP only has atomics on 32 bit words (exchange also takes floats). They are
+		// done with the word intrinsics, std::atomic_ref would need C++20 and the project
+		// builds as C++17.
+		template <typename T> inline void checkWord() { static_assert(sizeof(T) == 4, "atomics are on 32 bit words"); }
+		template <typename T> inline void checkInt() { static_assert(sizeof(T) == 4 && std::is_integral<T>::value, "atomic arithmetic is on 32 bit integers"); }
+#ifdef _MSC_VER
+		template <typename T> inline volatile long* word(T* p) { return reinterpret_cast<volatile long*>(p); }
+		template <typename T> inline long bits(const T v) { long b; std::memcpy(&b, &v, 4); return b; }
+		template <typename T> inline T value(const long b) { T v; std::memcpy(&v, &b, 4); return v; }
+		template <typename T> inline T load(T* p) { checkWord<T>(); return value<T>(*word(p)); }
+		template <typename T> inline T fetchAdd(T* p, T v) { checkInt<T>(); return (T)_InterlockedExchangeAdd(word(p), (long)v); }
+		template <typename T> inline T fetchOr(T* p, T v) { checkInt<T>(); return (T)_InterlockedOr(word(p), (long)v); }
+		template <typename T> inline T fetchAnd(T* p, T v) { checkInt<T>(); return (T)_InterlockedAnd(word(p), (long)v); }
+		template <typename T> inline T exchange(T* p, T v) { checkWord<T>(); return value<T>(_InterlockedExchange(word(p), bits(v))); }
+		template <typename T> inline bool compareExchange(T* p, T& expected, T v)
+		{
+			checkWord<T>();
+			const long old = _InterlockedCompareExchange(word(p), bits(v), bits(expected));
+			if (old == bits(expected)) return true;
+			expected = value<T>(old);
+			return false;
+		}
+#else
+		template <typename T> inline T load(T* p)
+		{
+			checkWord<T>();
+			T v;
+			__atomic_load(p, &v, __ATOMIC_SEQ_CST);
+			return v;
+		}
+		template <typename T> inline T fetchAdd(T* p, T v) { checkInt<T>(); return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+		template <typename T> inline T fetchOr(T* p, T v) { checkInt<T>(); return __atomic_fetch_or(p, v, __ATOMIC_SEQ_CST); }
+		template <typename T> inline T fetchAnd(T* p, T v) { checkInt<T>(); return __atomic_fetch_and(p, v, __ATOMIC_SEQ_CST); }
+		template <typename T> inline T exchange(T* p, T v)
+		{
+			checkWord<T>();
+			T old;
+			__atomic_exchange(p, &v, &old, __ATOMIC_SEQ_CST);
+			return old;
+		}
+		template <typename T> inline bool compareExchange(T* p, T& expected, T v)
+		{
+			checkWord<T>();
+			return __atomic_compare_exchange(p, &expected, &v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		}
+#endif
+	}
+
+	template <typename T> inline T atomic_fetch_add(T* dest, T value) { return detail::fetchAdd(dest, value); }
+	template <typename T> inline T atomic_fetch_sub(T* dest, T value) { return detail::fetchAdd(dest, (T)(0 - value)); }
+	template <typename T> inline T atomic_fetch_inc(T* dest) { return detail::fetchAdd(dest, (T)1); }
+	template <typename T> inline T atomic_fetch_dec(T* dest) { return detail::fetchAdd(dest, (T)-1); }
+	template <typename T> inline T atomic_fetch_max(T* dest, T value)
+	{
+		T old = detail::load(dest);
+		while (old < value && !detail::compareExchange(dest, old, value)) {}
+		return old;
+	}
+	template <typename T> inline T atomic_fetch_min(T* dest, T value)
+	{
+		T old = detail::load(dest);
+		while (value < old && !detail::compareExchange(dest, old, value)) {}
+		return old;
+	}
+	template <typename T> inline T atomic_fetch_or(T* dest, T value) { return detail::fetchOr(dest, value); }
+	template <typename T> inline T atomic_fetch_and(T* dest, T value) { return detail::fetchAnd(dest, value); }
+	template <typename T> inline T atomic_exchange(T* dest, T value) { return detail::exchange(dest, value); }
+	template <typename T> inline bool atomic_compare_exchange(T* dest, T* expected, T value)
+	{
+		return detail::compareExchange(dest, *expected, value);
+	}
+
+	namespace fast_math
+	{
+		inline float sqrtf(float x) { return std::sqrt(x); }
+		inline float atan2f(float y, float x) { return std::atan2(y, x); }
+		inline float sinf(float x) { return std::sin(x); }
+		inline float cosf(float x) { return std::cos(x); }
+		inline float floorf(float x) { return std::floor(x); }
+		inline float powf(float x, float p) { return std::pow(x, p); }
+		inline float fabsf(float x) { return std::fabs(x); }
+		inline float expf(float x) { return std::exp(x); }
+		inline float logf(float x) { return std::log(x); }
+	}
+	namespace precise_math = fast_math;
+
+	namespace direct3d
+	{
+		// no interop on this backend, the buffer is ignored
+		template <typename T, int N>
+		array<T, N> make_array(const extent<N>& e, const accelerator_view& av, ID3D11Buffer*) { return array<T, N>(e, av); }
+		template <typename T>
+		array<T, 1> make_array(int32_t e0, const accelerator_view& av, ID3D11Buffer*) { return array<T, 1>(e0, av); }
+	}
+
+	inline void amp_uninitialize() {}
+}
+
+namespace Concurrency = ampcpu;
+namespace concurrency = ampcpu;
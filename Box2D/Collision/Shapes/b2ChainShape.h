@@ -107,7 +107,7 @@ struct AmpChainShape
 	Vec2 m_prevVertex, m_nextVertex;
 	int32 m_hasPrevVertex, m_hasNextVertex;
 
-	void GetChildEdge(AmpEdgeShape& edge, int32 index) const restrict(amp)
+	void GetChildEdge(AmpEdgeShape& edge, int32 index) const AMP_RESTRICT
 	{
 		edge.m_type = b2Shape::e_edge;
 		edge.m_radius = m_radius;
@@ -138,21 +138,21 @@ struct AmpChainShape
 	}
 
 	void ComputeDistance(const b2Transform& xf, const Vec2& p,
-		float32& distance, Vec2& normal, int32 childIndex) const restrict(amp)
+		float32& distance, Vec2& normal, int32 childIndex) const AMP_RESTRICT
 	{
 		AmpEdgeShape edge;
 		GetChildEdge(edge, childIndex);
 		edge.ComputeDistance(xf, p, distance, normal);
 	}
 
-	bool TestZ(const b2Transform& xf, float32 z) const restrict(amp)
+	bool TestZ(const b2Transform& xf, float32 z) const AMP_RESTRICT
 	{
 		z -= (m_zPos + xf.z);
 		return z >= 0 && z <= m_height;
 	}
 
 	bool RayCast(b2RayCastOutput& output, const b2RayCastInput& input,
-		const b2Transform& xf, int32 childIndex) const restrict(amp)
+		const b2Transform& xf, int32 childIndex) const AMP_RESTRICT
 	{
 		AmpEdgeShape edgeShape;
 
@@ -83,7 +83,7 @@ struct AmpCircleShape
 	Vec2 m_p;
 
 	bool FindCollision(const b2Transform& xf, const Vec3& p,
-		float32& distance, Vec3& normal, float32 maxDist) const restrict(amp)
+		float32& distance, Vec3& normal, float32 maxDist) const AMP_RESTRICT
 	{
 		if (FindZCollision(xf, p.z, distance, normal, maxDist))
 		{
@@ -101,7 +101,7 @@ struct AmpCircleShape
 	}
 
 	bool FindZCollision(const b2Transform& xf, float32 z,
-		float32& distance, Vec3& normal, float32 maxDist) const restrict(amp)
+		float32& distance, Vec3& normal, float32 maxDist) const AMP_RESTRICT
 	{
 		const float32 halfHeight = m_height / 2;
 		const float32 zRelToCenter = z - (xf.z + m_zPos + halfHeight);
@@ -112,7 +112,7 @@ struct AmpCircleShape
 	}
 
 	bool RayCast(RayCastOutput& output, const RayCastInput& input,
-		const b2Transform& xf) const restrict(amp)
+		const b2Transform& xf) const AMP_RESTRICT
 	{
 		Vec2 position = xf.p + b2Mul(xf.q, m_p);
 
@@ -172,7 +172,7 @@ struct AmpCircleShape
 		return false;
 	}
 
-	bool TestPoint(const b2Transform& xf, const Vec3& p) const restrict(amp)
+	bool TestPoint(const b2Transform& xf, const Vec3& p) const AMP_RESTRICT
 	{
 		Vec2 center = xf.p + b2Mul(xf.q, m_p);
 		Vec2 d = p - center;
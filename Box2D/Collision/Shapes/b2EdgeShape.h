@@ -77,10 +77,10 @@ struct AmpEdgeShape
 	Vec2 m_vertex0, m_vertex3;
 	int32 m_hasVertex0, m_hasVertex3;
 
-	AmpEdgeShape() restrict(amp);
+	AmpEdgeShape() AMP_RESTRICT;
 
 	void ComputeDistance(const b2Transform& xf, const Vec2& p,
-		float32& distance,Vec2& normal) const restrict(amp)
+		float32& distance,Vec2& normal) const AMP_RESTRICT
 	{
 		Vec2 v1 = b2Mul(xf, m_vertex1);
 		Vec2 v2 = b2Mul(xf, m_vertex2);
@@ -102,14 +102,14 @@ struct AmpEdgeShape
 		normal = d1 > 0 ? 1 / d1 * d : Vec2(0, 0);
 	}
 
-	bool TestZ(const b2Transform& xf, float32 z) const restrict(amp)
+	bool TestZ(const b2Transform& xf, float32 z) const AMP_RESTRICT
 	{
 		z -= (m_zPos + xf.z);
 		return z >= 0 && z <= m_height;
 	}
 
 	bool RayCast(b2RayCastOutput& output, const b2RayCastInput& input,
-		const b2Transform& xf) const restrict(amp)
+		const b2Transform& xf) const AMP_RESTRICT
 	{
 		// Put the ray into the edge's frame of reference.
 		Vec2 p1 = b2MulT(xf.q, input.p1 - xf.p);
@@ -168,7 +168,7 @@ inline b2EdgeShape::b2EdgeShape()
 	m_hasVertex0 = false;
 	m_hasVertex3 = false;
 }
-inline AmpEdgeShape::AmpEdgeShape() restrict(amp)
+inline AmpEdgeShape::AmpEdgeShape() AMP_RESTRICT
 {
 	m_type = b2Shape::e_edge;
 	m_radius = b2_polygonRadius;
@@ -271,8 +271,6 @@ void b2PolygonShape::Set(const b2Shape::Def& shapeDef)
 		s += m_vertices[i];
 	s *= 1.0f / m_count;
 
-	const float32 k_inv3 = 1.0f / 3.0f;
-
 	for (int32 i = 0; i < m_count; ++i)
 	{
 		// Triangle vertices.
@@ -118,7 +118,7 @@ struct AmpPolygonShape
 	int32 _placeholder2;
 
 	bool FindCollision(const b2Transform& xf, const Vec3& p,
-		float32& distance, Vec3& normal, float32 maxDist) const restrict(amp)
+		float32& distance, Vec3& normal, float32 maxDist) const AMP_RESTRICT
 	{
 		if (FindZCollision(xf, p.z, distance, normal, maxDist))
 		{
@@ -172,7 +172,7 @@ struct AmpPolygonShape
 	}
 
 	bool FindZCollision(const b2Transform& xf, float32 z,
-		float32& distance, Vec3& normal, float32 maxDist) const restrict(amp)
+		float32& distance, Vec3& normal, float32 maxDist) const AMP_RESTRICT
 	{
 		const float32 halfHeight = m_height / 2;
 		const float32 zRelToCenter = z - (xf.z + m_zPos + halfHeight);
@@ -183,7 +183,7 @@ struct AmpPolygonShape
 	}
 
 	bool RayCast(RayCastOutput& output, const RayCastInput& input,
-		const b2Transform& xf) const restrict(amp)
+		const b2Transform& xf) const AMP_RESTRICT
 	{
 
 		// Put the ray into the polygon's frame of reference.
@@ -269,7 +269,7 @@ struct AmpPolygonShape
 		return false;
 	}
 
-	bool TestPoint(const b2Transform& xf, const Vec3& p) const restrict(amp)
+	bool TestPoint(const b2Transform& xf, const Vec3& p) const AMP_RESTRICT
 	{
 		Vec2 pLocal = b2MulT(xf.q, p - xf.p);
 
@@ -146,7 +146,9 @@ struct b2ClipVertex
 struct b2RayCastInput
 {
 	b2RayCastInput() {};
-	b2RayCastInput() restrict(amp) {};
+#ifndef AMP_CPU_BACKEND
+	b2RayCastInput() AMP_RESTRICT {};
+#endif
 	Vec2 p1, p2;
 	float32 maxFraction;
 };
@@ -156,7 +158,9 @@ struct b2RayCastInput
 struct b2RayCastOutput
 {
 	b2RayCastOutput() {};
-	b2RayCastOutput() restrict(amp) {};
+#ifndef AMP_CPU_BACKEND
+	b2RayCastOutput() AMP_RESTRICT {};
+#endif
 	Vec2 normal;
 	float32 fraction;
 };
@@ -165,7 +169,9 @@ struct b2RayCastOutput
 struct RayCastInput
 {
 	RayCastInput() {};
-	RayCastInput() restrict(amp) {};
+#ifndef AMP_CPU_BACKEND
+	RayCastInput() AMP_RESTRICT {};
+#endif
 	Vec3 p1, p2;
 	float32 maxFraction;
 };
@@ -175,7 +181,9 @@ struct RayCastInput
 struct RayCastOutput
 {
 	RayCastOutput() {};
-	RayCastOutput() restrict(amp) {};
+#ifndef AMP_CPU_BACKEND
+	RayCastOutput() AMP_RESTRICT {};
+#endif
 	Vec3 normal;
 	float32 fraction;
 };
@@ -184,31 +192,39 @@ struct RayCastOutput
 struct b2AABB
 {
 	b2AABB() {};
-	b2AABB() restrict(amp) {};
+#ifndef AMP_CPU_BACKEND
+	b2AABB() AMP_RESTRICT {};
+#endif
 
 	/// Verify that the bounds are sorted.
 	bool IsValid() const;
-	bool IsValid() const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	bool IsValid() const AMP_RESTRICT;
+#endif
 
 	/// Get the center of the AABB.
 	Vec2 GetCenter() const
 	{
 		return 0.5f * (lowerBound + upperBound);
 	}
-	Vec2 GetCenter() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	Vec2 GetCenter() const AMP_RESTRICT
 	{
 		return 0.5f* (lowerBound + upperBound);
 	}
+#endif
 
 	/// Get the extents of the AABB (half-widths).
 	Vec2 GetExtents() const
 	{
 		return 0.5f * (upperBound - lowerBound);
 	}
-	Vec2 GetExtents() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	Vec2 GetExtents() const AMP_RESTRICT
 	{
 		return 0.5f* (upperBound - lowerBound);
 	}
+#endif
 
 	/// Get the perimeter length
 	float32 GetPerimeter() const
@@ -217,12 +233,14 @@ struct b2AABB
 		float32 wy = upperBound.y - lowerBound.y;
 		return 2.0f * (wx + wy);
 	}
-	float32 GetPerimeter() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	float32 GetPerimeter() const AMP_RESTRICT
 	{
 		float32 wx = upperBound.x - lowerBound.x;
 		float32 wy = upperBound.y - lowerBound.y;
 		return 2.0f* (wx + wy);
 	}
+#endif
 
 	/// Combine an AABB into this one.
 	void Combine(const b2AABB& aabb)
@@ -230,11 +248,13 @@ struct b2AABB
 		lowerBound = b2Min(lowerBound, aabb.lowerBound);
 		upperBound = b2Max(upperBound, aabb.upperBound);
 	}
-	void Combine(const b2AABB& aabb) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	void Combine(const b2AABB& aabb) AMP_RESTRICT
 	{
 		lowerBound = b2Min(lowerBound, aabb.lowerBound);
 		upperBound = b2Max(upperBound, aabb.upperBound);
 	}
+#endif
 
 	/// Combine two AABBs into this one.
 	void Combine(const b2AABB& aabb1, const b2AABB& aabb2)
@@ -242,11 +262,13 @@ struct b2AABB
 		lowerBound = b2Min(aabb1.lowerBound, aabb2.lowerBound);
 		upperBound = b2Max(aabb1.upperBound, aabb2.upperBound);
 	}
-	void Combine(const b2AABB& aabb1, const b2AABB& aabb2) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	void Combine(const b2AABB& aabb1, const b2AABB& aabb2) AMP_RESTRICT
 	{
 		lowerBound = b2Min(aabb1.lowerBound, aabb2.lowerBound);
 		upperBound = b2Max(aabb1.upperBound, aabb2.upperBound);
 	}
+#endif
 
 	/// Does this aabb contain the provided AABB.
 	bool Contains(const b2AABB& aabb) const
@@ -258,7 +280,8 @@ struct b2AABB
 		result = result && aabb.upperBound.y <= upperBound.y;
 		return result;
 	}
-	bool Contains(const b2AABB& aabb) const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	bool Contains(const b2AABB& aabb) const AMP_RESTRICT
 	{
 		bool result = true;
 		result = result && lowerBound.x <= aabb.lowerBound.x;
@@ -267,6 +290,7 @@ struct b2AABB
 		result = result && aabb.upperBound.y <= upperBound.y;
 		return result;
 	}
+#endif
 
 	bool RayCast(b2RayCastOutput& output, const b2RayCastInput& input) const;
 
@@ -330,13 +354,15 @@ inline bool b2AABB::IsValid() const
 	valid = valid && lowerBound.IsValid() && upperBound.IsValid();
 	return valid;
 }
-inline bool b2AABB::IsValid() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline bool b2AABB::IsValid() const AMP_RESTRICT
 {
 	Vec2 d = upperBound - lowerBound;
 	bool valid = d.x >= 0.0f && d.y >= 0.0f;
 	valid = valid && lowerBound.IsValid() && upperBound.IsValid();
 	return valid;
 }
+#endif
 
 inline bool b2TestOverlap(const b2AABB& a, const b2AABB& b)
 {
@@ -28,7 +28,7 @@ b2DynamicTree::b2DynamicTree()
 	m_nodeCount = 0;
 	m_nodeCapacity = 16;
 	m_nodes.resize(m_nodeCapacity);
-	memset(m_nodes.data(), 0, m_nodeCapacity * sizeof(b2TreeNode));
+	memset((void*)m_nodes.data(), 0, m_nodeCapacity * sizeof(b2TreeNode));
 
 	// Build a linked list for the free list.
 	for (int32 i = 0; i < m_nodeCapacity - 1; ++i)
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Box2D/Common/b2Settings.h>
+#include <iterator>
+#include <map>
+#include <set>
+#include <utility>
+
+/// Free index ranges [first, last) of a buffer, like the slots of destroyed
+/// particle groups. The ranges are kept by first index for coalescing and by
+/// size for allocation, so Allocate() and Free() take O(log n) in the number
+/// of ranges. Allocate() takes the lowest of the smallest ranges that fit.
+class FreeRanges
+{
+	typedef std::map<int32, int32> ByFirst;
+
+	ByFirst m_byFirst;							// first -> last
+	std::set<std::pair<int32, int32>> m_bySize;	// (size, first)
+
+	void Insert(const int32 first, const int32 last)
+	{
+		m_byFirst.emplace(first, last);
+		m_bySize.emplace(last - first, first);
+	}
+	void Erase(const ByFirst::iterator range)
+	{
+		m_bySize.erase(std::make_pair(range->second - range->first, range->first));
+		m_byFirst.erase(range);
+	}
+
+public:
+	void Clear()
+	{
+		m_byFirst.clear();
+		m_bySize.clear();
+	}
+	bool Empty() const { return m_byFirst.empty(); }
+	int32 GetCount() const { return (int32)m_byFirst.size(); }
+
+	/// @return first of cnt free indices, INVALID_IDX if no range is large enough.
+	int32 Allocate(const int32 cnt)
+	{
+		const auto fit = m_bySize.lower_bound(std::make_pair(cnt, 0));
+		if (fit == m_bySize.end()) return INVALID_IDX;
+		const ByFirst::iterator range = m_byFirst.find(fit->second);
+		const int32 first = range->first, last = range->second;
+		Erase(range);
+		if (first + cnt < last)
+			Insert(first + cnt, last);
+		return first;
+	}
+
+	/// Adds [first, last) and merges it with the adjacent ranges.
+	void Free(int32 first, int32 last)
+	{
+		if (first >= last) return;
+		const ByFirst::iterator next = m_byFirst.lower_bound(first);
+		if (next != m_byFirst.begin())
+		{
+			const ByFirst::iterator prev = std::prev(next);
+			if (prev->second == first)
+			{
+				first = prev->first;
+				Erase(prev);
+			}
+		}
+		if (next != m_byFirst.end() && next->first == last)
+		{
+			last = next->second;
+			Erase(next);
+		}
+		Insert(first, last);
+	}
+
+	/// Removes the range ending at end, so the buffer can shrink to its first index.
+	/// @return the new end.
+	int32 TrimEnd(const int32 end)
+	{
+		if (m_byFirst.empty()) return end;
+		const ByFirst::iterator range = std::prev(m_byFirst.end());
+		if (range->second != end) return end;
+		const int32 first = range->first;
+		Erase(range);
+		return first;
+	}
+};
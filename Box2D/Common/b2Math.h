@@ -19,7 +19,9 @@
 #pragma once
 #include <Box2D/Common/b2Settings.h>
 #include <math.h>
+#ifndef AMP_CPU_BACKEND
 #include <amp_math.h>
+#endif
 
 /// This function is used to ensure that a floating point number is not a NaN or infinity.
 inline bool b2IsValid(float32 x)
@@ -30,7 +32,8 @@ inline bool b2IsValid(float32 x)
 	} v = { x };
 	return (v.i & 0x7f800000) != 0x7f800000;
 }
-inline bool b2IsValid(float32 x) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline bool b2IsValid(float32 x) AMP_RESTRICT
 {
 	union {
 		float32 f;
@@ -38,6 +41,7 @@ inline bool b2IsValid(float32 x) restrict(amp)
 	} v = { x };
 	return (v.i & 0x7f800000) != 0x7f800000;
 }
+#endif
 
 /// This is a approximate yet fast inverse square-root.
 inline float32 b2InvSqrt(float32 x)
@@ -55,7 +59,8 @@ inline float32 b2InvSqrt(float32 x)
 	x = x * (1.5f - xhalf * x * x);
 	return x;
 }
-inline float32 b2InvSqrt(float32 x) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline float32 b2InvSqrt(float32 x) AMP_RESTRICT
 {
 	union
 	{
@@ -70,7 +75,8 @@ inline float32 b2InvSqrt(float32 x) restrict(amp)
 	x = x * (1.5f - xhalf * x * x);
 	return x;
 }
-inline float32 b2InvCurt(float32 x) restrict(amp)
+#endif
+inline float32 b2InvCurt(float32 x) AMP_RESTRICT
 {
 	union
 	{
@@ -98,8 +104,10 @@ inline float32 b2InvCurt(float32 x) restrict(amp)
 
 struct b2Int2
 {
-	b2Int2() : y(0), x(0) {}
-	b2Int2() restrict(amp) : y(0), x(0) {}
+	b2Int2() : x(0), y(0) {}
+#ifndef AMP_CPU_BACKEND
+	b2Int2() AMP_RESTRICT : x(0), y(0) {}
+#endif
 
 	int32 x, y;
 };
@@ -109,53 +117,77 @@ struct Vec2
 {
 	/// Default constructor does nothing (for performance).
 	Vec2() : x(0), y(0) {}
-	Vec2() restrict(amp) : x(0), y(0) {}
+#ifndef AMP_CPU_BACKEND
+	Vec2() AMP_RESTRICT : x(0), y(0) {}
+#endif
 
 	/// Construct using coordinates
 	Vec2(float32 v) : x(v), y(v) {}
 	Vec2(float32 x, float32 y) : x(x), y(y) {}
-	Vec2(float32 x, float32 y) restrict(amp) : x(x), y(y) {}
+#ifndef AMP_CPU_BACKEND
+	Vec2(float32 x, float32 y) AMP_RESTRICT : x(x), y(y) {}
+#endif
 
 	/// Set this vector to all zeros.
 	void SetZero() { x = 0.0f; y = 0.0f; }
-	void SetZero() restrict(amp) { x = 0.0f; y = 0.0f; }
+#ifndef AMP_CPU_BACKEND
+	void SetZero() AMP_RESTRICT { x = 0.0f; y = 0.0f; }
+#endif
 
 	/// Set this vector to some specified coordinates.
 	void Set(float32 x_, float32 y_) { x = x_; y = y_; }
-	void Set(float32 x_, float32 y_) restrict(amp) { x = x_; y = y_; }
+#ifndef AMP_CPU_BACKEND
+	void Set(float32 x_, float32 y_) AMP_RESTRICT { x = x_; y = y_; }
+#endif
 
 	/// Negate this vector.
 	Vec2 operator -() const { Vec2 v; v.Set(-x, -y); return v; }
-	Vec2 operator -() const restrict(amp) { Vec2 v; v.Set(-x, -y); return v; }
+#ifndef AMP_CPU_BACKEND
+	Vec2 operator -() const AMP_RESTRICT { Vec2 v; v.Set(-x, -y); return v; }
+#endif
 
 	/// Read from and indexed element.
 	float32 operator () (int32 i) const { return (&x)[i]; }
-	float32 operator () (int32 i) const restrict(amp) { return (&x)[i]; }
+#ifndef AMP_CPU_BACKEND
+	float32 operator () (int32 i) const AMP_RESTRICT { return (&x)[i]; }
+#endif
 
 	/// Write to an indexed element.
 	float32& operator () (int32 i) { return (&x)[i]; }
-	float32& operator () (int32 i) restrict(amp) { return (&x)[i]; }
+#ifndef AMP_CPU_BACKEND
+	float32& operator () (int32 i) AMP_RESTRICT { return (&x)[i]; }
+#endif
 
 	/// Add a vector to this vector.
 	void operator += (const Vec2& v) { x += v.x; y += v.y; }
-	void operator += (const Vec2& v) restrict(amp) { x += v.x; y += v.y; }
+#ifndef AMP_CPU_BACKEND
+	void operator += (const Vec2& v) AMP_RESTRICT { x += v.x; y += v.y; }
+#endif
 
 	/// Subtract a vector from this vector.
 	void operator -= (const Vec2& v) { x -= v.x; y -= v.y; }
-	void operator -= (const Vec2& v) restrict(amp) { x -= v.x; y -= v.y; }
+#ifndef AMP_CPU_BACKEND
+	void operator -= (const Vec2& v) AMP_RESTRICT { x -= v.x; y -= v.y; }
+#endif
 
 	/// Multiply this vector by a scalar.
 	void operator *= (float32 a) { x *= a; y *= a; }
-	void operator *= (float32 a) restrict(amp) { x *= a; y *= a; }
+#ifndef AMP_CPU_BACKEND
+	void operator *= (float32 a) AMP_RESTRICT { x *= a; y *= a; }
+#endif
 
 	/// Get the length of this vector (the norm).
 	float32 Length() const { return b2Sqrt(x * x + y * y); }
-	float32 Length() const restrict(amp) { return ampSqrt(x * x + y * y); }
+#ifndef AMP_CPU_BACKEND
+	float32 Length() const AMP_RESTRICT { return ampSqrt(x * x + y * y); }
+#endif
 
 	/// Get the length squared. For performance, use this instead of
 	/// Vec2::Length (if possible).
 	float32 LengthSquared() const { return x * x + y * y; }
-	float32 LengthSquared() const restrict(amp) { return x * x + y * y; }
+#ifndef AMP_CPU_BACKEND
+	float32 LengthSquared() const AMP_RESTRICT { return x * x + y * y; }
+#endif
 
 	/// Convert this vector into a unit vector. Returns the length.
 	float32 Normalize()
@@ -167,7 +199,8 @@ struct Vec2
 		y *= invLength;
 		return length;
 	}
-	float32 Normalize() restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	float32 Normalize() AMP_RESTRICT
 	{
 		float32 length = Length();
 		if (length < b2_epsilon) return 0.0f;
@@ -176,7 +209,8 @@ struct Vec2
 		y *= invLength;
 		return length;
 	}
-	Vec2 Normalized() const restrict(amp)
+#endif
+	Vec2 Normalized() const AMP_RESTRICT
 	{
 		float32 length = Length();
 		if (length < b2_epsilon) return Vec2(0, 0);
@@ -186,86 +220,124 @@ struct Vec2
 
 	/// Does this vector contain finite coordinates?
 	bool IsValid() const { return b2IsValid(x) && b2IsValid(y); }
-	bool IsValid() const restrict(amp) { return b2IsValid(x) && b2IsValid(y); }
+#ifndef AMP_CPU_BACKEND
+	bool IsValid() const AMP_RESTRICT { return b2IsValid(x) && b2IsValid(y); }
+#endif
 
 	/// Get the skew vector such that dot(skew_vec, other) == cross(vec, other)
 	Vec2 Skew() const { return Vec2(-y, x); }
-	Vec2 Skew() const restrict(amp) { return Vec2(-y, x); }
+#ifndef AMP_CPU_BACKEND
+	Vec2 Skew() const AMP_RESTRICT { return Vec2(-y, x); }
+#endif
 
 	float32 x, y;
 };
 
 /// Add a float to a vector
 inline Vec2 operator + (const Vec2& v, float f) { return Vec2(v.x + f, v.y + f); }
-inline Vec2 operator + (const Vec2& v, float f) restrict(amp) { return Vec2(v.x + f, v.y + f); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator + (const Vec2& v, float f) AMP_RESTRICT { return Vec2(v.x + f, v.y + f); }
+#endif
 
 /// Substract a float from a vector.
 inline Vec2 operator - (const Vec2& v, float f) { return Vec2(v.x - f, v.y - f); }
-inline Vec2 operator - (const Vec2& v, float f) restrict(amp) { return Vec2(v.x - f, v.y - f); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator - (const Vec2& v, float f) AMP_RESTRICT { return Vec2(v.x - f, v.y - f); }
+#endif
 
 /// Multiply a float with a vector.
 inline Vec2 operator * (const Vec2& v, float f) { return Vec2(v.x * f, v.y * f); }
-inline Vec2 operator * (const Vec2& v, float f) restrict(amp) { return Vec2(v.x * f, v.y * f); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator * (const Vec2& v, float f) AMP_RESTRICT { return Vec2(v.x * f, v.y * f); }
+#endif
 
 /// Divide a vector by a float.
 inline Vec2 operator / (const Vec2& v, float f) { return Vec2(v.x / f, v.y / f); }
-inline Vec2 operator / (const Vec2& v, float f) restrict(amp) { return Vec2(v.x / f, v.y / f); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator / (const Vec2& v, float f) AMP_RESTRICT { return Vec2(v.x / f, v.y / f); }
+#endif
 
 /// A 3D column vector with 3 elements.
 struct Vec3
 {
 	/// Default constructor does nothing (for performance).
 	Vec3(): x(0), y(0), z(0) {}
-	Vec3() restrict(amp) : x(0), y(0), z(0) {}
+#ifndef AMP_CPU_BACKEND
+	Vec3() AMP_RESTRICT : x(0), y(0), z(0) {}
+#endif
 
 	/// Construct using coordinates.
 	Vec3(float32 v) : x(v), y(v), z(v) {}
 	Vec3(float32 x, float32 y, float32 z) : x(x), y(y), z(z) {}
-	Vec3(float32 x, float32 y, float32 z) restrict(amp) : x(x), y(y), z(z) {}
+#ifndef AMP_CPU_BACKEND
+	Vec3(float32 x, float32 y, float32 z) AMP_RESTRICT : x(x), y(y), z(z) {}
+#endif
 
 	/// Construct using Vec2 und float.
 	Vec3(Vec2 v, float32 z) : x(v.x), y(v.y), z(z) {}
-	Vec3(Vec2 v, float32 z) restrict(amp) : x(v.x), y(v.y), z(z) {}
+#ifndef AMP_CPU_BACKEND
+	Vec3(Vec2 v, float32 z) AMP_RESTRICT : x(v.x), y(v.y), z(z) {}
+#endif
 
 	/// Construct using Vec2 und float.
 	Vec3(Vec2 v) : x(v.x), y(v.y), z(0) {}
-	//Vec3(Vec2 v) restrict(amp) : x(v.x), y(v.y), z(0) {}
+	//Vec3(Vec2 v) AMP_RESTRICT : x(v.x), y(v.y), z(0) {}
 
 	/// Set this vector to all zeros.
 	void SetZero() { x = 0.0f; y = 0.0f; z = 0.0f; }
-	void SetZero() restrict(amp) { x = 0.0f; y = 0.0f; z = 0.0f; }
+#ifndef AMP_CPU_BACKEND
+	void SetZero() AMP_RESTRICT { x = 0.0f; y = 0.0f; z = 0.0f; }
+#endif
 
 	/// Set this vector to some specified coordinates.
 	void Set(float32 x_, float32 y_, float32 z_) { x = x_; y = y_; z = z_; }
-	void Set(float32 x_, float32 y_, float32 z_) restrict(amp) { x = x_; y = y_; z = z_; }
+#ifndef AMP_CPU_BACKEND
+	void Set(float32 x_, float32 y_, float32 z_) AMP_RESTRICT { x = x_; y = y_; z = z_; }
+#endif
 
 	/// Negate this vector.
 	Vec3 operator -() const { Vec3 v; v.Set(-x, -y, -z); return v; }
-	Vec3 operator -() const restrict(amp) { Vec3 v; v.Set(-x, -y, -z); return v; }
+#ifndef AMP_CPU_BACKEND
+	Vec3 operator -() const AMP_RESTRICT { Vec3 v; v.Set(-x, -y, -z); return v; }
+#endif
 
 	/// Add a vector to this vector.
 	void operator += (const Vec3& v) { x += v.x; y += v.y; z += v.z; }
-	void operator += (const Vec3& v) restrict(amp) { x += v.x; y += v.y; z += v.z; }
+#ifndef AMP_CPU_BACKEND
+	void operator += (const Vec3& v) AMP_RESTRICT { x += v.x; y += v.y; z += v.z; }
+#endif
 	void operator += (const Vec2& v) { x += v.x; y += v.y; }
-	void operator += (const Vec2& v) restrict(amp) { x += v.x; y += v.y; }
+#ifndef AMP_CPU_BACKEND
+	void operator += (const Vec2& v) AMP_RESTRICT { x += v.x; y += v.y; }
+#endif
 
 	/// Subtract a vector from this vector.
 	void operator -= (const Vec3& v) { x -= v.x; y -= v.y; z -= v.z; }
-	void operator -= (const Vec3& v)  restrict(amp) { x -= v.x; y -= v.y; z -= v.z; }
+#ifndef AMP_CPU_BACKEND
+	void operator -= (const Vec3& v)  AMP_RESTRICT { x -= v.x; y -= v.y; z -= v.z; }
+#endif
 	void operator -= (const Vec2& v) { x -= v.x; y -= v.y; }
-	void operator -= (const Vec2& v)  restrict(amp) { x -= v.x; y -= v.y; }
+#ifndef AMP_CPU_BACKEND
+	void operator -= (const Vec2& v)  AMP_RESTRICT { x -= v.x; y -= v.y; }
+#endif
 
 	/// Multiply this vector by a scalar.
 	void operator *= (float32 s) { x *= s; y *= s; z *= s; }
-	void operator *= (float32 s) restrict(amp) { x *= s; y *= s; z *= s; }
+#ifndef AMP_CPU_BACKEND
+	void operator *= (float32 s) AMP_RESTRICT { x *= s; y *= s; z *= s; }
+#endif
 
 	/// Multiply this vector by a scalar.
 	void operator /= (float32 s) { x /= s; y /= s; z /= s; }
-	void operator /= (float32 s) restrict(amp) { x /= s; y /= s; z /= s; }
+#ifndef AMP_CPU_BACKEND
+	void operator /= (float32 s) AMP_RESTRICT { x /= s; y /= s; z /= s; }
+#endif
 
 	/// Get the length of this vector (the norm).
 	float32 Length() const { return b2Sqrt(x * x + y * y + z * z); }
-	float32 Length() const restrict(amp) { return ampSqrt(x * x + y * y + z * z); }
+#ifndef AMP_CPU_BACKEND
+	float32 Length() const AMP_RESTRICT { return ampSqrt(x * x + y * y + z * z); }
+#endif
 
 	/// Convert this vector into a unit vector. Returns the length.
 	float32 Normalize()
@@ -278,7 +350,8 @@ struct Vec3
 		z *= invLength;
 		return length;
 	}
-	float32 Normalize() restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	float32 Normalize() AMP_RESTRICT
 	{
 		float32 length = Length();
 		if (length < b2_epsilon) return 0.0f;
@@ -288,7 +361,8 @@ struct Vec3
 		z *= invLength;
 		return length;
 	}
-	Vec3 Normalized() const restrict(amp)
+#endif
+	Vec3 Normalized() const AMP_RESTRICT
 	{
 		float32 length = Length();
 		if (length < b2_epsilon) return Vec3(0, 0, 0);
@@ -298,9 +372,13 @@ struct Vec3
 
 	/// conversion to Vec2 (type-cast operator)
 	operator Vec2() { return Vec2(x, y); }
-	operator Vec2() restrict(amp) { return Vec2(x, y); }
+#ifndef AMP_CPU_BACKEND
+	operator Vec2() AMP_RESTRICT { return Vec2(x, y); }
+#endif
 	operator Vec2() const { return Vec2(x, y); }
-	operator Vec2() const restrict(amp) { return Vec2(x, y); }
+#ifndef AMP_CPU_BACKEND
+	operator Vec2() const AMP_RESTRICT { return Vec2(x, y); }
+#endif
 
 	float32 x, y, z;
 };
@@ -310,11 +388,15 @@ struct b2Vec4
 {
 	/// Default constructor does nothing (for performance).
 	b2Vec4(): x(0), y(0), z(0), w(0) {}
-	b2Vec4() restrict(amp) : x(0), y(0), z(0), w(0) {}
+#ifndef AMP_CPU_BACKEND
+	b2Vec4() AMP_RESTRICT : x(0), y(0), z(0), w(0) {}
+#endif
 
 	/// Construct using coordinates.
 	b2Vec4(float32 x, float32 y, float32 z, float32 w) : x(x), y(y), z(z), w(w) {}
-	b2Vec4(float32 x, float32 y, float32 z, float32 w) restrict(amp) : x(x), y(y), z(z), w(w) {}
+#ifndef AMP_CPU_BACKEND
+	b2Vec4(float32 x, float32 y, float32 z, float32 w) AMP_RESTRICT : x(x), y(y), z(z), w(w) {}
+#endif
 
 	float32 x, y, z, w;
 };
@@ -324,27 +406,39 @@ struct b2Mat22
 {
 	/// The default constructor does nothing (for performance).
 	b2Mat22() {}
-	b2Mat22() restrict(amp) {}
+#ifndef AMP_CPU_BACKEND
+	b2Mat22() AMP_RESTRICT {}
+#endif
 
 	/// Construct this matrix using columns.
 	b2Mat22(const Vec2& c1, const Vec2& c2) { ex = c1; ey = c2; }
-	b2Mat22(const Vec2& c1, const Vec2& c2) restrict(amp) { ex = c1; ey = c2; }
+#ifndef AMP_CPU_BACKEND
+	b2Mat22(const Vec2& c1, const Vec2& c2) AMP_RESTRICT { ex = c1; ey = c2; }
+#endif
 
 	/// Construct this matrix using scalars.
 	b2Mat22(float32 a11, float32 a12, float32 a21, float32 a22) { ex.x = a11; ex.y = a21; ey.x = a12; ey.y = a22; }
-	b2Mat22(float32 a11, float32 a12, float32 a21, float32 a22) restrict(amp) { ex.x = a11; ex.y = a21; ey.x = a12; ey.y = a22; }
+#ifndef AMP_CPU_BACKEND
+	b2Mat22(float32 a11, float32 a12, float32 a21, float32 a22) AMP_RESTRICT { ex.x = a11; ex.y = a21; ey.x = a12; ey.y = a22; }
+#endif
 
 	/// Initialize this matrix using columns.
 	void Set(const Vec2& c1, const Vec2& c2) { ex = c1; ey = c2; }
-	void Set(const Vec2& c1, const Vec2& c2) restrict(amp) { ex = c1; ey = c2; }
+#ifndef AMP_CPU_BACKEND
+	void Set(const Vec2& c1, const Vec2& c2) AMP_RESTRICT { ex = c1; ey = c2; }
+#endif
 
 	/// Set this to the identity matrix.
 	void SetIdentity() { ex.x = 1.0f; ey.x = 0.0f; ex.y = 0.0f; ey.y = 1.0f; }
-	void SetIdentity() restrict(amp) { ex.x = 1.0f; ey.x = 0.0f; ex.y = 0.0f; ey.y = 1.0f; }
+#ifndef AMP_CPU_BACKEND
+	void SetIdentity() AMP_RESTRICT { ex.x = 1.0f; ey.x = 0.0f; ex.y = 0.0f; ey.y = 1.0f; }
+#endif
 
 	/// Set this matrix to all zeros.
 	void SetZero() { ex.x = 0.0f; ey.x = 0.0f; ex.y = 0.0f; ey.y = 0.0f; }
-	void SetZero() restrict(amp) { ex.x = 0.0f; ey.x = 0.0f; ex.y = 0.0f; ey.y = 0.0f; }
+#ifndef AMP_CPU_BACKEND
+	void SetZero() AMP_RESTRICT { ex.x = 0.0f; ey.x = 0.0f; ex.y = 0.0f; ey.y = 0.0f; }
+#endif
 
 	b2Mat22 GetInverse() const
 	{
@@ -356,7 +450,8 @@ struct b2Mat22
 		B.ex.y = -det * c;	B.ey.y = det * a;
 		return B;
 	}
-	b2Mat22 GetInverse() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	b2Mat22 GetInverse() const AMP_RESTRICT
 	{
 		float32 a = ex.x, b = ey.x, c = ex.y, d = ey.y;
 		b2Mat22 B;
@@ -366,6 +461,7 @@ struct b2Mat22
 		B.ex.y = -det * c;	B.ey.y = det * a;
 		return B;
 	}
+#endif
 
 	/// Solve A * x = b, where b is a column vector. This is more efficient
 	/// than computing the inverse in one-shot cases.
@@ -379,7 +475,8 @@ struct b2Mat22
 		x.y = det * (a11 * b.y - a21 * b.x);
 		return x;
 	}
-	Vec2 Solve(const Vec2& b) const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	Vec2 Solve(const Vec2& b) const AMP_RESTRICT
 	{
 		float32 a11 = ex.x, a12 = ey.x, a21 = ex.y, a22 = ey.y;
 		float32 det = a11 * a22 - a12 * a21;
@@ -389,6 +486,7 @@ struct b2Mat22
 		x.y = det * (a11 * b.y - a21 * b.x);
 		return x;
 	}
+#endif
 
 	Vec2 ex, ey;
 };
@@ -398,36 +496,50 @@ struct b2Mat33
 {
 	/// The default constructor does nothing (for performance).
 	b2Mat33() {}
-	b2Mat33() restrict(amp) {}
+#ifndef AMP_CPU_BACKEND
+	b2Mat33() AMP_RESTRICT {}
+#endif
 
 	/// Construct this matrix using columns.
 	b2Mat33(const Vec3& c1, const Vec3& c2, const Vec3& c3) { ex = c1; ey = c2; ez = c3; }
-	b2Mat33(const Vec3& c1, const Vec3& c2, const Vec3& c3) restrict(amp) { ex = c1; ey = c2; ez = c3; }
+#ifndef AMP_CPU_BACKEND
+	b2Mat33(const Vec3& c1, const Vec3& c2, const Vec3& c3) AMP_RESTRICT { ex = c1; ey = c2; ez = c3; }
+#endif
 
 	/// Set this matrix to all zeros.
 	void SetZero() { ex.SetZero(); ey.SetZero(); ez.SetZero(); }
-	void SetZero() restrict(amp) { ex.SetZero(); ey.SetZero(); ez.SetZero(); }
+#ifndef AMP_CPU_BACKEND
+	void SetZero() AMP_RESTRICT { ex.SetZero(); ey.SetZero(); ez.SetZero(); }
+#endif
 
 	/// Solve A * x = b, where b is a column vector. This is more efficient
 	/// than computing the inverse in one-shot cases.
 	Vec3 Solve33(const Vec3& b) const;
-	Vec3 Solve33(const Vec3& b) const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	Vec3 Solve33(const Vec3& b) const AMP_RESTRICT;
+#endif
 
 	/// Solve A * x = b, where b is a column vector. This is more efficient
 	/// than computing the inverse in one-shot cases. Solve only the upper
 	/// 2-by-2 matrix equation.
 	Vec2 Solve22(const Vec2& b) const;
-	Vec2 Solve22(const Vec2& b) const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	Vec2 Solve22(const Vec2& b) const AMP_RESTRICT;
+#endif
 
 	/// Get the inverse of this matrix as a 2-by-2.
 	/// Returns the zero matrix if singular.
 	void GetInverse22(b2Mat33* M) const;
-	void GetInverse22(b2Mat33* M) const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	void GetInverse22(b2Mat33* M) const AMP_RESTRICT;
+#endif
 
 	/// Get the symmetric inverse of this matrix as a 3-by-3.
 	/// Returns the zero matrix if singular.
 	void GetSymInverse33(b2Mat33* M) const;
-	void GetSymInverse33(b2Mat33* M) const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	void GetSymInverse33(b2Mat33* M) const AMP_RESTRICT;
+#endif
 
 	Vec3 ex, ey, ez;
 };
@@ -436,31 +548,45 @@ struct b2Mat33
 struct b2Rot
 {
 	b2Rot(): s(0), c(0) {}
-	b2Rot() restrict(amp) : s(0), c(0) {}
+#ifndef AMP_CPU_BACKEND
+	b2Rot() AMP_RESTRICT : s(0), c(0) {}
+#endif
 
 	/// Initialize from an angle in radians
 	explicit b2Rot(float32 angle) { s = sinf(angle); c = cosf(angle); }
-	explicit b2Rot(float32 angle) restrict(amp) { s = ampMath::sinf(angle); c = ampMath::cosf(angle); }
+#ifndef AMP_CPU_BACKEND
+	explicit b2Rot(float32 angle) AMP_RESTRICT { s = ampMath::sinf(angle); c = ampMath::cosf(angle); }
+#endif
 
 	/// Set using an angle in radians.
 	void Set(float32 angle) { s = sinf(angle); c = cosf(angle); }
-	void Set(float32 angle) restrict(amp) { s = ampSin(angle); c = ampCos(angle); }
+#ifndef AMP_CPU_BACKEND
+	void Set(float32 angle) AMP_RESTRICT { s = ampSin(angle); c = ampCos(angle); }
+#endif
 
 	/// Set to the identity rotation
 	void SetIdentity() { s = 0.0f; c = 1.0f; }
-	void SetIdentity() restrict(amp) { s = 0.0f; c = 1.0f; }
+#ifndef AMP_CPU_BACKEND
+	void SetIdentity() AMP_RESTRICT { s = 0.0f; c = 1.0f; }
+#endif
 
 	/// Get the angle in radians
 	float32 GetAngle() const { return b2Atan2(s, c); }
-	float32 GetAngle() const restrict(amp) { return ampAtan2(s, c); }
+#ifndef AMP_CPU_BACKEND
+	float32 GetAngle() const AMP_RESTRICT { return ampAtan2(s, c); }
+#endif
 
 	/// Get the x-axis
 	Vec2 GetXAxis() const { return Vec2(c, s); }
-	Vec2 GetXAxis() const restrict(amp) { return Vec2(c, s); }
+#ifndef AMP_CPU_BACKEND
+	Vec2 GetXAxis() const AMP_RESTRICT { return Vec2(c, s); }
+#endif
 
 	/// Get the u-axis
 	Vec2 GetYAxis() const { return Vec2(-s, c); }
-	Vec2 GetYAxis() const restrict(amp) { return Vec2(-s, c); }
+#ifndef AMP_CPU_BACKEND
+	Vec2 GetYAxis() const AMP_RESTRICT { return Vec2(-s, c); }
+#endif
 
 	/// Sine and cosine
 	float32 s, c;
@@ -472,23 +598,35 @@ struct b2Transform
 {
 	/// The default constructor does nothing.
 	b2Transform() { p.SetZero(); q.SetIdentity(); z = 0; }
-	b2Transform() restrict(amp) { p.SetZero(); q.SetIdentity(); z = 0; }
+#ifndef AMP_CPU_BACKEND
+	b2Transform() AMP_RESTRICT { p.SetZero(); q.SetIdentity(); z = 0; }
+#endif
 
 	/// Initialize using a position vector and a rotation.
 	b2Transform(const Vec2& position, const b2Rot& rotation) : p(position), q(rotation) {}
-	b2Transform(const Vec2& position, const b2Rot& rotation) restrict(amp) : p(position), q(rotation) {}
+#ifndef AMP_CPU_BACKEND
+	b2Transform(const Vec2& position, const b2Rot& rotation) AMP_RESTRICT : p(position), q(rotation) {}
+#endif
 	b2Transform(const Vec3& position, const b2Rot& rotation) : p(position), z(position.z), q(rotation) {}
-	b2Transform(const Vec3& position, const b2Rot& rotation) restrict(amp) : p(position), z(position.z), q(rotation) {}
+#ifndef AMP_CPU_BACKEND
+	b2Transform(const Vec3& position, const b2Rot& rotation) AMP_RESTRICT : p(position), z(position.z), q(rotation) {}
+#endif
 	b2Transform(float32 posX, float32 posY, const b2Rot& rotation) : p(Vec2(posX, posY)), q(rotation) {}
-	b2Transform(float32 posX, float32 posY, const b2Rot& rotation) restrict(amp) : p(Vec2(posX, posY)), q(rotation) {}
+#ifndef AMP_CPU_BACKEND
+	b2Transform(float32 posX, float32 posY, const b2Rot& rotation) AMP_RESTRICT : p(Vec2(posX, posY)), q(rotation) {}
+#endif
 
 	/// Set this to the identity transform.
 	void SetIdentity() { p.SetZero(); q.SetIdentity();  z = 0; }
-	void SetIdentity() restrict(amp) { p.SetZero(); q.SetIdentity(); z = 0; }
+#ifndef AMP_CPU_BACKEND
+	void SetIdentity() AMP_RESTRICT { p.SetZero(); q.SetIdentity(); z = 0; }
+#endif
 
 	/// Set this based on the position and angle.
 	void Set(const Vec2& position, float32 angle) { p = position; q.Set(angle); }
-	void Set(const Vec2& position, float32 angle) restrict(amp) { p = position; q.Set(angle); }
+#ifndef AMP_CPU_BACKEND
+	void Set(const Vec2& position, float32 angle) AMP_RESTRICT { p = position; q.Set(angle); }
+#endif
 
 #if LIQUIDFUN_EXTERNAL_LANGUAGE_API
 	/// Get x-coordinate of p.
@@ -518,16 +656,22 @@ struct b2Sweep
 	/// Get the interpolated transform at a specific time.
 	/// @param beta is a factor in [0,1], where 0 indicates alpha0.
 	void GetTransform(b2Transform& xfb, float32 beta) const;
-	void GetTransform(b2Transform& xfb, float32 beta) const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	void GetTransform(b2Transform& xfb, float32 beta) const AMP_RESTRICT;
+#endif
 
 	/// Advance the sweep forward, yielding a new initial state.
 	/// @param alpha the new initial time.
 	void Advance(float32 alpha);
-	void Advance(float32 alpha) restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	void Advance(float32 alpha) AMP_RESTRICT;
+#endif
 
 	/// Normalize the angles.
 	void Normalize();
-	void Normalize() restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	void Normalize() AMP_RESTRICT;
+#endif
 
 	Vec2 localCenter;	///< local center of mass position
 	Vec2 c0, c;		///< center world positions
@@ -545,216 +689,354 @@ extern const Vec3 Vec3_up;
 
 /// Perform the dot product on two vectors.
 inline float32 b2Dot(const Vec2& a, const Vec2& b) { return a.x * b.x + a.y * b.y; }
-inline float32 b2Dot(const Vec2& a, const Vec2& b) restrict(amp) { return a.x * b.x + a.y * b.y; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Dot(const Vec2& a, const Vec2& b) AMP_RESTRICT { return a.x * b.x + a.y * b.y; }
+#endif
 inline float32 b2Dot(const float32& ax, const float32& ay, const float32& bx, const float32& by) { return ax * bx + ay * by; }
-inline float32 b2Dot(const float32& ax, const float32& ay, const float32& bx, const float32& by) restrict(amp) { return ax * bx + ay * by; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Dot(const float32& ax, const float32& ay, const float32& bx, const float32& by) AMP_RESTRICT { return ax * bx + ay * by; }
+#endif
 inline void Normalize(float32& x, float32& y) { float32 length = b2Sqrt(x * x + y * y); x /= length; y /= length; }
-inline void Normalize(float32& x, float32& y) restrict(amp) { float32 length = ampSqrt(x * x + y * y); x /= length; y /= length; }
+#ifndef AMP_CPU_BACKEND
+inline void Normalize(float32& x, float32& y) AMP_RESTRICT { float32 length = ampSqrt(x * x + y * y); x /= length; y /= length; }
+#endif
 inline void Normalize(float32& x, float32& y, float32& z) { float32 length = b2Sqrt(x * x + y * y + z * z); x /= length; y /= length; z /= length; }
-inline void Normalize(float32& x, float32& y, float32& z) restrict(amp) { float32 length = ampSqrt(x * x + y * y + z * z); x /= length; y /= length; z /= length; }
+#ifndef AMP_CPU_BACKEND
+inline void Normalize(float32& x, float32& y, float32& z) AMP_RESTRICT { float32 length = ampSqrt(x * x + y * y + z * z); x /= length; y /= length; z /= length; }
+#endif
 
 /// Perform the cross product on two vectors. In 2D this produces a scalar.
 inline float32 b2Cross(const Vec2& a, const Vec2& b) { return a.x* b.y - a.y * b.x; }
-inline float32 b2Cross(const Vec2& a, const Vec2& b) restrict(amp) { return a.x* b.y - a.y * b.x; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Cross(const Vec2& a, const Vec2& b) AMP_RESTRICT { return a.x* b.y - a.y * b.x; }
+#endif
 
 inline float32 b2Cross(const float32& ax, const float32& ay, const float32& bx, const float32& by) { return ax * by - ay * bx; }
-inline float32 b2Cross(const float32& ax, const float32& ay, const float32& bx, const float32& by) restrict(amp) { return ax * by - ay * bx; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Cross(const float32& ax, const float32& ay, const float32& bx, const float32& by) AMP_RESTRICT { return ax * by - ay * bx; }
+#endif
 inline float32 b2Cross2D(const Vec3& a, const Vec3& b) { return a.x* b.y - a.y * b.x; }
-inline float32 b2Cross2D(const Vec3& a, const Vec3& b) restrict(amp) { return a.x* b.y - a.y * b.x; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Cross2D(const Vec3& a, const Vec3& b) AMP_RESTRICT { return a.x* b.y - a.y * b.x; }
+#endif
 
 /// Perform the cross product on a vector and a scalar. In 2D this produces
 /// a vector.
 inline Vec2 b2Cross(const Vec2& a, float32 s) { return Vec2(s * a.y, -s * a.x); }
-inline Vec2 b2Cross(const Vec2& a, float32 s) restrict(amp) { return Vec2(s * a.y, -s * a.x); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Cross(const Vec2& a, float32 s) AMP_RESTRICT { return Vec2(s * a.y, -s * a.x); }
+#endif
 
 /// Perform the cross product on a scalar and a vector. In 2D this produces
 /// a vector.
 inline Vec2 b2Cross(float32 s, const Vec2& a) { return Vec2(-s * a.y, s * a.x); }
-inline Vec2 b2Cross(float32 s, const Vec2& a) restrict(amp) { return Vec2(-s * a.y, s * a.x); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Cross(float32 s, const Vec2& a) AMP_RESTRICT { return Vec2(-s * a.y, s * a.x); }
+#endif
 
 /// Multiply a matrix times a vector. If a rotation matrix is provided,
 /// then this transforms the vector from one frame to another.
 inline Vec2 b2Mul(const b2Mat22& A, const Vec2& v) { return Vec2(A.ex.x * v.x + A.ey.x * v.y, A.ex.y * v.x + A.ey.y * v.y); }
-inline Vec2 b2Mul(const b2Mat22& A, const Vec2& v) restrict(amp) { return Vec2(A.ex.x * v.x + A.ey.x * v.y, A.ex.y * v.x + A.ey.y * v.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Mul(const b2Mat22& A, const Vec2& v) AMP_RESTRICT { return Vec2(A.ex.x * v.x + A.ey.x * v.y, A.ex.y * v.x + A.ey.y * v.y); }
+#endif
 
 /// Multiply a matrix transpose times a vector. If a rotation matrix is provided,
 /// then this transforms the vector from one frame to another (inverse transform).
 inline Vec2 b2MulT(const b2Mat22& A, const Vec2& v) { return Vec2(b2Dot(v, A.ex), b2Dot(v, A.ey)); }
-inline Vec2 b2MulT(const b2Mat22& A, const Vec2& v) restrict(amp) { return Vec2(b2Dot(v, A.ex), b2Dot(v, A.ey)); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2MulT(const b2Mat22& A, const Vec2& v) AMP_RESTRICT { return Vec2(b2Dot(v, A.ex), b2Dot(v, A.ey)); }
+#endif
 
 /// Add two vectors component-wise.
 inline Vec2 operator + (const Vec2& a, const Vec2& b) { return Vec2(a.x + b.x, a.y + b.y); }
-inline Vec2 operator + (const Vec2& a, const Vec2& b) restrict(amp) { return Vec2(a.x + b.x, a.y + b.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator + (const Vec2& a, const Vec2& b) AMP_RESTRICT { return Vec2(a.x + b.x, a.y + b.y); }
+#endif
 
 /// Subtract two vectors component-wise.
 inline Vec2 operator - (const Vec2& a, const Vec2& b) { return Vec2(a.x - b.x, a.y - b.y); }
-inline Vec2 operator - (const Vec2& a, const Vec2& b) restrict(amp) { return Vec2(a.x - b.x, a.y - b.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator - (const Vec2& a, const Vec2& b) AMP_RESTRICT { return Vec2(a.x - b.x, a.y - b.y); }
+#endif
 
 inline Vec2 operator * (float32 s, const Vec2& a) { return Vec2(s * a.x, s * a.y); }
-inline Vec2 operator * (float32 s, const Vec2& a) restrict(amp) { return Vec2(s * a.x, s * a.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator * (float32 s, const Vec2& a) AMP_RESTRICT { return Vec2(s * a.x, s * a.y); }
+#endif
 
 inline bool operator == (const Vec2& a, const Vec2& b) { return a.x == b.x && a.y == b.y; }
-inline bool operator == (const Vec2& a, const Vec2& b) restrict(amp) { return a.x == b.x && a.y == b.y; }
+#ifndef AMP_CPU_BACKEND
+inline bool operator == (const Vec2& a, const Vec2& b) AMP_RESTRICT { return a.x == b.x && a.y == b.y; }
+#endif
 
 inline bool operator != (const Vec2& a, const Vec2& b) { return !operator==(a, b); }
-inline bool operator != (const Vec2& a, const Vec2& b) restrict(amp) { return !operator==(a, b); }
+#ifndef AMP_CPU_BACKEND
+inline bool operator != (const Vec2& a, const Vec2& b) AMP_RESTRICT { return !operator==(a, b); }
+#endif
 
 inline float32 b2Distance(const Vec2& a, const Vec2& b) { Vec2 c = a - b; return c.Length(); }
-inline float32 b2Distance(const Vec2& a, const Vec2& b) restrict(amp) { Vec2 c = a - b; return c.Length(); }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Distance(const Vec2& a, const Vec2& b) AMP_RESTRICT { Vec2 c = a - b; return c.Length(); }
+#endif
 
 inline float32 b2DistanceSquared(const Vec2& a, const Vec2& b) { Vec2 c = a - b; return b2Dot(c, c); }
-inline float32 b2DistanceSquared(const Vec2& a, const Vec2& b) restrict(amp) { Vec2 c = a - b; return b2Dot(c, c); }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2DistanceSquared(const Vec2& a, const Vec2& b) AMP_RESTRICT { Vec2 c = a - b; return b2Dot(c, c); }
+#endif
 
 inline Vec3 operator * (float32 s, const Vec3& a) { return Vec3(s * a.x, s * a.y, s * a.z); }
-inline Vec3 operator * (float32 s, const Vec3& a) restrict(amp) { return Vec3(s * a.x, s * a.y, s * a.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 operator * (float32 s, const Vec3& a) AMP_RESTRICT { return Vec3(s * a.x, s * a.y, s * a.z); }
+#endif
 inline Vec3 operator * (const Vec3& a, float32 s) { return Vec3(s * a.x, s * a.y, s * a.z); }
-inline Vec3 operator * (const Vec3& a, float32 s) restrict(amp) { return Vec3(s * a.x, s * a.y, s * a.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 operator * (const Vec3& a, float32 s) AMP_RESTRICT { return Vec3(s * a.x, s * a.y, s * a.z); }
+#endif
 inline float32 operator * (const Vec3& a, const Vec3& b) { return a.x* b.x + a.y * b.y + a.z * b.z; }
-inline float32 operator * (const Vec3& a, const Vec3& b) restrict(amp) { return a.x* b.x + a.y * b.y + a.z * b.z; }
+#ifndef AMP_CPU_BACKEND
+inline float32 operator * (const Vec3& a, const Vec3& b) AMP_RESTRICT { return a.x* b.x + a.y * b.y + a.z * b.z; }
+#endif
 inline Vec3 operator / (const Vec3& a, float32 s) { return Vec3(a.x / s, a.y / s, a.z / s); }
-inline Vec3 operator / (const Vec3& a, float32 s) restrict(amp) { return Vec3(a.x / s, a.y / s, a.z / s); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 operator / (const Vec3& a, float32 s) AMP_RESTRICT { return Vec3(a.x / s, a.y / s, a.z / s); }
+#endif
 
 /// Add two vectors component-wise.
 inline Vec3 operator + (const Vec3& a, const Vec3& b) { return Vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
-inline Vec3 operator + (const Vec3& a, const Vec3& b) restrict(amp) { return Vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 operator + (const Vec3& a, const Vec3& b) AMP_RESTRICT { return Vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+#endif
 inline Vec3 operator + (const Vec3& a, const Vec2& b) { return Vec3(a.x + b.x, a.y + b.y, a.z); }
-inline Vec3 operator + (const Vec3& a, const Vec2& b) restrict(amp) { return Vec3(a.x + b.x, a.y + b.y, a.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 operator + (const Vec3& a, const Vec2& b) AMP_RESTRICT { return Vec3(a.x + b.x, a.y + b.y, a.z); }
+#endif
 inline Vec2 operator + (const Vec2& a, const Vec3& b) { return Vec2(a.x + b.x, a.y + b.y); }
-inline Vec2 operator + (const Vec2& a, const Vec3& b) restrict(amp) { return Vec2(a.x + b.x, a.y + b.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator + (const Vec2& a, const Vec3& b) AMP_RESTRICT { return Vec2(a.x + b.x, a.y + b.y); }
+#endif
 
 /// Subtract two vectors component-wise.
 inline Vec3 operator - (const Vec3& a, const Vec3& b) { return Vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
-inline Vec3 operator - (const Vec3& a, const Vec3& b) restrict(amp) { return Vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 operator - (const Vec3& a, const Vec3& b) AMP_RESTRICT { return Vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+#endif
 inline Vec3 operator - (const Vec3& a, const Vec2& b) { return Vec3(a.x - b.x, a.y - b.y, a.z); }
-inline Vec3 operator - (const Vec3& a, const Vec2& b) restrict(amp) { return Vec3(a.x - b.x, a.y - b.y, a.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 operator - (const Vec3& a, const Vec2& b) AMP_RESTRICT { return Vec3(a.x - b.x, a.y - b.y, a.z); }
+#endif
 inline Vec2 operator - (const Vec2& a, const Vec3& b) { return Vec2(a.x - b.x, a.y - b.y); }
-inline Vec2 operator - (const Vec2& a, const Vec3& b) restrict(amp) { return Vec2(a.x - b.x, a.y - b.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 operator - (const Vec2& a, const Vec3& b) AMP_RESTRICT { return Vec2(a.x - b.x, a.y - b.y); }
+#endif
 
 inline bool operator < (const Vec3& a, const Vec3& b) { return a.x < b.x && a.y < b.y && a.z < b.z; }
-inline bool operator < (const Vec3& a, const Vec3& b) restrict(amp) { return a.x < b.x && a.y < b.y && a.z < b.z; }
+#ifndef AMP_CPU_BACKEND
+inline bool operator < (const Vec3& a, const Vec3& b) AMP_RESTRICT { return a.x < b.x && a.y < b.y && a.z < b.z; }
+#endif
 inline bool operator > (const Vec3& a, const Vec3& b) { return a.x > b.x && a.y > b.y && a.z > b.z; }
-inline bool operator > (const Vec3& a, const Vec3& b) restrict(amp) { return a.x > b.x && a.y > b.y && a.z > b.z; }
+#ifndef AMP_CPU_BACKEND
+inline bool operator > (const Vec3& a, const Vec3& b) AMP_RESTRICT { return a.x > b.x && a.y > b.y && a.z > b.z; }
+#endif
 
 inline bool operator < (const Vec3& a, const float32& b) { return a.x < b && a.y < b && a.z < b; }
-inline bool operator < (const Vec3& a, const float32& b) restrict(amp) { return a.x < b && a.y < b && a.z < b; }
+#ifndef AMP_CPU_BACKEND
+inline bool operator < (const Vec3& a, const float32& b) AMP_RESTRICT { return a.x < b && a.y < b && a.z < b; }
+#endif
 inline bool operator > (const Vec3& a, const float32& b) { return a.x > b && a.y > b && a.z > b; }
-inline bool operator > (const Vec3& a, const float32& b) restrict(amp) { return a.x > b && a.y > b && a.z > b; }
+#ifndef AMP_CPU_BACKEND
+inline bool operator > (const Vec3& a, const float32& b) AMP_RESTRICT { return a.x > b && a.y > b && a.z > b; }
+#endif
 
 inline float32 b2Distance(const Vec3& a, const Vec3& b) { Vec3 c = a - b; return c.Length(); }
-inline float32 b2Distance(const Vec3& a, const Vec3& b) restrict(amp) { Vec3 c = a - b; return c.Length(); }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Distance(const Vec3& a, const Vec3& b) AMP_RESTRICT { Vec3 c = a - b; return c.Length(); }
+#endif
 
 /// Perform the dot product on two vectors.
 inline float32 b2Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
-inline float32 b2Dot(const Vec3& a, const Vec3& b) restrict(amp) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2Dot(const Vec3& a, const Vec3& b) AMP_RESTRICT { return a.x * b.x + a.y * b.y + a.z * b.z; }
+#endif
 
 /// Perform the cross product on two vectors.
 inline Vec3 b2Cross(const Vec3& a, const Vec3& b) { return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
-inline Vec3 b2Cross(const Vec3& a, const Vec3& b) restrict(amp) { return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 b2Cross(const Vec3& a, const Vec3& b) AMP_RESTRICT { return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+#endif
 
 inline b2Mat22 operator + (const b2Mat22& A, const b2Mat22& B) { return b2Mat22(A.ex + B.ex, A.ey + B.ey); }
-inline b2Mat22 operator + (const b2Mat22& A, const b2Mat22& B) restrict(amp) { return b2Mat22(A.ex + B.ex, A.ey + B.ey); }
+#ifndef AMP_CPU_BACKEND
+inline b2Mat22 operator + (const b2Mat22& A, const b2Mat22& B) AMP_RESTRICT { return b2Mat22(A.ex + B.ex, A.ey + B.ey); }
+#endif
 
 // A * B
 inline b2Mat22 b2Mul(const b2Mat22& A, const b2Mat22& B) { return b2Mat22(b2Mul(A, B.ex), b2Mul(A, B.ey)); }
-inline b2Mat22 b2Mul(const b2Mat22& A, const b2Mat22& B) restrict(amp) { return b2Mat22(b2Mul(A, B.ex), b2Mul(A, B.ey)); }
+#ifndef AMP_CPU_BACKEND
+inline b2Mat22 b2Mul(const b2Mat22& A, const b2Mat22& B) AMP_RESTRICT { return b2Mat22(b2Mul(A, B.ex), b2Mul(A, B.ey)); }
+#endif
 
 // A^T * B
 inline b2Mat22 b2MulT(const b2Mat22& A, const b2Mat22& B) { Vec2 c1(b2Dot(A.ex, B.ex), b2Dot(A.ey, B.ex)); Vec2 c2(b2Dot(A.ex, B.ey), b2Dot(A.ey, B.ey)); return b2Mat22(c1, c2); }
-inline b2Mat22 b2MulT(const b2Mat22& A, const b2Mat22& B) restrict(amp) { Vec2 c1(b2Dot(A.ex, B.ex), b2Dot(A.ey, B.ex)); Vec2 c2(b2Dot(A.ex, B.ey), b2Dot(A.ey, B.ey)); return b2Mat22(c1, c2); }
+#ifndef AMP_CPU_BACKEND
+inline b2Mat22 b2MulT(const b2Mat22& A, const b2Mat22& B) AMP_RESTRICT { Vec2 c1(b2Dot(A.ex, B.ex), b2Dot(A.ey, B.ex)); Vec2 c2(b2Dot(A.ex, B.ey), b2Dot(A.ey, B.ey)); return b2Mat22(c1, c2); }
+#endif
 
 /// Multiply a matrix times a vector.
 inline Vec3 b2Mul(const b2Mat33 & A, const Vec3& v) { return v.x* A.ex + v.y * A.ey + v.z * A.ez; }
-inline Vec3 b2Mul(const b2Mat33 & A, const Vec3& v) restrict(amp) { return v.x* A.ex + v.y * A.ey + v.z * A.ez; }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 b2Mul(const b2Mat33 & A, const Vec3& v) AMP_RESTRICT { return v.x* A.ex + v.y * A.ey + v.z * A.ez; }
+#endif
 
 /// Multiply a matrix times a vector.
 inline Vec2 b2Mul22(const b2Mat33 & A, const Vec2& v) { return Vec2(A.ex.x * v.x + A.ey.x * v.y, A.ex.y * v.x + A.ey.y * v.y); }
-inline Vec2 b2Mul22(const b2Mat33 & A, const Vec2& v) restrict(amp) { return Vec2(A.ex.x * v.x + A.ey.x * v.y, A.ex.y * v.x + A.ey.y * v.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Mul22(const b2Mat33 & A, const Vec2& v) AMP_RESTRICT { return Vec2(A.ex.x * v.x + A.ey.x * v.y, A.ex.y * v.x + A.ey.y * v.y); }
+#endif
 
 /// Multiply two rotations: q * r
 inline b2Rot b2Mul(const b2Rot & q, const b2Rot & r) { b2Rot qr; qr.s = q.s * r.c + q.c * r.s; qr.c = q.c * r.c - q.s * r.s; return qr; }
-inline b2Rot b2Mul(const b2Rot & q, const b2Rot & r) restrict(amp) { b2Rot qr; qr.s = q.s * r.c + q.c * r.s; qr.c = q.c * r.c - q.s * r.s; return qr; }
+#ifndef AMP_CPU_BACKEND
+inline b2Rot b2Mul(const b2Rot & q, const b2Rot & r) AMP_RESTRICT { b2Rot qr; qr.s = q.s * r.c + q.c * r.s; qr.c = q.c * r.c - q.s * r.s; return qr; }
+#endif
 
 /// Transpose multiply two rotations: qT * r
 inline b2Rot b2MulT(const b2Rot & q, const b2Rot & r) { b2Rot qr; qr.s = q.c * r.s - q.s * r.c; qr.c = q.c * r.c + q.s * r.s; return qr; }
-inline b2Rot b2MulT(const b2Rot & q, const b2Rot & r) restrict(amp) { b2Rot qr; qr.s = q.c * r.s - q.s * r.c; qr.c = q.c * r.c + q.s * r.s; return qr; }
+#ifndef AMP_CPU_BACKEND
+inline b2Rot b2MulT(const b2Rot & q, const b2Rot & r) AMP_RESTRICT { b2Rot qr; qr.s = q.c * r.s - q.s * r.c; qr.c = q.c * r.c + q.s * r.s; return qr; }
+#endif
 
 /// Rotate a vector
 inline Vec2 b2Mul(const b2Rot& q, const Vec2& v) { return Vec2(q.c * v.x - q.s * v.y, q.s * v.x + q.c * v.y); }
-inline Vec2 b2Mul(const b2Rot& q, const Vec2& v) restrict(amp) { return Vec2(q.c * v.x - q.s * v.y, q.s * v.x + q.c * v.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Mul(const b2Rot& q, const Vec2& v) AMP_RESTRICT { return Vec2(q.c * v.x - q.s * v.y, q.s * v.x + q.c * v.y); }
+#endif
 inline Vec3 b2Mul(const b2Rot& q, const Vec3& v) { return Vec3(q.c * v.x - q.s * v.y, q.s * v.x + q.c * v.y, v.z); }
-inline Vec3 b2Mul(const b2Rot& q, const Vec3& v) restrict(amp) { return Vec3(q.c * v.x - q.s * v.y, q.s * v.x + q.c * v.y, v.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 b2Mul(const b2Rot& q, const Vec3& v) AMP_RESTRICT { return Vec3(q.c * v.x - q.s * v.y, q.s * v.x + q.c * v.y, v.z); }
+#endif
 inline float32 b2MulX(const b2Rot & q, float32 x, float32 y) { return q.c* x - q.s * y; }
-inline float32 b2MulX(const b2Rot & q, float32 x, float32 y) restrict(amp) { return q.c* x - q.s * y; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2MulX(const b2Rot & q, float32 x, float32 y) AMP_RESTRICT { return q.c* x - q.s * y; }
+#endif
 inline float32 b2MulY(const b2Rot & q, float32 x, float32 y) { return q.s* x + q.c * y; }
-inline float32 b2MulY(const b2Rot & q, float32 x, float32 y) restrict(amp) { return q.s* x + q.c * y; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2MulY(const b2Rot & q, float32 x, float32 y) AMP_RESTRICT { return q.s* x + q.c * y; }
+#endif
 
 /// Inverse rotate a vector
 inline Vec2 b2MulT(const b2Rot & q, const Vec2& v) { return Vec2(q.c * v.x + q.s * v.y, -q.s * v.x + q.c * v.y); }
-inline Vec2 b2MulT(const b2Rot & q, const Vec2& v) restrict(amp) { return Vec2(q.c * v.x + q.s * v.y, -q.s * v.x + q.c * v.y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2MulT(const b2Rot & q, const Vec2& v) AMP_RESTRICT { return Vec2(q.c * v.x + q.s * v.y, -q.s * v.x + q.c * v.y); }
+#endif
 
 inline Vec2 b2Mul(const b2Transform & T, const Vec2& v) { float32 x = (T.q.c * v.x - T.q.s * v.y) + T.p.x; float32 y = (T.q.s * v.x + T.q.c * v.y) + T.p.y; return Vec2(x, y); }
-inline Vec2 b2Mul(const b2Transform & T, const Vec2& v) restrict(amp) { float32 x = (T.q.c * v.x - T.q.s * v.y) + T.p.x; float32 y = (T.q.s * v.x + T.q.c * v.y) + T.p.y; return Vec2(x, y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Mul(const b2Transform & T, const Vec2& v) AMP_RESTRICT { float32 x = (T.q.c * v.x - T.q.s * v.y) + T.p.x; float32 y = (T.q.s * v.x + T.q.c * v.y) + T.p.y; return Vec2(x, y); }
+#endif
 inline Vec2 b2Mul(const b2Transform & T, const Vec3& v) { float32 x = (T.q.c * v.x - T.q.s * v.y) + T.p.x; float32 y = (T.q.s * v.x + T.q.c * v.y) + T.p.y; return Vec2(x, y); }
-inline Vec2 b2Mul(const b2Transform& T, const Vec3& v) restrict(amp) { float32 x = (T.q.c * v.x - T.q.s * v.y) + T.p.x; float32 y = (T.q.s * v.x + T.q.c * v.y) + T.p.y; return Vec2(x, y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Mul(const b2Transform& T, const Vec3& v) AMP_RESTRICT { float32 x = (T.q.c * v.x - T.q.s * v.y) + T.p.x; float32 y = (T.q.s * v.x + T.q.c * v.y) + T.p.y; return Vec2(x, y); }
+#endif
 inline Vec3 b2Mul3D(const b2Transform& T, const Vec3& v) { return Vec3((T.q.c * v.x - T.q.s * v.y) + T.p.x, (T.q.s * v.x + T.q.c * v.y) + T.p.y, v.z + T.z); }
-inline Vec3 b2Mul3D(const b2Transform & T, const Vec3& v) restrict(amp) { return Vec3((T.q.c * v.x - T.q.s * v.y) + T.p.x, (T.q.s * v.x + T.q.c * v.y) + T.p.y, v.z + T.z); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 b2Mul3D(const b2Transform & T, const Vec3& v) AMP_RESTRICT { return Vec3((T.q.c * v.x - T.q.s * v.y) + T.p.x, (T.q.s * v.x + T.q.c * v.y) + T.p.y, v.z + T.z); }
+#endif
 inline float32 b2MulX(const b2Transform & T, float32 x, float32 y) { return (T.q.c * x - T.q.s * y) + T.p.x; }
-inline float32 b2MulX(const b2Transform & T, float32 x, float32 y) restrict(amp) { return (T.q.c * x - T.q.s * y) + T.p.x; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2MulX(const b2Transform & T, float32 x, float32 y) AMP_RESTRICT { return (T.q.c * x - T.q.s * y) + T.p.x; }
+#endif
 inline float32 b2MulY(const b2Transform & T, float32 x, float32 y) { return (T.q.s * x + T.q.c * y) + T.p.y; }
-inline float32 b2MulY(const b2Transform & T, float32 x, float32 y) restrict(amp) { return (T.q.s * x + T.q.c * y) + T.p.y; }
+#ifndef AMP_CPU_BACKEND
+inline float32 b2MulY(const b2Transform & T, float32 x, float32 y) AMP_RESTRICT { return (T.q.s * x + T.q.c * y) + T.p.y; }
+#endif
 
 inline Vec2 b2MulT(const b2Transform & T, const Vec2& v) { float32 px = v.x - T.p.x; float32 py = v.y - T.p.y; float32 x = (T.q.c * px + T.q.s * py); float32 y = (-T.q.s * px + T.q.c * py); return Vec2(x, y); }
-inline Vec2 b2MulT(const b2Transform & T, const Vec2& v) restrict(amp) { float32 px = v.x - T.p.x; float32 py = v.y - T.p.y; float32 x = (T.q.c * px + T.q.s * py); float32 y = (-T.q.s * px + T.q.c * py); return Vec2(x, y); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2MulT(const b2Transform & T, const Vec2& v) AMP_RESTRICT { float32 px = v.x - T.p.x; float32 py = v.y - T.p.y; float32 x = (T.q.c * px + T.q.s * py); float32 y = (-T.q.s * px + T.q.c * py); return Vec2(x, y); }
+#endif
 
 // v2 = A.q.Rot(B.q.Rot(v1) + B.p) + A.p
 //    = (A.q * B.q).Rot(v1) + A.q.Rot(B.p) + A.p
 inline b2Transform b2Mul(const b2Transform & A, const b2Transform & B) { b2Transform C; C.q = b2Mul(A.q, B.q); C.p = b2Mul(A.q, B.p) + A.p; return C; }
-inline b2Transform b2Mul(const b2Transform & A, const b2Transform & B) restrict(amp) { b2Transform C; C.q = b2Mul(A.q, B.q); C.p = b2Mul(A.q, B.p) + A.p; return C; }
+#ifndef AMP_CPU_BACKEND
+inline b2Transform b2Mul(const b2Transform & A, const b2Transform & B) AMP_RESTRICT { b2Transform C; C.q = b2Mul(A.q, B.q); C.p = b2Mul(A.q, B.p) + A.p; return C; }
+#endif
 
 // v2 = A.q' * (B.q * v1 + B.p - A.p)
 //    = A.q' * B.q * v1 + A.q' * (B.p - A.p)
 inline b2Transform b2MulT(const b2Transform & A, const b2Transform & B) { b2Transform C; C.q = b2MulT(A.q, B.q); C.p = b2MulT(A.q, B.p - A.p); return C; }
-inline b2Transform b2MulT(const b2Transform & A, const b2Transform & B) restrict(amp) { b2Transform C; C.q = b2MulT(A.q, B.q); C.p = b2MulT(A.q, B.p - A.p); return C; }
+#ifndef AMP_CPU_BACKEND
+inline b2Transform b2MulT(const b2Transform & A, const b2Transform & B) AMP_RESTRICT { b2Transform C; C.q = b2MulT(A.q, B.q); C.p = b2MulT(A.q, B.p - A.p); return C; }
+#endif
 
 template <typename T> inline T b2Abs(T a) { return a > T(0) ? a : -a; }
-template <typename T> inline T b2Abs(T a) restrict(amp) { return a > T(0) ? a : -a; }
-inline Vec3 b2Abs(Vec3 a) restrict(amp) { return Vec3(b2Abs(a.x), b2Abs(a.y), b2Abs(a.z)); }
+#ifndef AMP_CPU_BACKEND
+template <typename T> inline T b2Abs(T a) AMP_RESTRICT { return a > T(0) ? a : -a; }
+#endif
+inline Vec3 b2Abs(Vec3 a) AMP_RESTRICT { return Vec3(b2Abs(a.x), b2Abs(a.y), b2Abs(a.z)); }
 
 inline Vec2 b2Abs(const Vec2& a) { return Vec2(b2Abs(a.x), b2Abs(a.y)); }
-inline Vec2 b2Abs(const Vec2& a) restrict(amp) { return Vec2(b2Abs(a.x), b2Abs(a.y)); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Abs(const Vec2& a) AMP_RESTRICT { return Vec2(b2Abs(a.x), b2Abs(a.y)); }
+#endif
 
 inline b2Mat22 b2Abs(const b2Mat22& A) { return b2Mat22(b2Abs(A.ex), b2Abs(A.ey)); }
-inline b2Mat22 b2Abs(const b2Mat22& A) restrict(amp) { return b2Mat22(b2Abs(A.ex), b2Abs(A.ey)); }
+#ifndef AMP_CPU_BACKEND
+inline b2Mat22 b2Abs(const b2Mat22& A) AMP_RESTRICT { return b2Mat22(b2Abs(A.ex), b2Abs(A.ey)); }
+#endif
 
 template <typename T> inline T b2Min(T a, T b) { return a < b ? a : b; }
-template <typename T> inline T b2Min(T a, T b) restrict(amp) { return a < b ? a : b; }
+#ifndef AMP_CPU_BACKEND
+template <typename T> inline T b2Min(T a, T b) AMP_RESTRICT { return a < b ? a : b; }
+#endif
 template <typename T> inline T b2AbsMin(T a, T b) { return b2Abs(a) < b2Abs(b) ? a : b; }
-template <typename T> inline T b2AbsMin(T a, T b) restrict(amp) { return b2Abs(a) < b2Abs(b) ? a : b; }
+#ifndef AMP_CPU_BACKEND
+template <typename T> inline T b2AbsMin(T a, T b) AMP_RESTRICT { return b2Abs(a) < b2Abs(b) ? a : b; }
+#endif
 
 inline Vec2 b2Min(const Vec2& a, const Vec2& b) { return Vec2(b2Min(a.x, b.x), b2Min(a.y, b.y)); }
-inline Vec2 b2Min(const Vec2& a, const Vec2& b) restrict(amp) { return Vec2(b2Min(a.x, b.x), b2Min(a.y, b.y)); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Min(const Vec2& a, const Vec2& b) AMP_RESTRICT { return Vec2(b2Min(a.x, b.x), b2Min(a.y, b.y)); }
+#endif
 
 inline Vec3 b2Min(const Vec3& a, const Vec3& b) { return Vec3(b2Min(a.x, b.x), b2Min(a.y, b.y), b2Min(a.z, b.z)); }
-inline Vec3 b2Min(const Vec3& a, const Vec3& b) restrict(amp) { return Vec3(b2Min(a.x, b.x), b2Min(a.y, b.y), b2Min(a.z, b.z)); }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 b2Min(const Vec3& a, const Vec3& b) AMP_RESTRICT { return Vec3(b2Min(a.x, b.x), b2Min(a.y, b.y), b2Min(a.z, b.z)); }
+#endif
 inline Vec3 b2AbsMin(const Vec3& a, const Vec3& b) { return a.Length() < b.Length() ? a : b; }
-inline Vec3 b2AbsMin(const Vec3& a, const Vec3& b) restrict(amp) { return a.Length() < b.Length() ? a : b; }
+#ifndef AMP_CPU_BACKEND
+inline Vec3 b2AbsMin(const Vec3& a, const Vec3& b) AMP_RESTRICT { return a.Length() < b.Length() ? a : b; }
+#endif
 
 template <typename T> inline T b2Max(T a, T b) { return a > b ? a : b; }
-template <typename T> inline T b2Max(T a, T b) restrict(amp) { return a > b ? a : b; }
+#ifndef AMP_CPU_BACKEND
+template <typename T> inline T b2Max(T a, T b) AMP_RESTRICT { return a > b ? a : b; }
+#endif
 template <typename T> inline T b2AbsMax(T a, T b) { return b2Abs(a) > b2Abs(b) ? a : b; }
-template <typename T> inline T b2AbsMax(T a, T b) restrict(amp) { return b2Abs(a) > b2Abs(b) ? a : b; }
+#ifndef AMP_CPU_BACKEND
+template <typename T> inline T b2AbsMax(T a, T b) AMP_RESTRICT { return b2Abs(a) > b2Abs(b) ? a : b; }
+#endif
 
 inline Vec2 b2Max(const Vec2& a, const Vec2& b) { return Vec2(b2Max(a.x, b.x), b2Max(a.y, b.y)); }
-inline Vec2 b2Max(const Vec2& a, const Vec2& b) restrict(amp) { return Vec2(b2Max(a.x, b.x), b2Max(a.y, b.y)); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Max(const Vec2& a, const Vec2& b) AMP_RESTRICT { return Vec2(b2Max(a.x, b.x), b2Max(a.y, b.y)); }
+#endif
 
 template <typename T> inline T b2Clamp(T a, T low, T high) { return b2Max(low, b2Min(a, high)); }
-template <typename T> inline T b2Clamp(T a, T low, T high) restrict(amp) { return b2Max(low, b2Min(a, high)); }
+#ifndef AMP_CPU_BACKEND
+template <typename T> inline T b2Clamp(T a, T low, T high) AMP_RESTRICT { return b2Max(low, b2Min(a, high)); }
+#endif
 
 inline Vec2 b2Clamp(const Vec2& a, const Vec2& low, const Vec2& high) { return b2Max(low, b2Min(a, high)); }
-inline Vec2 b2Clamp(const Vec2& a, const Vec2& low, const Vec2& high) restrict(amp) { return b2Max(low, b2Min(a, high)); }
+#ifndef AMP_CPU_BACKEND
+inline Vec2 b2Clamp(const Vec2& a, const Vec2& low, const Vec2& high) AMP_RESTRICT { return b2Max(low, b2Min(a, high)); }
+#endif
 
 template<typename T> inline void b2Swap(T & a, T & b) { T tmp = a; a = b; b = tmp; }
-template<typename T> inline void b2Swap(T & a, T & b) restrict(amp) { T tmp = a; a = b; b = tmp; }
+#ifndef AMP_CPU_BACKEND
+template<typename T> inline void b2Swap(T & a, T & b) AMP_RESTRICT { T tmp = a; a = b; b = tmp; }
+#endif
 
 /// "Next Largest Power of 2
 /// Given a binary integer value x, the next largest power of 2 can be computed by a SWAR algorithm
@@ -762,10 +1044,14 @@ template<typename T> inline void b2Swap(T & a, T & b) restrict(amp) { T tmp = a;
 /// the same most significant 1 as x, but all 1's below it. Adding 1 to that value yields the next
 /// largest power of 2. For a 32-bit value:"
 inline uint32 b2NextPowerOfTwo(uint32 x) { x |= (x >> 1); x |= (x >> 2); x |= (x >> 4); x |= (x >> 8); x |= (x >> 16); return x + 1; }
-inline uint32 b2NextPowerOfTwo(uint32 x) restrict(amp) { x |= (x >> 1); x |= (x >> 2); x |= (x >> 4); x |= (x >> 8); x |= (x >> 16); return x + 1; }
+#ifndef AMP_CPU_BACKEND
+inline uint32 b2NextPowerOfTwo(uint32 x) AMP_RESTRICT { x |= (x >> 1); x |= (x >> 2); x |= (x >> 4); x |= (x >> 8); x |= (x >> 16); return x + 1; }
+#endif
 
 inline bool b2IsPowerOfTwo(uint32 x) { bool result = x > 0 && (x & (x - 1)) == 0; return result; }
-inline bool b2IsPowerOfTwo(uint32 x) restrict(amp) { bool result = x > 0 && (x & (x - 1)) == 0; return result; }
+#ifndef AMP_CPU_BACKEND
+inline bool b2IsPowerOfTwo(uint32 x) AMP_RESTRICT { bool result = x > 0 && (x & (x - 1)) == 0; return result; }
+#endif
 
 inline void b2Sweep::GetTransform(b2Transform& xf, float32 beta) const
 {
@@ -774,13 +1060,15 @@ inline void b2Sweep::GetTransform(b2Transform& xf, float32 beta) const
 	xf.q.Set(angle);
 	xf.p -= b2Mul(xf.q, localCenter);
 }
-inline void b2Sweep::GetTransform(b2Transform& xf, float32 beta) const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline void b2Sweep::GetTransform(b2Transform& xf, float32 beta) const AMP_RESTRICT
 {
 	xf.p = (1.0f - beta) * c0 + beta * c;
 	float32 angle = (1.0f - beta) * a0 + beta * a;
 	xf.q.Set(angle);
 	xf.p -= b2Mul(xf.q, localCenter);
 }
+#endif
 
 inline void b2Sweep::Advance(float32 alpha)
 {
@@ -789,13 +1077,15 @@ inline void b2Sweep::Advance(float32 alpha)
 	a0 += beta * (a - a0);
 	alpha0 = alpha;
 }
-inline void b2Sweep::Advance(float32 alpha) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline void b2Sweep::Advance(float32 alpha) AMP_RESTRICT
 {
 	float32 beta = (alpha - alpha0) / (1.0f - alpha0);
 	c0 += beta * (c - c0);
 	a0 += beta * (a - a0);
 	alpha0 = alpha;
 }
+#endif
 
 /// Normalize an angle in radians to be between -pi and pi
 inline void b2Sweep::Normalize()
@@ -805,13 +1095,15 @@ inline void b2Sweep::Normalize()
 	a0 -= d;
 	a -= d;
 }
-inline void b2Sweep::Normalize() restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline void b2Sweep::Normalize() AMP_RESTRICT
 {
 	float32 twoPi = 2.0f * b2_pi;
 	float32 d = twoPi * ampFloor(a0 / twoPi);
 	a0 -= d;
 	a -= d;
 }
+#endif
 
 inline float32 Random(const float32 min = 0, const float32 max = 1)
 {
@@ -822,13 +1114,15 @@ inline bool IsBetween(float32 x, float32 a, float32 b, float32 tol)
 	return a < b ? x + tol >= a && a + x - tol <= b
 				 : x + tol >= b && b + x - tol <= a;
 }
-inline bool IsBetween(float32 x, float32 a, float32 b, float32 tol) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline bool IsBetween(float32 x, float32 a, float32 b, float32 tol) AMP_RESTRICT
 {
 	return a < b ? x + tol >= a && x - tol <= b
 		         : x + tol >= b && x - tol <= a;
 }
+#endif
 
-inline boolean AdjustCapacityToSize(int32& capacity, int32 size, const int32 minCapacity)
+inline bool AdjustCapacityToSize(int32& capacity, int32 size, const int32 minCapacity)
 {
 	if (size < minCapacity)
 		size = minCapacity;
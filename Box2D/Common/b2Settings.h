@@ -23,7 +23,24 @@
 #include <stddef.h>
 #include <assert.h>
 #include <float.h>
+
+// Define AMP_CPU_BACKEND to run all amp:: kernels on a CPU thread pool instead of C++ AMP.
+// It is the default where amp.h is not available.
+#if !defined(AMP_CPU_BACKEND) && !defined(_MSC_VER)
+#define AMP_CPU_BACKEND
+#endif
+
+// Kernel code is marked AMP_RESTRICT and its tile memory AMP_TILE_STATIC. On the CPU
+// backend kernels are host code and the memory of a tile is thread_local (see ampCpu.h).
+#ifdef AMP_CPU_BACKEND
+#include <Box2D/Amp/ampCpu.h>
+#define AMP_RESTRICT
+#define AMP_TILE_STATIC static thread_local
+#else
 #include <amp.h>
+#define AMP_RESTRICT restrict(amp)
+#define AMP_TILE_STATIC tile_static
+#endif
 
 #define B2_NOT_USED(x) ((void)(x))
 #if DEBUG && !defined(NDEBUG)
@@ -61,18 +78,16 @@ typedef double float64;
 #define TILE_SIZE_QUARTER 64
 #define TILE_SIZE_SQRT 16
 
-//#define CONTACT_THREADS 256
-//#define CONTACT_THREADS 4096 // 256 * 16
-//#define CONTACT_THREADS 8192 // 256 * 32
-//#define CONTACT_THREADS 16384 // 256 * 64
-//#define CONTACT_THREADS 32768 // 256 * 128
-
-#define CONTACT_THREADS 65536 // 256 * 256
-#define MAX_ITERATIONS_PER_PARTICLE 8 // results in max 65536 * 8 = 524.288 Particles
-
-#define MAX_CONTACTS_PER_PARTICLE 8
+#define MAX_CONTACTS_PER_PARTICLE 8 // typical, not a limit (see ContactArrays::m_overflow)
 #define MAX_BODY_CONTACTS_PER_PARTICLE 8
 #define MAX_PARTICLES_PER_GROUND_TILE 8
+#define MAX_CONTACT_COLORS 32 // coloring rounds, the contacts left after them are applied with atomics
+#define PROXY_FIXUP_FRACTION 64 // proxies are fixed up in place if at most 1 / this are out of order
+#define PROXY_FIXUP_ROUNDS 4 // odd-even rounds of the fix-up before the radix sort takes over
+#define DEPTH_SLICE_CONTACTS 1024 // contacts one thread of ComputeDepth sweeps in order
+#define DEPTH_SLICE_SWEEPS 4 // sweeps of a slice per ComputeDepth dispatch
+#define COLUMN_RELEASE_STEPS 60 // steps an optional particle column stays allocated without use
+#define BUCKET_DENSE_FRACTION 4 // flag buckets above 1 / this of the particles dispatch over all particles
 
 template <typename T>
 using ampArrayView = Concurrency::array_view<T>;
@@ -103,10 +118,12 @@ struct Proxy
 	uint32 tag;
 
 	Proxy(int32 idx, uint32 tag) : idx(idx), tag(tag) {};
-	Proxy(int32 idx, uint32 tag) restrict(amp) : idx(idx), tag(tag) {};
-	Proxy() restrict(amp) : idx(-1), tag(0) {};
+#ifndef AMP_CPU_BACKEND
+	Proxy(int32 idx, uint32 tag) AMP_RESTRICT : idx(idx), tag(tag) {};
+	Proxy() AMP_RESTRICT : idx(-1), tag(0) {};
+#endif
 	Proxy() : idx(-1), tag(0) {};
-	void Set(int32 newIdx, uint32 newTag) restrict(amp) { idx = newIdx; tag = newTag; }
+	void Set(int32 newIdx, uint32 newTag) AMP_RESTRICT { idx = newIdx; tag = newTag; }
 
 	friend inline bool operator<(const Proxy& a, const Proxy& b)
 	{
@@ -120,18 +137,20 @@ struct Proxy
 	{
 		return a.tag < b;
 	}
-	friend inline bool operator<(const Proxy& a, const Proxy& b) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+	friend inline bool operator<(const Proxy& a, const Proxy& b) AMP_RESTRICT
 	{
 		return a.tag < b.tag;
 	}
-	friend inline bool operator<(uint32 a, const Proxy& b) restrict(amp)
+	friend inline bool operator<(uint32 a, const Proxy& b) AMP_RESTRICT
 	{
 		return a < b.tag;
 	}
-	friend inline bool operator<(const Proxy& a, uint32 b) restrict(amp)
+	friend inline bool operator<(const Proxy& a, uint32 b) AMP_RESTRICT
 	{
 		return a.tag < b;
 	}
+#endif
 };
 
 #ifdef WIN32
@@ -142,6 +161,11 @@ typedef long long int64;
 typedef unsigned long long uint64;
 #endif
 
+// callback calling convention of the exports, only meaningful on Windows
+#if !defined(_WIN32) && !defined(__stdcall)
+#define __stdcall
+#endif
+
 #define	b2_maxFloat		FLT_MAX
 #define	b2_minFloat		FLT_MIN
 #define	b2_epsilon		FLT_EPSILON
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Box2D/Amp/ampAlgorithms.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/// Dependency graph of tasks built from declared read and write sets.
+/// Tasks are added in program order. A task runs after every earlier task it
+/// conflicts with (read after write, write after read, write after write), so
+/// Run() gives the same result as running the tasks one after another.
+/// Build() sorts the tasks into levels of independent tasks, Run() executes
+/// the levels in order and the tasks of a level concurrently (amp::runTasks).
+class TaskGraph
+{
+public:
+	typedef std::function<void()> Function;
+
+	struct Task
+	{
+		const char* name;
+		Function function;
+		uint32 reads;
+		uint32 writes;
+		int32 level;
+	};
+
+private:
+	std::vector<Task> m_tasks;
+	std::vector<std::vector<int32>> m_levels;
+	bool m_built = false;
+
+public:
+	void Clear()
+	{
+		m_tasks.clear();
+		m_levels.clear();
+		m_built = false;
+	}
+	bool Empty() const { return m_tasks.empty(); }
+	bool IsBuilt() const { return m_built; }
+
+	/// @param reads bit set of resources the task needs.
+	/// @param writes bit set of resources the task modifies.
+	void Add(const char* name, const Function& function, const uint32 reads, const uint32 writes)
+	{
+		m_tasks.push_back({ name, function, reads, writes, 0 });
+		m_built = false;
+	}
+
+	void Build()
+	{
+		int32 lastWrite[32], lastRead[32];
+		std::fill(lastWrite, lastWrite + 32, -1);
+		std::fill(lastRead, lastRead + 32, -1);
+
+		int32 levelCnt = 0;
+		for (Task& task : m_tasks)
+		{
+			int32 level = 0;
+			for (int32 r = 0; r < 32; r++)
+			{
+				const uint32 bit = 1u << r;
+				if (task.reads & bit)
+					level = b2Max(level, lastWrite[r] + 1);
+				if (task.writes & bit)
+					level = b2Max(level, b2Max(lastWrite[r], lastRead[r]) + 1);
+			}
+			for (int32 r = 0; r < 32; r++)
+			{
+				const uint32 bit = 1u << r;
+				if (task.writes & bit)
+				{
+					lastWrite[r] = level;
+					lastRead[r] = -1;
+				}
+				else if (task.reads & bit)
+					lastRead[r] = b2Max(lastRead[r], level);
+			}
+			task.level = level;
+			levelCnt = b2Max(levelCnt, level + 1);
+		}
+
+		m_levels.assign(levelCnt, std::vector<int32>());
+		for (int32 i = 0; i < (int32)m_tasks.size(); i++)
+			m_levels[m_tasks[i].level].push_back(i);
+		m_built = true;
+	}
+
+	void Run()
+	{
+		if (!m_built) Build();
+		for (const std::vector<int32>& level : m_levels)
+		{
+			amp::runTasks((int32)level.size(), [&](const int32 i)
+			{
+				m_tasks[level[i]].function();
+			});
+		}
+	}
+
+	int32 GetLevelCount() const { return (int32)m_levels.size(); }
+	const std::vector<int32>& GetLevel(const int32 level) const { return m_levels[level]; }
+	const Task& GetTask(const int32 idx) const { return m_tasks[idx]; }
+};
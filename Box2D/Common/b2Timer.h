@@ -32,11 +32,11 @@ public:
 
 	float32 Stop()
 	{
-		return duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count() / 1000000.0f;
+		return duration_cast<nanoseconds>(steady_clock::now() - t0).count() / 1000000.0f;
 	}
 	float32 Restart() { float32 t = Stop(); Start(); return t; }
 
-	void Start() { t0 = high_resolution_clock::now(); }
+	void Start() { t0 = steady_clock::now(); }
 };
 
 /// Timer for profiling. This has platform specific code and may
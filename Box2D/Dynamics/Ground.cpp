@@ -6,9 +6,9 @@
 
 Ground::Ground(b2World& world, const def& gd) :
 	m_world(world),
+	m_ampTiles(amp::accelView(), 16),
 	m_ampChunkHasChange(1, amp::accelView()),
 	m_ampTilesChangedIdxs(16, amp::accelView()),
-	m_ampTiles(amp::accelView(), 16),
 	m_ampMaterials(8, amp::accelView())
 {
 	m_stride = gd.stride;
@@ -60,7 +60,7 @@ void Ground::CopyChangedTiles()
 		const int32 xSize = m_sizeX;
 		
 		amp::forEach2DTiled<TILE_SIZE_SQRT, TILE_SIZE_SQRT>(m_sizeY, m_sizeX, [=, &ampTiles,
-			&tilesTileHasChange, &ampChangedIdxs](const ampTiledIdx2D<TILE_SIZE_SQRT, TILE_SIZE_SQRT> tIdx) restrict(amp)
+			&tilesTileHasChange, &ampChangedIdxs](const ampTiledIdx2D<TILE_SIZE_SQRT, TILE_SIZE_SQRT> tIdx) AMP_RESTRICT
 		{
 			if (!tilesTileHasChange[tIdx.tile]) return;
 			const int32 gtIdx = tIdx.global[0] * xSize + tIdx.global[1];
@@ -177,7 +177,7 @@ bool Ground::HasChange()
 	ampArrayView<int32> hasChange(1);
 	amp::fill(hasChange, 0);
 	auto& chunkHasChanged = m_ampChunkHasChange;
-	amp::forEach(m_chunkCnt, [=, &chunkHasChanged](int32 i) restrict(amp)
+	amp::forEach(m_chunkCnt, [=, &chunkHasChanged](int32 i) AMP_RESTRICT
 	{
 		if (int32& chunkHasChange = chunkHasChanged[i]; chunkHasChange)
 		{
@@ -29,19 +29,27 @@ public:
 		Tile() : matIdx(INVALID_IDX), height(-b2_maxFloat) {}
 
 		inline bool getChanged() { if (flags & Flags::changed) { flags &= ~Flags::changed; return true; } return false; }
-		inline bool getChanged() restrict(amp) { if (flags & Flags::changed) { flags &= ~Flags::changed; return true; } return false; }
+#ifndef AMP_CPU_BACKEND
+		inline bool getChanged() AMP_RESTRICT { if (flags & Flags::changed) { flags &= ~Flags::changed; return true; } return false; }
+#endif
 		inline void setChanged() { flags |= Flags::changed; }
-		inline void setChanged() restrict(amp) { flags |= Flags::changed; }
+#ifndef AMP_CPU_BACKEND
+		inline void setChanged() AMP_RESTRICT { flags |= Flags::changed; }
+#endif
 		inline bool isWet() const { return flags & Flags::wet; }
-		inline bool isWet() const restrict(amp) { return flags & Flags::wet; }
-		inline bool setWet() { flags |= Flags::wet; }
-		inline bool atomicAddFlag(uint32 flag) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+		inline bool isWet() const AMP_RESTRICT { return flags & Flags::wet; }
+#endif
+		inline void setWet() { flags |= Flags::wet; }
+		inline bool atomicAddFlag(uint32 flag) AMP_RESTRICT
 		{
 			if (amp::atomicAddFlag(flags, flag)) { setChanged(); return true; }
 			return false;
 		}
 		inline void remWet() { flags &= ~Flags::wet; setChanged(); }
-		inline void remWet() restrict(amp) { flags &= ~Flags::wet; setChanged(); }
+#ifndef AMP_CPU_BACKEND
+		inline void remWet() AMP_RESTRICT { flags &= ~Flags::wet; setChanged(); }
+#endif
 
 		void removeParticle(int32 idx)
 		{
@@ -90,7 +98,9 @@ public:
 		uint32 color;
 
 		inline bool isWaterRepellent() const { return flags & Flags::waterRepellent; }
-		inline bool isWaterRepellent() const restrict(amp) { return flags & Flags::waterRepellent; }
+#ifndef AMP_CPU_BACKEND
+		inline bool isWaterRepellent() const AMP_RESTRICT { return flags & Flags::waterRepellent; }
+#endif
 	};
 
 
@@ -56,7 +56,6 @@ b2FrictionJoint::b2FrictionJoint(const b2FrictionJointDef* def, b2World& world)
 void b2FrictionJoint::InitVelocityConstraints(const b2SolverData& data)
 {
 	const Body& bodyA = GetBodyA();
-	const Body& bodyB = GetBodyB();
 	m_indexA = bodyA.m_islandIndex;
 	m_indexB = bodyA.m_islandIndex;
 	m_localCenterA = bodyA.m_sweep.localCenter;
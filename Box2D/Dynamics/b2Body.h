@@ -100,7 +100,9 @@ struct Body
 		~Mat() {}
 
 		bool HasFlag(const Flag flag) const { return m_matFlags & flag; }
-		bool HasFlag(const Flag flag) const restrict(amp) { return m_matFlags & flag; }
+#ifndef AMP_CPU_BACKEND
+		bool HasFlag(const Flag flag) const AMP_RESTRICT { return m_matFlags & flag; }
+#endif
 	};
 
 	enum Type
@@ -258,7 +260,9 @@ struct Body
 	/// low CPU cost.
 	/// @param flag set to true to wake the body, false to put it to sleep.
 	void SetAwake(bool flag);
-	void SetAwake(bool flag) restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	void SetAwake(bool flag) AMP_RESTRICT;
+#endif
 	/// Get the sleeping state of this body.
 	/// @return true if the body is awake.
 	bool IsAwake() const;
@@ -281,11 +285,15 @@ struct Body
 
 	/// Get the world position of the center of mass.
 	const Vec2 GetWorldCenter() const;
-	const Vec2 GetWorldCenter() const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	const Vec2 GetWorldCenter() const AMP_RESTRICT;
+#endif
 
 	/// Get the local position of the center of mass.
 	const Vec2 GetLocalCenter() const;
-	const Vec2 GetLocalCenter() const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	const Vec2 GetLocalCenter() const AMP_RESTRICT;
+#endif
 
 
 	/// Set the linear velocity of the center of mass.
@@ -332,7 +340,9 @@ struct Body
 	/// @param point the world position of the point of application.
 	/// @param wake also wake up the body
 	void ApplyLinearImpulse(const Vec2& impulse, const Vec2& point, bool wake);
-	void ApplyLinearImpulse(const Vec3& impulse, const Vec2& point, bool wake) restrict(amp);
+	void ApplyLinearImpulse(const Vec3& impulse, const Vec2& point, bool wake) AMP_RESTRICT;
+	/// Apply an impulse at the center of mass and an angular impulse.
+	void ApplyImpulse(const Vec3& impulse, float32 angularImpulse, bool wake) AMP_RESTRICT;
 
 	/// Apply an angular impulse.
 	/// @param impulse the angular impulse in units of kg*m*m/s
@@ -342,7 +352,9 @@ struct Body
 	/// Get the rotational inertia of the body about the local origin.
 	/// @return the rotational inertia, usually in kg-m^2.
 	float32 GetInertia() const;
-	float32 GetInertia() const restrict (amp);
+#ifndef AMP_CPU_BACKEND
+	float32 GetInertia() const AMP_RESTRICT;
+#endif
 
 	/// Get the mass data of the body.
 	/// @return a struct containing the mass, inertia and center of the body.
@@ -379,7 +391,9 @@ struct Body
 	/// @param a point in world coordinates.
 	/// @return the world velocity of a point.
 	Vec2 GetLinearVelocityFromWorldPoint(const Vec2& worldPoint) const;
-	Vec2 GetLinearVelocityFromWorldPoint(const Vec2& worldPoint) const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	Vec2 GetLinearVelocityFromWorldPoint(const Vec2& worldPoint) const AMP_RESTRICT;
+#endif
 
 	/// Get the world velocity of a local point.
 	/// @param a point in local coordinates.
@@ -395,21 +409,31 @@ struct Body
 
 	/// Does this body have fixed rotation?
 	bool IsFixedRotation() const;
-	bool IsFixedRotation() const restrict(amp);
+#ifndef AMP_CPU_BACKEND
+	bool IsFixedRotation() const AMP_RESTRICT;
+#endif
 
 	inline bool IsType(Body::Type t) const { return m_type == t; }
 
 	inline void AddFlag(Flag flags) { m_flags |= flags; }
-	inline void AddFlag(Flag flags) restrict(amp) { m_flags |= flags; }
+#ifndef AMP_CPU_BACKEND
+	inline void AddFlag(Flag flags) AMP_RESTRICT { m_flags |= flags; }
+#endif
 	inline void RemFlag(Flag flags) { m_flags &= ~flags; }
-	inline void RemFlag(Flag flags) restrict(amp) { m_flags &= ~flags; }
+#ifndef AMP_CPU_BACKEND
+	inline void RemFlag(Flag flags) AMP_RESTRICT { m_flags &= ~flags; }
+#endif
 
 	inline bool HasFlag(Flag flag) const { return m_flags & flag; }
-	inline bool HasFlag(Flag flag) const restrict(amp) { return m_flags & flag; }
+#ifndef AMP_CPU_BACKEND
+	inline bool HasFlag(Flag flag) const AMP_RESTRICT { return m_flags & flag; }
+#endif
 
-	inline bool IsAwake() const restrict(amp) { return HasFlag(Flag::Awake); }
+#ifndef AMP_CPU_BACKEND
+	inline bool IsAwake() const AMP_RESTRICT { return HasFlag(Flag::Awake); }
+#endif
 
-	inline bool atomicAddFlag(Flag flag) restrict(amp)
+	inline bool atomicAddFlag(Flag flag) AMP_RESTRICT
 	{
 		if (amp::atomicAddFlag(m_flags, flag)) return true;
 		return false;
@@ -430,19 +454,23 @@ inline const Vec2 Body::GetWorldCenter() const
 {
 	return m_sweep.c;
 }
-inline const Vec2 Body::GetWorldCenter() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline const Vec2 Body::GetWorldCenter() const AMP_RESTRICT
 {
 	return m_sweep.c;
 }
+#endif
 
 inline const Vec2 Body::GetLocalCenter() const
 {
 	return m_sweep.localCenter;
 }
-inline const Vec2 Body::GetLocalCenter() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline const Vec2 Body::GetLocalCenter() const AMP_RESTRICT
 {
 	return m_sweep.localCenter;
 }
+#endif
 
 inline void Body::SetLinearVelocity(const Vec3& v)
 {
@@ -466,10 +494,12 @@ inline float32 Body::GetInertia() const
 {
 	return m_I + m_mass * b2Dot(m_sweep.localCenter, m_sweep.localCenter);
 }
-inline float32 Body::GetInertia() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline float32 Body::GetInertia() const AMP_RESTRICT
 {
 	return m_I + m_mass * b2Dot(m_sweep.localCenter, m_sweep.localCenter);
 }
+#endif
 
 
 inline b2MassData Body::GetMassData() const
@@ -505,10 +535,12 @@ inline Vec2 Body::GetLinearVelocityFromWorldPoint(const Vec2& worldPoint) const
 {
 	return m_linearVelocity + b2Cross(m_angularVelocity, worldPoint - m_sweep.c);
 }
-inline Vec2 Body::GetLinearVelocityFromWorldPoint(const Vec2& worldPoint) const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline Vec2 Body::GetLinearVelocityFromWorldPoint(const Vec2& worldPoint) const AMP_RESTRICT
 {
 	return m_linearVelocity + b2Cross(m_angularVelocity, worldPoint - m_sweep.c);
 }
+#endif
 
 
 inline Vec2 Body::GetLinearVelocityFromLocalPoint(const Vec2& localPoint) const
@@ -545,7 +577,8 @@ inline void Body::SetAwake(bool flag)
 		m_torque = 0.0f;
 	}
 }
-inline void Body::SetAwake(bool flag) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline void Body::SetAwake(bool flag) AMP_RESTRICT
 {
 	if (flag)
 	{
@@ -565,6 +598,7 @@ inline void Body::SetAwake(bool flag) restrict(amp)
 		m_torque = 0.0f;
 	}
 }
+#endif
 inline bool Body::IsAwake() const
 {
 	return HasFlag(Flag::Awake);
@@ -579,10 +613,12 @@ inline bool Body::IsFixedRotation() const
 {
 	return HasFlag(Flag::FixedRotation);
 }
-inline bool Body::IsFixedRotation() const restrict(amp)
+#ifndef AMP_CPU_BACKEND
+inline bool Body::IsFixedRotation() const AMP_RESTRICT
 {
 	return HasFlag(Flag::FixedRotation);
 }
+#endif
 
 inline void Body::SetSleepingAllowed(bool flag)
 {
@@ -669,7 +705,7 @@ inline void Body::ApplyLinearImpulse(const Vec2& impulse, const Vec2& point, boo
 			m_angularVelocity += m_invI * b2Cross(point - m_sweep.c, impulse);
 	}
 }
-inline void Body::ApplyLinearImpulse(const Vec3& impulse, const Vec2& point, bool wake) restrict(amp)
+inline void Body::ApplyLinearImpulse(const Vec3& impulse, const Vec2& point, bool wake) AMP_RESTRICT
 {
 	if (m_type != Type::Dynamic)
 		return;
@@ -682,7 +718,23 @@ inline void Body::ApplyLinearImpulse(const Vec3& impulse, const Vec2& point, boo
 	{
 		amp::atomicAdd(m_linearVelocity, m_invMass * impulse);
 		if (!IsFixedRotation())
-			amp::atomicAdd(m_angularVelocity, m_invI * b2Cross(point - m_sweep.c, impulse));
+			amp::atomicAdd(m_angularVelocity, m_invI * b2Cross(point - m_sweep.c, (Vec2)impulse));
+	}
+}
+inline void Body::ApplyImpulse(const Vec3& impulse, float32 angularImpulse, bool wake) AMP_RESTRICT
+{
+	if (m_type != Type::Dynamic)
+		return;
+
+	if (wake && !IsAwake())
+		SetAwake(true);
+
+	// Don't accumulate velocity if the body is sleeping
+	if (IsAwake())
+	{
+		amp::atomicAdd(m_linearVelocity, m_invMass * impulse);
+		if (!IsFixedRotation())
+			amp::atomicAdd(m_angularVelocity, m_invI * angularImpulse);
 	}
 }
 
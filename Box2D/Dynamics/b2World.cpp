@@ -37,8 +37,8 @@
 #include <new>
 
 b2World::b2World() :
-	m_contactManager(*this),
-	m_ampBodyMaterials(16, amp::accelView())
+	m_ampBodyMaterials(16, amp::accelView()),
+	m_contactManager(*this)
 {
 	m_destructionListener = NULL;
 	m_debugDraw = NULL;
@@ -964,7 +964,6 @@ struct b2WorldRayCastWrapper
 	float32 RayCastCallback(const b2RayCastInput& input, int32 proxyId)
 	{
 		b2FixtureProxy* proxy = (b2FixtureProxy*)m_broadPhase.GetUserData(proxyId);
-		int32 fixtureIdx = proxy->fixtureIdx;
 		b2RayCastOutput output;
 		const Fixture& f = m_world.GetFixture(proxy->fixtureIdx);
 		bool hit = m_world.RayCast(f, output, input, proxy->childIndex);
@@ -1330,7 +1329,7 @@ int32 b2World::InsertIntoBuffer(T& value, vector<T>& buf, set<int32>& freeIdxs)
 template<typename T>
 void b2World::RemoveFromBuffer(const int32 idx, vector<T>& buffer, set<int32>& freeIdxs)
 {
-	const uint32 lastIdx = buffer.size() - 1;
+	const int32 lastIdx = (int32)buffer.size() - 1;
 	if (idx == lastIdx)
 	{
 		buffer.pop_back();
@@ -1347,7 +1346,7 @@ void b2World::RemoveFromBuffer(const int32 idx, vector<T>& buffer, set<int32>& f
 template<typename T1, typename T2>
 void b2World::RemoveFromBuffers(const int32 idx, vector<T1>& buf1, vector<T2>& buf2, set<int32>& freeIdxs)
 {
-	const uint32 lastIdx = buf1.size() - 1;
+	const int32 lastIdx = (int32)buf1.size() - 1;
 	if (idx == lastIdx)
 	{
 		buf1.pop_back();
@@ -1365,7 +1364,7 @@ void b2World::RemoveFromBuffers(const int32 idx, vector<T1>& buf1, vector<T2>& b
 template<typename T1, typename T2, typename T3, typename T4, typename T5>
 void b2World::RemoveFromBuffers(const int32 idx, vector<T1>& buf1, vector<T2>& buf2, vector<T3>& buf3, vector<T4>& buf4, vector<T5>& buf5, set<int32>& freeIdxs)
 {
-	const uint32 lastIdx = buf1.size() - 1;
+	const int32 lastIdx = (int32)buf1.size() - 1;
 	if (idx == lastIdx)
 	{
 		buf1.pop_back();
@@ -1449,6 +1448,7 @@ void b2World::DestroyShape(b2Shape::Type type, int32 idx)
 		case b2Shape::e_circle:	 RemoveFromBuffer(idx, m_circleShapeBuffer, m_freeCircleShapeIdxs); break;
 		case b2Shape::e_edge:	 RemoveFromBuffer(idx, m_edgeShapeBuffer, m_freeEdgeShapeIdxs); break;
 		case b2Shape::e_polygon: RemoveFromBuffer(idx, m_polygonShapeBuffer, m_freePolygonShapeIdxs); break;
+		default: break;
 	}
 }
 
@@ -1818,7 +1818,8 @@ b2Shape& b2World::InsertSubShapeIntoBuffer(b2Shape::Type shapeType, int32& outId
 		case b2Shape::Type::e_chain:   return InsertIntoBuffer(m_chainShapeBuffer, m_freeChainShapeIdxs, outIdx);
 		case b2Shape::Type::e_circle:  return InsertIntoBuffer(m_circleShapeBuffer, m_freeCircleShapeIdxs, outIdx);
 		case b2Shape::Type::e_edge:	   return InsertIntoBuffer(m_edgeShapeBuffer, m_freeEdgeShapeIdxs, outIdx);
-		case b2Shape::Type::e_polygon: return InsertIntoBuffer(m_polygonShapeBuffer, m_freePolygonShapeIdxs, outIdx);
+		case b2Shape::Type::e_polygon:
+		default:					   return InsertIntoBuffer(m_polygonShapeBuffer, m_freePolygonShapeIdxs, outIdx);
 	}
 }
 
@@ -1840,6 +1841,7 @@ void b2World::RemoveSubShapeFromBuffer(b2Shape::Type shapeType, int32 idx)
 		case b2Shape::Type::e_circle:  return RemoveFromBuffer(idx, m_circleShapeBuffer, m_freeCircleShapeIdxs);
 		case b2Shape::Type::e_edge:	   return RemoveFromBuffer(idx, m_edgeShapeBuffer, m_freeEdgeShapeIdxs);
 		case b2Shape::Type::e_polygon: return RemoveFromBuffer(idx, m_polygonShapeBuffer, m_freePolygonShapeIdxs);
+		default: return;
 	}
 }
 
@@ -329,6 +329,8 @@ public:
 			return m_circleShapeBuffer[idx];
 		case b2Shape::e_edge:
 			return m_edgeShapeBuffer[idx];
+		default:
+			break;
 		}
 		return m_polygonShapeBuffer[idx];
 	}
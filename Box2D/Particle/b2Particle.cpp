@@ -67,12 +67,11 @@ int32 b2CalculateParticleIterations(
 
 
 Particle::Buffers::Buffers(int32 cap) :
-	flags(cap),
-	position(cap), velocity(cap), force(cap),
+	flags(cap), color(cap),
+	position(cap), velocity(cap),
 	weight(cap), heat(cap), health(cap),
 	mass(cap), invMass(cap),
-	staticPressure(cap), accumulation(cap), depth(cap),
-	matIdx(cap), groupIdx(cap), color(cap)
+	matIdx(cap), groupIdx(cap)
 {}
 
 void Particle::Buffers::Resize(int32 capacity)
@@ -80,15 +79,11 @@ void Particle::Buffers::Resize(int32 capacity)
 	flags.resize(capacity);
 	position.resize(capacity);
 	velocity.resize(capacity);
-	force.resize(capacity);
 	weight.resize(capacity);
 	heat.resize(capacity);
 	health.resize(capacity);
 	mass.resize(capacity);
 	invMass.resize(capacity);
-	staticPressure.resize(capacity);
-	accumulation.resize(capacity);
-	depth.resize(capacity);
 	matIdx.resize(capacity);
 	groupIdx.resize(capacity);
 	color.resize(capacity);
@@ -96,10 +91,11 @@ void Particle::Buffers::Resize(int32 capacity)
 
 
 Particle::AmpArrays::AmpArrays(const ampAccelView& accView) :
-	m_flags(accView),
+	m_count(0), m_capacity(0),
+	m_flags(accView), m_color(accView),
 	m_position(accView), m_velocity(accView),
 	m_weight(accView), m_heat(accView), m_health(accView),
-	m_matIdx(accView), m_color(accView),
+	m_matIdx(accView),
 	m_force(accView),
 	m_accumulationVec3(accView),
 	m_mass(accView), m_invMass(accView),
@@ -107,41 +103,177 @@ Particle::AmpArrays::AmpArrays(const ampAccelView& accView) :
 	m_depth(accView),
 	m_groupIdx(accView),
 	m_proxy(accView),
-	m_count(0), m_capacity(0)
-{}
+	m_columns(0),
+	m_dirtyBuckets(k_allBuckets),
+	m_bucketEnds(accView, Bucket::Count),
+	m_bucketBits(accView),
+	m_bucketsMayHaveGrown(false)
+{
+	std::fill(m_columnIdleSteps, m_columnIdleSteps + Column::Count, 0);
+	std::fill(m_bucketCnts, m_bucketCnts + Bucket::Count, 0);
+	m_buckets.reserve(Bucket::Count);
+	for (int32 b = 0; b < Bucket::Count; b++)
+		m_buckets.emplace_back(accView);
+	amp::fill(m_bucketEnds.arr, 0);
+}
+
+const uint32 Particle::AmpArrays::k_bucketFlags[Bucket::Count] =
+{
+	Particle::Mat::k_changeFlags,
+	Particle::Mat::Flag::HeatLoosing,
+	Particle::Mat::Flag::Flame,
+};
 
 bool Particle::AmpArrays::Resize(int32 size)
 {
 	const int32 lastCnt = m_count;
 	m_count = size;
+	if (size != lastCnt)
+		MarkBucketsDirty();
 	if (!AdjustCapacityToSize(m_capacity, size, MIN_PART_CAPACITY)) return false;
+	// the particles past the size are dropped when the capacity shrinks
+	const int32 copyCnt = b2Min(lastCnt, size);
 
-	m_iterations = 1 + ((m_capacity - 1) / CONTACT_THREADS);
-
-	m_flags.Resize(m_capacity, lastCnt);
-	m_position.Resize(m_capacity, lastCnt);
-	m_velocity.Resize(m_capacity, lastCnt);
-	m_force.Resize(m_capacity, lastCnt);
-	m_accumulationVec3.Resize(m_capacity);
+	m_flags.Resize(m_capacity, copyCnt);
+	m_position.Resize(m_capacity, copyCnt);
+	m_velocity.Resize(m_capacity, copyCnt);
 
 	m_weight.Resize(m_capacity);
-	m_heat.Resize(m_capacity, lastCnt);
-	m_health.Resize(m_capacity, lastCnt);
-	m_mass.Resize(m_capacity, lastCnt);
-	m_invMass.Resize(m_capacity, lastCnt);
-	m_staticPressure.Resize(m_capacity, lastCnt);
+	m_heat.Resize(m_capacity, copyCnt);
+	m_health.Resize(m_capacity, copyCnt);
+	m_mass.Resize(m_capacity, copyCnt);
+	m_invMass.Resize(m_capacity, copyCnt);
 	m_accumulation.Resize(m_capacity);
-	m_depth.Resize(m_capacity);
 
-	m_matIdx.Resize(m_capacity, lastCnt);
-	m_groupIdx.Resize(m_capacity, lastCnt);
-	m_color.Resize(m_capacity, lastCnt);
+	m_matIdx.Resize(m_capacity, copyCnt);
+	m_groupIdx.Resize(m_capacity, copyCnt);
+	m_color.Resize(m_capacity, copyCnt);
 
 	m_proxy.Resize(m_capacity);
+	// a new capacity changes the count too, so every bucket is dirty
+	m_bucketBits.Resize(m_capacity);
+
+	for (int32 c = 0; c < Column::Count; c++)
+		if (HasColumn(c)) ResizeColumn(c, m_capacity, copyCnt);
 
 	return true;
 }
 
+void Particle::AmpArrays::ResizeColumn(const int32 column, const int32 size, const int32 copyCnt)
+{
+	switch (column)
+	{
+	case Column::Force:				m_force.Resize(size, copyCnt); break;
+	case Column::StaticPressure:	m_staticPressure.Resize(size, copyCnt); break;
+	case Column::Depth:				m_depth.Resize(size, copyCnt); break;
+	case Column::Tensile:			m_accumulationVec3.Resize(size); break;
+	}
+}
+
+bool Particle::AmpArrays::RequireColumn(const int32 column)
+{
+	m_columnIdleSteps[column] = 0;
+	if (HasColumn(column)) return false;
+	m_columns |= 1u << column;
+	ResizeColumn(column, m_capacity);
+	switch (column)
+	{
+	case Column::Force:				amp::fill(m_force.arr, Vec3_zero); break;
+	case Column::StaticPressure:	amp::fill(m_staticPressure.arr, 0.0f); break;
+	case Column::Depth:				amp::fill(m_depth.arr, 0.0f); break;
+	case Column::Tensile:			amp::fill(m_accumulationVec3.arr, Vec3_zero); break;
+	}
+	return true;
+}
+
+void Particle::AmpArrays::ReleaseUnusedColumns(const uint32 usedColumns)
+{
+	for (int32 c = 0; c < Column::Count; c++)
+	{
+		if (!HasColumn(c) || (usedColumns & (1u << c)))
+		{
+			m_columnIdleSteps[c] = 0;
+			continue;
+		}
+		if (++m_columnIdleSteps[c] < COLUMN_RELEASE_STEPS) continue;
+		m_columnIdleSteps[c] = 0;
+		m_columns &= ~(1u << c);
+		// Array keeps its minimum capacity
+		ResizeColumn(c, 0);
+	}
+}
+
+void Particle::AmpArrays::ReleaseUnusedBuckets(const uint32 allFlags)
+{
+	for (int32 b = 0; b < Bucket::Count; b++)
+	{
+		if (allFlags & k_bucketFlags[b]) continue;
+		m_bucketCnts[b] = 0;
+		m_dirtyBuckets |= 1u << b;
+		// Array keeps its minimum capacity
+		m_buckets[b].Resize(0);
+	}
+}
+
+Particle::AmpArrays::BucketAppender Particle::AmpArrays::GetBucketAppender()
+{
+	// array_view has no default constructor, so the lists are listed one by one
+	static_assert(Bucket::Count == 3, "list the views of all buckets");
+	BucketAppender appender =
+	{
+		{ m_buckets[0].GetView(), m_buckets[1].GetView(), m_buckets[2].GetView() },
+		{}, {}, m_bucketEnds.GetView(), m_bucketBits.GetView()
+	};
+	for (int32 b = 0; b < Bucket::Count; b++)
+	{
+		appender.capacities[b] = m_buckets[b].arr.extent[0];
+		appender.flags[b] = k_bucketFlags[b];
+	}
+	return appender;
+}
+
+void Particle::AmpArrays::UpdateBucketCounts()
+{
+	if (!m_bucketsMayHaveGrown) return;
+	m_bucketsMayHaveGrown = false;
+	std::vector<int32> ends(Bucket::Count);
+	amp::copy(m_bucketEnds.arr, ends);
+	for (int32 b = 0; b < Bucket::Count; b++)
+		if (!(m_dirtyBuckets & (1u << b))) m_bucketCnts[b] = ends[b];
+}
+
+int32 Particle::AmpArrays::UpdateBucket(const int32 bucket)
+{
+	const uint32 bit = 1u << bucket;
+	if (!(m_dirtyBuckets & bit)) return m_bucketCnts[bucket];
+	m_dirtyBuckets &= ~bit;
+	m_bucketCnts[bucket] = 0;
+	amp::fill(m_bucketEnds.arr, 0, bucket, bucket + 1);
+	if (!m_count) return 0;
+
+	const uint32 flag = k_bucketFlags[bucket];
+	amp::Array<int32>& bucketArr = m_buckets[bucket];
+	bucketArr.Resize(m_capacity);
+	auto flags = m_flags.GetConstView();
+	auto bits = m_bucketBits.GetView();
+	ampArrayView<int32> inBucket = amp::scratch().Alloc<int32>(m_count);
+	amp::forEach(m_count, [=](const int32 i) AMP_RESTRICT
+	{
+		const uint32 f = flags[i];
+		inBucket[i] = !(f & Particle::Flag::Zombie) && (f & flag);
+		bits[i] = inBucket[i] ? bits[i] | bit : bits[i] & ~bit;
+	});
+	auto idxs = bucketArr.GetView();
+	const int32 cnt = amp::scan(ampArrayView<const int32>(inBucket), m_count,
+		[=](const int32 i, const int32 wi) AMP_RESTRICT
+	{
+		if (inBucket[i]) idxs[wi] = i;
+	});
+	m_bucketCnts[bucket] = cnt;
+	amp::fill(m_bucketEnds.arr, cnt, bucket, bucket + 1);
+	return cnt;
+}
+
 void Particle::AmpArrays::SetD11Buffers(ID3D11Buffer** ppBufs)
 {
 	if (!ppBufs)
@@ -180,6 +312,43 @@ void Particle::AmpArrays::WaitForCopies()
 	m_color.copyFuture.wait();
 }
 
+template<typename T> inline void ReorderArray(amp::Array<T>& a, const ampArrayView<const Proxy>& order, int32 cnt)
+{
+	// gathers from a scratch copy, the column keeps its array and D3D11 buffer
+	ampArrayView<T> temp = amp::scratch().Alloc<T>(cnt);
+	auto dst = a.GetView();
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		temp[i] = dst[i];
+	});
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		dst[i] = temp[order[i].idx];
+	});
+}
+
+void Particle::AmpArrays::Reorder(const ampArrayView<const Proxy>& order)
+{
+	ReorderArray(m_flags, order, m_count);
+	ReorderArray(m_color, order, m_count);
+	ReorderArray(m_position, order, m_count);
+	ReorderArray(m_velocity, order, m_count);
+	ReorderArray(m_weight, order, m_count);
+	ReorderArray(m_heat, order, m_count);
+	ReorderArray(m_health, order, m_count);
+	ReorderArray(m_matIdx, order, m_count);
+	ReorderArray(m_mass, order, m_count);
+	ReorderArray(m_invMass, order, m_count);
+	ReorderArray(m_groupIdx, order, m_count);
+	if (HasColumn(Column::Force))
+		ReorderArray(m_force, order, m_count);
+	if (HasColumn(Column::StaticPressure))
+		ReorderArray(m_staticPressure, order, m_count);
+	if (HasColumn(Column::Depth))
+		ReorderArray(m_depth, order, m_count);
+	MarkBucketsDirty();
+}
+
 template<typename T> inline void ReplaceArray(ampArray<T>& arr, ID3D11Buffer* pNewBuf, int32 size, int32 copyCnt)
 {
 	ampArray<T> temp = pNewBuf ? 
@@ -201,16 +370,38 @@ void Particle::CopyBufferRangeToAmpArrays(Buffers& bufs, AmpArrays& arrs,
 	amp::copy(bufs.flags, arrs.m_flags.arr, first, size);
 	amp::copy(bufs.position, arrs.m_position.arr, first, size);
 	amp::copy(bufs.velocity, arrs.m_velocity.arr, first, size);
-	amp::copy(bufs.force, arrs.m_force.arr, first, size);
 	amp::copy(bufs.heat, arrs.m_heat.arr, first, size);
 	amp::copy(bufs.health, arrs.m_health.arr, first, size);
 	amp::copy(bufs.mass, arrs.m_mass.arr, first, size);
 	amp::copy(bufs.invMass, arrs.m_invMass.arr, first, size);
-	amp::copy(bufs.staticPressure, arrs.m_staticPressure.arr, first, size);
-	amp::copy(bufs.depth, arrs.m_depth.arr, first, size);
 	amp::copy(bufs.matIdx, arrs.m_matIdx.arr, first, size);
 	amp::copy(bufs.groupIdx, arrs.m_groupIdx.arr, first, size);
 	amp::copy(bufs.color, arrs.m_color.arr, first, size);
+	arrs.MarkBucketsDirty();
+	// the optional columns start at zero and have no host copy
+	if (arrs.HasColumn(AmpArrays::Column::Force))
+		amp::fill(arrs.m_force.arr, Vec3_zero, first, last);
+	if (arrs.HasColumn(AmpArrays::Column::StaticPressure))
+		amp::fill(arrs.m_staticPressure.arr, 0.0f, first, last);
+	if (arrs.HasColumn(AmpArrays::Column::Depth))
+		amp::fill(arrs.m_depth.arr, 0.0f, first, last);
+}
+
+void Particle::CopyAmpArraysToBuffers(const AmpArrays& arrs, Buffers& bufs)
+{
+	const int32 cnt = arrs.m_count;
+	if (!cnt) return;
+	amp::copy(arrs.m_flags.arr, bufs.flags, cnt);
+	amp::copy(arrs.m_position.arr, bufs.position, cnt);
+	amp::copy(arrs.m_velocity.arr, bufs.velocity, cnt);
+	amp::copy(arrs.m_weight.arr, bufs.weight, cnt);
+	amp::copy(arrs.m_heat.arr, bufs.heat, cnt);
+	amp::copy(arrs.m_health.arr, bufs.health, cnt);
+	amp::copy(arrs.m_mass.arr, bufs.mass, cnt);
+	amp::copy(arrs.m_invMass.arr, bufs.invMass, cnt);
+	amp::copy(arrs.m_matIdx.arr, bufs.matIdx, cnt);
+	amp::copy(arrs.m_groupIdx.arr, bufs.groupIdx, cnt);
+	amp::copy(arrs.m_color.arr, bufs.color, cnt);
 }
 
 
@@ -226,8 +417,9 @@ Particle::Mat::Mat(const Particle::Mat::Def& def)
 }
 
 Particle::MatArray::MatArray(const ampAccelView& accelView) :
+	m_count(0), m_capacity(0),
 	m_array(accelView, b2_minPartMatBufferCapacity),
-	m_capacity(0), m_count(0)
+	m_transitions(accelView, b2_minPartMatBufferCapacity)
 {}
 
 int32 Particle::MatArray::Add(Particle::Mat::Def& def)
@@ -237,12 +429,14 @@ int32 Particle::MatArray::Add(Particle::Mat::Def& def)
 	{
 		if (!m_capacity) m_capacity = 1;
 		else m_capacity *= 2;
-		m_array.Resize(m_capacity);
+		m_array.Resize(m_capacity, idx);
+		m_transitions.Resize(m_capacity, idx);
 		m_vector.resize(m_capacity);
 	}
 	m_vector[idx] = Particle::Mat(def);
 
 	amp::copy(m_vector[idx], m_array.arr, idx);
+	amp::copy(Particle::MatTransition(m_vector[idx]), m_transitions.arr, idx);
 	return idx;
 }
 
@@ -250,4 +444,5 @@ void Particle::MatArray::AddChange(const int32 idx, const Particle::Mat::ChangeD
 {
 	m_vector[idx].SetMatChanges(changeDef);
 	amp::copy(m_vector[idx], m_array.arr, idx);
+	amp::copy(Particle::MatTransition(m_vector[idx]), m_transitions.arr, idx);
 }
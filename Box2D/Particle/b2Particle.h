@@ -22,8 +22,10 @@
 #include <Box2D/Common/b2IntrusiveList.h>
 #include <Box2D/Amp/ampAlgorithms.h>
 #include <vector>
+#ifndef AMP_CPU_BACKEND
 #include <d3d11.h>
 #include <amp.h>
+#endif
 
 struct ParticleGroup;
 
@@ -60,6 +62,7 @@ namespace Particle
 		Reactive = 1u << 1,			/// Makes pairs or triads with other particles.
 		Controlled = 1u << 2,		/// markes Particles that are currently controlled
 		Burning = 1u << 3,			/// Burning down to other mat
+		DeathLogged = 1u << 4,		/// Zombie that has its Event::Died in the event log
 	};
 	/// For only getting particle flags from uint32
 	static const uint32 k_mask = 0x000000FF;
@@ -168,9 +171,84 @@ namespace Particle
 		}
 
 		inline bool HasFlag(Flag flag) const { return m_flags & flag; }
-		inline bool HasFlag(Flag flag) const restrict(amp) { return m_flags & flag; }
+#ifndef AMP_CPU_BACKEND
+		inline bool HasFlag(Flag flag) const AMP_RESTRICT { return m_flags & flag; }
+#endif
 		inline bool IsWallSpringOrElastic() const { return m_flags & k_wallOrSpringOrElasticFlags; }
-		inline bool IsWallSpringOrElastic() const restrict(amp) { return m_flags & k_wallOrSpringOrElasticFlags; }
+#ifndef AMP_CPU_BACKEND
+		inline bool IsWallSpringOrElastic() const AMP_RESTRICT { return m_flags & k_wallOrSpringOrElasticFlags; }
+#endif
+	};
+
+	/// The part of a Mat that SolveChangeMat reads, for the mat itself
+	/// and, through the indices, for the mats it changes to.
+	struct MatTransition
+	{
+		uint32 flags;
+		float32 mass;
+		float32 invMass;
+		float32 coldThreshold;
+		float32 hotThreshold;
+		int32 coldMatIdx;
+		int32 hotMatIdx;
+		int32 burnedMatIdx;
+
+		MatTransition() {}
+		MatTransition(const Mat& mat) :
+			flags(mat.m_flags), mass(mat.m_mass), invMass(mat.m_invMass),
+			coldThreshold(mat.m_coldThreshold), hotThreshold(mat.m_hotThreshold),
+			coldMatIdx(mat.m_changeToColdMatIdx), hotMatIdx(mat.m_changeToHotMatIdx),
+			burnedMatIdx(mat.m_changeToBurnedMatIdx)
+		{}
+	};
+
+	/// Entry of the compacted list of SolveChangeMat, one per changed particle.
+	struct MatChange
+	{
+		int32 idx;			/// of the particle
+		int32 oldMatIdx;
+		int32 newMatIdx;	/// INVALID_IDX if the particle died
+	};
+
+	/// Entry of the event log of a step, see b2ParticleSystemDef::eventTypes.
+	struct Event
+	{
+		enum Type
+		{
+			MatChanged,		/// a = old matIdx, b = new matIdx or INVALID_IDX if it died
+			Died,			/// a = matIdx, b = groupIdx
+			Ignited,		/// a = matIdx
+			BodyTouched,	/// a = body idx, b = fixture idx, in the last iteration
+		};
+		int32 type;
+		int32 idx;			/// of the particle after the step, INVALID_IDX if it was compacted
+		int32 a;
+		int32 b;
+	};
+
+	/// Appends events on the device, the ones beyond max are counted but dropped.
+	struct EventLog
+	{
+		ampArrayView<Event> events;
+		ampArrayView<int32> cnt;
+		int32 max;
+		uint32 types;
+
+		bool Logs(const int32 type) const { return types & (1u << type); }
+#ifndef AMP_CPU_BACKEND
+		bool Logs(const int32 type) const AMP_RESTRICT { return types & (1u << type); }
+#endif
+		void Add(const int32 type, const int32 idx, const int32 a, const int32 b) const AMP_RESTRICT
+		{
+			if (!Logs(type)) return;
+			const int32 k = amp::atomicInc(cnt[0]);
+			if (k >= max) return;
+			Event& e = events[k];
+			e.type = type;
+			e.idx = idx;
+			e.a = a;
+			e.b = b;
+		}
 	};
 
 	struct MatArray
@@ -179,6 +257,8 @@ namespace Particle
 
 		amp::Array<Mat> m_array;
 		std::vector<Mat> m_vector;
+		/// Transition table, one entry per mat, updated by Add and AddChange.
+		amp::Array<MatTransition> m_transitions;
 
 		MatArray(const ampAccelView& accelView);
 
@@ -190,9 +270,8 @@ namespace Particle
 	struct Buffers
 	{
 		std::vector<uint32> flags, color;
-		std::vector<Vec3> position, velocity, force;
-		std::vector<float32> weight, heat, health, mass, invMass,
-			staticPressure, accumulation, depth;
+		std::vector<Vec3> position, velocity;
+		std::vector<float32> weight, heat, health, mass, invMass;
 		std::vector<int32> matIdx, groupIdx;
 
 		Buffers(int32 cap);
@@ -201,7 +280,7 @@ namespace Particle
 
 	struct AmpArrays
 	{
-		int32 m_count, m_capacity, m_iterations;
+		int32 m_count, m_capacity;
 
 		amp::Array<uint32> m_flags, m_color;
 		amp::Array<Vec3> m_position, m_velocity;
@@ -214,17 +293,103 @@ namespace Particle
 		
 		amp::Array<Proxy> m_proxy;
 
+		/// Columns that are only allocated while something needs them,
+		/// otherwise they hold a single element.
+		struct Column
+		{
+			enum
+			{
+				Force,				// m_force, while forces are applied
+				StaticPressure,		// m_staticPressure, Mat::Flag::StaticPressure
+				Depth,				// m_depth, ParticleGroup::Flag::Solid
+				Tensile,			// m_accumulationVec3, Mat::Flag::Tensile
+				Count
+			};
+		};
+		uint32 m_columns;
+		int32 m_columnIdleSteps[Column::Count];
+
+		/// Compacted index lists of the particles with a flag, for passes that
+		/// usually touch only a few particles. Rebuilt on use when marked dirty,
+		/// kernels that add a flag append the particle with a BucketAppender.
+		struct Bucket
+		{
+			enum
+			{
+				Change,				// Mat::k_changeFlags
+				HeatLoosing,		// Mat::Flag::HeatLoosing
+				Flame,				// Mat::Flag::Flame
+				Count
+			};
+		};
+		static const uint32 k_bucketFlags[Bucket::Count];
+		static const uint32 k_allBuckets = (1u << Bucket::Count) - 1;
+		std::vector<amp::Array<int32>> m_buckets;
+		int32 m_bucketCnts[Bucket::Count];
+		uint32 m_dirtyBuckets;
+		// the ends of the lists on the device, appends go behind them
+		amp::Array<int32> m_bucketEnds;
+		// the bit of each list a particle is in, set by rebuilds and appends
+		amp::Array<uint32> m_bucketBits;
+		bool m_bucketsMayHaveGrown;
+
+		struct BucketAppender
+		{
+			ampArrayView<int32> idxs[Bucket::Count];
+			int32 capacities[Bucket::Count];
+			uint32 flags[Bucket::Count];
+			ampArrayView<int32> ends;
+			ampArrayView<uint32> bits;
+
+			/// Appends particle i to the lists of the bucket flags in f it is not in yet.
+			/// A particle stays listed when it loses the flag, so it is never listed twice.
+			void Add(const int32 i, const uint32 f) const AMP_RESTRICT
+			{
+				for (int32 b = 0; b < Bucket::Count; b++)
+				{
+					if (!(f & flags[b])) continue;
+					const uint32 bit = 1u << b;
+					if (Concurrency::atomic_fetch_or(&bits[i], bit) & bit) continue;
+					// only dirty lists, which are rebuilt before use, can be full
+					const int32 k = amp::atomicInc(ends[b]);
+					if (k < capacities[b]) idxs[b][k] = i;
+				}
+			}
+		};
 
 		AmpArrays(const ampAccelView& accelView);
 		bool Empty() const { return m_count == 0; }
 		bool Resize(int32 size);
+		bool HasColumn(const int32 column) const { return m_columns & (1u << column); }
+		/// Allocates the column filled with zeros.
+		/// @return true if it was not allocated before.
+		bool RequireColumn(const int32 column);
+		/// Releases the allocated columns that are not in the bit set usedColumns
+		/// after COLUMN_RELEASE_STEPS calls in a row.
+		void ReleaseUnusedColumns(const uint32 usedColumns);
+		void ResizeColumn(const int32 column, const int32 size, const int32 copyCnt = 0);
+		void MarkBucketsDirty(const uint32 buckets = k_allBuckets) { m_dirtyBuckets |= buckets; }
+		/// For kernels that add bucket flags, call MarkBucketsMayHaveGrown after launching them.
+		BucketAppender GetBucketAppender();
+		void MarkBucketsMayHaveGrown() { m_bucketsMayHaveGrown = true; }
+		/// Reads the ends of the lists that kernels appended to, once per step.
+		void UpdateBucketCounts();
+		/// Releases the lists of the buckets whose flag is not in allFlags.
+		void ReleaseUnusedBuckets(const uint32 allFlags);
+		/// Rebuilds the bucket if it is dirty.
+		/// @return the number of particles in the bucket.
+		int32 UpdateBucket(const int32 bucket);
+		int32 GetBucketCount(const int32 bucket) const { return m_bucketCnts[bucket]; }
 		void SetD11Buffers(ID3D11Buffer** ppNewBufs);
 		void WaitForCopies();
+		/// Moves the data of particle order[i].idx to i in every allocated column.
+		/// The scratch columns m_accumulation and m_accumulationVec3 are skipped.
+		void Reorder(const ampArrayView<const Proxy>& order);
 
 		template<typename F1, typename F2> void ForEachWithZombies(const F1& fn, const F2& zFn) const
 		{
 			auto flags = m_flags.GetConstView();
-			amp::forEach(m_count, [=](const int32 i) restrict(amp)
+			amp::forEach(m_count, [=](const int32 i) AMP_RESTRICT
 			{
 				if (flags[i] & Particle::Flag::Zombie) zFn(i);
 				else fn(i);
@@ -233,7 +398,7 @@ namespace Particle
 		template<typename F> void ForEach(const F& function) const
 		{
 			auto flags = m_flags.GetConstView();
-			amp::forEach(m_count, [=](const int32 i) restrict(amp)
+			amp::forEach(m_count, [=](const int32 i) AMP_RESTRICT
 			{
 				if (!(flags[i] & Particle::Flag::Zombie)) function(i);
 			});
@@ -241,25 +406,57 @@ namespace Particle
 		template<typename F> void ForEach(const uint32 flag, const F& function) const
 		{
 			auto flags = m_flags.GetConstView();
-			ForEach([=](const int32 i) restrict(amp)
+			ForEach([=](const int32 i) AMP_RESTRICT
 			{
 				if (flags[i] & flag) function(i);
 			});
 		}
+		/// Like ForEach(k_bucketFlags[bucket], function), but only dispatches
+		/// over the bucket unless it holds most of the particles.
+		template<typename F> void ForEachInBucket(const int32 bucket, const F& function)
+		{
+			const uint32 flag = k_bucketFlags[bucket];
+			const int32 cnt = UpdateBucket(bucket);
+			if (cnt > m_count / BUCKET_DENSE_FRACTION)
+			{
+				ForEach(flag, function);
+				return;
+			}
+			if (!cnt && !m_bucketsMayHaveGrown) return;
+			// the list may have grown on the device since its count was read,
+			// so the threads stride over it up to its end there
+			const int32 threadCnt = m_bucketsMayHaveGrown ? b2Max(cnt, TILE_SIZE) : cnt;
+			auto flags = m_flags.GetConstView();
+			auto idxs = m_buckets[bucket].GetConstView();
+			auto ends = m_bucketEnds.GetConstView();
+			amp::forEach(threadCnt, [=](const int32 t) AMP_RESTRICT
+			{
+				for (int32 j = t; j < ends[bucket]; j += threadCnt)
+				{
+					// the flag may have been removed since the particle was listed
+					const int32 i = idxs[j];
+					if (!(flags[i] & Particle::Flag::Zombie) && flags[i] & flag) function(i);
+				}
+			});
+		}
 		template<typename F> void ForEachProxy(const F& function) const
 		{
 			auto flags = m_flags.GetConstView();
 			auto proxies = m_proxy.GetConstView();
-			amp::forEach(m_count, [=](const int32 i) restrict(amp)
+			amp::forEach(m_count, [=](const int32 i) AMP_RESTRICT
 			{
 				const Proxy proxy = proxies[i];
-				if (!(flags[proxy.idx] & Particle::Flag::Zombie)) function(proxy);
+				// ResortProxies keeps the proxies of dead particles in place without an index
+				if (proxy.idx != INVALID_IDX && !(flags[proxy.idx] & Particle::Flag::Zombie))
+					function(proxy);
 			});
 		}
 	};
 	
 	void CopyBufferRangeToAmpArrays(Buffers& bufs,
 		AmpArrays& arrs, int32 first, int32 last);
+	/// Refreshes the host copies of the particles after the device moved them.
+	void CopyAmpArraysToBuffers(const AmpArrays& arrs, Buffers& bufs);
 };
 
 /// A helper function to calculate the optimal number of iterations.
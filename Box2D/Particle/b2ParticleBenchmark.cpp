@@ -0,0 +1,230 @@
+#include <Box2D/Particle/b2ParticleBenchmark.h>
+#include <Box2D/Common/b2Timer.h>
+#include <Box2D/Dynamics/b2World.h>
+
+template<typename F>
+float32 ParticleBenchmark::Time(int32 runs, const F& run)
+{
+	amp::accelView().wait();
+	Timer t = Timer();
+	for (int32 i = 0; i < runs; i++)
+	{
+		amp::scratch().Reset();
+		run();
+	}
+	amp::accelView().wait();
+	return t.Stop() / b2Max(runs, 1);
+}
+
+int32 ParticleBenchmark::FindContactsScaling(int32 maxCount, int32 runs, float32* times, int32 timesCapacity)
+{
+	// fills the empty system with square blocks of 64k, 128k, ... particles
+	ParticleSystem& s = m_system;
+	if (!s.m_ampParts.Empty() || s.m_groupCount) return 0;
+
+	int32 sizeCnt = 0;
+	for (int32 cnt = 1 << 16; cnt <= maxCount && sizeCnt < timesCapacity; cnt *= 2)
+	{
+		s.FillTestGrid(cnt, 1);
+		s.SortProxies();
+		times[sizeCnt++] = Time(runs, [&]() { s.FindContacts(true); });
+	}
+	s.ResizeParticleBuffers(0);
+	return sizeCnt;
+}
+
+float32 ParticleBenchmark::ContactSearch(bool grid, int32 particleCnt, int32 layers, int32 runs)
+{
+	// fills the empty system with a block of the given layers
+	ParticleSystem& s = m_system;
+	if (!s.m_ampParts.Empty() || s.m_groupCount || particleCnt <= 0 || layers <= 0) return 0;
+	s.FillTestGrid(particleCnt, 1, layers);
+	s.SortProxies();
+	const float32 time = Time(runs, [&]() { s.SearchContacts(true, s.m_particleDiameter, grid); });
+	s.ResizeParticleBuffers(0);
+	return time;
+}
+
+float32 ParticleBenchmark::NeighbourList(float32 skin, int32 iterations, int32 runs)
+{
+	// one list build and iterations - 1 reuses per run, like a step
+	ParticleSystem& s = m_system;
+	const float32 wasSkin = s.m_def.neighbourSkin;
+	s.m_def.neighbourSkin = skin;
+	const float32 time = Time(runs, [&]()
+	{
+		s.m_neighboursValid = false;
+		for (int32 j = 0; j < iterations; j++)
+			s.FindContacts(true);
+	});
+	s.m_def.neighbourSkin = wasSkin;
+	s.m_neighboursValid = false;
+	return time;
+}
+
+float32 ParticleBenchmark::FreeRanges(int32 groupCnt, int32 steps, int32 runs)
+{
+	// groupCnt live groups of 1 to 64 particles, every step one random
+	// group is destroyed and a new one is created, like short lived effects
+	return Time(runs, [&]()
+	{
+		::FreeRanges ranges;
+		vector<pair<int32, int32>> groups;
+		groups.reserve(groupCnt);
+		int32 end = 0;
+		auto create = [&]()
+		{
+			const int32 cnt = 1 + rand() % 64;
+			int32 first = ranges.Allocate(cnt);
+			if (first == INVALID_IDX)
+			{
+				first = end;
+				end += cnt;
+			}
+			groups.push_back(pair<int32, int32>(first, first + cnt));
+		};
+		for (int32 i = 0; i < groupCnt; i++)
+			create();
+		for (int32 s = 0; s < steps && !groups.empty(); s++)
+		{
+			const int32 i = rand() % groups.size();
+			ranges.Free(groups[i].first, groups[i].second);
+			end = ranges.TrimEnd(end);
+			groups[i] = groups.back();
+			groups.pop_back();
+			create();
+		}
+	});
+}
+
+float32 ParticleBenchmark::Integrate(bool fused, int32 particleCnt, int32 runs)
+{
+	// fills the empty system with a falling block
+	ParticleSystem& s = m_system;
+	if (!s.m_ampParts.Empty() || s.m_groupCount || particleCnt <= 0) return 0;
+	const bool wasFused = s.m_def.fuseIntegration;
+	const b2TimeStep subStep = s.m_subStep;
+	s.m_def.fuseIntegration = fused;
+	s.m_subStep = s.m_step;
+	s.m_subStep.dt /= s.m_step.particleIterations;
+	s.m_subStep.inv_dt *= s.m_step.particleIterations;
+
+	s.FillTestGrid(particleCnt, 2 * s.m_atmosphereParticleMass);
+	const float32 time = Time(runs, [&]()
+	{
+		s.SolveGravity();
+		s.SolveWind();
+		s.SolveAirResistance();
+		s.LimitVelocity();
+		s.SolvePosition();
+		s.SolveOutOfBounds();
+	});
+
+	s.ResizeParticleBuffers(0);
+	s.m_subStep = subStep;
+	s.m_def.fuseIntegration = wasFused;
+	return time;
+}
+
+float32 ParticleBenchmark::SortProxies(bool wide, int32 runs)
+{
+	ParticleSystem& s = m_system;
+	return Time(runs, [&]()
+	{
+		// the full sort, not the resort of the last order
+		s.m_proxiesCoherent = false;
+		if (wide)
+			s.SortProxies();
+		else
+			s.SortProxiesNarrow();
+	});
+}
+
+float32 ParticleBenchmark::ComputeDepth(int32 particleCnt, int32 runs)
+{
+	// fills the empty system with one solid block, its depth is computed again in each run
+	ParticleSystem& s = m_system;
+	if (!s.m_ampParts.Empty() || s.m_groupCount || particleCnt <= 0) return 0;
+	const uint32 allGroupFlags = s.m_allGroupFlags;
+	s.ResizeGroupBuffers(1);
+	s.FillTestGrid(particleCnt, 1);
+	ParticleGroup& group = s.m_groupBuffer[0];
+	group = ParticleGroup();
+	group.m_lastIndex = particleCnt;
+	s.m_groupCount = 1;
+	s.SortProxies();
+	s.FindContacts(true);
+	s.ReduceContacts();
+
+	const float32 time = Time(runs, [&]()
+	{
+		group.m_groupFlags = ParticleGroup::Flag::Solid | ParticleGroup::Flag::NeedsUpdateDepth;
+		amp::copy(group, s.m_ampGroups, 0);
+		s.m_allGroupFlags |= group.m_groupFlags;
+		s.ComputeDepth();
+	});
+
+	group = ParticleGroup();
+	s.m_groupCount = 0;
+	s.m_allGroupFlags = allGroupFlags;
+	s.ResizeParticleBuffers(0);
+	return time;
+}
+
+bool ParticleBenchmark::Deterministic(int32 matIdx, int32 particleCnt, int32 steps, int32 threadCntA, int32 threadCntB)
+{
+	// fills the empty system with the same falling block in each run, in the
+	// middle of the world borders
+	ParticleSystem& s = m_system;
+	if (!s.m_ampParts.Empty() || s.m_groupCount || particleCnt <= 0) return false;
+	const bool wasDeterministic = s.m_def.deterministic;
+	s.m_def.deterministic = true;
+	s.m_passGraph.Clear();
+
+	ParticleGroup::Def block;
+	block.particleCount = particleCnt;
+	block.matIdx = matIdx;
+	block.positions.resize(particleCnt);
+	const Vec3 center = 0.5f * (s.m_world.m_lowerBorder + s.m_world.m_upperBorder);
+	const int32 side = (int32)ceil(sqrt((float32)particleCnt));
+	const float32 spacing = 0.75f * s.m_particleDiameter;
+	for (int32 i = 0; i < particleCnt; i++)
+		block.positions[i] = center + Vec3((i % side - side / 2) * spacing, (i / side - side / 2) * spacing, 0);
+
+	const int32 threadCnts[2] = { threadCntA, threadCntB };
+	uint64 hashes[2];
+	bool stepped = true;
+	for (int32 r = 0; r < 2; r++)
+	{
+		amp::setThreadCount(threadCnts[r]);
+		ParticleGroup::Def def = block;
+		s.CreateGroup(def);
+		s.m_proxiesCoherent = false;
+		for (int32 i = 0; i < steps; i++)
+			stepped &= s.Step(0, i);
+		hashes[r] = HashState();
+		s.DestroyAllParticles();
+	}
+	amp::setThreadCount(0);
+	s.m_def.deterministic = wasDeterministic;
+	s.m_passGraph.Clear();
+	return stepped && hashes[0] == hashes[1];
+}
+
+uint64 ParticleBenchmark::HashState()
+{
+	const int32 cnt = m_system.m_ampParts.m_count;
+	vector<Vec3> positions(cnt), velocities(cnt);
+	amp::copy(m_system.m_ampParts.m_position.arr, positions, cnt);
+	amp::copy(m_system.m_ampParts.m_velocity.arr, velocities, cnt);
+	uint64 hash = 14695981039346656037ull;
+	const auto add = [&](const vector<Vec3>& v)
+	{
+		const uint8* bytes = reinterpret_cast<const uint8*>(v.data());
+		for (size_t i = 0; i < v.size() * sizeof(Vec3); i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+	};
+	add(positions);
+	add(velocities);
+	return hash;
+}
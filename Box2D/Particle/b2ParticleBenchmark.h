@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Box2D/Particle/b2ParticleSystem.h>
+
+/// Benchmarks of the particle passes, built with ELEMENTALPHYSICS_BENCHMARKS
+/// and exported to the plugin by BenchmarkInterface.cpp. The ones that fill the
+/// system with a test scene only run on an empty system, which is empty again
+/// afterwards.
+class ParticleBenchmark
+{
+public:
+	explicit ParticleBenchmark(ParticleSystem& system) : m_system(system) {}
+
+	/// Times FindContacts on dense blocks of 64k particles, doubled up to maxCount.
+	/// @return number of block sizes, at most timesCapacity, their average
+	/// milliseconds per run are in times.
+	int32 FindContactsScaling(int32 maxCount, int32 runs, float32* times, int32 timesCapacity);
+	/// Times the contact search with the cell list or the proxy row scan on a
+	/// block of particleCnt particles, stacked in the given number of layers.
+	float32 ContactSearch(bool grid, int32 particleCnt, int32 layers, int32 runs);
+	/// Times iterations FindContacts calls with the given neighbour skin.
+	float32 NeighbourList(float32 skin, int32 iterations, int32 runs);
+	/// Times steps of group churn on the free ranges of the particle slots,
+	/// without the system.
+	float32 FreeRanges(int32 groupCnt, int32 steps, int32 runs);
+	/// Times the integration passes, fused or one sweep per pass, on a falling
+	/// block of particleCnt particles.
+	float32 Integrate(bool fused, int32 particleCnt, int32 runs);
+	/// Times full sorts of the proxies with the 8 bit range limited sort or
+	/// the old 2 bit sort.
+	float32 SortProxies(bool wide, int32 runs);
+	/// Times ComputeDepth on a solid block of particleCnt particles.
+	float32 ComputeDepth(int32 particleCnt, int32 runs);
+	/// Steps a falling block of particleCnt particles of the material in
+	/// deterministic mode, once with threadCntA and once with threadCntB threads
+	/// of the cpu backend.
+	/// @return true if both runs end with the same positions and velocities.
+	bool Deterministic(int32 matIdx, int32 particleCnt, int32 steps, int32 threadCntA, int32 threadCntB);
+
+private:
+	/// Calls run() runs times on an idle device, with the scratch memory reset
+	/// before each call.
+	/// @return average milliseconds per run.
+	template<typename F> float32 Time(int32 runs, const F& run);
+	/// FNV-1a hash of the positions and velocities of the particles.
+	uint64 HashState();
+
+	ParticleSystem& m_system;
+};
@@ -29,31 +29,255 @@ inline bool Particle::Contact::ApproximatelyEqual(const Particle::Contact& rhs)
 
 Particle::ContactArrays::ContactArrays(const ampAccelView& accView, const Particle::AmpArrays& particleArrays) :
 	m_particleArrays(particleArrays),
-	m_cnt(accView, CONTACT_THREADS / TILE_SIZE),
+	m_count(0), m_capacity(0),
+	m_array(accView, MIN_PART_CAPACITY * MAX_CONTACTS_PER_PARTICLE),
 	m_idx(accView, MIN_PART_CAPACITY * MAX_CONTACTS_PER_PARTICLE),
-	m_perTile(accView, CONTACT_THREADS / TILE_SIZE, 1),
-	m_count(0), m_capacity(0), m_maxPerTile(1)
-{}
+	m_cnt(accView, MIN_PART_CAPACITY),
+	m_offset(accView, MIN_PART_CAPACITY),
+	m_overflow(accView, 1),
+	m_coloredIdx(accView, MIN_PART_CAPACITY * MAX_CONTACTS_PER_PARTICLE),
+	m_color(accView, MIN_PART_CAPACITY * MAX_CONTACTS_PER_PARTICLE),
+	m_colorClaim(accView, MIN_PART_CAPACITY),
+	m_colorCounter(accView, 1),
+	m_colorCursors(accView, MAX_CONTACT_COLORS + 1),
+	m_colorCnt(0), m_isColored(false), m_deterministic(false),
+	m_order(accView, MIN_PART_CAPACITY * MAX_CONTACTS_PER_PARTICLE),
+	m_sortBuffers(accView)
+{
+	std::fill(m_classCnts, m_classCnts + Class::Count, 0);
+	m_classIdx.reserve(Class::Count);
+	for (int32 c = 0; c < Class::Count; c++)
+		m_classIdx.emplace_back(accView);
+}
+
+const uint32 Particle::ContactArrays::k_classFlags[Class::Count] =
+{
+	Particle::Mat::Flag::StaticPressure,
+	Particle::Mat::Flag::Tensile,
+	Particle::Mat::Flag::Viscous,
+	Particle::Mat::Flag::Repulsive,
+	Particle::Mat::Flag::Powder,
+	Particle::Mat::Flag::HeatConducting,
+	Particle::Mat::Flag::Flame | Particle::Mat::Flag::Inflammable,
+	Particle::Flag::Burning | Particle::Mat::Flag::Extinguishing,
+};
 
 bool Particle::ContactArrays::Resize(int32 size)
 {
 	if (!AdjustCapacityToSize(m_capacity, size, MIN_PART_CAPACITY)) return false;
 
+	m_array.Resize(m_capacity);
 	m_idx.Resize(m_capacity);
-	m_maxPerTile = TILE_SIZE * m_particleArrays.m_iterations * MAX_CONTACTS_PER_PARTICLE;
-	m_perTile.Resize2ndDim(m_maxPerTile);
 
 	return true;
 }
 
+void Particle::ContactArrays::ResizeParticles(int32 particleCapacity)
+{
+	m_cnt.Resize(particleCapacity);
+	m_offset.Resize(particleCapacity);
+}
+
+void Particle::ContactArrays::Sort()
+{
+	if (Empty()) return;
+	m_order.Resize(m_capacity);
+	const int32 count = m_count;
+	auto idxs = m_idx.GetView();
+	auto contacts = m_array.GetConstView();
+	auto order = m_order.GetView();
+	// two stable sorts, by the second particle and then by the first, over the
+	// bits of the particle indices only
+	const uint32 keyBits = amp::radixSortKeyBits(0, m_particleArrays.m_count);
+	amp::forEach(count, [=](const int32 i) AMP_RESTRICT
+	{
+		const uint32 idx = idxs[i];
+		order[i].Set(idx, contacts[idx].idxB);
+	});
+	amp::radixSort(order, count, m_sortBuffers, 0, keyBits);
+	amp::forEach(count, [=](const int32 i) AMP_RESTRICT
+	{
+		const uint32 idx = order[i].idx;
+		order[i].tag = contacts[idx].idxA;
+	});
+	amp::radixSort(order, count, m_sortBuffers, 0, keyBits);
+	amp::forEach(count, [=](const int32 i) AMP_RESTRICT
+	{
+		idxs[i] = order[i].idx;
+	});
+}
+
+void Particle::ContactArrays::Color(const int32 maxColors)
+{
+	m_isColored = true;
+	m_colorCnt = 0;
+	m_colorOffsets.assign(1, 0);
+	if (Empty())
+	{
+		m_colorOffsets.push_back(0);
+		return;
+	}
+	m_coloredIdx.Resize(m_capacity);
+	m_color.Resize(m_capacity);
+	m_colorClaim.Resize(m_particleArrays.m_capacity);
+
+	m_colorCounter.Resize(maxColors + 1);
+	m_colorCursors.Resize(maxColors + 1);
+
+	const int32 count = m_count;
+	auto idxs = m_idx.GetConstView();
+	auto contacts = m_array.GetConstView();
+	auto colors = m_color.GetView();
+	auto claims = m_colorClaim.GetView();
+	amp::fill(m_color.arr, (int32)INVALID_IDX, count);
+	amp::fill(m_colorCounter.arr, 0, maxColors + 1);
+
+	// Each round, every uncolored contact bids the priority of each of its particles
+	// on the other one. Contacts whose particles bid on each other take the color.
+	// The priorities hash the particle indices with a seed per round, so the matches
+	// don't line up along the index order, which in a grid left few mutual bids.
+	// The particle with the highest priority and its highest neighbour always match,
+	// so every round colors at least one contact. The rounds don't read back how
+	// many contacts are left, so the colors after the last contact stay empty.
+	// Deterministic mode colors every contact, as the order of the atomics on the
+	// uncolored ones depends on the threads. It reads back the color counts after
+	// every maxColors rounds and runs more rounds while contacts are left.
+	const int32 particleCnt = m_particleArrays.m_count;
+	ampArrayView<int32> priorities = amp::scratch().Alloc<int32>(particleCnt);
+	int32 roundCnt = maxColors;
+	for (int32 color = 0; color < roundCnt; color++)
+	{
+		auto colorCnts = m_colorCounter.GetView();
+		const uint32 seed = (color * 0x2545F491u) & 0x7FFFFFFF;
+		amp::forEach(particleCnt, [=](const int32 i) AMP_RESTRICT
+		{
+			// a bijection on 31 bits, so no two particles share a priority
+			uint32 x = ((i ^ seed) * 0x9E3779B1u) & 0x7FFFFFFF;
+			x ^= x >> 15;
+			priorities[i] = (x * 0x85EBCA77u) & 0x7FFFFFFF;
+			claims[i] = INVALID_IDX;
+		});
+		amp::forEach(count, [=](const int32 i) AMP_RESTRICT
+		{
+			if (colors[i] != INVALID_IDX) return;
+			const uint32 idx = idxs[i];
+			const Contact& c = contacts[idx];
+			Concurrency::atomic_fetch_max(&claims[c.idxA], priorities[c.idxB]);
+			Concurrency::atomic_fetch_max(&claims[c.idxB], priorities[c.idxA]);
+		});
+		amp::forEach(count, [=](const int32 i) AMP_RESTRICT
+		{
+			if (colors[i] != INVALID_IDX) return;
+			const uint32 idx = idxs[i];
+			const Contact& c = contacts[idx];
+			if (claims[c.idxA] != priorities[c.idxB] || claims[c.idxB] != priorities[c.idxA]) return;
+			colors[i] = color;
+			amp::atomicInc(colorCnts[color]);
+		});
+		if (!m_deterministic || color + 1 < roundCnt) continue;
+		std::vector<int32> cnts(roundCnt);
+		amp::copy(m_colorCounter.arr, cnts, roundCnt);
+		int32 colored = 0;
+		for (const int32 cnt : cnts)
+			colored += cnt;
+		if (colored == count) break;
+		roundCnt += maxColors;
+		m_colorCounter.Resize(roundCnt + 1, color + 1);
+		amp::fill(m_colorCounter.arr, 0, color + 1, roundCnt + 1);
+	}
+
+	// One scan over the contacts per color gives the offsets of the colors. The
+	// uncolored slot counts 0, so its cursor starts after the colored contacts.
+	m_colorCursors.Resize(roundCnt + 1);
+	auto cursors = m_colorCursors.GetView();
+	amp::scan(m_colorCounter.GetConstView(), roundCnt + 1,
+		[=](const int32 c, const int32 wc) AMP_RESTRICT
+	{
+		cursors[c] = wc;
+	});
+	m_colorOffsets.resize(roundCnt + 1);
+	amp::copy(m_colorCursors.arr, m_colorOffsets, roundCnt + 1);
+	m_colorCnt = roundCnt;
+	while (m_colorCnt && m_colorOffsets[m_colorCnt - 1] == m_colorOffsets[m_colorCnt])
+		m_colorCnt--;
+	m_colorOffsets.resize(m_colorCnt + 1);
+	m_colorOffsets.push_back(count);
+
+	// Scatter the contacts into color order, the uncolored ones to the last range.
+	auto coloredIdxs = m_coloredIdx.GetView();
+	const int32 uncolored = m_colorCnt;
+	amp::forEach(count, [=](const int32 i) AMP_RESTRICT
+	{
+		const int32 color = colors[i] == INVALID_IDX ? uncolored : colors[i];
+		coloredIdxs[amp::atomicInc(cursors[color])] = idxs[i];
+	});
+}
+
+void Particle::ContactArrays::Classify(const uint32 allFlags)
+{
+	const int32 count = m_count;
+	const int32 offsetCnt = m_isColored ? m_colorCnt + 2 : 0;
+	ampArrayView<int32> colorOffsets = amp::scratch().Alloc<int32>(b2Max(offsetCnt, 1));
+	if (m_isColored)
+		amp::copy(m_colorOffsets, colorOffsets, offsetCnt);
+	auto idxs = m_isColored ? m_coloredIdx.GetConstView() : m_idx.GetConstView();
+	auto contacts = m_array.GetConstView();
+	ampArrayView<int32> inClass = amp::scratch().Alloc<int32>(count);
+	ampArrayView<int32> prefix = amp::scratch().Alloc<int32>(count);
+	for (int32 c = 0; c < Class::Count; c++)
+	{
+		const uint32 flags = k_classFlags[c];
+		// the particle flags like Burning are not always in allFlags
+		const uint32 matFlags = flags & Particle::Mat::k_mask;
+		amp::Array<uint32>& classIdx = m_classIdx[c];
+		m_classCnts[c] = 0;
+		if ((allFlags & matFlags) != matFlags || !count)
+		{
+			// Array keeps its minimum capacity
+			classIdx.Resize(0);
+			m_classColorOffsets[c].assign(offsetCnt, 0);
+			continue;
+		}
+		classIdx.Resize(m_capacity);
+		amp::forEach(count, [=](const int32 i) AMP_RESTRICT
+		{
+			inClass[i] = contacts[idxs[i]].HasFlags(flags);
+		});
+		auto classIdxs = classIdx.GetView();
+		const int32 classCnt = amp::scan(ampArrayView<const int32>(inClass), count,
+			[=](const int32 i, const int32 wi) AMP_RESTRICT
+		{
+			prefix[i] = wi;
+			if (inClass[i]) classIdxs[wi] = idxs[i];
+		});
+		m_classCnts[c] = classCnt;
+		if (!m_isColored) continue;
+
+		// the class contacts before each color offset
+		ampArrayView<int32> classOffsets = amp::scratch().Alloc<int32>(offsetCnt);
+		amp::forEach(offsetCnt, [=](const int32 o) AMP_RESTRICT
+		{
+			const int32 offset = colorOffsets[o];
+			classOffsets[o] = offset < count ? prefix[offset] : classCnt;
+		});
+		m_classColorOffsets[c].resize(offsetCnt);
+		amp::copy(classOffsets, m_classColorOffsets[c]);
+	}
+}
+
 
 Particle::BodyContactArrays::BodyContactArrays(const ampAccelView& accView,
 	const Particle::AmpArrays& particleArrays) :
 	m_particleArrays(particleArrays),
+	m_count(0), m_capacity(0),
 	m_array(accView),
-	m_cnt(accView),
 	m_idx(accView, MIN_PART_CAPACITY * MAX_BODY_CONTACTS_PER_PARTICLE),
-	m_count(0), m_capacity(0)
+	m_cnt(accView),
+	m_offset(accView),
+	m_deterministic(false),
+	m_impulses(accView, MIN_PART_CAPACITY * MAX_BODY_CONTACTS_PER_PARTICLE),
+	m_bodyOrder(accView, MIN_PART_CAPACITY * MAX_BODY_CONTACTS_PER_PARTICLE),
+	m_bodySortBuffers(accView)
 {}
 
 void Particle::BodyContactArrays::Resize(int32 size)
@@ -61,16 +285,19 @@ void Particle::BodyContactArrays::Resize(int32 size)
 	if (!AdjustCapacityToSize(m_capacity, size, MIN_PART_CAPACITY)) return;
 
 	m_idx.Resize(m_capacity);
+	m_impulses.Resize(m_capacity);
+	m_bodyOrder.Resize(m_capacity);
 	m_array.Resize(m_particleArrays.m_capacity);
 	m_cnt.Resize(m_particleArrays.m_capacity);
+	m_offset.Resize(m_particleArrays.m_capacity);
 }
 
 
 Particle::GroundContactArrays::GroundContactArrays(const ampAccelView& accView,
 	const Particle::AmpArrays& particleArrays) :
 	m_particleArrays(particleArrays),
-	m_array(accView),
-	m_count(0), m_capacity(0)
+	m_count(0), m_capacity(0),
+	m_array(accView)
 {}
 
 void Particle::GroundContactArrays::Resize(int32 size)
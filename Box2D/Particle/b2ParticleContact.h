@@ -21,18 +21,21 @@
 #include <Box2D/Common/b2Settings.h>
 #include <Box2D/Common/b2IntrusiveList.h>
 #include <Box2D/Particle/b2Particle.h>
+#include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Amp/ampAlgorithms.h>
 #include <vector>
+#ifndef AMP_CPU_BACKEND
 #include <d3d11.h>
 #include <amp.h>
+#endif
 
 namespace Particle
 {
 	struct ContactIdx
 	{
 		int32 i, j;
-		ContactIdx(int32 i, int32 j) restrict(amp) : i(i), j(j) {}
-		void Set(int32 newI, int32 newJ) restrict(amp) { i = newI; j = newJ; }
+		ContactIdx(int32 i, int32 j) AMP_RESTRICT : i(i), j(j) {}
+		void Set(int32 newI, int32 newJ) AMP_RESTRICT { i = newI; j = newJ; }
 	};
 
 	struct BodyContact
@@ -56,15 +59,82 @@ namespace Particle
 		/// The effective mass used in calculating force.
 		float32 mass;
 
-		inline void AddFlag(const uint32 f) restrict(amp) { flags |= f; }
-		inline bool HasFlag(const uint32 f) const restrict(amp) { return flags & f; }
-		inline bool IsReal() const restrict(amp) { return flags & Touching; }
+		inline void AddFlag(const uint32 f) AMP_RESTRICT { flags |= f; }
+		inline bool HasFlag(const uint32 f) const AMP_RESTRICT { return flags & f; }
+		inline bool IsReal() const AMP_RESTRICT { return flags & Touching; }
 	};
 	struct BodyContacts
 	{
 		BodyContact contacts[MAX_BODY_CONTACTS_PER_PARTICLE];
 	};
 
+	/// What a body contact does to its body, see BodyContactArrays::ForEachApply.
+	struct BodyImpulse
+	{
+		enum Flag
+		{
+			Impulse = 1 << 0,
+			Heat = 1 << 1
+		};
+
+		Vec3 impulse;
+		Vec2 point;
+		float32 heat;
+		uint32 flags;
+
+		BodyImpulse() : flags(0) {}
+#ifndef AMP_CPU_BACKEND
+		BodyImpulse() AMP_RESTRICT : flags(0) {}
+#endif
+
+		void Set(const Vec3& newImpulse, const Vec2& newPoint) AMP_RESTRICT
+		{
+			impulse = newImpulse;
+			point = newPoint;
+			flags |= Impulse;
+		}
+		void SetHeat(const float32 newHeat) AMP_RESTRICT
+		{
+			heat = newHeat;
+			flags |= Heat;
+		}
+		void ApplyTo(Body& b, const bool atomic) const AMP_RESTRICT
+		{
+			if (flags & Impulse) b.ApplyLinearImpulse(impulse, point, true);
+			if (flags & Heat) amp::add(b.m_surfaceHeat, heat, atomic);
+		}
+	};
+	/// A BodyImpulse as the change of momentum around the body center, so the
+	/// impulses of a body can be summed up before they are applied.
+	struct BodyImpulseSum
+	{
+		Vec3 linear;
+		float32 angular;
+		float32 heat;
+		uint32 flags;
+
+		void Set(const BodyImpulse& i, const Body& b) AMP_RESTRICT
+		{
+			flags = i.flags;
+			linear = flags & BodyImpulse::Impulse ? i.impulse : Vec3(0, 0, 0);
+			angular = flags & BodyImpulse::Impulse ? b2Cross(i.point - b.m_sweep.c, (Vec2)i.impulse) : 0;
+			heat = flags & BodyImpulse::Heat ? i.heat : 0;
+		}
+		BodyImpulseSum& operator+=(const BodyImpulseSum& s) AMP_RESTRICT
+		{
+			linear += s.linear;
+			angular += s.angular;
+			heat += s.heat;
+			flags |= s.flags;
+			return *this;
+		}
+		void ApplyTo(Body& b) const AMP_RESTRICT
+		{
+			if (flags & BodyImpulse::Impulse) b.ApplyImpulse(linear, angular, true);
+			if (flags & BodyImpulse::Heat) b.m_surfaceHeat += heat;
+		}
+	};
+
 	struct GroundContact
 	{
 		int32 groundTileIdx;
@@ -75,9 +145,13 @@ namespace Particle
 		float32 mass;
 
 		void setInvalid() { groundTileIdx = INVALID_IDX; }
-		void setInvalid() restrict(amp) { groundTileIdx = INVALID_IDX; }
+#ifndef AMP_CPU_BACKEND
+		void setInvalid() AMP_RESTRICT { groundTileIdx = INVALID_IDX; }
+#endif
 		bool getValid() const { return groundTileIdx != INVALID_IDX; }
-		bool getValid() const restrict(amp) { return groundTileIdx != INVALID_IDX; }
+#ifndef AMP_CPU_BACKEND
+		bool getValid() const AMP_RESTRICT { return groundTileIdx != INVALID_IDX; }
+#endif
 	};
 
 	struct Contact
@@ -94,11 +168,13 @@ namespace Particle
 		/// See the b2ParticleFlag enum.
 		uint32 flags;
 
-		Contact() restrict(amp) : idxA(INVALID_IDX), idxB(INVALID_IDX), weight(0), mass(0), normal(), flags(0) {}
+#ifndef AMP_CPU_BACKEND
+		Contact() AMP_RESTRICT : idxA(INVALID_IDX), idxB(INVALID_IDX), weight(0), mass(0), normal(), flags(0) {}
+#endif
 		Contact() : idxA(INVALID_IDX), idxB(INVALID_IDX), weight(0), mass(0), normal(), flags(0) {}
 
 		Contact(int32 idxA, int32 idxB, float32 weight, float32 mass,
-			Vec3 normal, uint32 flags) restrict(amp) :
+			Vec3 normal, uint32 flags) AMP_RESTRICT :
 			idxA(idxA), idxB(idxB), weight(weight), mass(mass),
 			normal(normal), flags(flags)
 		{}
@@ -109,10 +185,14 @@ namespace Particle
 		bool ApproximatelyEqual(const Contact& rhs) const;
 
 		inline bool HasFlag(const uint32 f) const { return flags & f; }
-		inline bool HasFlag(const uint32 f) const restrict(amp) { return flags & f; }
+#ifndef AMP_CPU_BACKEND
+		inline bool HasFlag(const uint32 f) const AMP_RESTRICT { return flags & f; }
+#endif
 		inline bool HasFlags(const uint32 f) const { return (flags & f) == f; }
-		inline bool HasFlags(const uint32 f) const restrict(amp) { return (flags & f) == f; }
-		inline bool IsZombie() const restrict(amp) { return HasFlag(Particle::Flag::Zombie); }
+#ifndef AMP_CPU_BACKEND
+		inline bool HasFlags(const uint32 f) const AMP_RESTRICT { return (flags & f) == f; }
+#endif
+		inline bool IsZombie() const AMP_RESTRICT { return HasFlag(Particle::Flag::Zombie); }
 	};
 
 	class ContactArrays
@@ -120,46 +200,127 @@ namespace Particle
 	public:
 		const Particle::AmpArrays& m_particleArrays;
 		int32 m_count, m_capacity;
-		uint32 m_maxPerTile;
 
+		// FindContacts counts the contacts of each proxy into m_cnt, scans them into
+		// m_offset and then writes them to m_array, which holds exactly m_count contacts.
+		amp::Array<Contact> m_array;
 		amp::Array<uint32> m_idx;
 		amp::Array<int32> m_cnt;
-		amp::Array2D<Contact> m_perTile;
+		amp::Array<int32> m_offset;
+		// contacts beyond MAX_CONTACTS_PER_PARTICLE of a particle, summed up
+		amp::Array<int32> m_overflow;
+
+		// Contact coloring: m_coloredIdx holds the values of m_idx ordered by color. No two
+		// contacts of a color share a particle, so a color can be solved without atomics.
+		// Range m_colorCnt of m_colorOffsets holds the contacts left uncolored.
+		amp::Array<uint32> m_coloredIdx;
+		amp::Array<int32> m_color;
+		amp::Array<int32> m_colorClaim;
+		amp::Array<int32> m_colorCounter;	// contacts per color
+		amp::Array<int32> m_colorCursors;
+		std::vector<int32> m_colorOffsets;
+		int32 m_colorCnt;
+		bool m_isColored;
+		// In deterministic mode Color colors every contact, so the uncolored range
+		// is empty.
+		bool m_deterministic;
+		amp::Array<Proxy> m_order;
+		amp::RadixSortBuffers m_sortBuffers;
+
+		// Interaction classes: Classify() compacts the contacts that have all flags of a
+		// class into its list, in the order of m_coloredIdx if colored. The per class color
+		// offsets then split the list into the ranges ColoredForEach runs.
+		struct Class
+		{
+			enum
+			{
+				StaticPressure,
+				Tensile,
+				Viscous,
+				Repulsive,
+				Powder,
+				HeatConducting,
+				Ignite,			// Flame | Inflammable
+				Extinguish,		// Burning | Extinguishing
+				Count
+			};
+		};
+		static const uint32 k_classFlags[Class::Count];
+		std::vector<amp::Array<uint32>> m_classIdx;
+		std::vector<int32> m_classColorOffsets[Class::Count];
+		int32 m_classCnts[Class::Count];
 
 		ContactArrays(const ampAccelView& accelView, const Particle::AmpArrays& particleArrays);
 
 		bool Empty() const { return m_count == 0; }
 		bool Resize(int32 size);
+		void ResizeParticles(int32 particleCapacity);
+		/// Contacts a search capped at MAX_CONTACTS_PER_PARTICLE would have dropped in the last FindContacts.
+		int32 GetOverflowCount() const { return amp::getValue(m_overflow.arr, 0); }
+		// Sorts m_idx by particle pair, which FindContacts doesn't fill in a fixed order.
+		void Sort();
+		// The colors only depend on the set of contacts, not on their order.
+		void Color(const int32 maxColors = MAX_CONTACT_COLORS);
+		void ClearColors() { m_isColored = false; }
+		bool IsColored() const { return m_isColored; }
+		/// Builds the class lists after the contacts are colored or not. Classes whose
+		/// material flags are not all in allFlags are left empty and release their list.
+		void Classify(const uint32 allFlags);
+		int32 GetClassCount(const int32 contactClass) const { return m_classCnts[contactClass]; }
 
 		template<typename F> void ForEach(const F& function)  const
 		{
 			auto idxs = m_idx.GetConstView();
-			auto contacts = m_perTile.GetConstView();
-			const uint32 maxPerTile = m_maxPerTile;
-			amp::forEach(m_count, [=](const int32 i) restrict(amp)
+			auto contacts = m_array.GetConstView();
+			amp::forEach(m_count, [=](const int32 i) AMP_RESTRICT
 			{
 				const uint32 idx = idxs[i];
-				function(contacts[idx / maxPerTile][idx % maxPerTile]);
+				function(contacts[idx]);
 			});
 		}
 		template<typename F> void ForEach(const uint32 flag, const F& function) const
 		{
-			ForEach([=](const Particle::Contact& contact) restrict(amp)
+			ForEach([=](const Particle::Contact& contact) AMP_RESTRICT
 			{
 				if (contact.HasFlags(flag)) function(contact);
 			});
 		}
+		/// ForEach over the contacts of a class.
+		template<typename F> void ForEachInClass(const int32 contactClass, const F& function) const
+		{
+			auto idxs = m_classIdx[contactClass].GetConstView();
+			auto contacts = m_array.GetConstView();
+			amp::forEach(m_classCnts[contactClass], [=](const int32 i) AMP_RESTRICT
+			{
+				const uint32 idx = idxs[i];
+				function(contacts[idx]);
+			});
+		}
+		// amp::forEachTarget over the contacts with record(contact, values).
+		template<int32 N, typename T, typename F1, typename F2>
+		void ForEachTarget(const F1& record, const F2& apply, const bool ordered,
+			amp::RadixSortBuffers& buffers, const uint32 keyBits) const
+		{
+			auto idxs = m_idx.GetConstView();
+			auto contacts = m_array.GetConstView();
+			amp::forEachTarget<N, T>(m_count, [=](const int32 i, amp::TargetValues<N, T>& values) AMP_RESTRICT
+			{
+				const uint32 idx = idxs[i];
+				record(contacts[idx], values);
+			}, apply, ordered, buffers, keyBits);
+		}
 		template<typename F> void ShuffledForEach(const F& function) const
 		{
-			const int32 count = m_count;
+			ShuffledForEach(m_idx.GetConstView(), m_count, function);
+		}
+		template<typename F> void ShuffledForEach(const ampArrayView<const uint32>& idxs, const int32 count,
+			const F& function) const
+		{
 			const uint32 blockSize = amp::getTileCount(count);
 
-			//auto& contacts = m_ampContacts;
-			auto idxs = m_idx.GetConstView();
-			auto contacts = m_perTile.GetConstView();
-			const uint32 maxPerTile = m_maxPerTile;
-			amp::forEachTiledWithBarrier(m_count,
-				[=](const ampTiledIdx<TILE_SIZE>& tIdx) restrict(amp)
+			auto contacts = m_array.GetConstView();
+			amp::forEachTiledWithBarrier(count,
+				[=](const ampTiledIdx<TILE_SIZE>& tIdx) AMP_RESTRICT
 			{
 				const uint32 gi = tIdx.global[0];
 				const uint32 li = gi % blockSize;
@@ -171,18 +332,64 @@ namespace Particle
 				const uint32 shuffledbi = bis * MAX_CONTACTS_PER_PARTICLE + lis;
 				const uint32 shuffledIdx = shuffledbi * blockSize + li;
 
-				if (shuffledIdx >= count) return;
+				if (shuffledIdx >= (uint32)count) return;
 				const uint32 idx = idxs[shuffledIdx];
-				function(contacts[idx / maxPerTile][idx % maxPerTile]);
+				function(contacts[idx]);
 			});
 		}
 		template<typename F> void ShuffledForEach(const uint32 flag, const F& function) const
 		{
-			ShuffledForEach([=](const Particle::Contact& c) restrict(amp)
+			ShuffledForEach([=](const Particle::Contact& c) AMP_RESTRICT
 			{
 				if (c.flags & flag) function(c);
 			});
 		}
+		// Applies several per-contact functions in one traversal, in argument order for each
+		// contact. Only combine functions that don't need the complete results of each other.
+		template<typename... Fs> static auto Fuse(const Fs&... functions)
+		{
+			return [=](const Particle::Contact& c) AMP_RESTRICT
+			{
+				(functions(c), ...);
+			};
+		}
+		// Runs function one color after another, atomicFunction on the uncolored rest.
+		template<typename F1, typename F2> void ColoredForEach(const F1& function, const F2& atomicFunction) const
+		{
+			ColoredForEach(m_coloredIdx.GetConstView(), m_colorOffsets, function, atomicFunction);
+		}
+		template<typename F1, typename F2> void ColoredForEach(const ampArrayView<const uint32>& idxs,
+			const std::vector<int32>& offsets, const F1& function, const F2& atomicFunction) const
+		{
+			auto contacts = m_array.GetConstView();
+			for (int32 c = 0; c < m_colorCnt; c++)
+			{
+				amp::forEach(offsets[c], offsets[c + 1], [=](const int32 i) AMP_RESTRICT
+				{
+					const uint32 idx = idxs[i];
+					function(contacts[idx]);
+				});
+			}
+			// empty in deterministic mode, see Color
+			amp::forEach(offsets[m_colorCnt], offsets[m_colorCnt + 1], [=](const int32 i) AMP_RESTRICT
+			{
+				const uint32 idx = idxs[i];
+				atomicFunction(contacts[idx]);
+			});
+		}
+		// ColoredForEach if colored, else ShuffledForEach with atomicFunction,
+		// over the contacts of a class.
+		template<typename F1, typename F2> void ClassForEach(const int32 contactClass,
+			const F1& function, const F2& atomicFunction) const
+		{
+			const int32 cnt = m_classCnts[contactClass];
+			if (!cnt) return;
+			auto idxs = m_classIdx[contactClass].GetConstView();
+			if (m_isColored)
+				ColoredForEach(idxs, m_classColorOffsets[contactClass], function, atomicFunction);
+			else
+				ShuffledForEach(idxs, cnt, atomicFunction);
+		}
 	};
 
 	class BodyContactArrays
@@ -194,6 +401,14 @@ namespace Particle
 		amp::Array<BodyContacts> m_array;
 		amp::Array<ContactIdx> m_idx;
 		amp::Array<int32> m_cnt;
+		amp::Array<int32> m_offset;	// of the contacts of each particle in m_idx
+
+		// In deterministic mode each particle runs its contacts in order, and
+		// ForEachApply sums the impulses of each body in particle order, see amp::reduceRuns.
+		bool m_deterministic;
+		amp::Array<BodyImpulseSum> m_impulses;
+		amp::Array<Proxy> m_bodyOrder;
+		amp::RadixSortBuffers m_bodySortBuffers;
 
 		BodyContactArrays(const ampAccelView& accelView,
 			const Particle::AmpArrays& particleArrays);
@@ -205,16 +420,88 @@ namespace Particle
 		{
 			auto idxs = m_idx.GetConstView();
 			auto bodyContacts = m_array.GetConstView();
-			amp::forEach(m_count, [=](const int32 i) restrict(amp)
+			if (m_deterministic)
+			{
+				auto cnts = m_cnt.GetConstView();
+				amp::forEach(m_particleArrays.m_count, [=](const int32 i) AMP_RESTRICT
+				{
+					for (int32 j = 0; j < cnts[i]; j++)
+						function(i, bodyContacts[i].contacts[j]);
+				});
+				return;
+			}
+			amp::forEach(m_count, [=](const int32 i) AMP_RESTRICT
 			{
 				const Particle::ContactIdx idx = idxs[i];
 				const Particle::BodyContact& c = bodyContacts[idx.i].contacts[idx.j];
 				function(idx.i, c);
 			});
 		}
+		// amp::forEachTarget over the real contacts with record(i, contact, values).
+		template<int32 N, typename T, typename F1, typename F2>
+		void ForEachTarget(const F1& record, const F2& apply, const bool ordered,
+			amp::RadixSortBuffers& buffers, const uint32 keyBits) const
+		{
+			auto idxs = m_idx.GetConstView();
+			auto bodyContacts = m_array.GetConstView();
+			amp::forEachTarget<N, T>(m_count, [=](const int32 k, amp::TargetValues<N, T>& values) AMP_RESTRICT
+			{
+				const Particle::ContactIdx idx = idxs[k];
+				const Particle::BodyContact& c = bodyContacts[idx.i].contacts[idx.j];
+				if (c.IsReal()) record(idx.i, c, values);
+			}, apply, ordered, buffers, keyBits);
+		}
+		// Runs function(i, contact, impulse) for each real contact and applies the
+		// impulses to the bodies.
+		template<typename F> void ForEachApply(const ampArrayView<Body>& bodies, const F& function)
+		{
+			if (!m_deterministic)
+			{
+				ForEach([=](const int32 i, const Particle::BodyContact& c) AMP_RESTRICT
+				{
+					Particle::BodyImpulse impulse;
+					function(i, c, impulse);
+					impulse.ApplyTo(bodies[c.bodyIdx], true);
+				});
+				return;
+			}
+			if (Empty()) return;
+			auto bodyContacts = m_array.GetConstView();
+			auto cnts = m_cnt.GetConstView();
+			auto offsets = m_offset.GetConstView();
+			auto impulses = m_impulses.GetView();
+			auto order = m_bodyOrder.GetView();
+			amp::forEach(m_particleArrays.m_count, [=](const int32 i) AMP_RESTRICT
+			{
+				for (int32 j = 0, k = offsets[i]; j < cnts[i]; j++, k++)
+				{
+					const Particle::BodyContact& c = bodyContacts[i].contacts[j];
+					Particle::BodyImpulse impulse;
+					if (c.IsReal()) function(i, c, impulse);
+					impulses[k].Set(impulse, bodies[c.bodyIdx]);
+					order[k].Set(k, c.bodyIdx);
+				}
+			});
+			// stable, so each body keeps its impulses in particle order
+			amp::radixSort(order, m_count, m_bodySortBuffers, 0, amp::radixSortKeyBits(0, bodies.extent[0]));
+			amp::reduceRuns(ampArrayView<const Proxy>(order), ampArrayView<const BodyImpulseSum>(impulses), m_count,
+				[=](const uint32 bodyIdx, const BodyImpulseSum& sum) AMP_RESTRICT
+			{
+				sum.ApplyTo(bodies[bodyIdx]);
+			});
+		}
+		template<typename F> void ForEachApply(const uint32 flag, const ampArrayView<Body>& bodies, const F& function)
+		{
+			auto flags = m_particleArrays.m_flags.GetConstView();
+			ForEachApply(bodies, [=](const int32 i, const Particle::BodyContact& contact,
+				Particle::BodyImpulse& impulse) AMP_RESTRICT
+			{
+				if (flags[i] & flag) function(i, contact, impulse);
+			});
+		}
 		template<typename F> void ForEach(const F& function) const
 		{
-			ForEachPotential([=](const int32 i, const Particle::BodyContact& c) restrict(amp)
+			ForEachPotential([=](const int32 i, const Particle::BodyContact& c) AMP_RESTRICT
 			{
 				if (c.IsReal()) function(i, c);
 			});
@@ -222,7 +509,7 @@ namespace Particle
 		template<typename F> void ForEach(const uint32 flag, const F& function) const
 		{
 			auto flags = m_particleArrays.m_flags.GetConstView();
-			ForEach([=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+			ForEach([=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
 			{
 				if (flags[i] & flag) function(i, contact);
 			});
@@ -243,7 +530,7 @@ namespace Particle
 		template<typename F> void ForEach(const F& function) const
 		{
 			auto groundContacts = m_array.GetConstView();
-			amp::forEach(m_particleArrays.m_count, [=](const int32 i) restrict(amp)
+			amp::forEach(m_particleArrays.m_count, [=](const int32 i) AMP_RESTRICT
 			{
 				const Particle::GroundContact& contact = groundContacts[i];
 				if (!contact.getValid()) return;
@@ -254,7 +541,7 @@ namespace Particle
 		{
 			auto groundContacts = m_array.GetConstView();
 			auto flags = m_particleArrays.m_flags.GetConstView();
-			amp::forEach(m_particleArrays.m_count, [=](const int32 i) restrict(amp)
+			amp::forEach(m_particleArrays.m_count, [=](const int32 i) AMP_RESTRICT
 			{
 				if (!(flags[i] & partFlag)) return;
 				const Particle::GroundContact& contact = groundContacts[i];
@@ -119,7 +119,9 @@ struct ParticleGroup
 	/// Get the construction flags for the group.
 	uint32 GetGroupFlags() const;
 	inline bool HasFlag(uint32 flag) const { return m_groupFlags & flag; }
-	inline bool HasFlag(uint32 flag) const restrict(amp) { return m_groupFlags & flag; }
+#ifndef AMP_CPU_BACKEND
+	inline bool HasFlag(uint32 flag) const AMP_RESTRICT { return m_groupFlags & flag; }
+#endif
 	
 	int32 GetMaterialIdx() const;
 
@@ -157,7 +159,7 @@ struct ParticleGroup
 		m_angularVelocity = 0;
 		m_transform.SetIdentity();
 
-		m_userData = NULL;
+		m_userData = 0;
 	};
 
 	//b2ParticleSystem* m_system;
@@ -24,8 +24,10 @@
 #include <Box2D/Dynamics/Ground.h>
 #include <Box2D/Dynamics/b2WorldCallbacks.h>
 #include <algorithm>
+#ifndef AMP_CPU_BACKEND
 #include <intrin.h>
 #include <ppl.h>
+#endif
 
 // Define LIQUIDFUN_SIMD_TEST_VS_REFERENCE to run both SIMD and reference
 // versions, and assert that the results are identical. This is useful when
@@ -45,10 +47,17 @@ static const uint32 tagBits = 8u * sizeof(uint32);
 static const uint32 yOffset = 1u << (yTruncBits - 1u);
 static const uint32 yShift = tagBits - yTruncBits;
 static const uint32 xShift = tagBits - yTruncBits - xTruncBits;
-static const uint32 xScale = 1u << xShift;
-static const uint32 xOffset = xScale * (1u << (xTruncBits - 1u));
+static const uint32 xOffset = 1u << (xTruncBits - 1u);
 static const uint32 yMask = ((1u << yTruncBits) - 1u) << yShift;
 static const uint32 xMask = ~yMask;
+// The bits below x hold the height layer of the particle and below them the
+// x position inside the cell. Layers are one diameter high and wrap around, so
+// particles zLayerCnt layers apart are in the same layer.
+static const uint32 cellTagMask = (1u << xShift) - 1u;
+static const uint32 xFracBits = 2;
+static const uint32 xFracMask = (1u << xFracBits) - 1u;
+static const uint32 zShift = xFracBits;
+static const uint32 zLayerCnt = 1u << (xShift - xFracBits);
 static const uint32 relativeTagRight = 1u << xShift;
 static const uint32 relativeTagBottomLeft = (uint32)((1 << yShift) +
                                                     (-1 << xShift));
@@ -64,7 +73,7 @@ class b2ParticleBodyContactRemovePredicate
 public:
 	b2ParticleBodyContactRemovePredicate(b2World& world, ParticleSystem& system,
 										 int32* discarded)
-		: m_world(world), m_system(system), m_lastIndex(-1), m_currentContacts(0),
+		: m_system(system), m_world(world), m_lastIndex(-1), m_currentContacts(0),
 		  m_discarded(discarded) {}
 
 	/*bool operator()(const Particle::BodyContact& contact)
@@ -322,7 +331,7 @@ public:
 	// if it's not present.
 	// NOTE: This was not written as a template function to avoid
 	// exposing any dependencies via this header.
-	int32 Find(const FixtureParticle& fixtureParticle) const;
+	[[maybe_unused]] int32 Find(const FixtureParticle& fixtureParticle) const;
 };
 
 // Set of particle / particle pairs.
@@ -342,26 +351,73 @@ public:
 	// if it's not present.
 	// NOTE: This was not written as a template function to avoid
 	// exposing any dependencies via this header.
-	int32 Find(const ParticlePair& pair) const;
+	[[maybe_unused]] int32 Find(const ParticlePair& pair) const;
 };
 
+// Tag of the lowest layer of the cell, computeUpperTag gives the highest.
+// Bounds in x and y take whole cells with them.
 static inline uint32 computeTag(float32 x, float32 y)
 {
-	return ((uint32)(y + yOffset) << yShift) + (uint32)(xScale * x + xOffset);
+	return ((uint32)(y + yOffset) << yShift) + ((uint32)(x + xOffset) << xShift);
+}
+#ifndef AMP_CPU_BACKEND
+static inline uint32 computeTag(float32 x, float32 y) AMP_RESTRICT
+{
+	return ((uint32)(y + yOffset) << yShift) + ((uint32)(x + xOffset) << xShift);
+}
+#endif
+static inline uint32 computeUpperTag(float32 x, float32 y)
+{
+	return computeTag(x, y) + cellTagMask;
+}
+#ifndef AMP_CPU_BACKEND
+static inline uint32 computeUpperTag(float32 x, float32 y) AMP_RESTRICT
+{
+	return computeTag(x, y) + cellTagMask;
 }
-static inline uint32 computeTag(float32 x, float32 y) restrict(amp)
+#endif
+static inline uint32 computeTag(float32 x, float32 y, float32 z) AMP_RESTRICT
 {
-	return ((uint32)(y + yOffset) << yShift) + (uint32)(xScale * x + xOffset);
+	const uint32 layer = (uint32)(int32)ampFloor(z) & (zLayerCnt - 1);
+	const uint32 xFrac = (uint32)((x + xOffset) * (1u << xFracBits)) & xFracMask;
+	return computeTag(x, y) + (layer << zShift) + xFrac;
 }
 
 static inline uint32 computeRelativeTag(uint32 tag, int32 x, int32 y)
 {
 	return tag + (y << yShift) + (x << xShift);
 }
-static inline uint32 computeRelativeTag(uint32 tag, uint32 x, uint32 y) restrict(amp)
+static inline uint32 computeRelativeTag(uint32 tag, uint32 x, uint32 y) AMP_RESTRICT
 {
 	return tag + (y << yShift) + (x << xShift);
 }
+// Tag of the neighbour cell (x, y) at the layer and the x position xFrac in it.
+static inline uint32 computeRelativeTag(uint32 tag, uint32 x, uint32 y, uint32 layer, uint32 xFrac) AMP_RESTRICT
+{
+	return (computeRelativeTag(tag, x, y) & ~cellTagMask) + (layer << zShift) + xFrac;
+}
+// The layers next to the layer of tag in tag order, k = 0, 1, 2.
+static inline uint32 computeNeighbourLayer(uint32 tag, int32 k) AMP_RESTRICT
+{
+	const uint32 layer = (tag >> zShift) & (zLayerCnt - 1);
+	if (layer == 0) return k == 2 ? zLayerCnt - 1 : k;
+	if (layer == zLayerCnt - 1) return k == 0 ? 0 : layer - 2 + k;
+	return layer - 1 + k;
+}
+
+// Bucket of the grid cell (x, y, z) in the cell list of FindContacts. The
+// cells of a column are in consecutive buckets, whose particles follow each
+// other in the list.
+static inline uint32 computeCellHash(int32 x, int32 y, int32 z, uint32 mask) AMP_RESTRICT
+{
+	return (((uint32)x * 73856093u ^ (uint32)y * 19349663u) + (uint32)z) & mask;
+}
+// The low 10 bits of x, y and z of a grid cell. Cells with the same key are
+// too far apart for a contact.
+static inline uint32 computeCellKey(int32 x, int32 y, int32 z) AMP_RESTRICT
+{
+	return ((uint32)x & 1023u) | ((uint32)y & 1023u) << 10 | ((uint32)z & 1023u) << 20;
+}
 
 ParticleSystem::InsideBoundsEnumerator::InsideBoundsEnumerator(
 	uint32 lower, uint32 upper, const Proxy* first, const Proxy* last)
@@ -395,34 +451,67 @@ int32 ParticleSystem::InsideBoundsEnumerator::GetNext()
 }
 
 ParticleSystem::ParticleSystem(b2World& world, b2TimeStep& step, vector<Body>& bodyBuffer, vector<Fixture>& fixtureBuffer) :
-	m_handleAllocator(MIN_PART_CAPACITY),
-	m_ampGroups(b2_minGroupBufferCapacity, amp::accelView()),
-	m_ampGroupHasAlive(b2_minGroupBufferCapacity, amp::accelView()),
+	m_step(step),
+
+	// Particles
+	m_buffers(MIN_PART_CAPACITY),
+	m_mats(amp::accelView()),
+	m_ampParts(amp::accelView()),
+	m_ampContacts(amp::accelView(), m_ampParts),
+	m_ampBodyContacts(amp::accelView(), m_ampParts),
+	m_ampGroundContacts(amp::accelView(), m_ampParts),
+	m_proxySortBuffers(amp::accelView()),
+	m_depthSortBuffers(amp::accelView()),
+	m_targetSortBuffers(amp::accelView()),
+	m_tagRange(amp::accelView(), 2),
+	m_proxyOutOfOrder(amp::accelView(), 1),
+	m_proxyCount(0), m_proxiesCoherent(false),
+	m_proxySortPathCnts{},
+	m_reorder(amp::accelView()),
+	m_reorderIdx(amp::accelView()),
+	m_cellCnt(amp::accelView()),
+	m_cellStart(amp::accelView()),
+	m_cellEnd(amp::accelView()),
+	m_cellParticles(amp::accelView()),
+	m_cellKeys(amp::accelView()),
+	m_cellZRange(amp::accelView(), 2),
+	m_cellMask(0), m_cellZSpan(0), m_cellsLayered(false),
+	m_neighbours(amp::accelView()),
+	m_neighbourHit(amp::accelView()),
+	m_neighbourOffset(amp::accelView()),
+	m_neighbourPositions(amp::accelView()),
+	m_neighbourMoved(amp::accelView(), 1),
+	m_neighbourCount(0), m_neighbourCapacity(0), m_neighbourParticleCount(0),
+	m_neighboursValid(false),
+	m_matChanges(amp::accelView()),
+	m_matChangeCnt(amp::accelView(), 1),
+	m_events(amp::accelView()),
+	m_eventCnt(amp::accelView(), 1),
+	m_eventCntHost(0),
 
 	// Box2D
+	m_ampFixtures(TILE_SIZE, amp::accelView()),
 	m_ampBodies(TILE_SIZE, amp::accelView()),
 	m_ampBodyParticles(TILE_SIZE, amp::accelView()),
-	m_ampFixtures(TILE_SIZE, amp::accelView()),
 	m_ampChainShapes(TILE_SIZE, amp::accelView()),
 	m_ampCircleShapes(TILE_SIZE, amp::accelView()),
 	m_ampEdgeShapes(TILE_SIZE, amp::accelView()),
 	m_ampPolygonShapes(TILE_SIZE, amp::accelView()),
 
-	// Particles
-	m_buffers(MIN_PART_CAPACITY),
-	m_ampParts(amp::accelView()),
-	m_ampContacts(amp::accelView(), m_ampParts),
-	m_ampBodyContacts(amp::accelView(), m_ampParts),
-	m_ampGroundContacts(amp::accelView(), m_ampParts),
-
-	// Materials
-	m_mats(amp::accelView()),
+	m_handleAllocator(MIN_PART_CAPACITY),
+	m_ampGroups(b2_minGroupBufferCapacity, amp::accelView()),
+	m_ampGroupAliveCnts(b2_minGroupBufferCapacity, amp::accelView()),
+	m_ampRigidRanges(2 * b2_minGroupBufferCapacity, amp::accelView()),
+	m_ampRigidSlots(b2_minGroupBufferCapacity, amp::accelView()),
+	m_ampRigidStats(b2_minGroupBufferCapacity, amp::accelView()),
+	m_ampRigidVelocityTransforms(b2_minGroupBufferCapacity, amp::accelView()),
+	m_ampStaleRanges(2 * b2_minGroupBufferCapacity, amp::accelView()),
+	m_ampStaleStats(b2_minGroupBufferCapacity, amp::accelView()),
 
 	// pairs and triads
 	m_ampPairs(TILE_SIZE, amp::accelView()),
 	m_ampTriads(TILE_SIZE, amp::accelView()),
-	m_world(world),
-	m_step(step)
+	m_world(world)
 {
 	m_paused = false;
 	m_timestamp = 0;
@@ -431,8 +520,11 @@ ParticleSystem::ParticleSystem(b2World& world, b2TimeStep& step, vector<Body>& b
 	m_allGroupFlags = 0;
 	m_needsUpdateAllGroupFlags = false;
 	m_hasForce = false;
-	m_hasDepth = false;
+
 	m_iteration = 0;
+	m_iterationCnt = 1;
+	m_resizeCallback = nullptr;
+	m_stepCallback = nullptr;
 
 	SetDensity(1.0f);
 	SetRadius(1.0f);
@@ -442,6 +534,7 @@ ParticleSystem::ParticleSystem(b2World& world, b2TimeStep& step, vector<Body>& b
 
 	m_groupCount = 0;
 	m_groupCapacity = 0;
+	m_sortsSinceReorder = 0;
 	m_pairCount = 0;
 	m_pairCapacity = 0;
 	m_triadCount = 0;
@@ -449,8 +542,7 @@ ParticleSystem::ParticleSystem(b2World& world, b2TimeStep& step, vector<Body>& b
 
 	m_hasColorBuf					 = false;
 	hasHandleIndexBuffer			 = false;
-	hasStaticPressureBuf			 = false;
-	hasAccumulation2Buf				 = false;
+
 
 	b2Assert(1.0f / 60.0f > 0.0f);
 
@@ -479,7 +571,7 @@ template <typename T> void ParticleSystem::FreeUserOverridableBuffer(
 	UserOverridableBuffer<T>* b)
 {
 	if (b->userSuppliedCapacity == 0)
-		FreeBuffer(&b->data, m_capacity);
+		FreeBuffer(&b->data, m_ampParts.m_capacity);
 }
 
 // Reallocate a buffer
@@ -524,15 +616,6 @@ template <typename T> T* ParticleSystem::ReallocateBuffer(
 							oldCapacity, newCapacity, deferred);
 }
 
-template <typename T>
-void ParticleSystem::RequestBuffer(ampArray<T>& a, bool& hasBuffer)
-{
-	if (!hasBuffer)
-	{
-		amp::resize(a, m_ampParts.m_capacity);
-		hasBuffer = true;
-	}
-}
 
 template<typename F>
 void ParticleSystem::ForEachGroup(const F& function) const
@@ -546,30 +629,27 @@ void ParticleSystem::ForEachGroup(const F& function) const
 }
 
 
-template<typename F>
-inline void ParticleSystem::ForEachPair(const F& function) const
+template<int32 N, typename T, typename F1, typename F2>
+inline void ParticleSystem::ForEachPair(const F1& record, const F2& apply)
 {
-	amp::forEach(m_pairCount, [=](const int32 i) restrict(amp)
-	{
-		function(i);
-	});
+	amp::forEachTarget<N, T>(m_pairCount, record, apply, m_def.deterministic,
+		m_targetSortBuffers, amp::radixSortKeyBits(0, m_ampParts.m_count));
 }
-template<typename F>
-inline void ParticleSystem::ForEachTriad(const F& function) const
+template<int32 N, typename T, typename F1, typename F2>
+inline void ParticleSystem::ForEachTriad(const F1& record, const F2& apply)
 {
-	amp::forEach(m_triadCount, [=](const int32 i) restrict(amp)
-	{
-		function(i);
-	});
+	amp::forEachTarget<N, T>(m_triadCount, record, apply, m_def.deterministic,
+		m_targetSortBuffers, amp::radixSortKeyBits(0, m_ampParts.m_count));
 }
 
 void ParticleSystem::ResizeParticleBuffers(int32 size)
 {
 	if (!m_ampParts.Resize(size)) return;
 	m_buffers.Resize(m_ampParts.m_capacity);
-	m_ampContacts.Resize(m_ampParts.m_capacity * MAX_CONTACTS_PER_PARTICLE);
+	m_ampContacts.ResizeParticles(m_ampParts.m_capacity);
 	m_ampBodyContacts.Resize(m_ampParts.m_capacity * MAX_BODY_CONTACTS_PER_PARTICLE);
 	m_ampGroundContacts.Resize(m_ampParts.m_capacity);
+	m_matChanges.Resize(m_ampParts.m_capacity);
 	if (m_resizeCallback) m_resizeCallback(m_ampParts.m_capacity);
 }
 
@@ -577,9 +657,15 @@ void ParticleSystem::ResizeGroupBuffers(int32 size)
 {
 	if (!AdjustCapacityToSize(m_groupCapacity, size, b2_minGroupBufferCapacity)) return;
 	m_groupBuffer.resize(m_groupCapacity);
-	m_groupHasAlive.resize(m_groupCapacity);
+	m_groupAliveCnts.resize(m_groupCapacity);
 	amp::resize(m_ampGroups, m_groupCapacity, m_groupCount);
-	amp::resize(m_ampGroupHasAlive, m_groupCapacity);
+	amp::resize(m_ampGroupAliveCnts, m_groupCapacity);
+	amp::resize(m_ampRigidRanges, 2 * m_groupCapacity);
+	amp::resize(m_ampRigidSlots, m_groupCapacity);
+	amp::resize(m_ampRigidStats, m_groupCapacity);
+	amp::resize(m_ampRigidVelocityTransforms, m_groupCapacity);
+	amp::resize(m_ampStaleRanges, 2 * m_groupCapacity);
+	amp::resize(m_ampStaleStats, m_groupCapacity);
 
 	m_groupExtent = ampExtent(m_groupCount);
 }
@@ -592,7 +678,7 @@ void ParticleSystem::DestroyAllParticles()
 
 	m_groupCount = 0;
 	m_freeGroupIdxs.clear();
-	m_zombieRanges.clear();
+	m_zombieRanges.Clear();
 	ResizeGroupBuffers(0);
 }
 
@@ -603,7 +689,7 @@ pair<int32, int32> ParticleSystem::CreateParticlesWithPositions(const ParticleGr
 	const auto& mat = m_mats.m_vector[groupDef.matIdx];
 	const uint32 flags = groupDef.flags | mat.m_flags;
 	const bool hasColors = !groupDef.colors.empty();
-	for (uint32 i = 0, wi = writeIdx; i < groupDef.particleCount; i++, wi++)
+	for (uint32 i = 0, wi = writeIdx; i < (uint32)groupDef.particleCount; i++, wi++)
 	{
 		m_buffers.groupIdx[wi] = groupDef.idx;
 		m_buffers.flags[wi] = flags;
@@ -613,13 +699,10 @@ pair<int32, int32> ParticleSystem::CreateParticlesWithPositions(const ParticleGr
 			b2Cross(groupDef.angularVelocity, (Vec2)p - groupDef.transform.p), 0);
 		m_buffers.heat[wi] = groupDef.heat;
 		m_buffers.health[wi] = groupDef.health;
-		m_buffers.force[wi].SetZero();
+
 		m_buffers.matIdx[wi] = groupDef.matIdx;
 		m_buffers.mass[wi] = mat.m_mass;
 		m_buffers.invMass[wi] = mat.m_invMass;
-		m_buffers.staticPressure[wi] = 0;
-
-		m_buffers.depth[wi] = 0;
 		m_buffers.color[wi] = hasColors ? groupDef.colors[i] : groupDef.color;
 	}
 	m_allFlags |= flags;
@@ -923,14 +1006,14 @@ void ParticleSystem::UpdatePairsAndTriadsWithReactiveParticles()
 
 	auto flags = m_ampParts.m_flags.GetView();
 	const uint32 remReactiveFlag = ~Particle::Flag::Reactive;
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		flags[i] &= remReactiveFlag;
 	});
 	m_ampCopyFutTriads.set(amp::copyAsync(m_triadBuffer, m_ampTriads, m_triadCount));
 }
 
-static bool ParticleCanBeConnected(uint32 flags, const ParticleGroup& group, int32 groupIdx)
+[[maybe_unused]] static bool ParticleCanBeConnected(uint32 flags, const ParticleGroup& group, int32 groupIdx)
 {
 	return
 		(flags & Particle::Mat::k_wallOrSpringOrElasticFlags) ||
@@ -967,7 +1050,7 @@ void ParticleSystem::AmpUpdatePairsAndTriads(
 
 	if (m_allFlags & Particle::Mat::k_pairFlags)
 	{
-		auto particleCanBeConnected = [=](uint32 flags, const ParticleGroup& group, int32 groupIdx) restrict(amp) -> bool
+		auto particleCanBeConnected = [=](uint32 flags, const ParticleGroup& group, int32 groupIdx) AMP_RESTRICT -> bool
 		{
 			return flags & Particle::Mat::k_wallOrSpringOrElasticFlags ||
 				(groupIdx != INVALID_IDX && group.HasFlag(ParticleGroup::Flag::Rigid));
@@ -978,14 +1061,13 @@ void ParticleSystem::AmpUpdatePairsAndTriads(
 		auto positions = m_ampParts.m_position.GetConstView();
 		auto& oldPairs = m_ampPairs;
 		auto contactIdxs = m_ampContacts.m_idx.GetConstView();
-		auto contacts = m_ampContacts.m_perTile.GetConstView();
-		const int32 contactsPerTile = m_ampContacts.m_maxPerTile;
-		ampArray<int32> cnts(m_ampContacts.m_count, amp::accelView());
+		auto contacts = m_ampContacts.m_array.GetConstView();
+		ampArrayView<int32> cnts = amp::scratch().Alloc<int32>(m_ampContacts.m_count);
 		amp::fill(cnts, 0);
-		amp::forEach(m_ampContacts.m_count, [=, &oldPairs, &cnts](const int32 i) restrict(amp)
+		amp::forEach(m_ampContacts.m_count, [=, &oldPairs](const int32 i) AMP_RESTRICT
 		{
 			const int32 contactIdx = contactIdxs[i];
-			const Particle::Contact& contact = contacts[contactIdx / contactsPerTile][contactIdx % contactsPerTile];
+			const Particle::Contact& contact = contacts[contactIdx];
 			const int32 a = contact.idxA;
 			const int32 b = contact.idxB;
 			const uint32 f = contact.flags;
@@ -1010,13 +1092,13 @@ void ParticleSystem::AmpUpdatePairsAndTriads(
 				pair.distance = b2Distance(positions[a], positions[b]);
 			}
 		});
-		ampArray<b2ParticlePair> newPairs(oldPairs.extent, amp::accelView());
+		ampArrayView<b2ParticlePair> newPairs = amp::scratch().Alloc<b2ParticlePair>(oldPairs.extent[0]);
 		m_pairCount = amp::scan(ampArrayView<const int32>(cnts), m_ampContacts.m_count,
-			[=, &newPairs, &oldPairs](const int32 i, const int32 wi) restrict(amp)
+			[=, &oldPairs](const int32 i, const int32 wi) AMP_RESTRICT
 		{
 			newPairs[wi] = oldPairs[i];
 		});
-		oldPairs = newPairs;
+		Concurrency::copy(newPairs, oldPairs);
 	}
 	//if (m_allFlags & Particle::Mat::k_triadFlags)
 	//{
@@ -1146,7 +1228,7 @@ void ParticleSystem::DestroyGroup(int32 groupIdx, int32 timestamp, bool destroyP
 	if (destroyParticles)
 	{
 		auto flags = m_ampParts.m_flags.GetView();
-		amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) restrict(amp)
+		amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) AMP_RESTRICT
 		{
 			flags[i] = Particle::Flag::Zombie;
 		});
@@ -1166,6 +1248,113 @@ void ParticleSystem::DestroyGroup(int32 groupIdx, int32 timestamp, bool destroyP
 		m_freeGroupIdxs.push_back(groupIdx);
 }
 
+void DistributeHeat(float32& aHeat, float32& bHeat, const float32& factor,
+	const float32& aMass, const float32& bMass) AMP_RESTRICT;
+
+template<typename F> void ParticleSystem::ShuffledForEachContact(const F& makeFunction)
+{
+	if (m_ampContacts.IsColored())
+		m_ampContacts.ColoredForEach(makeFunction(false), makeFunction(true));
+	else
+		m_ampContacts.ShuffledForEach(makeFunction(true));
+}
+template<typename F> void ParticleSystem::ShuffledForEachContact(const int32 contactClass, const F& makeFunction)
+{
+	m_ampContacts.ClassForEach(contactClass, makeFunction(false), makeFunction(true));
+}
+
+auto ParticleSystem::GetViscousContactFn(const bool atomic)
+{
+	const bool hasViscous = m_allFlags & Particle::Mat::Flag::Viscous;
+	const float32 viscousStrength = m_def.viscousStrength;
+
+	auto velocities = m_ampParts.m_velocity.GetView();
+	auto invMasses = m_ampParts.m_invMass.GetConstView();
+	return [=](const Particle::Contact& contact) AMP_RESTRICT
+	{
+		if (!hasViscous || !contact.HasFlags(Particle::Mat::Flag::Viscous)) return;
+		const int32 a = contact.idxA;
+		const int32 b = contact.idxB;
+		const float32 w = contact.weight;
+		const float32 m = contact.mass;
+		const Vec3 v = velocities[b] - velocities[a];
+		const Vec3 f = viscousStrength * w * m * v;
+		amp::add(velocities[a], invMasses[a] * f, atomic);
+		amp::sub(velocities[b], invMasses[b] * f, atomic);
+	};
+}
+auto ParticleSystem::GetHeatConductContactFn()
+{
+	const bool hasHeatConducting = m_allFlags & Particle::Mat::Flag::HeatConducting;
+	const b2TimeStep& step = m_subStep;
+
+	auto heats = m_ampParts.m_heat.GetView();
+	auto matIdxs = m_ampParts.m_matIdx.GetConstView();
+	auto mats = m_mats.m_array.GetConstView();
+	return [=](const Particle::Contact& contact) AMP_RESTRICT
+	{
+		if (!hasHeatConducting || !contact.HasFlag(Particle::Mat::Flag::HeatConducting)) return;
+		const int32 a = contact.idxA;
+		const int32 b = contact.idxB;
+		const Particle::Mat& aMat = mats[matIdxs[a]];
+		const Particle::Mat& bMat = mats[matIdxs[b]];
+		if (!(aMat.m_heatConductivity && bMat.m_heatConductivity)) return;
+		const float32 factor = step.dt * aMat.m_heatConductivity * bMat.m_heatConductivity
+			* ampSqrt(contact.weight);
+		DistributeHeat(heats[a], heats[b], factor, aMat.m_mass, bMat.m_mass);
+	};
+}
+auto ParticleSystem::GetDampingContactFn(const bool atomic)
+{
+	const float32 linearDamping = m_def.dampingStrength;
+	const float32 quadraticDamping = 1 / GetCriticalVelocity(m_subStep);
+
+	auto velocities = m_ampParts.m_velocity.GetView();
+	auto invMasses = m_ampParts.m_invMass.GetConstView();
+	return [=](const Particle::Contact& contact) AMP_RESTRICT
+	{
+		const int32 a = contact.idxA;
+		const int32 b = contact.idxB;
+		const float32 w = contact.weight;
+		const float32 m = contact.mass;
+		const Vec3 n = contact.normal;
+		const Vec3 v = velocities[b] - velocities[a];
+		const float32 vn = b2Dot(v, n);
+		if (vn >= 0) return;
+		const float32 damping = b2Max(linearDamping * w, b2Min(-quadraticDamping * vn, 0.5f));
+		const Vec3 f = damping * m * vn * n;
+		amp::add(velocities[a], invMasses[a] * f, atomic);
+		amp::sub(velocities[b], invMasses[b] * f, atomic);
+	};
+}
+auto ParticleSystem::GetApplyImpulseFn()
+{
+	auto velocities = m_ampParts.m_velocity.GetView();
+	auto forces = m_ampParts.m_force.GetView();
+	auto groups = GetGroups();
+	auto bodies = GetBodies();
+	return [=](const uint32 target, const Vec3& impulse, const bool atomic) AMP_RESTRICT
+	{
+		const int32 idx = target & ImpulseTarget::IdxMask;
+		switch (target & ~ImpulseTarget::IdxMask)
+		{
+		case ImpulseTarget::Velocity:
+			amp::add(velocities[idx], (Vec2)impulse, atomic);
+			break;
+		case ImpulseTarget::Group:
+			amp::add(groups[idx].m_linearVelocity, (Vec2)impulse, atomic);
+			amp::add(groups[idx].m_angularVelocity, impulse.z, atomic);
+			break;
+		case ImpulseTarget::Body:
+			bodies[idx].ApplyImpulse(Vec3((Vec2)impulse, 0), impulse.z, true);
+			break;
+		case ImpulseTarget::Force:
+			amp::add(forces[idx], (Vec2)impulse, atomic);
+			break;
+		}
+	};
+}
+
 void ParticleSystem::ComputeWeight()
 {
 	// calculates the sum of contact-weights for each particle
@@ -1173,27 +1362,41 @@ void ParticleSystem::ComputeWeight()
 	//memset(m_buffers.weight.data(), 0, sizeof(*(m_buffers.weight.data())) * m_count);
 	//m_buffers.weight.resize(m_capacity);
 
-	m_futureComputeWeight.RunDeferred([=]()
+	// with fused contact passes SolveViscous sums up the weights
+	if (m_def.fuseContactPasses) return;
+	m_futureComputeWeight.RunDeferred([=]() { SumWeights(false); });
+}
+void ParticleSystem::SumWeights(const bool fuseViscous)
+{
+	auto weights = m_ampParts.m_weight.GetView();
+	amp::fill(weights, 0.f, m_ampParts.m_count);
+	m_ampBodyContacts.ForEach([=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
 	{
-		auto weights = m_ampParts.m_weight.GetView();
-		amp::fill(weights, 0.f, m_ampParts.m_count);
-		m_ampBodyContacts.ForEach([=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
-		{
-			amp::atomicAdd(weights[i], contact.weight);
-		});
-		m_ampGroundContacts.ForEach([=](const int32 a, const Particle::GroundContact& contact) restrict(amp)
-		{
-			weights[a] += contact.weight;
-		});
-		m_ampContacts.ShuffledForEach([=](const Particle::Contact& contact) restrict(amp)
+		amp::atomicAdd(weights[i], contact.weight);
+	});
+	m_ampGroundContacts.ForEach([=](const int32 a, const Particle::GroundContact& contact) AMP_RESTRICT
+	{
+		weights[a] += contact.weight;
+	});
+	const auto addWeight = [=](const bool atomic)
+	{
+		return [=](const Particle::Contact& contact) AMP_RESTRICT
 		{
 			const int32 a = contact.idxA;
 			const int32 b = contact.idxB;
 			const float32 w = contact.weight;
-			amp::atomicAdd(weights[a], w);
-			amp::atomicAdd(weights[b], w);
+			amp::add(weights[a], w, atomic);
+			amp::add(weights[b], w, atomic);
+		};
+	};
+	// viscosity doesn't need the weights of the particles
+	if (fuseViscous)
+		ShuffledForEachContact([=](const bool atomic)
+		{
+			return Particle::ContactArrays::Fuse(addWeight(atomic), GetViscousContactFn(atomic));
 		});
-	});
+	else
+		ShuffledForEachContact(addWeight);
 }
 void ParticleSystem::WaitForComputeWeight()
 {
@@ -1214,41 +1417,30 @@ void ParticleSystem::ComputeDepth()
 
 	const float32 maxFloat = b2_maxFloat;
 	const float32 particleDiameter = m_particleDiameter;
-	ampArray<Particle::Contact> contactGroups(m_ampContacts.m_count, amp::accelView());
+	const int32 contactCnt = m_ampContacts.m_count;
+	const uint32 partCnt = m_ampParts.m_count;
 	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
 	auto contactIdxs = m_ampContacts.m_idx.GetConstView();
-	auto contacts = m_ampContacts.m_perTile.GetConstView();
-	const uint32 contactsPerTile = m_ampContacts.m_maxPerTile;
+	auto contacts = m_ampContacts.m_array.GetConstView();
 	auto groups = GetConstGroups();
-	const int32 contactTileCnt = amp::getTileCount(m_ampContacts.m_count);
-	ampArray<int32> contactCnts(contactTileCnt, amp::accelView());
-	amp::fill(contactCnts, 0);
-	ampArray2D<Particle::Contact> localContacts(contactTileCnt, TILE_SIZE, amp::accelView());
-	amp::forEachTiled(m_ampContacts.m_count,
-		[=, &contactCnts, &localContacts](const int32 gi, const int32 ti, const int32 li) restrict(amp)
-	{
-		const uint32 contactIdx = contactIdxs[gi];
-		const Particle::Contact& contact = contacts[contactIdx / contactsPerTile][contactIdx % contactsPerTile];
+	// The contacts inside a group sorted by their first particle, so the slices swept
+	// below hold neighbouring contacts. The other contacts are sorted behind them.
+	ampArrayView<Proxy> contactOrder = amp::scratch().Alloc<Proxy>(contactCnt);
+	amp::forEach(contactCnt, [=](const int32 i) AMP_RESTRICT
+	{
+		const uint32 contactIdx = contactIdxs[i];
+		const Particle::Contact& contact = contacts[contactIdx];
 		const int32 a = contact.idxA;
 		const int32 b = contact.idxB;
 		const int32 groupAIdx = groupIdxs[a];
 		const int32 groupBIdx = groupIdxs[b];
-		
-		tile_static uint32 cnt;
-		if (groupAIdx != INVALID_IDX && groupAIdx == groupBIdx &&
-			groups[groupAIdx].HasFlag(ParticleGroup::Flag::NeedsUpdateDepth))
-		{
-			localContacts[ti][Concurrency::atomic_fetch_inc(&contactCnts[ti])] = contact;
-		}
-	});
-	const uint32 contactGroupsCount = amp::scan(ampArrayView<const int32>(contactCnts), contactTileCnt,
-		[=, &contactCnts, &localContacts, &contactGroups](const int32 i, const int32 wi) restrict(amp)
-	{
-		for (uint32 j = 0; j < contactCnts[i]; j++)
-			contactGroups[wi + j] = localContacts[i][j];
+		const bool inGroup = groupAIdx != INVALID_IDX && groupAIdx == groupBIdx &&
+			groups[groupAIdx].HasFlag(ParticleGroup::Flag::NeedsUpdateDepth);
+		contactOrder[i].Set(contactIdx, inGroup ? a : partCnt);
 	});
+	amp::radixSort(contactOrder, contactCnt, m_depthSortBuffers, 0, amp::radixSortKeyBits(0, partCnt));
 
-	vector<uint32> groupIdxsToUpdate(m_groupCount);
+	vector<int32> groupIdxsToUpdate(m_groupCount);
 	int32 groupsToUpdateCount = 0;
 
 	auto accumulations = m_ampParts.m_accumulation.GetView();
@@ -1261,7 +1453,7 @@ void ParticleSystem::ComputeDepth()
 			{
 				groupIdxsToUpdate[groupsToUpdateCount++] = k;
 				SetGroupFlags(group, group.m_groupFlags & ~ParticleGroup::Flag::NeedsUpdateDepth);
-				amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) restrict(amp)
+				amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) AMP_RESTRICT
 				{
 					accumulations[i] = 0;
 				});
@@ -1269,67 +1461,76 @@ void ParticleSystem::ComputeDepth()
 		}
 	}
 	// Compute sum of weight of contacts except between different groups.
-	amp::forEach(contactGroupsCount, [=, &contactGroups](const int32 i) restrict(amp)
-	{
-		const Particle::Contact& contact = contactGroups[i];
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const float32 w = contact.weight;
-		amp::atomicAdd(accumulations[a], w);
-		amp::atomicAdd(accumulations[b], w);
-	});
-	b2Assert(m_hasDepth);
+	amp::forEachTarget<2, float32>(contactCnt,
+		[=](const int32 i, amp::TargetValues<2, float32>& weights) AMP_RESTRICT
+	{
+		if (contactOrder[i].tag == partCnt) return;
+		const Particle::Contact& contact = contacts[contactOrder[i].idx];
+		weights.Add(contact.idxA, contact.weight);
+		weights.Add(contact.idxB, contact.weight);
+	}, [=](const int32 i, const float32 w, const bool atomic) AMP_RESTRICT
+	{
+		amp::add(accumulations[i], w, atomic);
+	}, m_def.deterministic, m_depthSortBuffers, amp::radixSortKeyBits(0, partCnt));
+	m_ampParts.RequireColumn(Particle::AmpArrays::Column::Depth);
 	auto depths = m_ampParts.m_depth.GetView();
 	for (int32 i = 0; i < groupsToUpdateCount; i++)
 	{
 		ParticleGroup& group = m_groupBuffer[groupIdxsToUpdate[i]];
-		const uint32 startIdx = group.m_firstIndex;
-		amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) restrict(amp)
+		amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) AMP_RESTRICT
 		{
 			const float32 w = accumulations[i];
 			depths[i] = w < 0.8f ? 0 : maxFloat;
 		});
 	}
 
-	// The number of iterations is equal to particle number from the deepest
+	// The number of sweeps is equal to particle number from the deepest
 	// particle to the nearest surface particle, and in general it is smaller
 	// than sqrt of total particle number.
-	int32 iterationCount = (int32)b2Sqrt((float32)m_ampParts.m_count);
-
-	ampArrayView<uint32> ampUpdated(iterationCount);
+	const int32 maxSweeps = (int32)b2Sqrt((float32)m_ampParts.m_count);
+
+	// Each thread sweeps a slice of DEPTH_SLICE_CONTACTS sorted contacts, forward and
+	// backward by turns, until a sweep changes no depth or up to DEPTH_SLICE_SWEEPS
+	// times. A dispatch only runs if the one before changed a depth, so the dispatches
+	// are queued without a readback. The depths only decrease, so the result does not
+	// depend on the order.
+	const int32 sliceCnt = (contactCnt + DEPTH_SLICE_CONTACTS - 1) / DEPTH_SLICE_CONTACTS;
+	ampArrayView<uint32> ampUpdated = amp::scratch().Alloc<uint32>(maxSweeps);
 	amp::fill(ampUpdated, 0u);
-	for (int32 t = 0; t < iterationCount; t++)
+	for (int32 d = 0; d < maxSweeps; d++)
 	{
-		amp::forEach(contactGroupsCount, [=, &contactGroups](const int32 i) restrict(amp)
+		amp::forEach(sliceCnt, [=](const int32 s) AMP_RESTRICT
 		{
-			const Particle::Contact& contact = contactGroups[i];
-			const int32 a = contact.idxA;
-			const int32 b = contact.idxB;
-			const float32 r = 1 - contact.weight;
-			float32& ap0 = depths[a];
-			float32& bp0 = depths[b];
-			const float32 ap1 = bp0 + r;
-			const float32 bp1 = ap0 + r;
-			if (ap0 > ap1)
-			{
-				Concurrency::atomic_exchange(&ap0, ap1);
-				ampUpdated[t] = 1;
-			}
-			if (bp0 > bp1)
+			if (d > 0 && !ampUpdated[d - 1]) return;
+			const int32 first = s * DEPTH_SLICE_CONTACTS;
+			const int32 last = b2Min(first + DEPTH_SLICE_CONTACTS, contactCnt) - 1;
+			for (int32 t = 0; t < DEPTH_SLICE_SWEEPS; t++)
 			{
-				Concurrency::atomic_exchange(&bp0, bp1);
-				ampUpdated[t] = 1;
+				bool updated = false;
+				const int32 step = t % 2 ? -1 : 1;
+				for (int32 k = t % 2 ? last : first; first <= k && k <= last; k += step)
+				{
+					// the contacts outside of the groups are sorted behind them
+					if (contactOrder[k].tag == partCnt) continue;
+					const Particle::Contact& contact = contacts[contactOrder[k].idx];
+					const float32 r = 1 - contact.weight;
+					// the depths are not negative
+					const float32 ap1 = depths[contact.idxB] + r;
+					const float32 bp1 = depths[contact.idxA] + r;
+					if (amp::atomicMin(depths[contact.idxA], ap1) > ap1)
+						updated = true;
+					if (amp::atomicMin(depths[contact.idxB], bp1) > bp1)
+						updated = true;
+				}
+				if (!updated) break;
+				ampUpdated[d] = 1;
 			}
 		});
-		uint32 updated;
-		amp::copy(ampUpdated, t, updated);
-		if (!updated)
-			break;
 	}
 	for (int32 i = 0; i < groupsToUpdateCount; i++)
 	{
 		const ParticleGroup& group = m_groupBuffer[groupIdxsToUpdate[i]];
-		amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) restrict(amp)
+		amp::forEach(group.m_firstIndex, group.m_lastIndex, [=](const int32 i) AMP_RESTRICT
 		{
 			float32& p = depths[i];
 			if (p < maxFloat)
@@ -1351,14 +1552,17 @@ void ParticleSystem::AddFlagInsideFixture(const Particle::Flag flag, const int32
 	switch (fixture.m_shapeType)
 	{
 	case b2Shape::e_circle:
-		ForEachInsideCircle(m_world.m_circleShapeBuffer[fixture.m_shapeIdx], transform, [=](int32 i) restrict(amp)
+		ForEachInsideCircle(m_world.m_circleShapeBuffer[fixture.m_shapeIdx], transform, [=](int32 i) AMP_RESTRICT
 		{
 			if (matIdxs[i] == matIdx)
 				flags[i] |= flag;
 		});
 		break;
+	default:
+		break;
 	}
 	m_allFlags |= flag;
+	m_ampParts.MarkBucketsDirty();
 }
 
 void ParticleSystem::CopyShapeToGPU(b2Shape::Type type, int32 idx)
@@ -1377,6 +1581,8 @@ void ParticleSystem::CopyShapeToGPU(b2Shape::Type type, int32 idx)
 	case b2Shape::e_polygon:
 		amp::copy((AmpPolygonShape&)m_world.m_polygonShapeBuffer[idx], m_ampPolygonShapes, idx);
 		return;
+	default:
+		return;
 	}
 }
 
@@ -1384,7 +1590,7 @@ inline void ParticleSystem::BoundProxyToTagBound(const b2AABBFixtureProxy& aabb,
 {
 	tb.lowerTag = computeTag(m_inverseDiameter * aabb.lowerBound.x - 1,
 		m_inverseDiameter * aabb.lowerBound.y - 1);
-	tb.upperTag = computeTag(m_inverseDiameter * aabb.upperBound.x + 1,
+	tb.upperTag = computeUpperTag(m_inverseDiameter * aabb.upperBound.x + 1,
 		m_inverseDiameter * aabb.upperBound.y + 1);
 	tb.xLower = tb.lowerTag & xMask;
 	tb.xUpper = tb.upperTag & xMask;
@@ -1397,14 +1603,14 @@ void ParticleSystem::ForEachInsideBounds(const b2AABB& aabb, const F& function)
 {
 	uint32 lowerTag = computeTag(m_inverseDiameter * aabb.lowerBound.x - 1,
 		m_inverseDiameter * aabb.lowerBound.y - 1);
-	uint32 upperTag = computeTag(m_inverseDiameter * aabb.upperBound.x + 1,
+	uint32 upperTag = computeUpperTag(m_inverseDiameter * aabb.upperBound.x + 1,
 		m_inverseDiameter * aabb.upperBound.y + 1);
 	const uint32 xLower = lowerTag & xMask;
 	const uint32 xUpper = upperTag & xMask;
 
 	auto flags = m_ampParts.m_flags.GetConstView();
 	auto proxies = m_ampParts.m_proxy.GetConstView();
-	m_ampParts.ForEachProxy([=](const Proxy& proxy) restrict(amp)
+	m_ampParts.ForEachProxy([=](const Proxy& proxy) AMP_RESTRICT
 	{
 		if (proxy.tag > upperTag || lowerTag > proxy.tag) return;
 		const uint32 xTag = proxy.tag & xMask;
@@ -1424,7 +1630,7 @@ void ParticleSystem::ForEachInsideBounds(const vector<b2AABBFixtureProxy>& aabbs
 
 	auto flags = m_ampParts.m_flags.GetConstView();
 	auto proxies = m_ampParts.m_proxy.GetConstView();
-	m_ampParts.ForEachProxy([=](const Proxy& proxy) restrict(amp)
+	m_ampParts.ForEachProxy([=](const Proxy& proxy) AMP_RESTRICT
 	{
 		const uint32 xTag = proxy.tag & xMask;
 		for (int32 i = 0; i < boundCnt; i++)
@@ -1444,14 +1650,14 @@ void ParticleSystem::ForEachInsideCircle(const b2CircleShape& circle,
 	b2AABB aabb;
 	circle.ComputeAABB(aabb, transform, 0);
 	auto positions = m_ampParts.m_position.GetConstView();
-	ForEachInsideBounds(aabb, [=](const int32 i) restrict(amp)
+	ForEachInsideBounds(aabb, [=](const int32 i) AMP_RESTRICT
 	{
 		if (ampCircle[0].TestPoint(transform, positions[i]))
 			function(i);
 	});
 }
 
-bool ShouldCollisionGroupsCollide(int32 collGroupA, int32 collGroupB) restrict(amp)
+bool ShouldCollisionGroupsCollide(int32 collGroupA, int32 collGroupB) AMP_RESTRICT
 {
 	if (collGroupA == 0) return true;
 	return collGroupA != -collGroupB;
@@ -1459,30 +1665,95 @@ bool ShouldCollisionGroupsCollide(int32 collGroupA, int32 collGroupB) restrict(a
 	// return collGroupA == collGroupB;
 }
 
-void ParticleSystem::FindContacts(bool exceptZombie)
+void ParticleSystem::BuildCellList(bool exceptZombie, float32 cellSize)
+{
+	// Counting sort of the particles into the hashed cells of a grid with the
+	// given cell size. Bucket h holds the particles
+	// m_cellParticles[m_cellStart[h]] to m_cellParticles[m_cellEnd[h] - 1],
+	// m_cellKeys holds the key of their cell. The cells only take z into
+	// account if the particles of the last list spanned more than 2 cells in
+	// z, flat scenes search the 3x3 columns around a particle instead.
+	const int32 cnt = m_ampParts.m_count;
+	uint32 bucketCnt = TILE_SIZE;
+	while (bucketCnt < 2 * (uint32)cnt) bucketCnt *= 2;
+	m_cellMask = bucketCnt - 1;
+	m_cellCnt.Resize(bucketCnt);
+	m_cellStart.Resize(bucketCnt);
+	m_cellEnd.Resize(bucketCnt);
+	m_cellParticles.Resize(m_ampParts.m_capacity);
+	m_cellKeys.Resize(m_ampParts.m_capacity);
+
+	auto flags = m_ampParts.m_flags.GetConstView();
+	auto positions = m_ampParts.m_position.GetConstView();
+	auto cellCnts = m_cellCnt.GetView();
+	auto cellStarts = m_cellStart.GetView();
+	auto cellEnds = m_cellEnd.GetView();
+	auto cellParticles = m_cellParticles.GetView();
+	auto cellKeys = m_cellKeys.GetView();
+	auto zRange = m_cellZRange.GetView();
+	const float32 invCellSize = 1 / cellSize;
+	const uint32 mask = m_cellMask;
+	m_cellsLayered = m_cellZSpan > 1;
+	const bool layered = m_cellsLayered;
+	amp::fill(m_cellCnt.arr, 0);
+	amp::copy(vector<int32>{ INT32_MAX, INT32_MIN }, m_cellZRange.arr);
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		if (exceptZombie && flags[i] & Particle::Flag::Zombie) return;
+		const Vec3& p = positions[i];
+		const int32 z = (int32)ampFloor(invCellSize * p.z);
+		// the plain reads skip the atomics for most particles
+		if (z < zRange[0]) Concurrency::atomic_fetch_min(&zRange[0], z);
+		if (z > zRange[1]) Concurrency::atomic_fetch_max(&zRange[1], z);
+		amp::atomicInc(cellCnts[computeCellHash((int32)ampFloor(invCellSize * p.x),
+			(int32)ampFloor(invCellSize * p.y), layered ? z : 0, mask)]);
+	});
+	amp::scan(m_cellCnt.GetConstView(), bucketCnt, [=](const int32 h, const int32 wi) AMP_RESTRICT
+	{
+		cellStarts[h] = wi;
+		cellEnds[h] = wi + cellCnts[h];
+	});
+	// the counts run back down to 0 as cursors
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		if (exceptZombie && flags[i] & Particle::Flag::Zombie) return;
+		const Vec3& p = positions[i];
+		const int32 x = (int32)ampFloor(invCellSize * p.x);
+		const int32 y = (int32)ampFloor(invCellSize * p.y);
+		const int32 z = (int32)ampFloor(invCellSize * p.z);
+		const uint32 h = computeCellHash(x, y, layered ? z : 0, mask);
+		const int32 k = cellStarts[h] + Concurrency::atomic_fetch_dec(&cellCnts[h]) - 1;
+		cellParticles[k] = i;
+		cellKeys[k] = computeCellKey(x, y, z);
+	});
+	// read behind the scan, which waited for the counts
+	vector<int32> range(2);
+	amp::copy(m_cellZRange.arr, range);
+	m_cellZSpan = range[1] - range[0];
+}
+
+auto ParticleSystem::GetAddContactFn(const bool exceptZombie, const float32 radius)
 {
 	auto groups = ampArrayView<const ParticleGroup>(m_ampGroups);
 	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
-	const auto shouldCollide = [=](int32 a, int32 b) restrict(amp) -> bool
+	const auto shouldCollide = [=](int32 a, int32 b) AMP_RESTRICT -> bool
 	{
 		return ShouldCollisionGroupsCollide(groups[groupIdxs[a]].m_collisionGroup,
 			groups[groupIdxs[b]].m_collisionGroup);
 	};
 
 	auto positions = m_ampParts.m_position.GetConstView();
-	auto velocities = m_ampParts.m_velocity.GetConstView();
 	auto flags = m_ampParts.m_flags.GetConstView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
 	const float32 invDiameter = m_inverseDiameter;
-	const float32 diameter = m_particleDiameter;
-	const auto addContact = [=](const int32 a, const int32 b, Particle::Contact& contact) restrict(amp) -> bool
+	return [=](const int32 a, const int32 b, Particle::Contact& contact) AMP_RESTRICT -> bool
 	{
 		const uint32 flagsB = flags[b];
 		if (exceptZombie && flagsB & Particle::Flag::Zombie) return false;
 
 		const Vec3 d = positions[b] - positions[a];
 		const float32 dist = d.Length();
-		if (dist > diameter) return false;
+		if (dist > radius) return false;
 
 		if (!shouldCollide(a, b)) return false;
 		//if (d.Length() < b2_epsilon)
@@ -1499,12 +1770,39 @@ void ParticleSystem::FindContacts(bool exceptZombie)
 		);
 		return true;
 	};
+}
+
+void ParticleSystem::FindContacts(bool exceptZombie)
+{
+	if (m_def.neighbourSkin > 0)
+		FindContactsOfNeighbours(exceptZombie);
+	else
+		SearchContacts(exceptZombie, m_particleDiameter, m_def.gridContacts);
+}
+
+void ParticleSystem::SearchContacts(bool exceptZombie, float32 radius, bool grid)
+{
+	// the proxy rows are one diameter apart, wider searches need the cell list
+	b2Assert(grid || radius <= m_particleDiameter);
+	if (grid)
+		BuildCellList(exceptZombie, radius);
+
+	auto positions = m_ampParts.m_position.GetConstView();
+	auto flags = m_ampParts.m_flags.GetConstView();
+	const auto addContact = GetAddContactFn(exceptZombie, radius);
 
 	auto proxies = m_ampParts.m_proxy.GetConstView();
 	const int32 cnt = m_ampParts.m_count;
-	const auto LowerBoundTag = [=](int32 first, const uint32 tag) restrict(amp) -> int32
+	// Galloping search, as the bound is usually a few proxies behind first.
+	const auto LowerBoundTag = [=](int32 first, const uint32 tag) AMP_RESTRICT -> int32
 	{
-		int32 i, step, count = cnt - first;
+		int32 last = first;
+		for (int32 gallop = 1; last < cnt && proxies[last].tag < tag; gallop *= 2)
+		{
+			first = last + 1;
+			last += gallop;
+		}
+		int32 i, step, count = b2Min(last, cnt) - first;
 		while (count > 0)
 		{
 			step = count / 2;
@@ -1520,126 +1818,440 @@ void ParticleSystem::FindContacts(bool exceptZombie)
 		return first;
 	};
 
-	const int32 iterationCnt = m_ampParts.m_iterations;
-	const uint32 partsPerTile = TILE_SIZE * m_ampParts.m_iterations;
-	const auto GetLocalOrGlobalProxy = [=](const uint32 i, const uint32 t, const Proxy* lProxies) restrict(amp) -> Proxy
+	// One thread per proxy. The proxies of a tile are cached in local memory,
+	// so neither the work of a thread nor the local memory grow with the count.
+	const auto GetLocalOrGlobalProxy = [=](const uint32 i, const uint32 t, const Proxy* tProxies) AMP_RESTRICT -> Proxy
 	{
-		return (i / partsPerTile == t) ? lProxies[i % partsPerTile] : proxies[i];
+		return (i / TILE_SIZE == t) ? tProxies[i % TILE_SIZE] : proxies[i];
 	};
 
-	const auto FindNextContacts = [=](uint32& b, const uint32 t, const Proxy* lProxies, const uint32 tag, const int32 aIdx,
-		uint32& contactCnt, Particle::Contact* contacts) restrict(amp)
+	// Writes the contacts to contacts[wi...] if fill is set, otherwise only counts them.
+	const auto FindNextContacts = [=](uint32& b, const uint32 t, const Proxy* tProxies, const uint32 tag, const int32 aIdx,
+		uint32& contactCnt, const ampArrayView<Particle::Contact>& contacts, const int32 wi, const bool fill) AMP_RESTRICT
 	{
-		for (; b < cnt; b++)
+		Particle::Contact contact;
+		for (; b < (uint32)cnt; b++)
 		{
-			const Proxy bProxy = GetLocalOrGlobalProxy(b, t, lProxies);
+			const Proxy bProxy = GetLocalOrGlobalProxy(b, t, tProxies);
 			if (tag < bProxy.tag) return;
-			if (addContact(aIdx, bProxy.idx, contacts[contactCnt])
-				&& ++contactCnt == MAX_CONTACTS_PER_PARTICLE) return;
+			// the resort keeps the proxies of dead particles in place
+			if (bProxy.idx == INVALID_IDX) continue;
+			if (!addContact(aIdx, bProxy.idx, contact)) continue;
+			if (fill) contacts[wi + contactCnt] = contact;
+			contactCnt++;
+		}
+	};
+
+	// Searches the layers next to the layer of a in the cell (x, y), each from
+	// the x position xLower to xUpper in the cell. Whole layers that follow each
+	// other are searched as one range.
+	const auto FindCellContacts = [=](uint32& c, const uint32 t, const Proxy* tProxies, const Proxy& aProxy,
+		const int32 x, const int32 y, const uint32 xLower, const uint32 xUpper,
+		uint32& contactCnt, const ampArrayView<Particle::Contact>& contacts, const int32 wi, const bool fill) AMP_RESTRICT
+	{
+		const bool wholeLayers = xLower == 0 && xUpper == xFracMask;
+		for (int32 k = 0; k < 3; k++)
+		{
+			const uint32 lower = computeNeighbourLayer(aProxy.tag, k);
+			uint32 upper = lower;
+			while (wholeLayers && k < 2 && computeNeighbourLayer(aProxy.tag, k + 1) == upper + 1)
+				upper = computeNeighbourLayer(aProxy.tag, ++k);
+			c = LowerBoundTag(c, computeRelativeTag(aProxy.tag, x, y, lower, xLower));
+			FindNextContacts(c, t, tProxies, computeRelativeTag(aProxy.tag, x, y, upper, xUpper), aProxy.idx,
+				contactCnt, contacts, wi, fill);
 		}
 	};
 
-	const auto FindContactsOfProxy = [=](const Proxy& aProxy, uint32 b, uint32& c,
-		const uint32 t, const Proxy* lProxies, Particle::Contact* contacts) restrict(amp) -> uint32
+	const auto FindContactsOfProxy = [=](const Proxy& aProxy, uint32 b, const uint32 t, const Proxy* tProxies,
+		const ampArrayView<Particle::Contact>& contacts, const int32 wi, const bool fill) AMP_RESTRICT -> uint32
 	{
+		if (aProxy.idx == INVALID_IDX) return 0;
 		if (exceptZombie && flags[aProxy.idx] & Particle::Flag::Zombie) return 0;
 
+		// Only the layers next to the layer of a are searched in each cell, and
+		// in the cells left and right of a only the x positions within a
+		// diameter. In its own cell a takes the layers behind it, which are its
+		// own and the one above, or the highest one if a is in the lowest.
+		const uint32 layer = (aProxy.tag >> zShift) & (zLayerCnt - 1);
+		const uint32 xFrac = aProxy.tag & xFracMask;
 		uint32 contactCnt = 0;
-		FindNextContacts(b, t, lProxies, computeRelativeTag(aProxy.tag, 1, 0), aProxy.idx, contactCnt, contacts);
-		if (contactCnt == MAX_CONTACTS_PER_PARTICLE) return contactCnt;
+		const uint32 upperLayer = b2Min(layer + 1, zLayerCnt - 1);
+		FindNextContacts(b, t, tProxies, computeRelativeTag(aProxy.tag, 0, 0, upperLayer, xFracMask),
+			aProxy.idx, contactCnt, contacts, wi, fill);
+		if (layer == 0)
+		{
+			b = LowerBoundTag(b, computeRelativeTag(aProxy.tag, 0, 0, zLayerCnt - 1, 0));
+			FindNextContacts(b, t, tProxies, computeRelativeTag(aProxy.tag, 0, 0, zLayerCnt - 1, xFracMask),
+				aProxy.idx, contactCnt, contacts, wi, fill);
+		}
+		FindCellContacts(b, t, tProxies, aProxy, 1, 0, 0, xFrac, contactCnt, contacts, wi, fill);
 
-		if (!c) c = LowerBoundTag(b, computeRelativeTag(aProxy.tag, -1, 1));
-		FindNextContacts(c, t, lProxies, computeRelativeTag(aProxy.tag, 1, 1), aProxy.idx, contactCnt, contacts);
+		// the next row starts behind the end of this one
+		FindCellContacts(b, t, tProxies, aProxy, -1, 1, xFrac, xFracMask, contactCnt, contacts, wi, fill);
+		FindCellContacts(b, t, tProxies, aProxy, 0, 1, 0, xFracMask, contactCnt, contacts, wi, fill);
+		FindCellContacts(b, t, tProxies, aProxy, 1, 1, 0, xFrac, contactCnt, contacts, wi, fill);
+		return contactCnt;
+	};
+
+	// Cell list alternative: each particle checks the buckets of the 3x3x3 cells
+	// around it, or of the 3x3 columns if the cells are flat, and takes the
+	// particles with a higher index.
+	auto cellStarts = m_cellStart.GetConstView();
+	auto cellEnds = m_cellEnd.GetConstView();
+	auto cellParticles = m_cellParticles.GetConstView();
+	auto cellKeys = m_cellKeys.GetConstView();
+	const uint32 cellMask = m_cellMask;
+	const bool cellsLayered = m_cellsLayered;
+	const float32 invCellSize = 1 / radius;
+	const auto FindGridContactsOfParticle = [=](const int32 a,
+		const ampArrayView<Particle::Contact>& contacts, const int32 wi, const bool fill) AMP_RESTRICT -> uint32
+	{
+		if (exceptZombie && flags[a] & Particle::Flag::Zombie) return 0;
+
+		const Vec3& p = positions[a];
+		const int32 x = (int32)ampFloor(invCellSize * p.x);
+		const int32 y = (int32)ampFloor(invCellSize * p.y);
+		const int32 z = (int32)ampFloor(invCellSize * p.z);
+		uint32 buckets[9];
+		int32 bucketCnt = 0;
+		uint32 contactCnt = 0;
+		Particle::Contact contact;
+		for (int32 dy = -1; dy <= 1; dy++)
+		{
+			for (int32 dx = -1; dx <= 1; dx++)
+			{
+				if (!cellsLayered)
+				{
+					// neighbour columns can share a bucket, which must only be searched once
+					const uint32 h = computeCellHash(x + dx, y + dy, 0, cellMask);
+					bool searched = false;
+					for (int32 k = 0; k < bucketCnt; k++)
+						searched |= buckets[k] == h;
+					if (searched) continue;
+					buckets[bucketCnt++] = h;
+
+					for (int32 i = cellStarts[h]; i < cellEnds[h]; i++)
+					{
+						const int32 b = cellParticles[i];
+						if (b <= a || !addContact(a, b, contact)) continue;
+						if (fill) contacts[wi + contactCnt] = contact;
+						contactCnt++;
+					}
+					continue;
+				}
+
+				// The 3 cells of the column are one range of particles, unless
+				// their buckets wrap around the last one. Buckets are shared by
+				// cells, also by the neighbour cells, so only the particles with
+				// the key of the column are taken and none is found twice.
+				const uint32 first = computeCellHash(x + dx, y + dy, z - 1, cellMask);
+				const uint32 last = (first + 2) & cellMask;
+				const bool wraps = last < first;
+				const uint32 lowerKey = computeCellKey(x + dx, y + dy, z - 1);
+				for (int32 part = 0; part < (wraps ? 2 : 1); part++)
+				{
+					const int32 end = cellEnds[wraps && !part ? cellMask : last];
+					for (int32 i = cellStarts[part ? 0 : first]; i < end; i++)
+					{
+						const uint32 key = cellKeys[i];
+						if ((key & 0xFFFFFu) != (lowerKey & 0xFFFFFu)
+							|| (((key >> 20) - (lowerKey >> 20)) & 1023u) > 2)
+							continue;
+						const int32 b = cellParticles[i];
+						if (b <= a || !addContact(a, b, contact)) continue;
+						if (fill) contacts[wi + contactCnt] = contact;
+						contactCnt++;
+					}
+				}
+			}
+		}
 		return contactCnt;
 	};
-	
 
-	auto contacts = m_ampContacts.m_perTile.GetView();
-	const int32 contactsPerTile = m_ampContacts.m_maxPerTile;
+	// The same search runs twice. The first pass counts the contacts of each proxy
+	// (or particle), the second one writes them behind the scanned counts, so
+	// nothing is dropped.
 	auto contactCnts = m_ampContacts.m_cnt.GetView();
-	amp::forEachTiledWithBarrier(b2Min(cnt, CONTACT_THREADS), [=](const ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+	auto contactOffsets = m_ampContacts.m_offset.GetView();
+	auto overflow = m_ampContacts.m_overflow.GetView();
+	const auto SetContactCnt = [=](const int32 i, const uint32 contactCnt) AMP_RESTRICT
 	{
-		const uint32 t = tIdx.tile[0];
-		const uint32 l = tIdx.local[0] * iterationCnt;
-		const uint32 g = tIdx.global[0] * iterationCnt;
+		contactCnts[i] = contactCnt;
+		if (contactCnt > MAX_CONTACTS_PER_PARTICLE)
+			amp::atomicAdd(overflow[0], (int32)(contactCnt - MAX_CONTACTS_PER_PARTICLE));
+	};
+	const auto FindAllGridContacts = [=](const ampArrayView<Particle::Contact>& contacts, const bool fill)
+	{
+		amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+		{
+			if (fill)
+				FindGridContactsOfParticle(i, contacts, contactOffsets[i], true);
+			else
+				SetContactCnt(i, FindGridContactsOfParticle(i, contacts, 0, false));
+		});
+	};
+	const auto FindAllRowContacts = [=](const ampArrayView<Particle::Contact>& contacts, const bool fill)
+	{
+		amp::forEachTiledWithBarrier(cnt, [=](const ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
+		{
+			const uint32 t = tIdx.tile[0];
+			const uint32 j = tIdx.global[0];
 
-		// cache global Proxies in local memory
-		Proxy lProxies[MAX_ITERATIONS_PER_PARTICLE];
-		tile_static Proxy tProxies[TILE_SIZE * MAX_ITERATIONS_PER_PARTICLE];	// only works with (iterationCnt <= 8) so less then ‭1.048.576‬ Particles
-		for (uint32 i = 0; i < iterationCnt; i++)
-			if (const uint32 j = g + i; j < cnt)
-				lProxies[i] = tProxies[l + i] = proxies[j];
+			AMP_TILE_STATIC Proxy tProxies[TILE_SIZE];
+			if (j < (uint32)cnt)
+				tProxies[tIdx.local[0]] = proxies[j];
+			tIdx.barrier.wait_with_tile_static_memory_fence();
+			if (j >= (uint32)cnt) return;
 
-		tIdx.barrier.wait_with_tile_static_memory_fence();
+			if (fill)
+				FindContactsOfProxy(tProxies[tIdx.local[0]], j + 1, t, tProxies, contacts, contactOffsets[j], true);
+			else
+				SetContactCnt(j, FindContactsOfProxy(tProxies[tIdx.local[0]], j + 1, t, tProxies, contacts, 0, false));
+		});
+	};
+	const auto FindAllContacts = [=](const ampArrayView<Particle::Contact>& contacts, const bool fill)
+	{
+		if (grid) FindAllGridContacts(contacts, fill);
+		else FindAllRowContacts(contacts, fill);
+	};
 
-		uint32 contactCnt = 0;
-		Particle::Contact lContacts[MAX_CONTACTS_PER_PARTICLE * MAX_ITERATIONS_PER_PARTICLE];
-		for (uint32 i = 0, c = 0; i < iterationCnt; i++)
-			if (const uint32 j = g + i; j < cnt)
-				contactCnt += FindContactsOfProxy(lProxies[i], j + 1, c, t, tProxies, (Particle::Contact*)lContacts + contactCnt);
-
-		uint32 sum;
-		const uint32 scan = amp::_prefix_sum_detail::tilePrefixSum(contactCnt, tIdx, sum);
-		if (l == 0)
-			contactCnts[t] = sum;
-
-		// write contacts to global memory
-		ampArrayView<Particle::Contact>& tContacts = contacts[t];
-		for (int32 i = 0; i < contactCnt; i++)
-			tContacts[scan + i] = lContacts[i];
+	amp::fill(m_ampContacts.m_overflow.arr, 0);
+	if (!cnt)
+	{
+		m_ampContacts.m_count = 0;
+		return;
+	}
+	FindAllContacts(m_ampContacts.m_array.GetView(), false);
+	m_ampContacts.m_count = amp::scan(m_ampContacts.m_cnt.GetConstView(), cnt,
+		[=](const int32 i, const int32 wi) AMP_RESTRICT
+	{
+		contactOffsets[i] = wi;
 	});
+	m_ampContacts.Resize(m_ampContacts.m_count);
+	FindAllContacts(m_ampContacts.m_array.GetView(), true);
 	//amp::accelView().wait();
 }
-float32 ParticleSystem::FindContactsTest()
+
+void ParticleSystem::BuildNeighbourList(bool exceptZombie, float32 skin)
 {
-	amp::accelView().wait();
-	Timer t = Timer();
-	FindContacts(true);
-	amp::accelView().wait();
-	return t.Stop();
+	// all pairs within diameter + skin, found with the cell list
+	SearchContacts(exceptZombie, m_particleDiameter + skin, true);
+	m_neighbourCount = m_ampContacts.m_count;
+	if (AdjustCapacityToSize(m_neighbourCapacity, m_neighbourCount, MIN_PART_CAPACITY))
+	{
+		m_neighbours.Resize(m_neighbourCapacity);
+		m_neighbourHit.Resize(m_neighbourCapacity);
+		m_neighbourOffset.Resize(m_neighbourCapacity);
+	}
+	m_neighbourPositions.Resize(m_ampParts.m_capacity);
+
+	auto contacts = m_ampContacts.m_array.GetConstView();
+	auto neighbours = m_neighbours.GetView();
+	amp::forEach(m_neighbourCount, [=](const int32 i) AMP_RESTRICT
+	{
+		neighbours[i] = Particle::ContactIdx(contacts[i].idxA, contacts[i].idxB);
+	});
+	auto positions = m_ampParts.m_position.GetConstView();
+	auto listPositions = m_neighbourPositions.GetView();
+	amp::forEach(m_ampParts.m_count, [=](const int32 i) AMP_RESTRICT
+	{
+		listPositions[i] = positions[i];
+	});
+	m_neighbourParticleCount = m_ampParts.m_count;
+	m_neighboursValid = true;
 }
 
-void ParticleSystem::ReduceContacts()
+void ParticleSystem::CheckNeighboursMoved(float32 maxDisplacement)
 {
-	const int32 contactsPerTile = m_ampContacts.m_maxPerTile;
-	auto idxs = m_ampContacts.m_idx.GetView();
-	auto cnts = m_ampContacts.m_cnt.GetConstView();
-	
-	m_ampContacts.m_count = amp::scan(cnts, amp::getTileCount(b2Min(m_ampParts.m_count, CONTACT_THREADS)),
-		[=](const int32 i, const int32 wi) restrict(amp)
+	auto positions = m_ampParts.m_position.GetConstView();
+	auto listPositions = m_neighbourPositions.GetConstView();
+	auto moved = m_neighbourMoved.GetView();
+	amp::fill(m_neighbourMoved.arr, 0);
+	amp::forEach(m_ampParts.m_count, [=](const int32 i) AMP_RESTRICT
 	{
-		for (int32 j = 0; j < cnts[i]; j++)
-			idxs[wi + j] = i * contactsPerTile + j;
+		if ((positions[i] - listPositions[i]).Length() > maxDisplacement)
+			moved[0] = 1;
 	});
-	//amp::accelView().wait();
+}
+
+void ParticleSystem::FindContactsOfNeighbours(bool exceptZombie)
+{
+	// As long as no particle moved more than half the skin since the list was
+	// built, every pair closer than a diameter is in the list.
+	const float32 skin = m_def.neighbourSkin * m_particleDiameter;
+	if (m_neighboursValid && m_neighbourParticleCount == m_ampParts.m_count)
+	{
+		// the moved flag stays on the device until the contact count is read
+		CheckNeighboursMoved(skin / 2);
+		if (AddNeighbourContacts(exceptZombie))
+			return;
+	}
+	BuildNeighbourList(exceptZombie, skin);
+	amp::fill(m_neighbourMoved.arr, 0);
+	AddNeighbourContacts(exceptZombie);
+}
+
+bool ParticleSystem::AddNeighbourContacts(bool exceptZombie)
+{
+	// the overflow of the candidates is recounted from the contacts below
+	amp::fill(m_ampContacts.m_overflow.arr, 0);
+	const int32 cnt = m_neighbourCount;
+	if (!cnt)
+	{
+		m_ampContacts.m_count = 0;
+		return !amp::getValue(m_neighbourMoved.arr, 0);
+	}
+	amp::fill(m_ampContacts.m_cnt.arr, 0, m_ampParts.m_count);
+	auto contactCnts = m_ampContacts.m_cnt.GetView();
+	auto overflow = m_ampContacts.m_overflow.GetView();
+	auto neighbours = m_neighbours.GetConstView();
+	auto hits = m_neighbourHit.GetView();
+	auto offsets = m_neighbourOffset.GetView();
+	auto flags = m_ampParts.m_flags.GetConstView();
+	auto moved = m_neighbourMoved.GetConstView();
+	const auto addContact = GetAddContactFn(exceptZombie, m_particleDiameter);
+	const auto AddNeighbourContact = [=](const int32 i, Particle::Contact& contact) AMP_RESTRICT -> bool
+	{
+		const Particle::ContactIdx n = neighbours[i];
+		if (exceptZombie && flags[n.i] & Particle::Flag::Zombie) return false;
+		return addContact(n.i, n.j, contact);
+	};
+
+	// count, scan and fill like SearchContacts, with one thread per candidate.
+	// A stale list finds no contacts, its flag is read with the scan's sum.
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		Particle::Contact contact;
+		hits[i] = !moved[0] && AddNeighbourContact(i, contact) ? 1 : 0;
+		if (hits[i] && amp::atomicInc(contactCnts[neighbours[i].i]) >= MAX_CONTACTS_PER_PARTICLE)
+			amp::atomicInc(overflow[0]);
+	});
+	int32 stale;
+	ampCopyFuture staleFut = amp::copyAsync(m_neighbourMoved.arr, 0, stale);
+	m_ampContacts.m_count = amp::scan(m_neighbourHit.GetConstView(), cnt,
+		[=](const int32 i, const int32 wi) AMP_RESTRICT
+	{
+		offsets[i] = wi;
+	});
+	staleFut.wait();
+	if (stale) return false;
+	m_ampContacts.Resize(m_ampContacts.m_count);
+	auto contacts = m_ampContacts.m_array.GetView();
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		if (!hits[i]) return;
+		Particle::Contact contact;
+		AddNeighbourContact(i, contact);
+		contacts[offsets[i]] = contact;
+	});
+	return true;
+}
+float32 ParticleSystem::FindContactsTest()
+{
+	amp::accelView().wait();
+	Timer t = Timer();
+	FindContacts(true);
+	amp::accelView().wait();
+	return t.Stop();
+}
+void ParticleSystem::FillTestGrid(int32 cnt, float32 mass, int32 layers)
+{
+	amp::copy(ParticleGroup(), m_ampGroups, 0);
+	ResizeParticleBuffers(cnt);
+	const int32 side = (int32)ceil(sqrt((float32)cnt / layers));
+	const float32 spacing = 0.75f * m_particleDiameter;
+	auto flags = m_ampParts.m_flags.GetView();
+	auto positions = m_ampParts.m_position.GetView();
+	auto velocities = m_ampParts.m_velocity.GetView();
+	auto masses = m_ampParts.m_mass.GetView();
+	auto invMasses = m_ampParts.m_invMass.GetView();
+	auto groupIdxs = m_ampParts.m_groupIdx.GetView();
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		flags[i] = 0;
+		positions[i] = Vec3((i % side - side / 2) * spacing, (i / side % side - side / 2) * spacing,
+			i / (side * side) * spacing);
+		velocities[i] = Vec3(0, 0, 0);
+		masses[i] = mass;
+		invMasses[i] = 1 / mass;
+		groupIdxs[i] = 0;
+	});
+}
+
+void ParticleSystem::ReduceContacts()
+{
+	auto idxs = m_ampContacts.m_idx.GetView();
+	amp::forEach(m_ampContacts.m_count, [=](const int32 i) AMP_RESTRICT
+	{
+		idxs[i] = i;
+	});
+	//amp::accelView().wait();
+
+	// the sums per target follow the sorted order, and every contact gets a color
+	m_ampContacts.m_deterministic = m_def.deterministic;
+	if (m_def.deterministic)
+	{
+		m_ampContacts.Sort();
+		m_ampContacts.Color();
+	}
+	else if (m_def.colorContacts)
+		m_ampContacts.Color();
+	else
+		m_ampContacts.ClearColors();
+	m_ampContacts.Classify(m_allFlags);
 }
 
 void ParticleSystem::SortProxies()
 {
+	if (m_proxiesCoherent && m_proxyCount == m_ampParts.m_count && ResortProxies())
+		return;
+	m_proxySortPathCnts[ProxySortPath::Full]++;
+
 	// Sort the proxy array by 'tag'. This orders the particles into rows that
 	// run left-to-right, top-to-bottom. The rows are spaced m_particleDiameter
 	// apart, such that a particle in one row can only collide with the rows
 	// immediately above and below it. This ordering makes collision computation
-	// tractable.
+	// tractable. Inside a cell of a row the particles are ordered by their
+	// height layer and then by x, so stacked particles are not all candidates
+	// of each other.
+
+	// Only the bits spanned by the tags of the alive particles are sorted.
+	// That is the tag range of the particle AABB, usually 2 or 3 of the
+	// 4 digits. Zombies get tag 0 and stay in front with base = lowest - 1.
+	// Tag 0 is reserved for them, the lowest layer of the first cell is
+	// moved up one layer, so no alive particle ties with a zombie.
 
 	const float32 invDiameter = m_inverseDiameter;
 	auto proxies = m_ampParts.m_proxy.GetView();
 	auto positions = m_ampParts.m_position.GetConstView();
-	m_ampParts.ForEachWithZombies([=](const int32 i) restrict(amp)
+	auto tagRange = m_tagRange.GetView();
+	amp::copy(vector<uint32>{ 0xFFFFFFFF, 0 }, m_tagRange.arr);
+	m_ampParts.ForEachWithZombies([=](const int32 i) AMP_RESTRICT
 	{
 		const Vec3& pos = positions[i];
-		proxies[i].Set(i, computeTag(invDiameter * pos.x, invDiameter * pos.y));
+		const uint32 tag = b2Max(computeTag(invDiameter * pos.x, invDiameter * pos.y, invDiameter * pos.z), 1u);
+		proxies[i].Set(i, tag);
+		// the plain reads skip the atomics for most particles
+		if (tag < tagRange[0]) Concurrency::atomic_fetch_min(&tagRange[0], tag);
+		if (tag > tagRange[1]) Concurrency::atomic_fetch_max(&tagRange[1], tag);
 	},
-	[=](const int32 i) restrict(amp)
+	[=](const int32 i) AMP_RESTRICT
 	{
 		proxies[i].Set(INVALID_IDX, 0);
 	});
-	amp::radixSort(proxies, m_ampParts.m_count);
+	m_proxyCount = m_ampParts.m_count;
+	m_proxiesCoherent = true;
+	vector<uint32> range(2);
+	amp::copy(m_tagRange.arr, range);
+	if (range[0] > range[1]) return;
+	const uint32 base = range[0] - 1;
+	amp::radixSort(proxies, m_ampParts.m_count, m_proxySortBuffers,
+		base, amp::radixSortKeyBits(base, range[1]));
 
 	//ampArrayView<int32> sortError(1);
 	//amp::fill(sortError, 0);
 	//const int32 count = m_count;
-	//amp::forEach(count, [=, &proxies](const int32 i) restrict(amp)
+	//amp::forEach(count, [=, &proxies](const int32 i) AMP_RESTRICT
 	//{
 	//	const int32 i2 = i + 1;
 	//	if (i2 >= count) return;
@@ -1649,6 +2261,194 @@ void ParticleSystem::SortProxies()
 	//amp::accelView().wait();
 }
 
+bool ParticleSystem::ResortProxies()
+{
+	// The proxies still hold the order of the last sort, which barely changes
+	// between iterations. Their tags are updated in place. Proxies of particles
+	// that died keep their tag, so they stay in order without a particle.
+	const int32 cnt = m_proxyCount;
+	if (cnt < 2) return false;
+	const float32 invDiameter = m_inverseDiameter;
+	auto proxies = m_ampParts.m_proxy.GetView();
+	auto positions = m_ampParts.m_position.GetConstView();
+	auto flags = m_ampParts.m_flags.GetConstView();
+	amp::forEach(cnt, [=](const int32 k) AMP_RESTRICT
+	{
+		const int32 i = proxies[k].idx;
+		if (i == INVALID_IDX) return;
+		if (flags[i] & Particle::Flag::Zombie)
+		{
+			proxies[k].idx = INVALID_IDX;
+			return;
+		}
+		const Vec3& pos = positions[i];
+		// the same tags as SortProxies, which reserves 0 for zombies
+		proxies[k].tag = b2Max(computeTag(invDiameter * pos.x, invDiameter * pos.y, invDiameter * pos.z), 1u);
+	});
+
+	auto outOfOrder = m_proxyOutOfOrder.GetView();
+	const auto CountOutOfOrder = [=]() -> int32
+	{
+		amp::fill(m_proxyOutOfOrder.arr, 0);
+		amp::forEach(cnt - 1, [=](const int32 k) AMP_RESTRICT
+		{
+			if (proxies[k].tag > proxies[k + 1].tag)
+				amp::atomicInc(outOfOrder[0]);
+		});
+		return amp::getValue(m_proxyOutOfOrder.arr, 0);
+	};
+	const int32 outOfOrderCnt = CountOutOfOrder();
+	if (!outOfOrderCnt)
+	{
+		m_proxySortPathCnts[ProxySortPath::Kept]++;
+		return true;
+	}
+	if (outOfOrderCnt > cnt / PROXY_FIXUP_FRACTION) return false;
+
+	// Odd-even transposition rounds move each proxy up to one place per phase.
+	// Equal tags are never swapped, so the fix-up is stable.
+	for (int32 round = 0; round < PROXY_FIXUP_ROUNDS; round++)
+	{
+		for (int32 phase = 0; phase < 2; phase++)
+		{
+			amp::forEach(cnt / 2, [=](const int32 i) AMP_RESTRICT
+			{
+				const int32 k = 2 * i + phase;
+				if (k + 1 >= cnt) return;
+				const Proxy a = proxies[k];
+				const Proxy b = proxies[k + 1];
+				if (a.tag <= b.tag) return;
+				proxies[k] = b;
+				proxies[k + 1] = a;
+			});
+		}
+	}
+	if (CountOutOfOrder()) return false;
+	m_proxySortPathCnts[ProxySortPath::FixUp]++;
+	return true;
+}
+
+void ParticleSystem::SortProxiesNarrow()
+{
+	const float32 invDiameter = m_inverseDiameter;
+	auto proxies = m_ampParts.m_proxy.GetView();
+	auto positions = m_ampParts.m_position.GetConstView();
+	m_ampParts.ForEachWithZombies([=](const int32 i) AMP_RESTRICT
+	{
+		const Vec3& pos = positions[i];
+		proxies[i].Set(i, computeTag(invDiameter * pos.x, invDiameter * pos.y, invDiameter * pos.z));
+	},
+	[=](const int32 i) AMP_RESTRICT
+	{
+		proxies[i].Set(INVALID_IDX, 0);
+	});
+	amp::radixSort(proxies, m_ampParts.m_count);
+}
+
+void ParticleSystem::ReorderParticles()
+{
+	if (!m_def.reorderInterval || ++m_sortsSinceReorder < m_def.reorderInterval) return;
+	m_sortsSinceReorder = 0;
+	const int32 cnt = m_ampParts.m_count;
+	if (cnt <= 1) return;
+
+	// Group ranges must stay intact, so the particles of a group are sorted
+	// by tag inside the group's range, and particles outside of any group
+	// range keep their index. Sorting the proxy order stably by range start
+	// gives exactly that, as only the first particles in front of a range
+	// starting at first have a smaller range start.
+	m_reorder.Resize(cnt);
+	m_reorderIdx.Resize(cnt);
+	auto order = m_reorder.GetView();
+	auto newIdxs = m_reorderIdx.GetView();
+	auto proxies = m_ampParts.m_proxy.GetView();
+	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
+	auto groups = GetConstGroups();
+	const int32 groupCnt = m_groupCount;
+	const uint32 keyBits = amp::radixSortKeyBits(0, cnt);
+
+	// zombies have no proxy and go to the front of their range
+	amp::fill(newIdxs, 0, cnt);
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		const int32 idx = proxies[i].idx;
+		if (idx != INVALID_IDX)
+			newIdxs[idx] = i + 1;
+	});
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		order[i].Set(i, newIdxs[i]);
+	});
+	amp::radixSort(order, cnt, m_proxySortBuffers, 0, keyBits);
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		const int32 idx = order[i].idx;
+		const int32 g = groupIdxs[idx];
+		const bool inGroup = g != INVALID_IDX && g < groupCnt
+			&& groups[g].m_firstIndex <= idx && idx < groups[g].m_lastIndex;
+		order[i].tag = inGroup ? groups[g].m_firstIndex : idx;
+	});
+	amp::radixSort(order, cnt, m_proxySortBuffers, 0, keyBits);
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		newIdxs[order[i].idx] = i;
+	});
+
+	m_ampParts.Reorder(order);
+	RemapEvents(cnt, cnt);
+	// the proxies stay sorted
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		const int32 idx = proxies[i].idx;
+		if (idx != INVALID_IDX)
+			proxies[i].idx = newIdxs[idx];
+	});
+	if (m_pairCount)
+	{
+		auto pairs = m_ampPairs.section(0, m_pairCount);
+		amp::forEach(m_pairCount, [=](const int32 i) AMP_RESTRICT
+		{
+			b2ParticlePair& pair = pairs[i];
+			pair.indexA = newIdxs[pair.indexA];
+			pair.indexB = newIdxs[pair.indexB];
+		});
+	}
+	if (m_triadCount)
+	{
+		auto triads = m_ampTriads.section(0, m_triadCount);
+		amp::forEach(m_triadCount, [=](const int32 i) AMP_RESTRICT
+		{
+			b2ParticleTriad& triad = triads[i];
+			triad.indexA = newIdxs[triad.indexA];
+			triad.indexB = newIdxs[triad.indexB];
+			triad.indexC = newIdxs[triad.indexC];
+		});
+		// triads are uploaded from m_triadBuffer when reactive particles connect
+		amp::copy(m_ampTriads, m_triadBuffer, m_triadCount);
+	}
+	// particle contacts are found after this, body and ground contacts too
+	if (!m_handleIndexBuffer.empty())
+	{
+		vector<int32> newIdxBuf(cnt);
+		amp::copy(m_reorderIdx.arr, newIdxBuf, cnt);
+		vector<b2ParticleHandle*> handles(m_handleIndexBuffer.size(), nullptr);
+		for (int32 i = 0; i < cnt; i++)
+		{
+			b2ParticleHandle* handle = m_handleIndexBuffer[i];
+			if (handle) handle->SetIndex(newIdxBuf[i]);
+			handles[newIdxBuf[i]] = handle;
+		}
+		m_handleIndexBuffer.swap(handles);
+	}
+	// the host copies are read by index, e.g. by ApplyForce
+	Particle::CopyAmpArraysToBuffers(m_ampParts, m_buffers);
+	// the other columns are copied every step, the colors only in SolveInit
+	m_ampParts.m_matIdx.CopyToD11Async();
+	m_ampParts.m_weight.CopyToD11Async();
+	m_ampParts.m_color.CopyToD11Async();
+	m_neighboursValid = false;
+}
+
 template<class T>
 void ParticleSystem::reorder(vector<T>& v, const vector<int32>& order) 
 {
@@ -1698,19 +2498,19 @@ void ParticleSystem::reorder(vector<T1>& v1, vector<T2>& v2, const vector<int32>
 void ParticleSystem::ComputeAABB(b2AABB& aabb, bool addVel) const
 {
 	// TODO calc y bounds with Proxy (wait for proxy sort)
-	const uint32 cnt = m_ampParts.m_count;
+	const int32 cnt = m_ampParts.m_count;
 	auto flags = m_ampParts.m_flags.GetConstView();
 	auto positions = m_ampParts.m_position.GetConstView();
 	auto velocities = m_ampParts.m_velocity.GetConstView();
 	int32 tileCnt;
 	int32 halfCnt = amp::getTilable(cnt / 2, tileCnt);
 	ampArrayView<b2AABB> tileAABBs(b2Max(1, tileCnt));
-	amp::forEachTiledWithBarrier(halfCnt, [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+	amp::forEachTiledWithBarrier(halfCnt, [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 	{
 		const int32 gi = tIdx.global[0];
 		const int32 li = tIdx.local[0];
 		const int32 ti = tIdx.tile[0];
-		tile_static b2AABB aabbs[TILE_SIZE];
+		AMP_TILE_STATIC b2AABB aabbs[TILE_SIZE];
 		const int32 a = gi * 2;
 		const int32 b = a + 1;
 		const bool aZombie = (a >= cnt) || (flags[a] & Particle::Flag::Zombie);
@@ -1750,7 +2550,7 @@ void ParticleSystem::ComputeAABB(b2AABB& aabb, bool addVel) const
 			aabb.upperBound = b2Max(aPos, bPos);
 		}
 		tIdx.barrier.wait_with_tile_static_memory_fence();
-		for (uint32 stride = TILE_SIZE_HALF; stride > 0; stride /= 2)
+		for (int32 stride = TILE_SIZE_HALF; stride > 0; stride /= 2)
 		{
 			if (li < stride)
 			{
@@ -1919,6 +2719,8 @@ void ParticleSystem::UpdateBodyContacts()
 {
 	// If the particle contact listener is enabled, generate a set of
 	// fixture / particle contacts.
+	const Particle::EventLog log = GetEventLog();
+	const bool logTouches = IsLastIteration() && log.Logs(Particle::Event::BodyTouched);
 	m_futureUpdateBodyContacts.RunAsync([=]()
 	{
 		m_ampBodyContacts.Clear();
@@ -1939,12 +2741,13 @@ void ParticleSystem::UpdateBodyContacts()
 
 		auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
 		auto groups = GetConstGroups();
-		const auto shouldCollide = [=](int32 i, const Fixture& f) restrict(amp) -> bool
+		const auto shouldCollide = [=](int32 i, const Fixture& f) AMP_RESTRICT -> bool
 		{
 			return ShouldCollisionGroupsCollide(f.m_filter.collisionGroup, groups[groupIdxs[i]].m_collisionGroup);
 		};
 
 		
+		m_ampBodyContacts.m_deterministic = m_def.deterministic;
 		auto bodyContactCnts = m_ampBodyContacts.m_cnt.GetView();
 		amp::fill(bodyContactCnts, 0, m_ampParts.m_count);
 
@@ -1958,7 +2761,7 @@ void ParticleSystem::UpdateBodyContacts()
 		const float32 doublePartDiameter = 2 * m_particleDiameter;
 		const float32 invDiameter = m_inverseDiameter;
 		const auto computeDistance = [=] (const Fixture& f, const b2Transform& xf, const Vec3& p,
-			float32& d, Vec3& n, int32 childIndex) restrict(amp) -> bool
+			float32& d, Vec3& n, int32 childIndex) AMP_RESTRICT -> bool
 		{
 			//if (f.m_shapeType == b2Shape::e_chain)
 			//{
@@ -1988,7 +2791,7 @@ void ParticleSystem::UpdateBodyContacts()
 		auto flags = m_ampParts.m_flags.GetConstView();
 		auto invMasses = m_ampParts.m_invMass.GetConstView();
 		auto bodyContacts = m_ampBodyContacts.m_array.GetView();
-		ForEachInsideBounds(fixtureBounds, [=](int32 i, int32 fixtureIdx, int32 childIdx) restrict(amp)
+		ForEachInsideBounds(fixtureBounds, [=](int32 i, int32 fixtureIdx, int32 childIdx) AMP_RESTRICT
 		{
 			const Fixture& fixture = fixtures[fixtureIdx];
 			if (!shouldCollide(i, fixture)) return;
@@ -1996,7 +2799,7 @@ void ParticleSystem::UpdateBodyContacts()
 			int32& bodyContactIdx = bodyContactCnts[i];
 			if (bodyContactIdx + 1 >= MAX_BODY_CONTACTS_PER_PARTICLE) return;
 		
-			float32 d;
+			float32 d = b2_maxFloat;
 			Vec3 n;
 			const int32 bIdx = fixture.m_bodyIdx;
 			const Body& b = bodies[bIdx];
@@ -2022,7 +2825,7 @@ void ParticleSystem::UpdateBodyContacts()
 			const float32 invBI = bI > 0 ? 1 / bI : 0;
 			const float32 invAm = flags[i] & Particle::Mat::Flag::Wall ? 0 : invMasses[i];
 			const Vec2 rp = ap - bp;
-			const float32 rpn = b2Cross(rp, n);
+			const float32 rpn = b2Cross(rp, (Vec2)n);
 			const float32 invM = invAm + invBm + invBI * rpn * rpn;
 			
 			contact.weight = b2Max(1 - d * invDiameter, 1.0f);
@@ -2036,16 +2839,25 @@ void ParticleSystem::UpdateBodyContacts()
 		//amp::copy(contactCnts, cpuContactCnts, m_count);
 		
 		auto bodyContactIdxs = m_ampBodyContacts.m_idx.GetView();
+		auto bodyContactOffsets = m_ampBodyContacts.m_offset.GetView();
 		auto constBodyContactCnts = m_ampBodyContacts.m_cnt.GetConstView();
 		m_ampBodyContacts.m_count = amp::scan(constBodyContactCnts, m_ampParts.m_count,
-			[=](const int32 i, const int32 wi) restrict(amp)
+			[=](const int32 i, const int32 wi) AMP_RESTRICT
 		{
+			bodyContactOffsets[i] = wi;
 			for (int32 j = 0; j < constBodyContactCnts[i]; j++)
 				bodyContactIdxs[wi + j].Set(i, j);
 		});
 	
 		if (m_def.strictContactCheck)
 			RemoveSpuriousBodyContacts();
+		if (logTouches)
+		{
+			m_ampBodyContacts.ForEach([=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
+			{
+				log.Add(Particle::Event::BodyTouched, i, contact.bodyIdx, contact.fixtureIdx);
+			});
+		}
 	});
 }
 
@@ -2064,7 +2876,7 @@ void ParticleSystem::UpdateGroundContacts()
 		auto positions = m_ampParts.m_position.GetConstView();
 		auto masses = m_ampParts.m_mass.GetConstView();
 		auto groundTiles = m_world.m_ground->GetConstTiles();
-		m_ampParts.ForEach([=](int32 i) restrict(amp)
+		m_ampParts.ForEach([=](int32 i) AMP_RESTRICT
 		{
 			const Vec3& p = positions[i];
 			int32 tx = p.x * invStride;
@@ -2155,7 +2967,7 @@ void ParticleSystem::RemoveSpuriousBodyContacts()
 //	if (!m_bodyContactCount) return;
 //	ampArrayView<const float32> add = bodyRes.section(0, m_bodyContactCount);
 //	auto& bodyContactPartIdxs = m_ampBodyContactPartIdxs;
-//	amp::forEach(m_bodyContactCount, [=, &dst, &bodyContactPartIdxs](const int32 i) restrict(amp)
+//	amp::forEach(m_bodyContactCount, [=, &dst, &bodyContactPartIdxs](const int32 i) AMP_RESTRICT
 //	{
 //		amp::atomicAdd(dst[bodyContactPartIdxs[i]], add[i]);
 //	});
@@ -2165,7 +2977,7 @@ void ParticleSystem::RemoveSpuriousBodyContacts()
 //	if (!m_bodyContactCount) return;
 //	ampArrayView<const Vec3> add = bodyRes.section(0, m_bodyContactCount);
 //	auto& bodyContactPartIdxs = m_ampBodyContactPartIdxs;
-//	amp::forEach(m_bodyContactCount, [=, &dst, &bodyContactPartIdxs](const int32 i) restrict(amp)
+//	amp::forEach(m_bodyContactCount, [=, &dst, &bodyContactPartIdxs](const int32 i) AMP_RESTRICT
 //	{
 //		amp::atomicAdd(dst[bodyContactPartIdxs[i]], add[i]);
 //	});
@@ -2175,11 +2987,13 @@ static inline bool IsSignificantForce(Vec3 force)
 {
 	return force.x != 0 || force.y != 0 || force.z != 0;
 }
-static inline bool IsSignificantForce(Vec3 force) restrict(amp)
+#ifndef AMP_CPU_BACKEND
+static inline bool IsSignificantForce(Vec3 force) AMP_RESTRICT
 {
 	return force.x != 0 || force.y != 0 || force.z != 0;
 }
-static inline bool IsSignificantForce(Vec2 force) restrict(amp)
+#endif
+static inline bool IsSignificantForce(Vec2 force) AMP_RESTRICT
 {
 	return force.x != 0 || force.y != 0;
 }
@@ -2193,7 +3007,6 @@ void ParticleSystem::SolveCollision()
 	// and modifies velocities of them so that they will move just in front of
 	// boundary. This function also applies the reaction force to
 	// bodies as precisely as the numerical stability is kept.
-	const b2TimeStep& step = m_subStep;
 
 	//vector<b2AABBFixtureProxy> fixtureBounds;
 
@@ -2212,7 +3025,7 @@ void ParticleSystem::SolveCollision()
 	auto positions = m_ampParts.m_position.GetView();
 	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
 	auto groups = GetConstGroups();
-	const auto shouldCollide = [=](const Fixture& f, int32 i) restrict(amp) -> bool
+	const auto shouldCollide = [=](const Fixture& f, int32 i) AMP_RESTRICT -> bool
 	{
 		return ShouldCollisionGroupsCollide(f.m_filter.collisionGroup, groups[groupIdxs[i]].m_collisionGroup);
 	};
@@ -2222,7 +3035,7 @@ void ParticleSystem::SolveCollision()
 	auto edgeShapes = GetConstEdgeShapes();
 	auto polygonShapes = GetConstPolygonShapes();
 	const auto rayCast = [=](const Fixture& f, RayCastOutput& output, const RayCastInput& input,
-		const float32 z, const b2Transform& xf, int32 childIdx) restrict(amp) -> bool
+		const float32 z, const b2Transform& xf, int32 childIdx) AMP_RESTRICT -> bool
 	{
 		switch (f.m_shapeType)
 		{
@@ -2250,20 +3063,24 @@ void ParticleSystem::SolveCollision()
 			//if (!s.TestZ(xf, z)) return false;
 			return s.RayCast(output, input, xf);
 		}
+		default:
+			break;
 		}
 		return false;
 	};
 
 	auto flags = m_ampParts.m_flags.GetConstView();
 	auto forces = m_ampParts.m_force.GetView();
-	const auto particleAtomicApplyForce = [=](int32 index, const Vec2& force) restrict(amp)
+	// the force column is optional
+	const bool hasForce = m_ampParts.HasColumn(Particle::AmpArrays::Column::Force);
+	const auto particleAtomicApplyForce = [=](int32 index, const Vec2& force) AMP_RESTRICT
 	{
-		if (IsSignificantForce(force) && !(flags[index] & Particle::Mat::Flag::Wall))
+		if (hasForce && IsSignificantForce(force) && !(flags[index] & Particle::Mat::Flag::Wall))
 			amp::atomicAdd(forces[index], force);
 	};
-	const auto particleApplyForce = [=](int32 index, const Vec2& force) restrict(amp)
+	const auto particleApplyForce = [=](int32 index, const Vec2& force) AMP_RESTRICT
 	{
-		if (IsSignificantForce(force) && !(flags[index] & Particle::Mat::Flag::Wall))
+		if (hasForce && IsSignificantForce(force) && !(flags[index] & Particle::Mat::Flag::Wall))
 			forces[index] += force;
 	};
 
@@ -2275,7 +3092,7 @@ void ParticleSystem::SolveCollision()
 	auto fixtures = GetConstFixtures();
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto masses = m_ampParts.m_mass.GetConstView();
-	//AmpForEachInsideBounds(fixtureBounds, [=](int32 a, int32 fixtureIdx, int32 childIdx) restrict(amp)
+	//AmpForEachInsideBounds(fixtureBounds, [=](int32 a, int32 fixtureIdx, int32 childIdx) AMP_RESTRICT
 	//{
 	//	const Fixture& fixture = fixtures[fixtureIdx];
 	//	if (!shouldCollide(fixture, a)) return;
@@ -2319,7 +3136,7 @@ void ParticleSystem::SolveCollision()
 	//});
 
 	
-	m_ampBodyContacts.ForEachPotential([=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+	m_ampBodyContacts.ForEachPotential([=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
 	{
 		const Vec3 ap = positions[i];
 		const Body& body = bodies[contact.bodyIdx];
@@ -2363,7 +3180,7 @@ void ParticleSystem::SolveCollision()
 
 	const float32 heightOffset = b2_linearSlop; // m_particleRadius;
 	auto groundTiles = m_world.m_ground->GetConstTiles();
-	m_ampGroundContacts.ForEach([=](const int32 a, const Particle::GroundContact& contact) restrict(amp)
+	m_ampGroundContacts.ForEach([=](const int32 a, const Particle::GroundContact& contact) AMP_RESTRICT
 	{
 		const Vec3 p1 = positions[a];
 		Vec3& v = velocities[a];
@@ -2389,7 +3206,7 @@ void ParticleSystem::SolveBarrier()
 
 	auto flags = m_ampParts.m_flags.GetConstView();
 	auto velocities = m_ampParts.m_velocity.GetView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		if ((flags[i] & Particle::Mat::k_barrierWallFlags) == Particle::Mat::k_barrierWallFlags)
 			velocities[i].SetZero();
@@ -2400,7 +3217,7 @@ void ParticleSystem::SolveBarrier()
 
 	const int32 timeStamp = m_timestamp;
 	auto masses = m_ampParts.m_mass.GetConstView();
-	const auto UpdateStatistics = [=](const int32 partIdx, const ParticleGroup& group) restrict(amp)
+	const auto UpdateStatistics = [=](const int32 partIdx, const ParticleGroup& group) AMP_RESTRICT
 	{
 		if (group.m_timestamp == timeStamp) return;
 		const float32 m = masses[partIdx];
@@ -2441,7 +3258,7 @@ void ParticleSystem::SolveBarrier()
 	};
 
 	const auto GetLinearVelocity = [=](const ParticleGroup & group, int32 partIdx,
-		const Vec2 & point) restrict(amp) -> Vec2
+		const Vec2 & point) AMP_RESTRICT -> Vec2
 	{
 		if (group.HasFlag(ParticleGroup::Flag::Rigid))
 		{
@@ -2452,7 +3269,7 @@ void ParticleSystem::SolveBarrier()
 			return velocities[partIdx];
 	};
 	auto proxies = m_ampParts.m_proxy.GetConstView();
-	const auto TagLowerBound = [=](uint32 first, uint32 last, uint32 tag) restrict(amp) -> int32
+	const auto TagLowerBound = [=](uint32 first, uint32 last, uint32 tag) AMP_RESTRICT -> int32
 	{
 		int32 i, step;
 		int32 count = last - first;
@@ -2470,7 +3287,7 @@ void ParticleSystem::SolveBarrier()
 		}
 		return first;
 	};
-	const auto TagUpperBound = [=](uint32 first, uint32 last, uint32 tag) restrict(amp) -> int32
+	const auto TagUpperBound = [=](uint32 first, uint32 last, uint32 tag) AMP_RESTRICT -> int32
 	{
 		int32 i, step;
 		int32 count = last - first;
@@ -2494,7 +3311,7 @@ void ParticleSystem::SolveBarrier()
 		/// Construct an enumerator with bounds of tags and a range of proxies.
 		AmpInsideBoundsEnumerator(
 			uint32 lower, uint32 upper,
-			int32 first, int32 last) restrict(amp)
+			int32 first, int32 last) AMP_RESTRICT
 		{
 			m_xLower = lower & xMask;
 			m_xUpper = upper & xMask;
@@ -2515,11 +3332,11 @@ void ParticleSystem::SolveBarrier()
 	const int32 cnt = m_ampParts.m_count;
 	const float32 invDiameter = m_inverseDiameter;
 	const auto GetInsideBoundsEnumerator = [=](const b2AABB & aabb)
-		restrict(amp) -> AmpInsideBoundsEnumerator
+		AMP_RESTRICT -> AmpInsideBoundsEnumerator
 	{
 		uint32 lowerTag = computeTag(invDiameter * aabb.lowerBound.x - 1,
 			invDiameter * aabb.lowerBound.y - 1);
-		uint32 upperTag = computeTag(invDiameter * aabb.upperBound.x + 1,
+		uint32 upperTag = computeUpperTag(invDiameter * aabb.upperBound.x + 1,
 			invDiameter * aabb.upperBound.y + 1);
 
 		const int32 first = TagLowerBound(0, cnt, lowerTag);
@@ -2528,12 +3345,13 @@ void ParticleSystem::SolveBarrier()
 		return AmpInsideBoundsEnumerator(lowerTag, upperTag, first, last);
 	};
 
-	const auto GetNext = [=](AmpInsideBoundsEnumerator& ibe) restrict(amp) -> int32
+	const auto GetNext = [=](AmpInsideBoundsEnumerator& ibe) AMP_RESTRICT -> int32
 	{
 		while (ibe.m_first < ibe.m_last)
 		{
 			uint32 xTag = proxies[ibe.m_first].tag & xMask;
-			if (xTag >= ibe.m_xLower && xTag <= ibe.m_xUpper)
+			if (xTag >= ibe.m_xLower && xTag <= ibe.m_xUpper
+				&& proxies[ibe.m_first].idx != INVALID_IDX)
 			{
 				return proxies[ibe.m_first++].idx;
 			}
@@ -2542,20 +3360,27 @@ void ParticleSystem::SolveBarrier()
 		return -1;
 	};
 
-	auto forces = m_ampParts.m_force.GetView();
+	const bool hasForce = m_ampParts.HasColumn(Particle::AmpArrays::Column::Force);
 	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
 	auto groups = GetGroups();
-	ForEachPair([=](const int32 i) restrict(amp)
+	const auto GetPairEnumerator = [=](const b2ParticlePair& pair) AMP_RESTRICT -> AmpInsideBoundsEnumerator
+	{
+		const Vec2 pa = positions[pair.indexA];
+		const Vec2 pb = positions[pair.indexB];
+		b2AABB aabb;
+		aabb.lowerBound = b2Min(pa, pb);
+		aabb.upperBound = b2Max(pa, pb);
+		return GetInsideBoundsEnumerator(aabb);
+	};
+	// Finds the next particle c passing between the particles of the pair and adds
+	// the impulses that stop it there. Returns false after the last one.
+	const auto AddNextHit = [=](const b2ParticlePair& pair, AmpInsideBoundsEnumerator& enumerator,
+		amp::TargetValues<2, Vec3>& impulses) AMP_RESTRICT -> bool
 	{
-		const b2ParticlePair& pair = pairs[i];
-		if (!(pair.flags & Particle::Mat::Flag::Barrier)) return;
 		const int32 a = pair.indexA;
 		const int32 b = pair.indexB;
 		const Vec2 pa = positions[a];
 		const Vec2 pb = positions[b];
-		b2AABB aabb;
-		aabb.lowerBound = b2Min(pa, pb);
-		aabb.upperBound = b2Max(pa, pb);
 		const int32 aGroupIdx = groupIdxs[a];
 		const int32 bGroupIdx = groupIdxs[b];
 		ParticleGroup& aGroup = groups[aGroupIdx];
@@ -2564,7 +3389,6 @@ void ParticleSystem::SolveBarrier()
 		const Vec2 vb = GetLinearVelocity(bGroup, b, pb);
 		const Vec2 pba = pb - pa;
 		const Vec2 vba = vb - va;
-		AmpInsideBoundsEnumerator enumerator = GetInsideBoundsEnumerator(aabb);
 		int32 c;
 		while ((c = GetNext(enumerator)) >= 0)
 		{
@@ -2628,26 +3452,95 @@ void ParticleSystem::SolveBarrier()
 					// distributed in the group->
 					const float32 mass = cGroup.m_mass;
 					const float32 inertia = cGroup.m_inertia;
-					if (mass > 0)
-					{
-						cGroup.m_linearVelocity += 1 / mass * f;
-					}
-					if (inertia > 0)
-						cGroup.m_angularVelocity +=
-						b2Cross(pc - cGroup.m_center, f) / inertia;
+					impulses.Add(ImpulseTarget::Group | cGroupIdx, Vec3(
+						mass > 0 ? 1 / mass * f : Vec2(0, 0),
+						inertia > 0 ? b2Cross(pc - cGroup.m_center, f) / inertia : 0));
 				}
 				else
 				{
-					amp::atomicAdd(velocities[c], dv);
+					impulses.Add(ImpulseTarget::Velocity | c, Vec3(dv, 0));
 				}
 				// Apply a reversed force to particle c after particle
 				// movement so that momentum will be preserved.
 				Vec2 force = -step.inv_dt * f;
-				if (IsSignificantForce(force) && flags[c] & Particle::Mat::Flag::Wall)
-					amp::atomicAdd(forces[c], force);
+				if (hasForce && IsSignificantForce(force) && flags[c] & Particle::Mat::Flag::Wall)
+					impulses.Add(ImpulseTarget::Force | c, Vec3(force, 0));
+				return true;
+			}
+		}
+		return false;
+	};
+	const auto applyImpulse = GetApplyImpulseFn();
+	if (!m_def.deterministic)
+	{
+		amp::forEach(m_pairCount, [=](const int32 i) AMP_RESTRICT
+		{
+			const b2ParticlePair& pair = pairs[i];
+			if (!(pair.flags & Particle::Mat::Flag::Barrier)) return;
+			AmpInsideBoundsEnumerator enumerator = GetPairEnumerator(pair);
+			amp::TargetValues<2, Vec3> impulses;
+			for (impulses.cnt = 0; AddNextHit(pair, enumerator, impulses); impulses.cnt = 0)
+			{
+				for (int32 j = 0; j < impulses.cnt; j++)
+					applyImpulse(impulses.targets[j], impulses.values[j], true);
+			}
+		});
+		return;
+	}
+
+	// Deterministic mode counts the impulses of each pair, writes them in pair order
+	// and sums up those of each target in that order. The statistics of the rigid
+	// groups are updated first, so both passes over the pairs only read them.
+	amp::forEach(m_groupCount, [=](const int32 g) AMP_RESTRICT
+	{
+		const ParticleGroup& group = groups[g];
+		if (group.m_firstIndex != INVALID_IDX && group.m_firstIndex < group.m_lastIndex
+			&& group.HasFlag(ParticleGroup::Flag::Rigid))
+			UpdateStatistics(group.m_firstIndex, group);
+	});
+	const int32 pairCnt = m_pairCount;
+	if (!pairCnt) return;
+	ampArrayView<int32> impulseCnts = amp::scratch().Alloc<int32>(pairCnt);
+	amp::forEach(pairCnt, [=](const int32 i) AMP_RESTRICT
+	{
+		const b2ParticlePair& pair = pairs[i];
+		int32 cnt = 0;
+		if (pair.flags & Particle::Mat::Flag::Barrier)
+		{
+			AmpInsideBoundsEnumerator enumerator = GetPairEnumerator(pair);
+			amp::TargetValues<2, Vec3> impulses;
+			for (impulses.cnt = 0; AddNextHit(pair, enumerator, impulses); impulses.cnt = 0)
+				cnt += impulses.cnt;
+		}
+		impulseCnts[i] = cnt;
+	});
+	ampArrayView<int32> impulseOffsets = amp::scratch().Alloc<int32>(pairCnt);
+	const int32 impulseCnt = amp::scan(ampArrayView<const int32>(impulseCnts), pairCnt,
+		[=](const int32 i, const int32 wi) AMP_RESTRICT
+	{
+		impulseOffsets[i] = wi;
+	});
+	if (!impulseCnt) return;
+	ampArrayView<Proxy> order = amp::scratch().Alloc<Proxy>(impulseCnt);
+	ampArrayView<Vec3> impulseValues = amp::scratch().Alloc<Vec3>(impulseCnt);
+	amp::forEach(pairCnt, [=](const int32 i) AMP_RESTRICT
+	{
+		const b2ParticlePair& pair = pairs[i];
+		if (!(pair.flags & Particle::Mat::Flag::Barrier)) return;
+		AmpInsideBoundsEnumerator enumerator = GetPairEnumerator(pair);
+		amp::TargetValues<2, Vec3> impulses;
+		int32 k = impulseOffsets[i];
+		for (impulses.cnt = 0; AddNextHit(pair, enumerator, impulses); impulses.cnt = 0)
+		{
+			for (int32 j = 0; j < impulses.cnt; j++, k++)
+			{
+				order[k].Set(k, impulses.targets[j]);
+				impulseValues[k] = impulses.values[j];
 			}
 		}
 	});
+	amp::reduceByTarget(order, ampArrayView<const Vec3>(impulseValues), impulseCnt,
+		m_targetSortBuffers, 32, applyImpulse);
 }
 
 bool ParticleSystem::ShouldSolve()
@@ -2662,25 +3555,50 @@ void ParticleSystem::SolveInit(int32 timestamp)
 	//if (!m_expireTimeBuf.empty())
 	//	SolveLifetimes(m_step);
 	m_iteration = 0;
+	m_iterationCnt = m_step.particleIterations;
 	m_timestamp = timestamp;
+	// particles are created and destroyed between steps
+	m_neighboursValid = false;
+	amp::scratch().Reset();
+	// Array keeps its minimum capacity
+	m_events.Resize(m_def.eventTypes ? m_def.maxEvents : 0);
+	amp::fill(m_eventCnt.arr, 0);
 
 	CopyBox2DToGPUAsync();
 	SolveZombie();
+	m_ampParts.UpdateBucketCounts();
 	m_ampParts.m_color.CopyToD11Async();
 	if (m_needsUpdateAllParticleFlags)
 		UpdateAllParticleFlags();
 	
 	if (m_needsUpdateAllGroupFlags)
 		UpdateAllGroupFlags();
+	m_ampParts.ReleaseUnusedColumns(GetUsedColumns());
+}
 
+uint32 ParticleSystem::GetUsedColumns() const
+{
+	typedef Particle::AmpArrays::Column Column;
+	uint32 columns = 0;
+	if (m_hasForce)
+		columns |= 1u << Column::Force;
+	if (m_allFlags & Particle::Mat::Flag::StaticPressure)
+		columns |= 1u << Column::StaticPressure;
+	if (m_allGroupFlags & ParticleGroup::Flag::Solid)
+		columns |= 1u << Column::Depth;
+	if (m_allFlags & Particle::Mat::Flag::Tensile)
+		columns |= 1u << Column::Tensile;
+	return columns;
 }
 
 void ParticleSystem::InitStep()
 {
 	++m_timestamp;
 	m_subStep = m_step;
-	m_subStep.dt /= m_step.particleIterations;
-	m_subStep.inv_dt *= m_step.particleIterations;
+	m_subStep.dt /= m_iterationCnt;
+	m_subStep.inv_dt *= m_iterationCnt;
+	// no scratch view outlives its iteration, so they don't stack up over the step
+	amp::scratch().Reset();
 
 	//amp::accelView().wait();
 }
@@ -2703,13 +3621,230 @@ void ParticleSystem::SolveEnd()
 		if (m_debugContacts) m_ampCopyFutContacts.wait();
 		m_ampParts.WaitForCopies();
 		//amp::accelView().wait();
+		// before the count is read, so the deaths are in the log of their step
+		LogDeaths();
+	}
+	if (m_def.eventTypes)
+		m_eventCntFuture.set(amp::copyAsync(m_eventCnt.arr, 0, m_eventCntHost));
+}
+
+bool ParticleSystem::Step(int32 iterations, int32 timestamp)
+{
+	if (!ShouldSolve()) return false;
+
+	SolveInit(timestamp);
+	// m_step is the world's, so only this step runs the requested iterations
+	if (iterations > 0)
+		m_iterationCnt = iterations;
+	if (m_def.concurrentPasses)
+	{
+		if (m_passGraph.Empty()) BuildPassGraph();
+		for (int32 i = 0; i < m_iterationCnt; i++)
+			m_passGraph.Run();
+		SolveEnd();
+
+		if (m_stepCallback) m_stepCallback(m_ampParts.m_count);
+		return true;
+	}
+	for (int32 i = 0; i < m_iterationCnt; i++)
+	{
+		InitStep();
+		SortProxies();
+		ReorderParticles();
+		UpdateContacts(true);
+		ReduceContacts();
+		ComputeDepth();
+		UpdatePairsAndTriadsWithReactiveParticles();
+
+		// Velocity
+		SolveForce();
+		WaitForUpdateBodyContacts();
+		ComputeWeight();
+		SolveViscous();
+		SolveRepulsive();
+		SolvePowder();
+		WaitForComputeWeight();
+
+		SolveTensile();
+		SolveSolid();
+		SolveGravity();
+		SolveWind();
+		SolveStaticPressure();
+		SolvePressure();
+		SolveDamping();
+		SolveExtraDamping();
+		SolveAirResistance();
+		SolveElastic();
+		SolveSpring();
+		LimitVelocity();
+		SolveRigidDamping();
+		SolveBarrier();
+		SolveCollision();
+		SolveRigid();
+		SolveWall();
+		CopyVelocities();
+		SolveKillNotMoving();
+		SolveFluid();
+
+		// Burning and Heat
+		SolveFlame();
+		SolveIgnite();
+		SolveExtinguish();
+		SolveHeatConduct();
+		SolveLooseHeat();
+		CopyHeats();
+		SolveChangeMat();
+
+		// Find Dead
+		SolveHealth();
+		CopyHealths();
+		SolveSource();
+		SolvePosition();
+		SolveOutOfBounds();
+		CopyFlags();
+		CopyBodies();
+
+		IncrementIteration();
 	}
+	SolveEnd();
+
+	if (m_stepCallback) m_stepCallback(m_ampParts.m_count);
+	return true;
+}
+
+void ParticleSystem::BuildPassGraph()
+{
+	// Every pass needs the sub step. Passes with a zombie filter or a material flag test also need Flags.
+	const auto add = [=](const char* name, const TaskGraph::Function& pass, uint32 needs, uint32 modifies)
+	{
+		m_passGraph.Add(name, pass, needs | Res::Step, modifies);
+	};
+	const auto addPass = [=](const char* name, void (ParticleSystem::*pass)(), uint32 needs, uint32 modifies)
+	{
+		add(name, [=]() { (this->*pass)(); }, needs, modifies);
+	};
+	// only the deterministic ForEachApply shares its impulse buffers between passes
+	const uint32 bodyImpulses = m_def.deterministic ? Res::BodyImpulses : 0;
+	m_passGraph.Clear();
+
+	// in the order of Step, the read and write sets find the passes that can run concurrently
+	addPass("InitStep", &ParticleSystem::InitStep, 0, Res::All);
+	addPass("SortProxies", &ParticleSystem::SortProxies, Res::Position | Res::Flags, Res::Proxies);
+	// modifying all resources makes it a barrier, so it is only added while reordering is on
+	if (m_def.reorderInterval)
+		addPass("ReorderParticles", &ParticleSystem::ReorderParticles, Res::Proxies, Res::All);
+	// UpdateContacts split up, so body and ground contacts are found alongside particle contacts
+	add("UpdateBodyContacts", [=]()
+	{
+		UpdateBodyContacts();
+		m_futureUpdateBodyContacts.wait();
+	}, Res::Proxies | Res::Position | Res::Flags | Res::Mass | Res::Groups | Res::BodyMotion, Res::BodyContacts);
+	add("UpdateGroundContacts", [=]()
+	{
+		UpdateGroundContacts();
+		m_futureUpdateGroundContacts.wait();
+	}, Res::Proxies | Res::Position | Res::Flags | Res::Mass | Res::Ground, Res::GroundContacts);
+	add("FindContacts", [=]() { FindContacts(true); },
+		Res::Proxies | Res::Position | Res::Flags | Res::Groups, Res::Contacts);
+	addPass("ReduceContacts", &ParticleSystem::ReduceContacts, 0, Res::Contacts);
+	addPass("ComputeDepth", &ParticleSystem::ComputeDepth,
+		Res::Contacts | Res::Groups, Res::Depth | Res::Accumulation);
+	addPass("UpdatePairsAndTriadsWithReactiveParticles", &ParticleSystem::UpdatePairsAndTriadsWithReactiveParticles,
+		Res::Contacts | Res::Position | Res::Flags | Res::Groups, Res::StateFlags | Res::PairsTriads);
+
+	// Velocity
+	addPass("SolveForce", &ParticleSystem::SolveForce, Res::Mass | Res::Flags, Res::Velocity | Res::Force);
+	// Step defers the weights to WaitForComputeWeight, none of the passes in between read them
+	add("ComputeWeight", [=]()
+	{
+		ComputeWeight();
+		WaitForComputeWeight();
+	}, Res::Contacts | Res::BodyContacts | Res::GroundContacts, Res::Weight);
+	// with fused contact passes SolveViscous also sums up the weights
+	addPass("SolveViscous", &ParticleSystem::SolveViscous,
+		Res::Mass | Res::Position | Res::Flags | Res::Contacts | Res::BodyContacts | Res::GroundContacts,
+		Res::Velocity | Res::BodyMotion | bodyImpulses | (m_def.fuseContactPasses ? Res::Weight : 0));
+	addPass("SolveRepulsive", &ParticleSystem::SolveRepulsive,
+		Res::Mass | Res::Groups | Res::Contacts, Res::Velocity);
+	addPass("SolvePowder", &ParticleSystem::SolvePowder, Res::Mass | Res::Contacts, Res::Velocity);
+
+	addPass("SolveTensile", &ParticleSystem::SolveTensile,
+		Res::Mass | Res::Weight | Res::Contacts, Res::Velocity | Res::Accumulation);
+	addPass("SolveSolid", &ParticleSystem::SolveSolid,
+		Res::Mass | Res::Depth | Res::Groups | Res::Contacts, Res::Velocity);
+	// applies the wind, air resistance and velocity limit too if m_def.fuseIntegration is set
+	addPass("SolveGravity", &ParticleSystem::SolveGravity, Res::Mass | Res::Flags, Res::Velocity);
+	addPass("SolveWind", &ParticleSystem::SolveWind, Res::Mass | Res::Flags, Res::Velocity);
+	addPass("SolveStaticPressure", &ParticleSystem::SolveStaticPressure,
+		Res::Mass | Res::Weight | Res::Flags | Res::Contacts, Res::StaticPressure | Res::Accumulation);
+	addPass("SolvePressure", &ParticleSystem::SolvePressure,
+		Res::Mass | Res::Position | Res::Weight | Res::StaticPressure | Res::Flags | Res::Contacts
+		| Res::BodyContacts | Res::GroundContacts | Res::Ground,
+		Res::Velocity | Res::Accumulation | Res::BodyMotion | bodyImpulses);
+	addPass("SolveDamping", &ParticleSystem::SolveDamping,
+		Res::Mass | Res::Position | Res::Flags | Res::Contacts | Res::BodyContacts | Res::GroundContacts | Res::Ground,
+		Res::Velocity | Res::BodyMotion | bodyImpulses);
+	addPass("SolveExtraDamping", &ParticleSystem::SolveExtraDamping,
+		Res::Mass | Res::Position | Res::Flags | Res::BodyContacts | Res::GroundContacts,
+		Res::Velocity | Res::BodyMotion | bodyImpulses);
+	addPass("SolveAirResistance", &ParticleSystem::SolveAirResistance, Res::Mass | Res::Flags, Res::Velocity);
+	addPass("SolveElastic", &ParticleSystem::SolveElastic, Res::Position | Res::PairsTriads, Res::Velocity);
+	addPass("SolveSpring", &ParticleSystem::SolveSpring, Res::Position | Res::PairsTriads, Res::Velocity);
+	addPass("LimitVelocity", &ParticleSystem::LimitVelocity, Res::Flags, Res::Velocity);
+	addPass("SolveRigidDamping", &ParticleSystem::SolveRigidDamping,
+		Res::Mass | Res::MatIdx | Res::Position | Res::Flags | Res::Contacts | Res::BodyContacts,
+		Res::Velocity | Res::Groups | Res::BodyMotion);
+	addPass("SolveBarrier", &ParticleSystem::SolveBarrier,
+		Res::Mass | Res::Position | Res::Flags | Res::Proxies | Res::PairsTriads,
+		Res::Velocity | Res::Force | Res::Groups);
+	addPass("SolveCollision", &ParticleSystem::SolveCollision,
+		Res::Mass | Res::Flags | Res::Groups | Res::BodyContacts | Res::GroundContacts | Res::BodyMotion | Res::Ground,
+		Res::Position | Res::Velocity | Res::Force);
+	addPass("SolveRigid", &ParticleSystem::SolveRigid, Res::Position | Res::Mass | Res::Flags, Res::Velocity | Res::Groups);
+	addPass("SolveWall", &ParticleSystem::SolveWall, Res::Flags, Res::Velocity);
+	addPass("CopyVelocities", &ParticleSystem::CopyVelocities, Res::Velocity, 0);
+	addPass("SolveKillNotMoving", &ParticleSystem::SolveKillNotMoving, Res::Velocity | Res::Weight, Res::Flags);
+	addPass("SolveFluid", &ParticleSystem::SolveFluid,
+		Res::MatIdx | Res::Mass | Res::BodyContacts | Res::GroundContacts,
+		Res::Flags | Res::Heat | Res::BodyHeat | Res::BodyMotion | Res::Ground);
+
+	// Burning and Heat, body flags go with BodyMotion since impulses wake the bodies
+	addPass("SolveFlame", &ParticleSystem::SolveFlame,
+		Res::MatIdx | Res::Weight | Res::Flags, Res::Heat | Res::Health | Res::Buckets);
+	addPass("SolveIgnite", &ParticleSystem::SolveIgnite,
+		Res::Heat | Res::MatIdx | Res::Flags | Res::Contacts | Res::BodyContacts | Res::BodyHeat,
+		Res::StateFlags | Res::BodyMotion | Res::Buckets);
+	addPass("SolveExtinguish", &ParticleSystem::SolveExtinguish,
+		Res::Heat | Res::MatIdx | Res::Flags | Res::Contacts | Res::BodyContacts | Res::BodyHeat,
+		Res::StateFlags | Res::BodyMotion);
+	addPass("SolveHeatConduct", &ParticleSystem::SolveHeatConduct,
+		Res::MatIdx | Res::Flags | Res::Contacts | Res::BodyContacts, Res::Heat | Res::BodyHeat | bodyImpulses);
+	addPass("SolveLooseHeat", &ParticleSystem::SolveLooseHeat, Res::MatIdx | Res::Flags, Res::Heat | Res::Buckets);
+	addPass("CopyHeats", &ParticleSystem::CopyHeats, Res::Heat, 0);
+	addPass("SolveChangeMat", &ParticleSystem::SolveChangeMat, Res::Heat | Res::StateFlags,
+		Res::Flags | Res::StateFlags | Res::Mass | Res::MatIdx | Res::Health | Res::Buckets);
+
+	// Find Dead
+	addPass("SolveHealth", &ParticleSystem::SolveHealth,
+		Res::MatIdx, Res::Flags | Res::Mass | Res::Health | Res::Buckets);
+	addPass("CopyHealths", &ParticleSystem::CopyHealths, Res::Health, 0);
+	addPass("SolveSource", &ParticleSystem::SolveSource, Res::MatIdx | Res::GroundContacts | Res::Ground, Res::Flags);
+	// checks the bounds too if m_def.fuseIntegration is set
+	addPass("SolvePosition", &ParticleSystem::SolvePosition, Res::Velocity, Res::Position | Res::Flags);
+	addPass("SolveOutOfBounds", &ParticleSystem::SolveOutOfBounds, Res::Position, Res::Flags);
+	addPass("CopyFlags", &ParticleSystem::CopyFlags, Res::Flags | Res::StateFlags, 0);
+	addPass("CopyBodies", &ParticleSystem::CopyBodies, Res::BodyMotion | Res::BodyHeat | Res::BodyContacts, 0);
+
+	addPass("IncrementIteration", &ParticleSystem::IncrementIteration, 0, Res::All);
+	m_passGraph.Build();
 }
 
 void ParticleSystem::UpdateAllParticleFlags()
 {
 	m_allFlags = amp::reduceFlags(m_ampParts.m_flags.arr, m_ampParts.m_count);
 	m_needsUpdateAllParticleFlags = false;
+	m_ampParts.MarkBucketsDirty();
+	m_ampParts.ReleaseUnusedBuckets(m_allFlags);
 }
 
 void ParticleSystem::UpdateAllGroupFlags()
@@ -2725,11 +3860,14 @@ void ParticleSystem::UpdateAllGroupFlags()
 
 void ParticleSystem::LimitVelocity()
 {
+	// SolveGravity limits the velocities with fused integration
+	if (m_def.fuseIntegration) return;
+
 	const b2TimeStep& step = m_subStep;
 	const float32 criticalVelocitySquared = GetCriticalVelocitySquared(step);
 
 	auto velocities = m_ampParts.m_velocity.GetView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		const Vec3 v = velocities[i];
 		const float32 v2 = b2Dot(v, v);
@@ -2741,6 +3879,12 @@ void ParticleSystem::LimitVelocity()
 
 void ParticleSystem::SolveGravity()
 {
+	if (m_def.fuseIntegration)
+	{
+		SolveFusedVelocity();
+		return;
+	}
+
 	const Vec3 gravity = m_atmosphereParticleInvMass * m_subStep.dt * m_def.gravityScale * m_world.m_gravity;
 	const float32 riseFactor = m_world.m_riseFactor;
 	const float32 atmosphericMass = m_atmosphereParticleMass;
@@ -2748,7 +3892,7 @@ void ParticleSystem::SolveGravity()
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto masses = m_ampParts.m_mass.GetConstView();
 	auto flags = m_ampParts.m_flags.GetConstView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		if (flags[i] & Particle::Flag::Controlled) return;
 		const float32 relativeMass = masses[i] - atmosphericMass;
@@ -2756,15 +3900,66 @@ void ParticleSystem::SolveGravity()
 	});
 }
 
+void ParticleSystem::SolveFusedVelocity()
+{
+	// one sweep instead of SolveGravity, SolveWind, SolveAirResistance and
+	// LimitVelocity, the latter two move before the contact impulses
+	const Vec3 gravity = m_atmosphereParticleInvMass * m_subStep.dt * m_def.gravityScale * m_world.m_gravity;
+	const float32 riseFactor = m_world.m_riseFactor;
+	const float32 atmosphericMass = m_atmosphereParticleMass;
+	const Vec3 wind = m_world.m_wind;
+	const float32 factor = m_subStep.dt * m_atmosphereParticleMass;
+	const float32 rand = GetWindPhase();
+	const float32 airResistance = m_def.airResistanceFactor * m_atmosphereParticleMass * m_subStep.dt;
+	const float32 criticalVelocitySquared = GetCriticalVelocitySquared(m_subStep);
+
+	auto velocities = m_ampParts.m_velocity.GetView();
+	auto masses = m_ampParts.m_mass.GetConstView();
+	auto invMasses = m_ampParts.m_invMass.GetConstView();
+	auto flags = m_ampParts.m_flags.GetConstView();
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
+	{
+		Vec3 v = velocities[i];
+		if (!(flags[i] & Particle::Flag::Controlled))
+		{
+			const float32 relativeMass = masses[i] - atmosphericMass;
+			v += (relativeMass > 0 ? relativeMass : relativeMass * riseFactor) * gravity;
+		}
+		const float32 invMass = invMasses[i];
+		v += invMass * factor * (wind + amp::toNormal(rand * i));
+		v *= 1 - (airResistance * invMass);
+		const float32 v2 = b2Dot(v, v);
+		if (v2 > criticalVelocitySquared)
+			v *= ampSqrt(criticalVelocitySquared / v2);
+		velocities[i] = v;
+	});
+}
+
+float32 ParticleSystem::GetWindPhase() const
+{
+	if (!m_def.deterministic) return Random(0, b2_2pi);
+	// b2World seeds rand() with the time, so the phase is hashed instead
+	uint32 x = m_def.deterministicSeed ^ (m_timestamp * 0x9E3779B1u) ^ (m_iteration * 0x85EBCA77u);
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return (x >> 8) * (b2_2pi / (1 << 24));
+}
+
 void ParticleSystem::SolveWind()
 {
+	// SolveGravity applies the wind with fused integration
+	if (m_def.fuseIntegration) return;
+
 	const Vec3 wind = m_world.m_wind;
 	const float32 factor = m_subStep.dt * m_atmosphereParticleMass;
-	const float32 rand = Random(0, b2_2pi);
+	const float32 rand = GetWindPhase();
 
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		velocities[i] += invMasses[i] * factor * (wind + amp::toNormal(rand * i));
 	});
@@ -2772,11 +3967,14 @@ void ParticleSystem::SolveWind()
 
 void ParticleSystem::SolveAirResistance()
 {
+	// SolveGravity applies the air resistance with fused integration
+	if (m_def.fuseIntegration) return;
+
 	const float32 airResistance = m_def.airResistanceFactor * m_atmosphereParticleMass * m_subStep.dt;
 
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		velocities[i] *= 1 - (airResistance * invMasses[i]);
 	});
@@ -2795,6 +3993,8 @@ void ParticleSystem::SolveStaticPressure()
 	///     w_ij is contact weight between particle i and j
 	///     w_i is sum of contact weight of particle i
 	if (!(m_allFlags & Particle::Mat::Flag::StaticPressure)) return;
+	// SolvePressure reads the column too
+	m_ampParts.RequireColumn(Particle::AmpArrays::Column::StaticPressure);
 	if (m_ampContacts.Empty()) return;
 
 	const b2TimeStep& step = m_subStep;
@@ -2804,7 +4004,6 @@ void ParticleSystem::SolveStaticPressure()
 	const float32 relaxation = m_def.staticPressureRelaxation;
 	const float32 minWeight = b2_minParticleWeight;
 
-	RequestBuffer(m_ampParts.m_staticPressure.arr, hasStaticPressureBuf);
 	auto staticPressures = m_ampParts.m_staticPressure.GetView();
 	auto accumulations = m_ampParts.m_accumulation.GetView();
 	auto weights = m_ampParts.m_weight.GetConstView();
@@ -2812,16 +4011,18 @@ void ParticleSystem::SolveStaticPressure()
 	for (int32 t = 0; t < m_def.staticPressureIterations; t++)
 	{
 		amp::fill(accumulations, 0.0f, m_ampParts.m_count);
-		m_ampContacts.ForEach(Particle::Mat::Flag::StaticPressure, 
-			[=](const Particle::Contact& contact) restrict(amp)
+		ShuffledForEachContact(Particle::ContactArrays::Class::StaticPressure, [=](const bool atomic)
 		{
-			const int32 a = contact.idxA;
-			const int32 b = contact.idxB;
-			const float32 w = contact.weight;
-			amp::atomicAdd(accumulations[a], w * staticPressures[b]);	// a <- b
-			amp::atomicAdd(accumulations[b], w * staticPressures[a]);	// b <- a
+			return [=](const Particle::Contact& contact) AMP_RESTRICT
+			{
+				const int32 a = contact.idxA;
+				const int32 b = contact.idxB;
+				const float32 w = contact.weight;
+				amp::add(accumulations[a], w * staticPressures[b], atomic);	// a <- b
+				amp::add(accumulations[b], w * staticPressures[a], atomic);	// b <- a
+			};
 		});
-		m_ampParts.ForEach([=](const int32 i) restrict(amp)
+		m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 		{
 			const float32 w = weights[i];
 			if (flags[i] & Particle::Mat::Flag::StaticPressure)
@@ -2848,22 +4049,25 @@ void ParticleSystem::SolvePressure()
 
 	auto weights = m_ampParts.m_weight.GetConstView();
 	auto accumulations = m_ampParts.m_accumulation.GetView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		const float32 h = pressurePerWeight * b2Max(0.0f, weights[i] - b2_minParticleWeight);
 		accumulations[i] = b2Min(h, maxPressure);
 	});
 	// ignores particles which have their own repulsive force
-	m_ampParts.ForEach(Particle::Mat::k_noPressureFlags, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEach(Particle::Mat::k_noPressureFlags, [=](const int32 i) AMP_RESTRICT
 	{
 		accumulations[i] = 0;
 	});
 	// static pressure
-	auto staticPressures = m_ampParts.m_staticPressure.GetConstView();
-	m_ampParts.ForEach(Particle::Mat::Flag::StaticPressure, [=](const int32 i) restrict(amp)
+	if (m_ampParts.HasColumn(Particle::AmpArrays::Column::StaticPressure))
 	{
-		accumulations[i] += staticPressures[i];
-	});
+		auto staticPressures = m_ampParts.m_staticPressure.GetConstView();
+		m_ampParts.ForEach(Particle::Mat::Flag::StaticPressure, [=](const int32 i) AMP_RESTRICT
+		{
+			accumulations[i] += staticPressures[i];
+		});
+	}
 
 	// applies pressure between each particles in contact<
 	auto velocities = m_ampParts.m_velocity.GetView();
@@ -2871,9 +4075,9 @@ void ParticleSystem::SolvePressure()
 	auto bodies = GetBodies();
 	auto fixtures = GetConstFixtures();
 	auto positions = m_ampParts.m_position.GetConstView();
-	m_ampBodyContacts.ForEach([=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+	m_ampBodyContacts.ForEachApply(bodies, [=](const int32 i, const Particle::BodyContact& contact,
+		Particle::BodyImpulse& impulse) AMP_RESTRICT
 	{
-		Body& b = bodies[contact.bodyIdx];
 		const float32 w = contact.weight;
 		const float32 m = contact.mass;
 		const Vec3 n = contact.normal;
@@ -2881,10 +4085,10 @@ void ParticleSystem::SolvePressure()
 		const Vec3 f = fixtures[contact.fixtureIdx].m_restitution *
 						velocityPerPressure * w * m * h * n;
 		amp::atomicSub(velocities[i], invMasses[i] * f);
-		b.ApplyLinearImpulse(f, positions[i], true);
+		impulse.Set(f, positions[i]);
 	});
 	auto groundMats = m_world.m_ground->GetConstMats();
-	m_ampGroundContacts.ForEach([=](int32 i, const Particle::GroundContact& contact) restrict(amp)
+	m_ampGroundContacts.ForEach([=](int32 i, const Particle::GroundContact& contact) AMP_RESTRICT
 	{
 		const float32 w = contact.weight;
 		const Vec3 n = contact.normal;
@@ -2892,18 +4096,22 @@ void ParticleSystem::SolvePressure()
 		const Vec3 f = groundMats[contact.groundMatIdx].bounciness * w * h * n;
 		velocities[i] += f;
 	});
-	m_ampContacts.ShuffledForEach([=](const Particle::Contact& contact) restrict(amp)
+	const auto applyPressure = [=](const bool atomic)
 	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const float32 w = contact.weight;
-		const float32 m = contact.mass;
-		const Vec3 n = contact.normal;
-		const float32 h = accumulations[a] + accumulations[b];
-		const Vec3 f = velocityPerPressure * w * m * h * n;
-		amp::atomicSub(velocities[a], invMasses[a] * f);
-		amp::atomicAdd(velocities[b], invMasses[b] * f);
-	});
+		return [=](const Particle::Contact& contact) AMP_RESTRICT
+		{
+			const int32 a = contact.idxA;
+			const int32 b = contact.idxB;
+			const float32 w = contact.weight;
+			const float32 m = contact.mass;
+			const Vec3 n = contact.normal;
+			const float32 h = accumulations[a] + accumulations[b];
+			const Vec3 f = velocityPerPressure * w * m * h * n;
+			amp::sub(velocities[a], invMasses[a] * f, atomic);
+			amp::add(velocities[b], invMasses[b] * f, atomic);
+		};
+	};
+	ShuffledForEachContact(applyPressure);
 }
 
 void ParticleSystem::SolveDamping()
@@ -2918,26 +4126,27 @@ void ParticleSystem::SolveDamping()
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
 	auto bodies = GetBodies();
 	auto positions = m_ampParts.m_position.GetConstView();
-	m_ampBodyContacts.ForEach([=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+	m_ampBodyContacts.ForEachApply(bodies, [=](const int32 i, const Particle::BodyContact& contact,
+		Particle::BodyImpulse& impulse) AMP_RESTRICT
 	{
-		Body& b = bodies[contact.bodyIdx];
+		const Body& b = bodies[contact.bodyIdx];
 		const float32 w = contact.weight;
 		const float32 m = contact.mass;
 		const Vec3 n = contact.normal;
 		const Vec2 p = Vec2(positions[i]);
 		const Vec2 v = b.GetLinearVelocityFromWorldPoint(p) -
 			Vec2(velocities[i]);
-		const float32 vn = b2Dot(v, n);
+		const float32 vn = b2Dot(v, (Vec2)n);
 		if (vn >= 0) return;
 		const float32 damping =
 			b2Max(linearDamping * w, b2Min(-quadraticDamping * vn, 0.5f));
 		const Vec3 f = damping * m * vn * n;
 		amp::atomicAdd(velocities[i], invMasses[i] * f);
-		b.ApplyLinearImpulse(-f, p, true);
+		impulse.Set(-f, p);
 	});
 	auto flags = m_ampParts.m_flags.GetConstView();
 	auto groundMats = m_world.m_ground->GetConstMats();
-	m_ampGroundContacts.ForEach([=](int32 a, const Particle::GroundContact& contact) restrict(amp)
+	m_ampGroundContacts.ForEach([=](int32 a, const Particle::GroundContact& contact) AMP_RESTRICT
 	{
 		const float32 w = contact.weight;
 		const Vec3 n = contact.normal;
@@ -2954,21 +4163,7 @@ void ParticleSystem::SolveDamping()
 		v.x *= frictionFactor;
 		v.y *= frictionFactor;
 	});
-	m_ampContacts.ShuffledForEach([=](const Particle::Contact& contact) restrict(amp)
-	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const float32 w = contact.weight;
-		const float32 m = contact.mass;
-		const Vec3 n = contact.normal;
-		const Vec3 v = velocities[b] - velocities[a];
-		const float32 vn = b2Dot(v, n);
-		if (vn >= 0) return;
-		const float32 damping = b2Max(linearDamping * w, b2Min(-quadraticDamping * vn, 0.5f));
-		const Vec3 f = damping * m * vn * n;
-		amp::atomicAdd(velocities[a], invMasses[a] * f);
-		amp::atomicSub(velocities[b], invMasses[b] * f);
-	});
+	ShuffledForEachContact([=](const bool atomic) { return GetDampingContactFn(atomic); });
 }
 
 inline bool ParticleSystem::IsRigidGroup(const ParticleGroup& group) const
@@ -3062,7 +4257,7 @@ void ParticleSystem::SolveRigidDamping()
 	auto groups = GetGroups();
 	auto masses = m_ampParts.m_mass.GetConstView();
 	
-	const auto AmpUpdateStatistics = [=](const int32 partIdx, const ParticleGroup& group) restrict(amp)
+	const auto AmpUpdateStatistics = [=](const int32 partIdx, const ParticleGroup& group) AMP_RESTRICT
 	{
 		if (group.m_timestamp == timeStamp) return;
 		const float32 m = masses[partIdx];
@@ -3101,7 +4296,7 @@ void ParticleSystem::SolveRigidDamping()
 	};
 
 	const auto AmpGetLinearVelocity = [=](const int32 partIdx,
-		const ParticleGroup& group, const Vec2& point) restrict(amp) -> Vec2
+		const ParticleGroup& group, const Vec2& point) AMP_RESTRICT -> Vec2
 	{
 		AmpUpdateStatistics(partIdx, group);
 		return group.m_linearVelocity + b2Cross(group.m_angularVelocity, point - group.m_center);
@@ -3110,7 +4305,7 @@ void ParticleSystem::SolveRigidDamping()
 	const auto AmpInitDampingParameter = [=](
 		float32& invMass, float32& invInertia, float32& tangentDistance,
 		float32 mass, float32 inertia, const Vec2& center,
-		const Vec2& point, const Vec2 & normal) restrict(amp)
+		const Vec2& point, const Vec2 & normal) AMP_RESTRICT
 	{
 		invMass = mass > 0 ? 1 / mass : 0;
 		invInertia = inertia > 0 ? 1 / inertia : 0;
@@ -3122,7 +4317,7 @@ void ParticleSystem::SolveRigidDamping()
 	const auto AmpInitDampingParameterWithRigidGroupOrParticle = [=](
 		float32& invMass, float32& invInertia, float32& tangentDistance,
 		uint32 isRigid, const ParticleGroup& group, int32 particleIndex,
-		const Vec2& point, const Vec2& normal) restrict(amp)
+		const Vec2& point, const Vec2& normal) AMP_RESTRICT
 	{
 		if (isRigid)
 		{
@@ -3142,31 +4337,27 @@ void ParticleSystem::SolveRigidDamping()
 	const auto AmpComputeDampingImpulse = [=](
 		float32 invMassA, float32 invInertiaA, float32 tangentDistanceA,
 		float32 invMassB, float32 invInertiaB, float32 tangentDistanceB,
-		float32 normalVelocity) restrict(amp) -> float32
+		float32 normalVelocity) AMP_RESTRICT -> float32
 	{
 		const float32 invMass =
 			invMassA + invInertiaA * tangentDistanceA * tangentDistanceA +
 			invMassB + invInertiaB * tangentDistanceB * tangentDistanceB;
 		return invMass > 0 ? normalVelocity / invMass : 0;
 	};
-	const auto ApplyDamping = [=](
+	const auto AddDamping = [=](amp::TargetValues<2, Vec3>& impulses,
 		float32 invMass, float32 invInertia, float32 tangentDistance,
-		uint32 isRigid, ParticleGroup& group, int32 particleIndex,
-		float32 impulse, const Vec2& normal) restrict(amp)
+		uint32 isRigid, int32 groupIdx, int32 particleIndex,
+		float32 impulse, const Vec2& normal) AMP_RESTRICT
 	{
+		const Vec2 vel = impulse * invMass * normal;
 		if (isRigid)
-		{
-			group.m_linearVelocity += impulse * invMass * normal;
-			group.m_angularVelocity += impulse * tangentDistance * invInertia;
-		}
+			impulses.Add(ImpulseTarget::Group | groupIdx, Vec3(vel, impulse * tangentDistance * invInertia));
 		else
-		{
-			const Vec2 vel = impulse * invMass * normal;
-			amp::atomicAdd(velocities[particleIndex], vel);
-		}
+			impulses.Add(ImpulseTarget::Velocity | particleIndex, Vec3(vel, 0));
 	};
 	auto bodies = GetBodies();
-	m_ampBodyContacts.ForEach([=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+	const auto dampBodyContact = [=](const int32 i, const Particle::BodyContact& contact,
+		amp::TargetValues<2, Vec3>& impulses) AMP_RESTRICT
 	{
 		ParticleGroup& aGroup = groups[groupIdxs[i]];
 		if (!aGroup.HasFlag(ParticleGroup::Flag::Rigid)) return;
@@ -3176,7 +4367,7 @@ void ParticleSystem::SolveRigidDamping()
 		Vec2 p = Vec2(positions[i]);
 		Vec2 v = b.GetLinearVelocityFromWorldPoint(p) -
 			AmpGetLinearVelocity(i, aGroup, p);
-		float32 vn = b2Dot(v, n);
+		float32 vn = b2Dot(v, (Vec2)n);
 		if (vn >= 0) return;
 		// The group's average velocity at particle position 'p' is pushing
 		// the particle into the body.
@@ -3197,12 +4388,15 @@ void ParticleSystem::SolveRigidDamping()
 			invMassA, invInertiaA, tangentDistanceA,
 			invMassB, invInertiaB, tangentDistanceB,
 			vn);
-		ApplyDamping(
+		AddDamping(impulses,
 			invMassA, invInertiaA, tangentDistanceA,
-			true, aGroup, i, f, n);
-		b.ApplyLinearImpulse(-f * n, p, true);
-	});
-	m_ampContacts.ForEach([=](const Particle::Contact& contact) restrict(amp)
+			true, groupIdxs[i], i, f, n);
+		const Vec2 impulse = -f * (Vec2)n;
+		impulses.Add(ImpulseTarget::Body | contact.bodyIdx,
+			Vec3(impulse, b2Cross(p - b.GetWorldCenter(), impulse)));
+	};
+	const auto dampContact = [=](const Particle::Contact& contact,
+		amp::TargetValues<2, Vec3>& impulses) AMP_RESTRICT
 	{
 		const int32 a = contact.idxA;
 		const int32 b = contact.idxB;
@@ -3216,9 +4410,9 @@ void ParticleSystem::SolveRigidDamping()
 		const bool bRigid = bGroup.HasFlag(ParticleGroup::Flag::Rigid);
 		if (aGroupIdx == bGroupIdx || !(aRigid || bRigid)) return;
 		const Vec2 p = 0.5f * positions[a] + positions[b];
-		const Vec2 v = (bRigid ? AmpGetLinearVelocity(b, bGroup, p) : velocities[b]) -
-							(aRigid ? AmpGetLinearVelocity(a, aGroup, p) : velocities[a]);
-		const float32 vn = b2Dot(v, n);
+		const Vec2 v = (bRigid ? AmpGetLinearVelocity(b, bGroup, p) : Vec2(velocities[b])) -
+							(aRigid ? AmpGetLinearVelocity(a, aGroup, p) : Vec2(velocities[a]));
+		const float32 vn = b2Dot(v, (Vec2)n);
 		if (vn >= 0) return;
 		float32 invMassA, invInertiaA, tangentDistanceA;
 		float32 invMassB, invInertiaB, tangentDistanceB;
@@ -3232,13 +4426,30 @@ void ParticleSystem::SolveRigidDamping()
 			invMassA, invInertiaA, tangentDistanceA,
 			invMassB, invInertiaB, tangentDistanceB,
 			vn);
-		ApplyDamping(
+		AddDamping(impulses,
 			invMassA, invInertiaA, tangentDistanceA,
-			aRigid, aGroup, a, f, n);
-		ApplyDamping(
+			aRigid, aGroupIdx, a, f, n);
+		AddDamping(impulses,
 			invMassB, invInertiaB, tangentDistanceB,
-			bRigid, bGroup, b, -f, n);
-	});
+			bRigid, bGroupIdx, b, -f, n);
+	};
+	// Deterministic mode sums up the impulses of each target in contact order. The
+	// statistics of the groups are updated first, so the contacts only read them.
+	const bool ordered = m_def.deterministic;
+	if (ordered)
+	{
+		amp::forEach(m_groupCount, [=](const int32 g) AMP_RESTRICT
+		{
+			const ParticleGroup& group = groups[g];
+			if (group.m_firstIndex != INVALID_IDX && group.m_firstIndex < group.m_lastIndex
+				&& group.HasFlag(ParticleGroup::Flag::Rigid))
+				AmpUpdateStatistics(group.m_firstIndex, group);
+		});
+	}
+	const auto applyImpulse = GetApplyImpulseFn();
+	// the targets are ImpulseTargets, so their kind in the top bits is sorted as well
+	m_ampBodyContacts.ForEachTarget<2, Vec3>(dampBodyContact, applyImpulse, ordered, m_targetSortBuffers, 32);
+	m_ampContacts.ForEachTarget<2, Vec3>(dampContact, applyImpulse, ordered, m_targetSortBuffers, 32);
 }
 
 void ParticleSystem::SolveExtraDamping()
@@ -3253,24 +4464,24 @@ void ParticleSystem::SolveExtraDamping()
 	auto positions = m_ampParts.m_position.GetConstView();
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
-	m_ampBodyContacts.ForEach(Particle::Mat::k_extraDampingFlags,
-		[=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+	m_ampBodyContacts.ForEachApply(Particle::Mat::k_extraDampingFlags, bodies,
+		[=](const int32 i, const Particle::BodyContact& contact, Particle::BodyImpulse& impulse) AMP_RESTRICT
 	{
-		Body& b = bodies[contact.bodyIdx];
+		const Body& b = bodies[contact.bodyIdx];
 		const float32 m = contact.mass;
 		const Vec3 n = contact.normal;
 		const Vec2 p = Vec2(positions[i]);
 		const Vec2 v =
 			b.GetLinearVelocityFromWorldPoint(p) -
 			Vec2(velocities[i]);
-		const float32 vn = b2Dot(v, n);
+		const float32 vn = b2Dot(v, (Vec2)n);
 		if (vn >= 0) return;
 		const Vec3 f = 0.5f * m * vn * n;
 		amp::atomicAdd(velocities[i], invMasses[i] * f);
-		b.ApplyLinearImpulse(-f, p, true);
+		impulse.Set(-f, p);
 	});
 	m_ampGroundContacts.ForEach(Particle::Mat::k_extraDampingFlags,
-		[=](const int32 i, const Particle::GroundContact& contact) restrict(amp)
+		[=](const int32 i, const Particle::GroundContact& contact) AMP_RESTRICT
 	{
 		const Vec3 n = contact.normal;
 		Vec3& v = velocities[i];
@@ -3286,7 +4497,7 @@ void ParticleSystem::SolveWall()
 	if (!FlagExists(Particle::Mat::Flag::Wall)) return;
 
 	auto velocities = m_ampParts.m_velocity.GetView();
-	m_ampParts.ForEach(Particle::Mat::Flag::Wall, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEach(Particle::Mat::Flag::Wall, [=](const int32 i) AMP_RESTRICT
 	{
 		velocities[i].SetZero();
 	});
@@ -3304,37 +4515,148 @@ void ParticleSystem::SolveRigid()
 
 	const b2TimeStep& step = m_subStep;
 
+	m_rigidGroupIdxs.clear();
+	m_rigidRanges.clear();
+	m_rigidSlots.assign(m_groupCount, INVALID_IDX);
+	for (int32 k = 0; k < m_groupCount; k++)
+	{
+		const ParticleGroup& group = m_groupBuffer[k];
+		if (group.m_firstIndex == INVALID_IDX || !group.HasFlag(ParticleGroup::Flag::Rigid)) continue;
+		m_rigidSlots[k] = (int32)m_rigidGroupIdxs.size();
+		m_rigidGroupIdxs.push_back(k);
+		m_rigidRanges.push_back(group.m_firstIndex);
+		m_rigidRanges.push_back(group.m_lastIndex);
+	}
+	const int32 rigidCnt = (int32)m_rigidGroupIdxs.size();
+	if (!rigidCnt) return;
+	amp::copy(m_rigidRanges, m_ampRigidRanges, 2 * rigidCnt);
+	amp::copy(m_rigidSlots, m_ampRigidSlots, m_groupCount);
+	ReduceGroupStatistics(ampArrayView<const int32>(m_ampRigidRanges), rigidCnt,
+		ampArrayView<GroupStatistics>(m_ampRigidStats));
+
+	// one readback for all groups, the transforms stay on the host
+	m_rigidStats.resize(rigidCnt);
+	m_rigidVelocityTransforms.resize(rigidCnt);
+	amp::copy(m_ampRigidStats, m_rigidStats, rigidCnt);
+	for (int32 r = 0; r < rigidCnt; r++)
+	{
+		ParticleGroup& group = m_groupBuffer[m_rigidGroupIdxs[r]];
+		const GroupStatistics& stats = m_rigidStats[r];
+		group.m_mass = stats.mass;
+		group.m_center = stats.center;
+		group.m_linearVelocity = stats.linearVelocity;
+		group.m_inertia = stats.inertia;
+		group.m_angularVelocity = stats.angularVelocity;
+		group.m_timestamp = m_timestamp;
+
+		const b2Rot rotation(step.dt * group.m_angularVelocity);
+		const Vec2 center = group.m_center;
+		const Vec2 linVel = group.m_linearVelocity;
+		const b2Transform transform(center + step.dt * linVel -
+			b2Mul(rotation, center), rotation);
+		group.m_transform = b2Mul(transform, group.m_transform);
+		b2Transform& velocityTransform = m_rigidVelocityTransforms[r];
+		velocityTransform.p.x = step.inv_dt * transform.p.x;
+		velocityTransform.p.y = step.inv_dt * transform.p.y;
+		velocityTransform.q.s = step.inv_dt * transform.q.s;
+		velocityTransform.q.c = step.inv_dt * (transform.q.c - 1);
+	}
+	amp::copy(m_rigidVelocityTransforms, m_ampRigidVelocityTransforms, rigidCnt);
+
+	// one write back for all groups
 	auto positions = m_ampParts.m_position.GetConstView();
 	auto velocities = m_ampParts.m_velocity.GetView();
-	for (int32 k = 0; k < m_groupCount; k++)
+	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
+	auto rigidSlots = ampArrayView<const int32>(m_ampRigidSlots);
+	auto velocityTransforms = ampArrayView<const b2Transform>(m_ampRigidVelocityTransforms);
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
+	{
+		const int32 g = groupIdxs[i];
+		if (g == INVALID_IDX) return;
+		const int32 slot = rigidSlots[g];
+		if (slot == INVALID_IDX) return;
+		velocities[i] = Vec3(b2Mul(velocityTransforms[slot], positions[i]), 0);
+	});
+}
+
+void ParticleSystem::ReduceGroupStatistics(const ampArrayView<const int32>& ranges, const int32 cnt,
+	const ampArrayView<GroupStatistics>& groupStats) const
+{
+	// Segmented reduction with one tile per range: mass, center and linear
+	// velocity first, then inertia and angular velocity around the center.
+	auto positions = m_ampParts.m_position.GetConstView();
+	auto velocities = m_ampParts.m_velocity.GetConstView();
+	auto masses = m_ampParts.m_mass.GetConstView();
+	auto flags = m_ampParts.m_flags.GetConstView();
+	amp::forEachTiledWithBarrier(cnt * TILE_SIZE, [=](const ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 	{
-		ParticleGroup& group = m_groupBuffer[k];
-		if (group.m_firstIndex != INVALID_IDX)
+		const int32 li = tIdx.local[0];
+		const int32 firstIdx = ranges[2 * tIdx.tile[0]];
+		const int32 lastIdx = ranges[2 * tIdx.tile[0] + 1];
+		AMP_TILE_STATIC float32 tSums[5][TILE_SIZE];
+
+		float32 mass = 0;
+		Vec2 center(0, 0), linVel(0, 0);
+		for (int32 i = firstIdx + li; i < lastIdx; i += TILE_SIZE)
 		{
-			if (group.HasFlag(ParticleGroup::Flag::Rigid))
+			if (flags[i] & Particle::Flag::Zombie) continue;
+			const float32 m = masses[i];
+			mass += m;
+			center += m * (Vec2)positions[i];
+			linVel += m * (Vec2)velocities[i];
+		}
+		tSums[0][li] = mass;
+		tSums[1][li] = center.x;
+		tSums[2][li] = center.y;
+		tSums[3][li] = linVel.x;
+		tSums[4][li] = linVel.y;
+		for (int32 s = TILE_SIZE / 2; s > 0; s /= 2)
+		{
+			tIdx.barrier.wait_with_tile_static_memory_fence();
+			if (li < s)
+				for (int32 k = 0; k < 5; k++)
+					tSums[k][li] += tSums[k][li + s];
+		}
+		tIdx.barrier.wait_with_tile_static_memory_fence();
+		mass = tSums[0][0];
+		center = Vec2(tSums[1][0], tSums[2][0]);
+		linVel = Vec2(tSums[3][0], tSums[4][0]);
+		if (mass > 0)
+		{
+			center *= 1 / mass;
+			linVel *= 1 / mass;
+		}
+		tIdx.barrier.wait_with_tile_static_memory_fence();
+
+		float32 inertia = 0, angVel = 0;
+		for (int32 i = firstIdx + li; i < lastIdx; i += TILE_SIZE)
+		{
+			if (flags[i] & Particle::Flag::Zombie) continue;
+			const float32 m = masses[i];
+			const Vec2 p = (Vec2)positions[i] - center;
+			const Vec2 v = (Vec2)velocities[i] - linVel;
+			inertia += m * b2Dot(p, p);
+			angVel += m * b2Cross(p, v);
+		}
+		tSums[0][li] = inertia;
+		tSums[1][li] = angVel;
+		for (int32 s = TILE_SIZE / 2; s > 0; s /= 2)
+		{
+			tIdx.barrier.wait_with_tile_static_memory_fence();
+			if (li < s)
 			{
-				UpdateStatistics(group);
-				const b2Rot rotation(step.dt * group.m_angularVelocity);
-				const Vec2 center = group.m_center;
-				const Vec2 linVel = group.m_linearVelocity;
-				const b2Transform transform(center + step.dt * linVel -
-					b2Mul(rotation, center), rotation);
-				group.m_transform = b2Mul(transform, group.m_transform);
-				b2Transform velocityTransform;
-				velocityTransform.p.x = step.inv_dt * transform.p.x;
-				velocityTransform.p.y = step.inv_dt * transform.p.y;
-				velocityTransform.q.s = step.inv_dt * transform.q.s;
-				velocityTransform.q.c = step.inv_dt * (transform.q.c - 1);
-
-				amp::forEach(group.m_firstIndex, group.m_lastIndex,
-					[=](const int32 i) restrict(amp)
-				{
-					const Vec3 vel = Vec3(b2Mul(velocityTransform, positions[i]), 0);
-					velocities[i] = vel;
-				});
+				tSums[0][li] += tSums[0][li + s];
+				tSums[1][li] += tSums[1][li + s];
 			}
 		}
-	}
+		if (li) return;
+		GroupStatistics& stats = groupStats[tIdx.tile[0]];
+		stats.mass = mass;
+		stats.center = center;
+		stats.linearVelocity = linVel;
+		stats.inertia = tSums[0][0];
+		stats.angularVelocity = stats.inertia > 0 ? tSums[1][0] / stats.inertia : 0;
+	});
 }
 
 // SolveElastic and SolveSpring refer the current velocities for
@@ -3350,7 +4672,7 @@ void ParticleSystem::SolveElastic()
 	auto triads = GetConstTriads();
 	auto positions = m_ampParts.m_position.GetConstView();
 	auto velocities =  m_ampParts.m_velocity.GetView();
-	ForEachTriad([=](const int32 i) restrict(amp)
+	ForEachTriad<3, Vec2>([=](const int32 i, amp::TargetValues<3, Vec2>& impulses) AMP_RESTRICT
 	{
 		const b2ParticleTriad& triad = triads[i];
 		if (!(triad.flags & Particle::Mat::Flag::Elastic)) return;
@@ -3382,11 +4704,14 @@ void ParticleSystem::SolveElastic()
 		r.c *= invR;
 		float32 strength = elasticStrength * triad.strength;
 		Vec2 vel = b2Mul(r, oa) - pa;
-		amp::atomicAdd(velocities[a], strength * vel);
+		impulses.Add(a, strength * vel);
 		vel = b2Mul(r, ob) - pb;
-		amp::atomicAdd(velocities[b], strength * vel);
+		impulses.Add(b, strength * vel);
 		vel = b2Mul(r, oc) - pc;
-		amp::atomicAdd(velocities[c], strength * vel);
+		impulses.Add(c, strength * vel);
+	}, [=](const int32 i, const Vec2& v, const bool atomic) AMP_RESTRICT
+	{
+		amp::add(velocities[i], v, atomic);
 	});
 }
 
@@ -3400,7 +4725,7 @@ void ParticleSystem::SolveSpring()
 	auto pairs = GetConstPairs();
 	auto positions = m_ampParts.m_position.GetConstView();
 	auto velocities = m_ampParts.m_velocity.GetView();
-	ForEachPair([=](const int32 i) restrict(amp)
+	ForEachPair<2, Vec2>([=](const int32 i, amp::TargetValues<2, Vec2>& impulses) AMP_RESTRICT
 	{
 		const b2ParticlePair& pair = pairs[i];
 		if (!(pair.flags & Particle::Mat::Flag::Spring)) return;
@@ -3417,14 +4742,18 @@ void ParticleSystem::SolveSpring()
 		const float32 r1 = d.Length();
 		const float32 strength = springStrength * pair.strength;
 		Vec2 f = strength * (r0 - r1) / r1 * d;
-		amp::atomicAdd(velocities[a], f);
-		amp::atomicSub(velocities[b], f);
+		impulses.Add(a, f);
+		impulses.Add(b, -f);
+	}, [=](const int32 i, const Vec2& v, const bool atomic) AMP_RESTRICT
+	{
+		amp::add(velocities[i], v, atomic);
 	});
 }
 
 void ParticleSystem::SolveTensile()
 {
 	if (!(m_allFlags & Particle::Mat::Flag::Tensile)) return;
+	m_ampParts.RequireColumn(Particle::AmpArrays::Column::Tensile);
 
 	const b2TimeStep& step = m_subStep;
 	const float32 criticalVelocity = GetCriticalVelocity(step);
@@ -3434,42 +4763,54 @@ void ParticleSystem::SolveTensile()
 
 	auto accumulations = m_ampParts.m_accumulationVec3.GetView();
 	amp::fill(accumulations, Vec3_zero);
-	m_ampContacts.ForEach(Particle::Mat::Flag::Tensile, [=](const Particle::Contact& contact) restrict(amp)
+	ShuffledForEachContact(Particle::ContactArrays::Class::Tensile, [=](const bool atomic)
 	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const float32 w = contact.weight;
-		const Vec3 n = contact.normal;
-		const Vec3 weightedNormal = (1 - w) * w * n;
-		amp::atomicSub(accumulations[a], weightedNormal);
-		amp::atomicAdd(accumulations[b], weightedNormal);
+		return [=](const Particle::Contact& contact) AMP_RESTRICT
+		{
+			const int32 a = contact.idxA;
+			const int32 b = contact.idxB;
+			const float32 w = contact.weight;
+			const Vec3 n = contact.normal;
+			const Vec3 weightedNormal = (1 - w) * w * n;
+			amp::sub(accumulations[a], weightedNormal, atomic);
+			amp::add(accumulations[b], weightedNormal, atomic);
+		};
 	});
 
 	auto weights = m_ampParts.m_weight.GetConstView();
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
-	m_ampContacts.ForEach(Particle::Mat::Flag::Tensile, [=](const Particle::Contact& contact) restrict(amp)
+	ShuffledForEachContact(Particle::ContactArrays::Class::Tensile, [=](const bool atomic)
 	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const float32 w = contact.weight;
-		const float32 m = contact.mass;
-		const Vec3 n = contact.normal;
-		const float32 h = weights[a] + weights[b];
-		const Vec3 s = accumulations[b] - accumulations[a];
-		const float32 fn = b2Min(
-			pressureStrength * (h - 2) + normalStrength * b2Dot(s, n),
-			maxVelocityVariation) * w;
-		Vec3 f = fn * n * m;
-		f.z = 0;
-		amp::atomicSub(velocities[a], invMasses[a] * f);
-		amp::atomicAdd(velocities[b], invMasses[b] * f);
+		return [=](const Particle::Contact& contact) AMP_RESTRICT
+		{
+			const int32 a = contact.idxA;
+			const int32 b = contact.idxB;
+			const float32 w = contact.weight;
+			const float32 m = contact.mass;
+			const Vec3 n = contact.normal;
+			const float32 h = weights[a] + weights[b];
+			const Vec3 s = accumulations[b] - accumulations[a];
+			const float32 fn = b2Min(
+				pressureStrength * (h - 2) + normalStrength * b2Dot(s, n),
+				maxVelocityVariation) * w;
+			Vec3 f = fn * n * m;
+			f.z = 0;
+			amp::sub(velocities[a], invMasses[a] * f, atomic);
+			amp::add(velocities[b], invMasses[b] * f, atomic);
+		};
 	});
 }
 
 void ParticleSystem::SolveViscous()
 {
-	if (!(m_allFlags & Particle::Mat::Flag::Viscous)) return;
+	// with fused contact passes the weights are summed up in the traversal of the
+	// particle contact viscosity, nothing before WaitForComputeWeight reads them
+	if (!(m_allFlags & Particle::Mat::Flag::Viscous))
+	{
+		if (m_def.fuseContactPasses) SumWeights(false);
+		return;
+	}
 
 	const float32 viscousStrength = m_def.viscousStrength;
 
@@ -3477,10 +4818,10 @@ void ParticleSystem::SolveViscous()
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
 	auto bodies = GetBodies();
 	auto positions = m_ampParts.m_position.GetConstView();
-	m_ampBodyContacts.ForEach(Particle::Mat::Flag::Viscous,
-		[=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+	m_ampBodyContacts.ForEachApply(Particle::Mat::Flag::Viscous, bodies,
+		[=](const int32 i, const Particle::BodyContact& contact, Particle::BodyImpulse& impulse) AMP_RESTRICT
 	{
-		Body& b = bodies[contact.bodyIdx];
+		const Body& b = bodies[contact.bodyIdx];
 		const float32 w = contact.weight;
 		const float32 m = contact.mass;
 		const Vec3 p = positions[i];
@@ -3488,28 +4829,21 @@ void ParticleSystem::SolveViscous()
 			Vec2(velocities[i]), 0);
 		const Vec3 f = viscousStrength * m * w * v;
 		amp::atomicAdd(velocities[i], invMasses[i] * f);
-		b.ApplyLinearImpulse(-f, p, true);
+		impulse.Set(-f, p);
 	});
 	m_ampGroundContacts.ForEach(Particle::Mat::Flag::Viscous, 
-		[=](const int32 i, const Particle::GroundContact& contact) restrict(amp)
+		[=](const int32 i, const Particle::GroundContact& contact) AMP_RESTRICT
 	{
 		const float32 w = contact.weight;
-		const float32 m = contact.mass;
 		Vec3& v = velocities[i];
 		Vec3 f = viscousStrength * w * v;
 		v += f;
 	});
-	m_ampContacts.ForEach(Particle::Mat::Flag::Viscous, [=](const Particle::Contact& contact) restrict(amp)
-	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const float32 w = contact.weight;
-		const float32 m = contact.mass;
-		const Vec3 v = velocities[b] - velocities[a];
-		const Vec3 f = viscousStrength * w * m * v;
-		amp::atomicAdd(velocities[a], invMasses[a] * f);
-		amp::atomicSub(velocities[b], invMasses[b] * f);
-	});
+	if (m_def.fuseContactPasses)
+		SumWeights(true);
+	else
+		ShuffledForEachContact(Particle::ContactArrays::Class::Viscous,
+			[=](const bool atomic) { return GetViscousContactFn(atomic); });
 }
 
 void ParticleSystem::SolveRepulsive()
@@ -3523,17 +4857,20 @@ void ParticleSystem::SolveRepulsive()
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
-	m_ampContacts.ForEach(Particle::Mat::Flag::Repulsive, [=](const Particle::Contact& contact) restrict(amp)
+	ShuffledForEachContact(Particle::ContactArrays::Class::Repulsive, [=](const bool atomic)
 	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		if (groupIdxs[a] == groupIdxs[b]) return;
-		const float32 w = contact.weight;
-		const float32 m = contact.mass;
-		const Vec3 n = contact.normal;
-		const Vec3 f = repulsiveStrength * w * m * n;
-		amp::atomicSub(velocities[a], invMasses[a] * f);
-		amp::atomicAdd(velocities[b], invMasses[b] * f);
+		return [=](const Particle::Contact& contact) AMP_RESTRICT
+		{
+			const int32 a = contact.idxA;
+			const int32 b = contact.idxB;
+			if (groupIdxs[a] == groupIdxs[b]) return;
+			const float32 w = contact.weight;
+			const float32 m = contact.mass;
+			const Vec3 n = contact.normal;
+			const Vec3 f = repulsiveStrength * w * m * n;
+			amp::sub(velocities[a], invMasses[a] * f, atomic);
+			amp::add(velocities[b], invMasses[b] * f, atomic);
+		};
 	});
 }
 
@@ -3547,17 +4884,20 @@ void ParticleSystem::SolvePowder()
 
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
-	m_ampContacts.ForEach(Particle::Mat::Flag::Powder, [=](const Particle::Contact& contact) restrict(amp)
+	ShuffledForEachContact(Particle::ContactArrays::Class::Powder, [=](const bool atomic)
 	{
-		const float32 w = contact.weight;
-		if (w <= minWeight) return;
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const float32 m = contact.mass;
-		const Vec3 n = contact.normal;
-		const Vec3 f = powderStrength * (w - minWeight) * m * n;
-		amp::atomicSub(velocities[a], invMasses[a] * f);
-		amp::atomicAdd(velocities[b], invMasses[b] * f);
+		return [=](const Particle::Contact& contact) AMP_RESTRICT
+		{
+			const float32 w = contact.weight;
+			if (w <= minWeight) return;
+			const int32 a = contact.idxA;
+			const int32 b = contact.idxB;
+			const float32 m = contact.mass;
+			const Vec3 n = contact.normal;
+			const Vec3 f = powderStrength * (w - minWeight) * m * n;
+			amp::sub(velocities[a], invMasses[a] * f, atomic);
+			amp::add(velocities[b], invMasses[b] * f, atomic);
+		};
 	});
 }
 
@@ -3566,7 +4906,8 @@ void ParticleSystem::SolveSolid()
 	// applies extra repulsive force from solid particle groups
 	if (!(m_allGroupFlags & ParticleGroup::Flag::Solid)) return;
 
-	b2Assert(m_hasDepth);
+	// the depths are computed first in ComputeDepth
+	if (!m_ampParts.HasColumn(Particle::AmpArrays::Column::Depth)) return;
 	const b2TimeStep& step = m_subStep;
 	const float32 ejectionStrength = step.inv_dt * m_def.ejectionStrength;
 	
@@ -3574,18 +4915,21 @@ void ParticleSystem::SolveSolid()
 	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
 	auto depths = m_ampParts.m_depth.GetConstView();
-	m_ampContacts.ForEach([=](const Particle::Contact& contact) restrict(amp)
+	ShuffledForEachContact([=](const bool atomic)
 	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		if (groupIdxs[a] == groupIdxs[b]) return;
-		const float32 w = contact.weight;
-		const float32 m = contact.mass;
-		const Vec3 n = contact.normal;
-		const float32 h = depths[a] + depths[b];
-		const Vec3 f = ejectionStrength * h * m * w * n;
-		amp::atomicSub(velocities[a], invMasses[a] * f);
-		amp::atomicAdd(velocities[b], invMasses[b] * f);
+		return [=](const Particle::Contact& contact) AMP_RESTRICT
+		{
+			const int32 a = contact.idxA;
+			const int32 b = contact.idxB;
+			if (groupIdxs[a] == groupIdxs[b]) return;
+			const float32 w = contact.weight;
+			const float32 m = contact.mass;
+			const Vec3 n = contact.normal;
+			const float32 h = depths[a] + depths[b];
+			const Vec3 f = ejectionStrength * h * m * w * n;
+			amp::sub(velocities[a], invMasses[a] * f, atomic);
+			amp::add(velocities[b], invMasses[b] * f, atomic);
+		};
 	});
 }
 
@@ -3597,7 +4941,7 @@ void ParticleSystem::SolveForce()
 	auto velocities = m_ampParts.m_velocity.GetView();
 	auto forces = m_ampParts.m_force.GetConstView();
 	auto invMasses = m_ampParts.m_invMass.GetConstView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		velocities[i] += step.dt * invMasses[i] * forces[i];
 	});
@@ -3649,7 +4993,7 @@ void ParticleSystem::SolveColorMixing()
 }
 
 void DistributeHeatAtomicB(float32& aHeat, float32& bHeat, float32 factor,
-	const float32& aMass, const float32& bMass) restrict(amp)
+	const float32& aMass, const float32& bMass) AMP_RESTRICT
 {
 	factor /= aMass + bMass;
 	if (b2Abs(factor) < b2_epsilon) return;
@@ -3661,13 +5005,12 @@ void DistributeHeatAtomicB(float32& aHeat, float32& bHeat, float32 factor,
 		expectedB = bHeat;
 		newA = aHeat - d * bMass;
 		newB = bHeat + d * aMass;
-	} while (!Concurrency::atomic_compare_exchange((uint32*)&bHeat,
-		(uint32*)&expectedB, reinterpret_cast<uint32&>(newB)));
+	} while (!amp::atomicCompareExchange(bHeat, expectedB, newB));
 	aHeat = newA;
 }
 
 void DistributeHeat(float32& aHeat, float32& bHeat, const float32& factor,
-	const float32& aMass, const float32& bMass) restrict(amp)
+	const float32& aMass, const float32& bMass) AMP_RESTRICT
 {
 	const float32 d = (aHeat - bHeat) * factor / (aMass + bMass);
 	if (b2Abs(d) < b2_epsilon) return;
@@ -3677,6 +5020,8 @@ void DistributeHeat(float32& aHeat, float32& bHeat, const float32& factor,
 
 void ParticleSystem::SolveHeatConduct()
 {
+	if (!(m_allFlags & Particle::Mat::Flag::HeatConducting)) return;
+
 	const b2TimeStep& step = m_subStep;
 
 	auto heats = m_ampParts.m_heat.GetView();
@@ -3684,28 +5029,39 @@ void ParticleSystem::SolveHeatConduct()
 	auto mats = m_mats.m_array.GetConstView();
 	auto bodies = GetBodies();
 	auto bodyMats = GetConstBodyMats();
-	m_ampBodyContacts.ForEach(Particle::Mat::Flag::HeatConducting,
-		[=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+	if (m_def.deterministic)
 	{
-		Body& b = bodies[contact.bodyIdx];
-		const Body::Mat& bMat = bodyMats[b.m_matIdx];
-		if (!bMat.HasFlag(Body::Mat::Flag::HeatConducting)) return;
-		const Particle::Mat& aMat = mats[matIdxs[i]];
-		const float32 factor = step.dt * aMat.m_heatConductivity * bMat.m_heatConductivity
-			* ampSqrt(contact.weight);
-		DistributeHeatAtomicB(heats[i], b.m_surfaceHeat, factor, aMat.m_mass, b.m_surfaceMass);
-	});
-	m_ampContacts.ShuffledForEach(Particle::Mat::Flag::HeatConducting, [=](const Particle::Contact& contact) restrict(amp)
+		// all contacts see the body heat from before the pass
+		m_ampBodyContacts.ForEachApply(Particle::Mat::Flag::HeatConducting, bodies,
+			[=](const int32 i, const Particle::BodyContact& contact, Particle::BodyImpulse& impulse) AMP_RESTRICT
+		{
+			const Body& b = bodies[contact.bodyIdx];
+			const Body::Mat& bMat = bodyMats[b.m_matIdx];
+			if (!bMat.HasFlag(Body::Mat::Flag::HeatConducting)) return;
+			const Particle::Mat& aMat = mats[matIdxs[i]];
+			const float32 factor = step.dt * aMat.m_heatConductivity * bMat.m_heatConductivity
+				* ampSqrt(contact.weight);
+			float32 bHeat = b.m_surfaceHeat;
+			DistributeHeat(heats[i], bHeat, factor, aMat.m_mass, b.m_surfaceMass);
+			impulse.SetHeat(bHeat - b.m_surfaceHeat);
+		});
+	}
+	else
 	{
-		const int32 a = contact.idxA;
-		const int32 b = contact.idxB;
-		const Particle::Mat& aMat = mats[matIdxs[a]];
-		const Particle::Mat& bMat = mats[matIdxs[b]];
-		if (!(aMat.m_heatConductivity && bMat.m_heatConductivity)) return;
-		const float32 factor = step.dt * aMat.m_heatConductivity * bMat.m_heatConductivity
-			* ampSqrt(contact.weight);
-		DistributeHeat(heats[a], heats[b], factor, aMat.m_mass, bMat.m_mass);
-	});
+		m_ampBodyContacts.ForEach(Particle::Mat::Flag::HeatConducting,
+			[=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
+		{
+			Body& b = bodies[contact.bodyIdx];
+			const Body::Mat& bMat = bodyMats[b.m_matIdx];
+			if (!bMat.HasFlag(Body::Mat::Flag::HeatConducting)) return;
+			const Particle::Mat& aMat = mats[matIdxs[i]];
+			const float32 factor = step.dt * aMat.m_heatConductivity * bMat.m_heatConductivity
+				* ampSqrt(contact.weight);
+			DistributeHeatAtomicB(heats[i], b.m_surfaceHeat, factor, aMat.m_mass, b.m_surfaceMass);
+		});
+	}
+	ShuffledForEachContact(Particle::ContactArrays::Class::HeatConducting,
+		[=](const bool) { return GetHeatConductContactFn(); });
 }
 
 void ParticleSystem::SolveLooseHeat()
@@ -3719,13 +5075,13 @@ void ParticleSystem::SolveLooseHeat()
 	auto mats = m_mats.m_array.GetConstView();
 	const float32 roomTemp = m_world.m_roomTemperature;
 	const float32 heatLossRatio = m_def.heatLossRatio;
-	m_ampParts.ForEach(Particle::Mat::Flag::HeatLoosing, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEachInBucket(Particle::AmpArrays::Bucket::HeatLoosing, [=](const int32 i) AMP_RESTRICT
 	{
 		const Particle::Mat& mat = mats[matIdxs[i]];
 		float32& heat = heats[i];
 		const float32 loss = step.dt * mat.m_heatConductivity * (heat - roomTemp);
 		if (!loss) return;
-		heat -= loss * (1 - __dp_math_powf(heatLossRatio,
+		heat -= loss * (1 - ampPow(heatLossRatio,
 				//(2.0f - (m_buffers.weight[k] < 0 ? 0 : m_buffers.weight[k] > 1 ? 1 : m_buffers.weight[k])) *
 				0.0005f * mat.m_invMass));
 	});
@@ -3756,7 +5112,7 @@ void ParticleSystem::SolveFlame()
 	auto heats = m_ampParts.m_heat.GetView();
 	auto healths = m_ampParts.m_health.GetView();
 	auto weights = m_ampParts.m_weight.GetConstView();
-	m_ampParts.ForEach(Particle::Mat::Flag::Flame, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEachInBucket(Particle::AmpArrays::Bucket::Flame, [=](const int32 i) AMP_RESTRICT
 	{
 		float32& heat = heats[i];
 		const Particle::Mat& mat = mats[matIdxs[i]];
@@ -3775,7 +5131,7 @@ void ParticleSystem::SolveIgnite()
 	auto bodies = GetBodies();
 	auto bodyMats = GetConstBodyMats();
 	m_ampBodyContacts.ForEach(Particle::Mat::Flag::Flame,
-		[=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+		[=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
 	{
 		Body& b = bodies[contact.bodyIdx];
 		const Body::Mat& bMat = bodyMats[b.m_matIdx];
@@ -3789,8 +5145,19 @@ void ParticleSystem::SolveIgnite()
 	auto matIdxs = m_ampParts.m_matIdx.GetConstView();
 	auto mats = m_mats.m_array.GetConstView();
 	auto flags = m_ampParts.m_flags.GetView();
-	m_ampContacts.ForEach(Particle::Mat::Flag::Flame | Particle::Mat::Flag::Inflammable,
-		[=](const Particle::Contact& contact) restrict(amp)
+	const Particle::AmpArrays::BucketAppender buckets = m_ampParts.GetBucketAppender();
+	const Particle::EventLog log = GetEventLog();
+	const auto Ignite = [=](const int32 idx) AMP_RESTRICT
+	{
+		if (flags[idx] & Particle::Flag::Burning) return;
+		// only the contact that sets the flag logs the event
+		if (Concurrency::atomic_fetch_or(&flags[idx], (uint32)Particle::Flag::Burning) & Particle::Flag::Burning)
+			return;
+		buckets.Add(idx, Particle::Flag::Burning);
+		log.Add(Particle::Event::Ignited, idx, matIdxs[idx], INVALID_IDX);
+	};
+	m_ampContacts.ForEachInClass(Particle::ContactArrays::Class::Ignite,
+		[=](const Particle::Contact& contact) AMP_RESTRICT
 	{	
 		const int32 a = contact.idxA;
 		const int32 b = contact.idxB;
@@ -3802,18 +5169,21 @@ void ParticleSystem::SolveIgnite()
 		if (aIsFlame)
 		{
 			if (bMat.HasFlag(Particle::Mat::Flag::Inflammable) && heats[b] >= bMat.m_ignitionThreshold)
-				flags[b] |= Particle::Flag::Burning;
+				Ignite(b);
 		}
 		else
 		{
 			if (aMat.HasFlag(Particle::Mat::Flag::Inflammable) && heats[a] >= aMat.m_ignitionThreshold)
-				flags[a] |= Particle::Flag::Burning;
+				Ignite(a);
 		}
 	});
+	m_ampParts.MarkBucketsMayHaveGrown();
 }
 
 void ParticleSystem::SolveExtinguish()
 {
+	if (!(m_allFlags & Particle::Mat::Flag::Extinguishing)) return;
+
 	auto flags = m_ampParts.m_flags.GetView();
 	auto heats = m_ampParts.m_heat.GetConstView();
 	auto matIdxs = m_ampParts.m_matIdx.GetConstView();
@@ -3821,7 +5191,7 @@ void ParticleSystem::SolveExtinguish()
 	auto bodies = GetBodies();
 	auto bodyMats = GetConstBodyMats();
 	m_ampBodyContacts.ForEach(Particle::Mat::Flag::Extinguishing,
-		[=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+		[=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
 	{
 		Body& b = bodies[contact.bodyIdx];
 		if (!b.HasFlag(Body::Flag::Burning)) return;
@@ -3829,8 +5199,8 @@ void ParticleSystem::SolveExtinguish()
 		if (b.m_surfaceHeat < bodyMats[b.m_matIdx].m_ignitionThreshold)
 			b.RemFlag(Body::Flag::Burning);
 	});
-	m_ampContacts.ForEach(Particle::Flag::Burning | Particle::Mat::Flag::Extinguishing,
-		[=](const Particle::Contact& contact) restrict(amp)
+	m_ampContacts.ForEachInClass(Particle::ContactArrays::Class::Extinguish,
+		[=](const Particle::Contact& contact) AMP_RESTRICT
 	{
 		const int32 a = contact.idxA;
 		const int32 b = contact.idxB;
@@ -3859,7 +5229,7 @@ void ParticleSystem::SolveSource()
 	auto flags = m_ampParts.m_flags.GetView();
 	auto matIdxs = m_ampParts.m_matIdx.GetConstView();
 	auto groundMats = m_world.m_ground->GetConstMats();
-	m_ampGroundContacts.ForEach([=](int32 a, const Particle::GroundContact& contact) restrict(amp)
+	m_ampGroundContacts.ForEach([=](int32 a, const Particle::GroundContact& contact) AMP_RESTRICT
 	{
 		if (groundMats[contact.groundMatIdx].partMatIdx == matIdxs[a])
 			flags[a] = Particle::Flag::Zombie;
@@ -3883,13 +5253,15 @@ void ParticleSystem::SolveFluid()
 	//		b.RemFlags((int16)b2_burningBody);
 	//	}
 	//}
+	if (!(m_allFlags & Particle::Mat::Flag::Fluid)) return;
+
 	auto flags = m_ampParts.m_flags.GetView();
 	auto groundTiles = m_world.m_ground->GetTiles();
 	auto groundMats = m_world.m_ground->GetConstMats();
 	auto groundChunkHasChange = m_world.m_ground->GetChunkHasChange();
 	auto matIdxs = m_ampParts.m_matIdx.GetConstView();
 	m_ampGroundContacts.ForEach(Particle::Mat::Flag::Fluid,
-		[=](const int32 i, const Particle::GroundContact& contact) restrict(amp)
+		[=](const int32 i, const Particle::GroundContact& contact) AMP_RESTRICT
 	{
 		if (flags[i] & Particle::Flag::Controlled) return;
 		Ground::Tile& tile = groundTiles[contact.groundTileIdx];
@@ -3909,7 +5281,7 @@ void ParticleSystem::SolveFluid()
 	auto heats = m_ampParts.m_heat.GetView();
 	auto masses = m_ampParts.m_mass.GetConstView();
 	m_ampBodyContacts.ForEach(Particle::Mat::Flag::Fluid,
-		[=](const int32 i, const Particle::BodyContact& contact) restrict(amp)
+		[=](const int32 i, const Particle::BodyContact& contact) AMP_RESTRICT
 	{
 		Body& b = bodies[contact.bodyIdx];
 		if (b.HasFlag(Body::Flag::Wet) ||
@@ -3921,94 +5293,133 @@ void ParticleSystem::SolveFluid()
 		flags[i] = Particle::Flag::Zombie;
 	});
 
-	if (m_allFlags & Particle::Mat::Flag::Fluid)
-		m_allFlags |= Particle::Flag::Zombie;
+	m_allFlags |= Particle::Flag::Zombie;
 }
 void ParticleSystem::SolveKillNotMoving()
 {
+	if (!(m_allFlags & Particle::Mat::Flag::KillIfNotMoving)) return;
+
 	const Vec3& wind = m_world.m_wind;
 	const float32 minSpeed = m_def.minAirSpeed;
 	
 	auto flags = m_ampParts.m_flags.GetView();
 	auto velocities = m_ampParts.m_velocity.GetConstView();
 	auto weights = m_ampParts.m_weight.GetConstView();
-	m_ampParts.ForEach(Particle::Mat::Flag::KillIfNotMoving, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEach(Particle::Mat::Flag::KillIfNotMoving, [=](const int32 i) AMP_RESTRICT
 	{
 		const Vec3& v = velocities[i];
 		if (v.Length() < minSpeed || (v - wind).Length() < minSpeed || weights[i] < 0.2)
 			flags[i] = Particle::Flag::Zombie;
 	});
 	
-	if (m_allFlags & Particle::Mat::Flag::KillIfNotMoving)
-		m_allFlags |= Particle::Flag::Zombie;
+	m_allFlags |= Particle::Flag::Zombie;
+}
+
+// Moves the particle state of SolveChangeMat to newMatIdx.
+// @return false if the particle dies.
+inline bool ChangeToMat(const int32 newMatIdx, const ampArrayView<const Particle::MatTransition>& transitions,
+	int32& matIdx, uint32& f, Particle::MatTransition& t) AMP_RESTRICT
+{
+	matIdx = newMatIdx;
+	if (matIdx == INVALID_IDX) return false;
+	t = transitions[matIdx];
+	f = ((f & Particle::k_mask) & ~Particle::Flag::Controlled) | t.flags;
+	if (!(t.flags & Particle::Mat::Flag::Inflammable))
+		f &= ~Particle::Flag::Burning;
+	return true;
 }
 
 void ParticleSystem::SolveChangeMat()
 {
+	if (!(m_allFlags & Particle::Mat::k_changeFlags))
+	{
+		if (IsLastIteration())
+			m_ampParts.m_matIdx.CopyToD11Async();
+		return;
+	}
+
+	typedef Particle::AmpArrays::Bucket Bucket;
 	auto flags = m_ampParts.m_flags.GetView();
 	auto masses = m_ampParts.m_mass.GetView();
 	auto invMasses = m_ampParts.m_invMass.GetView();
-	const auto UpdateParticle = [=](int32 idx, const Particle::Mat& newMat) restrict(amp)
-	{
-		uint32& f = flags[idx];
-		f = ((f & Particle::k_mask) & ~Particle::Flag::Controlled) | newMat.m_flags;
-		if (!(newMat.m_flags & Particle::Mat::Flag::Inflammable))
-			f &= ~Particle::Flag::Burning;
-		masses[idx] = newMat.m_mass;
-		invMasses[idx] = newMat.m_invMass;
-	};
+	auto healths = m_ampParts.m_health.GetView();
 	auto heats = m_ampParts.m_heat.GetConstView();
 	auto matIdxs = m_ampParts.m_matIdx.GetView();
-	auto mats = m_mats.m_array.GetConstView();
+	auto transitions = m_mats.m_transitions.GetConstView();
+	const Particle::AmpArrays::BucketAppender buckets = m_ampParts.GetBucketAppender();
+	auto changes = m_matChanges.GetView();
+	auto changeCnt = m_matChangeCnt.GetView();
+
+	// cold, hot and burned in one visit, a particle can go through all three,
+	// and each changed particle is appended once to m_matChanges
+	amp::fill(m_matChangeCnt.arr, 0);
+	m_ampParts.ForEachInBucket(Bucket::Change, [=](const int32 i) AMP_RESTRICT
+	{
+		const int32 oldMatIdx = matIdxs[i];
+		int32 matIdx = oldMatIdx;
+		Particle::MatTransition t = transitions[matIdx];
+		uint32 f = flags[i];
+		const float32 heat = heats[i];
+		bool changed = false, alive = true;
+		if (f & Particle::Mat::Flag::ChangeWhenCold && heat < t.coldThreshold)
+		{
+			alive = ChangeToMat(t.coldMatIdx, transitions, matIdx, f, t);
+			changed = true;
+		}
+		if (alive && f & Particle::Mat::Flag::ChangeWhenHot && heat > t.hotThreshold)
+		{
+			alive = ChangeToMat(t.hotMatIdx, transitions, matIdx, f, t);
+			changed = true;
+		}
+		if (alive && f & Particle::Flag::Burning && healths[i] <= 0)
+		{
+			alive = ChangeToMat(t.burnedMatIdx, transitions, matIdx, f, t);
+			if (alive) healths[i] = 1;
+			changed = true;
+		}
+		if (!changed) return;
 
-	m_ampParts.ForEach(Particle::Mat::Flag::ChangeWhenCold, [=](const int32 i) restrict(amp)
-	{
-		int32& matIdx = matIdxs[i];
-		const Particle::Mat& mat = mats[matIdx];
-		if (heats[i] >= mat.m_coldThreshold) return;
-			
-		matIdx = mat.m_changeToColdMatIdx;
-		if (matIdx != INVALID_IDX)
-			UpdateParticle(i, mats[matIdx]);
+		matIdxs[i] = matIdx;
+		if (alive)
+		{
+			flags[i] = f;
+			masses[i] = t.mass;
+			invMasses[i] = t.invMass;
+			buckets.Add(i, f);
+		}
 		else
 			flags[i] = Particle::Flag::Zombie;
+		Particle::MatChange& change = changes[amp::atomicInc(changeCnt[0])];
+		change.idx = i;
+		change.oldMatIdx = oldMatIdx;
+		change.newMatIdx = matIdx;
 	});
+	m_ampParts.MarkBucketsMayHaveGrown();
+	LogMatChanges();
 
-	m_ampParts.ForEach(Particle::Mat::Flag::ChangeWhenHot, [=](const int32 i) restrict(amp)
-	{
-		int32& matIdx = matIdxs[i];
-		const Particle::Mat& mat = mats[matIdx];
-		if (heats[i] <= mat.m_hotThreshold) return;
+	if (IsLastIteration())
+		m_ampParts.m_matIdx.CopyToD11Async();
 
-		matIdx = mat.m_changeToHotMatIdx;
-		if (matIdx != INVALID_IDX)
-			UpdateParticle(i, mats[matIdx]);
-		else
-			flags[i] = Particle::Flag::Zombie;
-	});
+	m_allFlags |= Particle::Flag::Zombie;
+}
 
-	auto healths = m_ampParts.m_health.GetView();
-	m_ampParts.ForEach(Particle::Flag::Burning, [=](const int32 i) restrict(amp)
+void ParticleSystem::LogMatChanges()
+{
+	const Particle::EventLog log = GetEventLog();
+	if (!log.Logs(Particle::Event::MatChanged)) return;
+	// the list is no longer than the bucket, the threads stride over it up to
+	// its count on the device
+	const int32 threadCnt = b2Max(m_ampParts.GetBucketCount(Particle::AmpArrays::Bucket::Change), TILE_SIZE);
+	auto changes = m_matChanges.GetConstView();
+	auto changeCnt = m_matChangeCnt.GetConstView();
+	amp::forEach(threadCnt, [=](const int32 t) AMP_RESTRICT
 	{
-		if (healths[i] > 0) return;
-		int32& matIdx = matIdxs[i];
-		const Particle::Mat& mat = mats[matIdx];
-
-		matIdx = mat.m_changeToBurnedMatIdx;
-		if (matIdx != INVALID_IDX)
+		for (int32 k = t; k < changeCnt[0]; k += threadCnt)
 		{
-			healths[i] = 1;
-			UpdateParticle(i, mats[matIdx]);
+			const Particle::MatChange& change = changes[k];
+			log.Add(Particle::Event::MatChanged, change.idx, change.oldMatIdx, change.newMatIdx);
 		}
-		else
-			flags[i] = Particle::Flag::Zombie;
 	});
-
-	if (IsLastIteration())
-		m_ampParts.m_matIdx.CopyToD11Async();
-
-	if (m_allFlags & Particle::Mat::k_changeFlags)
-		m_allFlags |= Particle::Flag::Zombie;
 }
 
 void ParticleSystem::SolveFreeze()
@@ -4019,25 +5430,34 @@ void ParticleSystem::SolveFreeze()
 void ParticleSystem::SolvePosition()
 {
 	const b2TimeStep& step = m_subStep;
+	// with fused integration the sweep also does SolveOutOfBounds
+	const bool deleteOutside = m_world.m_deleteOutside && m_def.fuseIntegration;
+	const Vec3 lowerBound = m_world.m_lowerBorder;
+	const Vec3 upperBound = m_world.m_upperBorder;
 	
 	auto positions = m_ampParts.m_position.GetView();
 	auto velocities = m_ampParts.m_velocity.GetConstView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	auto flags = m_ampParts.m_flags.GetView();
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
-		positions[i] += step.dt * velocities[i];
+		Vec3& p = positions[i];
+		p += step.dt * velocities[i];
+		if (deleteOutside && (!(p > lowerBound) || !(p < upperBound)))
+			flags[i] = Particle::Flag::Zombie;
 	});
 	if (IsLastIteration())
 		m_ampParts.m_position.CopyToD11Async();
 }
 void ParticleSystem::SolveOutOfBounds()
 {
-	if (!m_world.m_deleteOutside) return;
+	// SolvePosition checks the bounds with fused integration
+	if (!m_world.m_deleteOutside || m_def.fuseIntegration) return;
 	const Vec3& lowerBound = m_world.m_lowerBorder;
 	const Vec3& upperBound = m_world.m_upperBorder;
 
 	auto positions = m_ampParts.m_position.GetConstView();
 	auto flags = m_ampParts.m_flags.GetView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		const Vec3& p = positions[i];
 		if (!(p > lowerBound) || !(p < upperBound))
@@ -4055,17 +5475,19 @@ void ParticleSystem::SolveHealth()
 	auto flags = m_ampParts.m_flags.GetView();
 	auto masses = m_ampParts.m_mass.GetView();
 	auto invMasses = m_ampParts.m_invMass.GetView();
-	const auto UpdateParticle = [=](int32 idx, const Particle::Mat& newMat) restrict(amp)
+	const Particle::AmpArrays::BucketAppender buckets = m_ampParts.GetBucketAppender();
+	const auto UpdateParticle = [=](int32 idx, const Particle::Mat& newMat) AMP_RESTRICT
 	{
 		flags[idx] = (flags[idx] & Particle::k_mask) | newMat.m_flags;
 		masses[idx] = newMat.m_mass;
 		invMasses[idx] = newMat.m_invMass;
+		buckets.Add(idx, flags[idx]);
 	};
 
 	auto healths = m_ampParts.m_health.GetView();
 	auto mats = m_mats.m_array.GetConstView();
 	auto matIdxs = m_ampParts.m_matIdx.GetConstView();
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
 		float32& h = healths[i];
 		if (h > 0) return;
@@ -4077,6 +5499,7 @@ void ParticleSystem::SolveHealth()
 		else
 			flags[i] = Particle::Flag::Zombie;
 	});
+	m_ampParts.MarkBucketsMayHaveGrown();
 	m_allFlags |= Particle::Flag::Zombie;
 }
 
@@ -4087,7 +5510,7 @@ void ParticleSystem::CopyBodies()
 }
 
 template <class T1, class UnaryPredicate> 
-static void ParticleSystem::RemoveFromVectorIf(vector<T1>& v1,
+void ParticleSystem::RemoveFromVectorIf(vector<T1>& v1,
 	int32& size, UnaryPredicate pred, bool adjustSize)
 {
 	int newI = 0;
@@ -4111,10 +5534,10 @@ static void ParticleSystem::RemoveFromVectorIf(vector<T1>& v1,
 //	ampArrayView<uint32> invalidCnts(tileCnt);
 //	ampExtent e(m_contactCount);
 //	
-//	Concurrency::parallel_for_each(ampExtent(m_contactCount).tile<TILE_SIZE>(), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+//	Concurrency::parallel_for_each(ampExtent(m_contactCount).tile<TILE_SIZE>(), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 //	{
-//		tile_static uint32 invalid[TILE_SIZE];
-//		tile_static uint32 invalidCnt;
+//		AMP_TILE_STATIC uint32 invalid[TILE_SIZE];
+//		AMP_TILE_STATIC uint32 invalidCnt;
 //		if (tIdx.local[0] == 0) invalidCnt = 0;
 //		tIdx.barrier.wait_with_tile_static_memory_fence();
 //
@@ -4124,7 +5547,7 @@ static void ParticleSystem::RemoveFromVectorIf(vector<T1>& v1,
 //		tIdx.barrier.wait_with_tile_static_memory_fence();
 //		invalidCnts[tIdx.tile] = invalidCnt;
 //	});
-//	Concurrency::parallel_for_each(ampExtent(tileCnt).tile<TILE_SIZE>(), [=](ampTiledIdx<TILE_SIZE> tIdx) restrict(amp)
+//	Concurrency::parallel_for_each(ampExtent(tileCnt).tile<TILE_SIZE>(), [=](ampTiledIdx<TILE_SIZE> tIdx) AMP_RESTRICT
 //	{
 //
 //	});
@@ -4143,7 +5566,7 @@ static void ParticleSystem::RemoveFromVectorIf(vector<T1>& v1,
 //	}
 //}
 template <class T1, class T2, class UnaryPredicate>
-static void ParticleSystem::RemoveFromVectorsIf(vector<T1>& v1, vector<T2>& v2,
+void ParticleSystem::RemoveFromVectorsIf(vector<T1>& v1, vector<T2>& v2,
 	int32& size, UnaryPredicate pred, bool adjustSize)
 {
 	int newI = 0;
@@ -4162,7 +5585,7 @@ static void ParticleSystem::RemoveFromVectorsIf(vector<T1>& v1, vector<T2>& v2,
 	}
 }
 template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class UnaryPredicate>
-static void ParticleSystem::RemoveFromVectorsIf(
+void ParticleSystem::RemoveFromVectorsIf(
 	vector<T1>& v1, vector<T2>& v2, vector<T3>& v3, vector<T4>& v4, vector<T5>& v5, vector<T6>& v6, vector<T7>& v7,
 	int32& size, UnaryPredicate pred, bool adjustSize)
 {
@@ -4187,7 +5610,7 @@ static void ParticleSystem::RemoveFromVectorsIf(
 	}
 }
 template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class UnaryPredicate>
-static void ParticleSystem::RemoveFromVectorsIf(
+void ParticleSystem::RemoveFromVectorsIf(
 	vector<T1>& v1, vector<T2>& v2, vector<T3>& v3, vector<T4>& v4, vector<T5>& v5, vector<T6>& v6, vector<T7>& v7, vector<T8>& v8,
 	int32& size, UnaryPredicate pred, bool adjustSize)
 {
@@ -4213,7 +5636,7 @@ static void ParticleSystem::RemoveFromVectorsIf(
 	}
 }
 template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class UnaryPredicate1, class UnaryPredicate2> 
-static void ParticleSystem::RemoveFromVectorsIf(
+void ParticleSystem::RemoveFromVectorsIf(
 	vector<T1>& v1, vector<T2>& v2, vector<T3>& v3, vector<T4>& v4, vector<T5>& v5, vector<T6>& v6, vector<T7>& v7, vector<T8>& v8,
 	int32& size, UnaryPredicate1 pred1, UnaryPredicate2 pred2, bool adjustSize)
 {
@@ -4239,100 +5662,200 @@ static void ParticleSystem::RemoveFromVectorsIf(
 	}
 }
 
+void ParticleSystem::LogDeaths()
+{
+	const Particle::EventLog log = GetEventLog();
+	if (!log.Logs(Particle::Event::Died)) return;
+	auto flags = m_ampParts.m_flags.GetView();
+	auto matIdxs = m_ampParts.m_matIdx.GetConstView();
+	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
+	amp::forEach(m_ampParts.m_count, [=](const int32 i) AMP_RESTRICT
+	{
+		uint32& f = flags[i];
+		if (!(f & Particle::Flag::Zombie) || f & Particle::Flag::DeathLogged) return;
+		f |= Particle::Flag::DeathLogged;
+		log.Add(Particle::Event::Died, i, matIdxs[i], groupIdxs[i]);
+	});
+}
+
 void ParticleSystem::SolveZombie()
 {
 	if (m_ampParts.Empty()) return;
 	if (!(m_allFlags & Particle::Flag::Zombie)) return;
 	
+	// the deaths of the last step are logged in SolveEnd, these were destroyed since
+	LogDeaths();
 	auto groupIdxs = m_ampParts.m_groupIdx.GetConstView();
-	auto groupHasAlive = m_ampGroupHasAlive.section(0, m_groupCount);
-	amp::fill(groupHasAlive, 0u, m_groupCount);
-	m_ampParts.ForEach([=](const int32 i) restrict(amp)
+	auto groupAliveCnts = m_ampGroupAliveCnts.section(0, m_groupCount);
+	amp::fill(groupAliveCnts, 0u, m_groupCount);
+	m_ampParts.ForEach([=](const int32 i) AMP_RESTRICT
 	{
-		groupHasAlive[groupIdxs[i]] = 1;
+		Concurrency::atomic_fetch_inc(&groupAliveCnts[groupIdxs[i]]);
 	});
 	// add new dead groups to zombieRanges
 	bool groupWasDestroyed = false;
+	int32 aliveCnt = 0;
 	for (int32 i = 0; i < m_groupCount; i++)
 	{
 		auto& group = m_groupBuffer[i];
-		if (!groupHasAlive[i] && group.m_firstIndex != INVALID_IDX)
+		const int32 groupAliveCnt = groupAliveCnts[i];
+		aliveCnt += groupAliveCnt;
+		if (!groupAliveCnt && group.m_firstIndex != INVALID_IDX)
 		{
 			DestroyGroup(i);
 			groupWasDestroyed = true;
 		}
 	}
 	if (groupWasDestroyed)
-	{
 		ResizeParticleBuffers(m_ampParts.m_count);
+	if (CompactZombies(aliveCnt) || groupWasDestroyed)
+	{
 		m_ampCopyFutGroups.set(amp::copyAsync(m_groupBuffer, m_ampGroups, m_groupCount));
 		m_needsUpdateAllParticleFlags = true;
 	}
 }
 
-void ParticleSystem::AddZombieRange(int32 firstIdx, int32 lastIdx)
+bool ParticleSystem::CompactZombies(const int32 aliveCnt)
 {
-	// at the end of the Particle Buffers
-	if (m_ampParts.m_count == lastIdx)
+	const int32 cnt = m_ampParts.m_count;
+	if (m_def.zombieCompactionFraction <= 0 || !cnt) return false;
+	if (cnt - aliveCnt <= cnt * m_def.zombieCompactionFraction) return false;
+
+	auto flags = m_ampParts.m_flags.GetConstView();
+	ampArrayView<int32> alive = amp::scratch().Alloc<int32>(cnt);
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		alive[i] = !(flags[i] & Particle::Flag::Zombie);
+	});
+	m_reorder.Resize(cnt);
+	m_reorderIdx.Resize(cnt);
+	auto order = m_reorder.GetView();
+	auto newIdxs = m_reorderIdx.GetView();
+	// alive particles before i, which is the new index of an alive particle
+	amp::scan(ampArrayView<const int32>(alive), cnt,
+		[=](const int32 i, const int32 wi) AMP_RESTRICT
+	{
+		newIdxs[i] = wi;
+	});
+
+	// alive particles move down in order, zombies go behind them
+	amp::forEach(cnt, [=](const int32 i) AMP_RESTRICT
+	{
+		const int32 wi = newIdxs[i];
+		order[alive[i] ? wi : aliveCnt + i - wi].Set(i, 0);
+	});
+	m_ampParts.Reorder(order);
+	// the deaths logged by SolveZombie lose their index
+	RemapEvents(cnt, aliveCnt);
+	if (m_pairCount)
+	{
+		const int32 pairCnt = m_pairCount;
+		auto pairs = m_ampPairs.section(0, pairCnt);
+		ampArrayView<int32> keep = amp::scratch().Alloc<int32>(pairCnt);
+		ampArrayView<b2ParticlePair> kept = amp::scratch().Alloc<b2ParticlePair>(pairCnt);
+		amp::forEach(pairCnt, [=](const int32 i) AMP_RESTRICT
+		{
+			const b2ParticlePair& pair = pairs[i];
+			keep[i] = alive[pair.indexA] && alive[pair.indexB];
+		});
+		m_pairCount = amp::scan(ampArrayView<const int32>(keep), pairCnt,
+			[=](const int32 i, const int32 wi) AMP_RESTRICT
+		{
+			if (!keep[i]) return;
+			b2ParticlePair pair = pairs[i];
+			pair.indexA = newIdxs[pair.indexA];
+			pair.indexB = newIdxs[pair.indexB];
+			kept[wi] = pair;
+		});
+		if (m_pairCount)
+			Concurrency::copy(kept.section(0, m_pairCount), pairs.section(0, m_pairCount));
+	}
+	if (m_triadCount)
 	{
-		int32 newCnt = firstIdx;
-		if (!m_zombieRanges.empty() && newCnt == m_zombieRanges.back().second)	// connected to previous
+		const int32 triadCnt = m_triadCount;
+		auto triads = m_ampTriads.section(0, triadCnt);
+		ampArrayView<int32> keep = amp::scratch().Alloc<int32>(triadCnt);
+		ampArrayView<b2ParticleTriad> kept = amp::scratch().Alloc<b2ParticleTriad>(triadCnt);
+		amp::forEach(triadCnt, [=](const int32 i) AMP_RESTRICT
+		{
+			const b2ParticleTriad& triad = triads[i];
+			keep[i] = alive[triad.indexA] && alive[triad.indexB] && alive[triad.indexC];
+		});
+		m_triadCount = amp::scan(ampArrayView<const int32>(keep), triadCnt,
+			[=](const int32 i, const int32 wi) AMP_RESTRICT
+		{
+			if (!keep[i]) return;
+			b2ParticleTriad triad = triads[i];
+			triad.indexA = newIdxs[triad.indexA];
+			triad.indexB = newIdxs[triad.indexB];
+			triad.indexC = newIdxs[triad.indexC];
+			kept[wi] = triad;
+		});
+		if (m_triadCount)
 		{
-			newCnt = m_zombieRanges.back().first;
-			m_zombieRanges.pop_back();
+			Concurrency::copy(kept.section(0, m_triadCount), triads.section(0, m_triadCount));
+			amp::copy(m_ampTriads, m_triadBuffer, m_triadCount);
 		}
-		ResizeParticleBuffers(newCnt);
-		return;
 	}
-	// merge with prev or next range if possible
-	for (auto curr = m_zombieRanges.begin(), prev = m_zombieRanges.begin(); curr != m_zombieRanges.end(); prev = curr, curr++)
+
+	// a range [first, last) maps to the alive particles before first and last
+	vector<int32> newIdxBuf(cnt);
+	amp::copy(m_reorderIdx.arr, newIdxBuf, cnt);
+	newIdxBuf.push_back(aliveCnt);
+	for (int32 i = 0; i < m_groupCount; i++)
 	{
-		if (firstIdx < curr->first)
+		ParticleGroup& group = m_groupBuffer[i];
+		if (group.m_firstIndex == INVALID_IDX) continue;
+		group.m_firstIndex = newIdxBuf[group.m_firstIndex];
+		group.m_lastIndex = newIdxBuf[group.m_lastIndex];
+	}
+	if (!m_handleIndexBuffer.empty())
+	{
+		vector<b2ParticleHandle*> handles(m_handleIndexBuffer.size(), nullptr);
+		for (int32 i = 0; i < cnt; i++)
 		{
-			if (prev->second == firstIdx)
+			b2ParticleHandle* handle = m_handleIndexBuffer[i];
+			const int32 newIdx = newIdxBuf[i];
+			if (newIdxBuf[i + 1] == newIdx)		// zombie
 			{
-				if (curr->first == lastIdx)	// connects two existing ranges
-				{
-					prev->second = curr->second;
-					m_zombieRanges.erase(curr);
-				}
-				else						// connected to previous range
-					prev->second = lastIdx;
+				if (handle) handle->SetIndex(INVALID_IDX);
+				continue;
 			}
-			else if (curr->first == lastIdx)	// connected to next range
-				curr->first = firstIdx;
-			else								// connected to no range, but between existing ones
-				m_zombieRanges.insert(curr, pair(firstIdx, lastIdx));
-			return;
+			if (handle) handle->SetIndex(newIdx);
+			handles[newIdx] = handle;
 		}
+		m_handleIndexBuffer.swap(handles);
 	}
-	// if at the end, join with previous if connected or create new
-	if (!m_zombieRanges.empty() && m_zombieRanges.back().second == firstIdx)	
-		m_zombieRanges.back().second = lastIdx;
-	else
-		m_zombieRanges.push_back(pair(firstIdx, lastIdx));
+
+	m_zombieRanges.Clear();
+	ResizeParticleBuffers(aliveCnt);
+	Particle::CopyAmpArraysToBuffers(m_ampParts, m_buffers);
+	m_ampParts.m_matIdx.CopyToD11Async();
+	m_ampParts.m_weight.CopyToD11Async();
+	m_proxiesCoherent = false;
+	m_neighboursValid = false;
+	return true;
+}
+
+void ParticleSystem::AddZombieRange(int32 firstIdx, int32 lastIdx)
+{
+	m_zombieRanges.Free(firstIdx, lastIdx);
+	// a range at the end of the particle buffers shrinks them instead
+	const int32 newCnt = m_zombieRanges.TrimEnd(m_ampParts.m_count);
+	if (newCnt != m_ampParts.m_count)
+		ResizeParticleBuffers(newCnt);
 }
 
 uint32 ParticleSystem::GetWriteIdx(int32 particleCnt)
 {
-	uint32 writeIdx;
-	for (auto zombieRange = m_zombieRanges.begin(); zombieRange != m_zombieRanges.end(); zombieRange++)
-	{
-		int32 remainingSpace = zombieRange->second - zombieRange->first - particleCnt;
-		if (remainingSpace >= 0)
-		{
-			writeIdx = zombieRange->first;
-			if (remainingSpace == 0)
-				m_zombieRanges.erase(zombieRange);
-			else
-				zombieRange->first += particleCnt;
-			return writeIdx;
-		}
-	}
-	writeIdx = m_ampParts.m_count;
-	ResizeParticleBuffers(m_ampParts.m_count + particleCnt);
-	m_ampParts.m_count += particleCnt;
-	return writeIdx;
+	// new particles have no proxy yet
+	m_proxiesCoherent = false;
+	const int32 writeIdx = m_zombieRanges.Allocate(particleCnt);
+	if (writeIdx != INVALID_IDX) return writeIdx;
+	// ResizeParticleBuffers sets the new count
+	const int32 endIdx = m_ampParts.m_count;
+	ResizeParticleBuffers(endIdx + particleCnt);
+	return endIdx;
 }
 
 /// Get the time elapsed in b2ParticleSystemDef::lifetimeGranularity.
@@ -4355,7 +5878,7 @@ template <typename T> void ParticleSystem::SetUserOverridableBuffer(
 	if (!buffer->userSuppliedCapacity && buffer->data())
 	{
 		m_world.m_blockAllocator.Free(
-			buffer->data(), sizeof(T) * m_capacity);
+			buffer->data(), sizeof(T) * m_ampParts.m_capacity);
 	}
 	buffer->data = newData;
 	buffer->userSuppliedCapacity = newCapacity;
@@ -4384,11 +5907,50 @@ void ParticleSystem::SetColorBuffer(int32* buffer, int32 capacity)
 	m_buffers.color.assign(buffer, buffer + capacity);
 }
 
+Particle::EventLog ParticleSystem::GetEventLog()
+{
+	return { m_events.GetView(), m_eventCnt.GetView(),
+		b2Min(m_def.maxEvents, m_events.arr.extent[0]), m_def.eventTypes };
+}
+
+void ParticleSystem::RemapEvents(const int32 cnt, const int32 aliveCnt)
+{
+	if (!m_def.eventTypes) return;
+	// the count stays on the device, the events past it are skipped
+	const Particle::EventLog log = GetEventLog();
+	auto events = log.events;
+	auto eventCnt = log.cnt;
+	auto newIdxs = m_reorderIdx.GetConstView();
+	amp::forEach(log.max, [=](const int32 k) AMP_RESTRICT
+	{
+		if (k >= eventCnt[0]) return;
+		int32& idx = events[k].idx;
+		if (idx == INVALID_IDX) return;
+		// a removed particle has the new index of the next one
+		const int32 newIdx = newIdxs[idx];
+		const int32 nextIdx = idx + 1 < cnt ? newIdxs[idx + 1] : aliveCnt;
+		idx = newIdx == nextIdx ? INVALID_IDX : newIdx;
+	});
+}
+
+const vector<Particle::Event>& ParticleSystem::ReadEvents(int32* outDropped)
+{
+	// the count was copied back at the end of the step, the events are only
+	// copied as far as they go
+	m_eventCntFuture.wait();
+	const int32 logged = m_def.eventTypes ? m_eventCntHost : 0;
+	const int32 cnt = b2Min(logged, GetEventLog().max);
+	m_eventBuffer.resize(cnt);
+	if (cnt) amp::copy(m_events.arr, m_eventBuffer, cnt);
+	if (outDropped) *outDropped = logged - cnt;
+	return m_eventBuffer;
+}
+
 void ParticleSystem::RemovePartFlagFromAll(const uint32 flag)
 {
 	const uint32 invFlag = ~flag;
 	auto flags = m_ampParts.m_flags.GetView();
-	m_ampParts.ForEach(flag, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEach(flag, [=](const int32 i) AMP_RESTRICT
 	{
 		flags[i] &= invFlag;
 	});
@@ -4415,50 +5977,43 @@ void ParticleSystem::SetGroupFlags(
 	if (~m_allGroupFlags & newFlags)
 	{
 		// If any flags were added
-		//if (newFlags & ParticleGroup::Flag::Solid)
-		//	RequestBuffer(m_buffers.depth, m_hasDepth);
-		
 		m_allGroupFlags |= newFlags;
 	}
 	oldFlags = newFlags;
 }
 void ParticleSystem::UpdateStatistics(const ParticleGroup& group) const
 {
-	if (group.m_timestamp != m_timestamp)
+	if (group.m_timestamp == m_timestamp) return;
+
+	// The reduction of SolveRigid, for every stale group at once, so querying
+	// the statistics of all groups costs one dispatch and one readback.
+	m_staleGroupIdxs.clear();
+	m_staleRanges.clear();
+	for (int32 k = 0; k < m_groupCount; k++)
 	{
-		const float32 m = m_mats.m_vector[group.m_matIdx].m_mass;
-		const int32& firstIdx = group.m_firstIndex;
-		const int32& lastIdx = group.m_lastIndex;
-		float32& mass = group.m_mass = 0;
-		Vec2& center = group.m_center;
-		Vec2& linVel = group.m_linearVelocity;
-		center.SetZero();
-		linVel.SetZero();
-		for (int32 i = firstIdx; i < lastIdx; i++)
-		{
-			mass += m;
-			center += m * (Vec2)m_buffers.position[i];
-			linVel += m * (Vec2)m_buffers.velocity[i];
-		}
-		if (mass > 0)
-		{
-			center *= 1 / mass;
-			linVel *= 1 / mass;
-		}
-		float32& inertia = group.m_inertia = 0;
-		float32& angVel = group.m_angularVelocity = 0;
-		for (int32 i = firstIdx; i < lastIdx; i++)
-		{
-			Vec2 p = (Vec2)m_buffers.position[i] - center;
-			Vec2 v = (Vec2)m_buffers.velocity[i] - linVel;
-			inertia += m * b2Dot(p, p);
-			angVel += m * b2Cross(p, v);
-		}
-		if (inertia > 0)
-		{
-			angVel *= 1 / inertia;
-		}
-		group.m_timestamp = m_timestamp;
+		const ParticleGroup& g = m_groupBuffer[k];
+		if (g.m_firstIndex == INVALID_IDX || g.m_timestamp == m_timestamp) continue;
+		m_staleGroupIdxs.push_back(k);
+		m_staleRanges.push_back(g.m_firstIndex);
+		m_staleRanges.push_back(g.m_lastIndex);
+	}
+	const int32 staleCnt = (int32)m_staleGroupIdxs.size();
+	if (!staleCnt) return;
+	amp::copy(m_staleRanges, m_ampStaleRanges, 2 * staleCnt);
+	ReduceGroupStatistics(ampArrayView<const int32>(m_ampStaleRanges), staleCnt,
+		ampArrayView<GroupStatistics>(m_ampStaleStats));
+	m_staleStats.resize(staleCnt);
+	amp::copy(m_ampStaleStats, m_staleStats, staleCnt);
+	for (int32 s = 0; s < staleCnt; s++)
+	{
+		const ParticleGroup& g = m_groupBuffer[m_staleGroupIdxs[s]];
+		const GroupStatistics& stats = m_staleStats[s];
+		g.m_mass = stats.mass;
+		g.m_center = stats.center;
+		g.m_linearVelocity = stats.linearVelocity;
+		g.m_inertia = stats.inertia;
+		g.m_angularVelocity = stats.angularVelocity;
+		g.m_timestamp = m_timestamp;
 	}
 }
 
@@ -4471,7 +6026,8 @@ inline void ParticleSystem::PrepareForceBuffer()
 {
 	if (!m_hasForce)
 	{
-		amp::fill(m_ampParts.m_force.arr, Vec3_zero, m_ampParts.m_count);
+		if (!m_ampParts.RequireColumn(Particle::AmpArrays::Column::Force))
+			amp::fill(m_ampParts.m_force.arr, Vec3_zero, m_ampParts.m_count);
 		m_hasForce = true;
 	}
 }
@@ -4503,7 +6059,7 @@ void ParticleSystem::ApplyForce(int32 firstIndex, int32 lastIndex, const Vec3& f
 
 		// Distribute the force over all the particles.
 		auto forces = m_ampParts.m_force.GetView();
-		amp::forEach(firstIndex, lastIndex, [=](const int32 i) restrict(amp)
+		amp::forEach(firstIndex, lastIndex, [=](const int32 i) AMP_RESTRICT
 		{
 			forces[i] += distributedForce;
 		});
@@ -4518,7 +6074,7 @@ void ParticleSystem::PullIntoCircle(const Vec3& pos, const float32 radius,
 	
 	auto positions = m_ampParts.m_position.GetView();
 	auto forces = ignoreMass ? m_ampParts.m_velocity.GetView() : m_ampParts.m_force.GetView();
-	m_ampParts.ForEach(flag, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEach(flag, [=](const int32 i) AMP_RESTRICT
 	{
 		Vec3& p = positions[i];
 		Vec3& f = forces[i];
@@ -4543,7 +6099,7 @@ void ParticleSystem::Swirl(const Vec3& center, float32 swirlStrength, float32 pu
 	PrepareForceBuffer();
 	auto positions = m_ampParts.m_position.GetConstView();
 	auto forces = m_ampParts.m_force.GetView();
-	m_ampParts.ForEach(flag, [=](const int32 i) restrict(amp)
+	m_ampParts.ForEach(flag, [=](const int32 i) AMP_RESTRICT
 	{
 		Vec3 toCenter = center - positions[i];
 		float32 toCenterLength = toCenter.Length();
@@ -4559,7 +6115,12 @@ void ParticleSystem::ParticleApplyForce(int32 index, const Vec3& force)
 	if (IsSignificantForce(force) &&
 		ForceCanBeApplied(m_buffers.flags[index]))
 	{
-		m_buffers.force[index] += force;
+		PrepareForceBuffer();
+		auto forces = m_ampParts.m_force.GetView();
+		amp::forEach(index, index + 1, [=](const int32 i) AMP_RESTRICT
+		{
+			forces[i] += force;
+		});
 	}
 }
 
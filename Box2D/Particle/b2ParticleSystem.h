@@ -20,6 +20,8 @@
 #include <Box2D/Common/b2SlabAllocator.h>
 #include <Box2D/Common/b2GrowableBuffer.h>
 #include <Box2D/Common/Global.h>
+#include <Box2D/Common/b2TaskGraph.h>
+#include <Box2D/Common/b2FreeRanges.h>
 #include <Box2D/Particle/b2Particle.h>
 #include <Box2D/Particle/b2ParticleContact.h>
 #include <Box2D/Particle/b2ParticleGroup.h>
@@ -33,8 +35,11 @@
 #include <Box2D/Collision/Shapes/b2ChainShape.h>
 #include <vector>
 #include <numeric>
+#include <atomic>
+#ifndef AMP_CPU_BACKEND
 #include <process.h>
 #include <amp.h>
+#endif
 
 class b2World;
 struct b2Shape;
@@ -52,9 +57,6 @@ struct b2AABB;
 struct FindContactInput;
 struct FindContactCheck;
 
-struct Particle::Mat;
-struct ParticleGroup::Def;
-struct Body::Mat;
 
 using namespace std;
 
@@ -74,7 +76,9 @@ struct b2ParticlePair
 	float32 distance;
 
 	inline bool HasFlag(const uint32 f) const { return flags & f; }
-	inline bool HasFlag(const uint32 f) const restrict(amp) { return flags & f; }
+#ifndef AMP_CPU_BACKEND
+	inline bool HasFlag(const uint32 f) const AMP_RESTRICT { return flags & f; }
+#endif
 };
 
 /// Connection between three particles
@@ -94,7 +98,9 @@ struct b2ParticleTriad
 	float32 ka, kb, kc, s;
 
 	inline bool HasFlag(const uint32 f) const { return flags & f; }
-	inline bool HasFlag(const uint32 f) const restrict(amp) { return flags & f; }
+#ifndef AMP_CPU_BACKEND
+	inline bool HasFlag(const uint32 f) const AMP_RESTRICT { return flags & f; }
+#endif
 };
 
 struct b2ParticleSystemDef
@@ -103,6 +109,18 @@ struct b2ParticleSystemDef
 	{
 		accelerate = true;
 		strictContactCheck = false;
+		concurrentPasses = false;
+		fuseIntegration = false;
+		fuseContactPasses = false;
+		colorContacts = false;
+		deterministic = false;
+		deterministicSeed = 0;
+		reorderInterval = 0;
+		gridContacts = false;
+		neighbourSkin = 0.0f;
+		zombieCompactionFraction = 0.25f;
+		eventTypes = 0;
+		maxEvents = 1 << 14;
 		density = 1.0f;
 		gravityScale = 1.0f;
 		radius = 1.0f;
@@ -141,6 +159,63 @@ struct b2ParticleSystemDef
 	/// intersections.
 	bool strictContactCheck;
 
+	/// Run the passes of a particle iteration as a dependency graph, so
+	/// that independent passes run concurrently. See ParticleSystem::Res.
+	bool concurrentPasses;
+
+	/// Apply gravity, wind, air resistance and the velocity limit in one
+	/// sweep, and the position update and bounds check in another. Air
+	/// resistance and the limit then act before the contact impulses of the
+	/// iteration instead of after them.
+	bool fuseIntegration;
+
+	/// Sum up the weights in the same traversal of the contact list as
+	/// viscosity. Only passes without an order between them are fused.
+	bool fuseContactPasses;
+
+	/// Color the contacts after finding them, so that contacts of one color
+	/// share no particle and are applied without atomics. Contacts left after
+	/// MAX_CONTACT_COLORS colors are applied with atomics.
+	bool colorContacts;
+
+	/// Give the same result on every run and for every thread count.
+	/// Particle contacts are colored until none are left, body contacts run
+	/// per particle in order
+	/// and their impulses are summed per body in particle order, and the
+	/// impulses of pairs, triads and rigid damping are summed per target in
+	/// order. The wind noise follows deterministicSeed instead of rand().
+	bool deterministic;
+
+	/// Seeds the wind noise of deterministic mode, which is a hash of the
+	/// seed, the timestamp and the particle iteration.
+	uint32 deterministicSeed;
+
+	/// Move the particle data into proxy order every reorderInterval proxy
+	/// sorts, so that neighbours are close in memory. Particles stay inside
+	/// their group's index range. 0 disables the reordering.
+	int32 reorderInterval;
+
+	/// Find particle contacts with a hashed cell list instead of scanning the
+	/// rows of the sorted proxies. Faster for sparse particles like gas and spray.
+	bool gridContacts;
+
+	/// Find the pairs within diameter + skin once and reuse them as contact
+	/// candidates in the following particle iterations, until a particle moved
+	/// more than half the skin. In particle diameters, 0 disables the list.
+	float32 neighbourSkin;
+
+	/// Move the alive particles down over the zombies when more than this
+	/// fraction of the particles are zombies, and shrink the particle count.
+	/// Groups, pairs, triads, handles and the host buffers follow the particles.
+	/// The default is 0.25, 0 disables it.
+	float32 zombieCompactionFraction;
+
+	/// Bit set of the Particle::Event::Type to log on the device during a
+	/// step, see ParticleSystem::ReadEvents. 0 logs nothing.
+	uint32 eventTypes;
+	/// Events of a step beyond this count are dropped.
+	int32 maxEvents;
+
 	/// Set the particle density.
 	/// See SetDensity for details.
 	float32 density;
@@ -265,15 +340,17 @@ class ParticleSystem
 {
 private:
 	int32 m_iteration;
+	// particle iterations of the current step, Step can override the world's count
+	int32 m_iterationCnt;
 	b2TimeStep& m_step;
 	b2TimeStep m_subStep;
 
-	HANDLE findBodyContactsThread;
-
 
 public:
 	typedef void(__stdcall* ResizeCallback)(int32);
 	ResizeCallback m_resizeCallback;
+	typedef void(__stdcall* StepCallback)(int32);
+	StepCallback m_stepCallback;
 	b2ParticleSystemDef m_def;
 	bool m_debugContacts;
 
@@ -283,12 +360,107 @@ public:
 	Particle::ContactArrays m_ampContacts;
 	Particle::BodyContactArrays m_ampBodyContacts;
 	Particle::GroundContactArrays m_ampGroundContacts;
+	amp::RadixSortBuffers m_proxySortBuffers;
+	amp::RadixSortBuffers m_depthSortBuffers;	// contacts of ComputeDepth by first particle
+	amp::RadixSortBuffers m_targetSortBuffers;	// ordered forEachTarget, only passes writing Velocity
+	amp::Array<uint32> m_tagRange;		// lowest and highest tag of the alive particles
+	amp::Array<int32> m_proxyOutOfOrder;
+	int32 m_proxyCount;				// particle count of the last full sort
+	bool m_proxiesCoherent;			// the proxies hold every particle in the last order
+	struct ProxySortPath
+	{
+		enum
+		{
+			Kept,		// the last order was still sorted
+			FixUp,		// sorted by odd-even transposition
+			Full,		// radix sort
+			Count
+		};
+	};
+	int32 m_proxySortPathCnts[ProxySortPath::Count];
+	amp::Array<Proxy> m_reorder;		// old index of the particle moved to i
+	amp::Array<int32> m_reorderIdx;		// new index of particle i
+	int32 m_sortsSinceReorder;
+	// cell list of FindContacts with m_def.gridContacts
+	amp::Array<int32> m_cellCnt, m_cellStart, m_cellEnd, m_cellParticles;
+	amp::Array<uint32> m_cellKeys;
+	amp::Array<int32> m_cellZRange;		// lowest and highest z cell of the list
+	uint32 m_cellMask;
+	int32 m_cellZSpan;		// z cells of the last list, more than 1 layers the next one
+	bool m_cellsLayered;	// the cells of the list take z into account
+	// neighbour list of FindContacts with m_def.neighbourSkin
+	amp::Array<Particle::ContactIdx> m_neighbours;
+	amp::Array<int32> m_neighbourHit, m_neighbourOffset;
+	amp::Array<Vec3> m_neighbourPositions;	// positions when the list was built
+	amp::Array<int32> m_neighbourMoved;		// a particle moved more than half the skin
+	int32 m_neighbourCount, m_neighbourCapacity, m_neighbourParticleCount;
+	bool m_neighboursValid;
+	// mat changes of the last SolveChangeMat, at most one per particle
+	amp::Array<Particle::MatChange> m_matChanges;
+	amp::Array<int32> m_matChangeCnt;
+	// event log of the current step, its count is copied back in SolveEnd
+	amp::Array<Particle::Event> m_events;
+	amp::Array<int32> m_eventCnt;
+	int32 m_eventCntHost;
+	amp::CopyFuture m_eventCntFuture;
+	vector<Particle::Event> m_eventBuffer;
+
+	/// Data read (Needs) and written (Modifies) by the passes.
+	/// BuildPassGraph declares these sets for every pass.
+	struct Res
+	{
+		enum : uint32
+		{
+			Step			= 1u << 0,	// m_subStep, m_iteration
+			// zombie, controlled and material bits, read by the zombie filter of ForEach.
+			// Only the passes that kill particles or change their material modify them.
+			Flags			= 1u << 1,
+			Position		= 1u << 2,
+			Velocity		= 1u << 3,
+			Mass			= 1u << 4,	// mass and invMass
+			Weight			= 1u << 5,
+			Heat			= 1u << 6,
+			Health			= 1u << 7,
+			MatIdx			= 1u << 8,
+			Force			= 1u << 9,	// includes m_hasForce
+			Accumulation	= 1u << 10,
+			StaticPressure	= 1u << 11,
+			Depth			= 1u << 12,
+			Proxies			= 1u << 13,
+			Contacts		= 1u << 14,
+			BodyContacts	= 1u << 15,
+			GroundContacts	= 1u << 16,
+			BodyMotion		= 1u << 17,	// body velocities, impulses and flags
+			BodyHeat		= 1u << 18,	// body surface heat
+			Ground			= 1u << 19,
+			Groups			= 1u << 20,	// groups and groupIdx
+			PairsTriads		= 1u << 21,
+			// Burning and Reactive bits, set and cleared during the iteration. Their
+			// writers also need Flags, so they never run alongside a writer of Flags.
+			StateFlags		= 1u << 22,
+			Buckets			= 1u << 23,	// flag buckets, rebuilt by ForEachInBucket
+			BodyImpulses	= 1u << 24,	// impulse buffers of the deterministic ForEachApply
+			All				= ~0u
+		};
+	};
 
 	bool ShouldSolve();
 	void SolveInit(int32 timestamp);
+	/// The optional particle columns are allocated by the passes that use
+	/// them and released in SolveInit when this bit set lacks them.
+	uint32 GetUsedColumns() const;
 
 	void InitStep();
 	void SortProxies();
+	/// Sorts the proxies by their full tags with the old 2 bit sort, for the benchmarks.
+	/// Leaves m_proxiesCoherent as it is.
+	void SortProxiesNarrow();
+	/// Sorts the proxies of the last sort again after updating their tags.
+	/// @return false if the full sort is needed.
+	bool ResortProxies();
+	int32 GetProxySortPathCount(int32 path) const { return m_proxySortPathCnts[path]; }
+	void ResetProxySortPathCounts() { std::fill(m_proxySortPathCnts, m_proxySortPathCnts + ProxySortPath::Count, 0); }
+	void ReorderParticles();		// Needs: Proxies	| Modifies: All
 	void UpdateContacts(bool exceptZombie);
 	void ReduceContacts();
 	void ComputeDepth();
@@ -305,6 +477,7 @@ public:
 	void SolveTensile();			// Needs: weight
 	void SolveSolid();
 	void SolveGravity();			// Needs: Mass		| Modifies: Velocity
+	void SolveFusedVelocity();		// Needs: Mass		| Modifies: Velocity
 	void SolveWind();				// Needs: Mass		| Modifies: Velocity
 	void SolveStaticPressure();
 	void SolvePressure();
@@ -332,6 +505,8 @@ public:
 	void SolveLooseHeat();
 	void CopyHeats();
 	void SolveChangeMat();
+	/// Logs Event::MatChanged for each entry of m_matChanges.
+	void LogMatChanges();
 
 	// Find Dead
 	void SolveHealth();
@@ -345,6 +520,18 @@ public:
 	void IncrementIteration();
 
 	void SolveEnd();
+
+	/// Runs SolveInit, all particle iterations in canonical pass order and SolveEnd
+	/// natively. Passes of materials not present in m_allFlags are skipped.
+	/// m_stepCallback is called once with the particle count when done.
+	/// @param iterations overrides the particle iterations of this step if > 0,
+	/// the world's particleIterations stay as they are.
+	/// @return false if ShouldSolve() declined the step.
+	bool Step(int32 iterations, int32 timestamp);
+	/// Builds the dependency graph of one particle iteration. Used by Step
+	/// if m_def.concurrentPasses is set.
+	void BuildPassGraph();
+	TaskGraph m_passGraph;
 	
 
 	void DestroyAllParticles();
@@ -392,7 +579,7 @@ public:
 	/// Initially, true, then, the last value passed into SetPaused().
 	bool GetPaused() const;
 
-	bool IsLastIteration() const { return m_iteration + 1 == m_step.particleIterations; }
+	bool IsLastIteration() const { return m_iteration + 1 == m_iterationCnt; }
 
 	/// Change the particle density.
 	/// Particle density affects the mass of the particles, which in turn
@@ -415,6 +602,15 @@ public:
 	/// Set flags for a particle. See the b2ParticleFlag enum.
 	void RemovePartFlagFromAll(const uint32 flags);
 
+	Particle::EventLog GetEventLog();
+	/// Moves the particle index of the events logged so far in the step to
+	/// m_reorderIdx, after ReorderParticles or CompactZombies.
+	/// @param aliveCnt the particles kept of cnt, the events of the others get INVALID_IDX.
+	void RemapEvents(int32 cnt, int32 aliveCnt);
+	/// Reads back the events of the last step, only as many as were logged.
+	/// @param outDropped events beyond m_def.maxEvents.
+	const vector<Particle::Event>& ReadEvents(int32* outDropped = nullptr);
+
 	/// Set an external buffer for particle data.
 	/// Normally, the b2World's block allocator is used for particle data.
 	/// However, sometimes you may have an OpenGL or Java buffer for particle
@@ -591,6 +787,7 @@ private:
 	friend struct ParticleGroup;
 	friend class b2ParticleBodyContactRemovePredicate;
 	friend class AmpFixtureParticleQueryCallback;
+	friend class ParticleBenchmark;
 #ifdef LIQUIDFUN_UNIT_TESTS
 	FRIEND_TEST(FunctionTests, GetParticleMass);
 	FRIEND_TEST(FunctionTests, AreProxyBuffersTheSame);
@@ -690,12 +887,14 @@ private:
 	template <typename T> T* ReallocateBuffer(
 		UserOverridableBuffer<T>* buffer, int32 oldCapacity, int32 newCapacity,
 		bool deferred);
-	template <typename T> void RequestBuffer(ampArray<T>& buf, bool& hasBuf);
 	
 	template<typename F> void ForEachGroup(const F& function) const;
 
-	template<typename F> void ForEachPair(const F& function) const;
-	template<typename F> void ForEachTriad(const F& function) const;
+	// Run record(i, values) for each pair or triad and apply(target, value, atomic)
+	// for the values it added, see amp::forEachTarget. Deterministic mode sums up the
+	// values of each target in order.
+	template<int32 N, typename T, typename F1, typename F2> void ForEachPair(const F1& record, const F2& apply);
+	template<int32 N, typename T, typename F1, typename F2> void ForEachTriad(const F1& record, const F2& apply);
 
 	void ResizeParticleBuffers(int32 size);
 	void ResizeGroupBuffers(int32 size);
@@ -752,6 +951,18 @@ private:
 	void UpdateAllGroupFlags();
 	void FindContacts(bool exceptZombie);
 	float32 FindContactsTest();
+	/// Fills the empty system with cnt resting particles of the given mass in a square
+	/// grid around the origin, stacked in layers above z = 0, all in the default
+	/// group 0. For the benchmarks, which empty the system again with
+	/// ResizeParticleBuffers(0).
+	void FillTestGrid(int32 cnt, float32 mass, int32 layers = 1);
+	void SearchContacts(bool exceptZombie, float32 radius, bool grid);
+	auto GetAddContactFn(const bool exceptZombie, const float32 radius);
+	void BuildCellList(bool exceptZombie, float32 cellSize);
+	void BuildNeighbourList(bool exceptZombie, float32 skin);
+	void CheckNeighboursMoved(float32 maxDisplacement);
+	void FindContactsOfNeighbours(bool exceptZombie);
+	bool AddNeighbourContacts(bool exceptZombie);
 	template<class T>
 	void reorder(vector<T>& v, const vector<int32>& order);
 	template<class T1, class T2>
@@ -765,7 +976,11 @@ private:
 
 	void SolveColorMixing();
 	void SolveFreeze();
+	/// Logs Event::Died once for each zombie.
+	void LogDeaths();
 	void SolveZombie();
+	/// @param aliveCnt the particles without the zombie flag, counted by SolveZombie.
+	bool CompactZombies(int32 aliveCnt);
 	/// Destroy all particles which have outlived their lifetimes set by
 	/// SetParticleLifetime().
 	void SolveLifetimes(const b2TimeStep& step);
@@ -793,6 +1008,36 @@ private:
 		vector<T1>& v1, vector<T2>& v2, vector<T3>& v3, vector<T4>& v4, vector<T5>& v5, vector<T6>& v6, vector<T7>& v7, vector<T8>& v8,
 		int32& size, UnaryPredicate1 pred1, UnaryPredicate2 pred2, bool adjustSize);
 
+	// Sums up the contact weights of the particles, see ComputeWeight.
+	void SumWeights(const bool fuseViscous);
+	// Per-contact parts of the contact passes, the viscous one is also fused
+	// into SumWeights, see m_def.fuseContactPasses.
+	// atomic = false if the contacts are applied one color at a time.
+	auto GetViscousContactFn(const bool atomic = true);
+	auto GetHeatConductContactFn();
+	auto GetDampingContactFn(const bool atomic = true);
+	// makeFunction(bool atomic) returns the per-contact function.
+	template<typename F> void ShuffledForEachContact(const F& makeFunction);
+	// Only over the contacts of a Particle::ContactArrays::Class.
+	template<typename F> void ShuffledForEachContact(const int32 contactClass, const F& makeFunction);
+	// Targets of the impulses of SolveBarrier and SolveRigidDamping, the kind in the
+	// top bits and the index of the particle, group or body below.
+	struct ImpulseTarget
+	{
+		enum : uint32
+		{
+			Velocity = 0,		// of a particle
+			Group = 1u << 30,	// a rigid group, z is the angular velocity
+			Body = 2u << 30,	// z is the angular impulse
+			Force = 3u << 30,	// of a particle
+			IdxMask = Group - 1
+		};
+	};
+	// Applies an impulse to its ImpulseTarget, see amp::forEachTarget.
+	auto GetApplyImpulseFn();
+
+	/// The phase of the wind noise of this particle iteration, in [0, 2pi).
+	float32 GetWindPhase() const;
 	float32 GetCriticalVelocity(const b2TimeStep& step) const;
 	float32 GetCriticalVelocitySquared(const b2TimeStep& step) const;
 	float32 GetCriticalPressure(const b2TimeStep& step) const;
@@ -895,12 +1140,11 @@ private:
 
 	bool m_paused;
 	int32 m_timestamp;
-	int32 m_allFlags;
+	std::atomic<int32> m_allFlags;	// passes may run concurrently
 	bool m_needsUpdateAllParticleFlags;
 	int32 m_allGroupFlags;
 	bool m_needsUpdateAllGroupFlags;
 	bool m_hasForce;
-	bool m_hasDepth;
 	float32 m_particleDiameter;
 	float32 m_particleRadius;
 	float32 m_particleVolume;
@@ -941,29 +1185,45 @@ private:
 
 	bool m_hasColorBuf;
 
-	list<pair<int32, int32>>	m_zombieRanges;
+	FreeRanges					m_zombieRanges;
 	vector<int32>				m_freeGroupIdxs;
 	vector<ParticleGroup>		m_groupBuffer;
-	vector<uint32>		m_groupHasAlive;
+	vector<uint32>		m_groupAliveCnts;
 	ampArray<ParticleGroup>	m_ampGroups;
-	ampArray<uint32>	m_ampGroupHasAlive;
-
-	/// When any particles have the flag b2_staticPressureParticle,
-	/// m_staticPressureBuffer is first allocated and used in
-	/// SolveStaticPressure() and SolvePressure().  It will be reallocated on
-	/// subsequent CreateParticle() calls.
-	bool hasStaticPressureBuf;
-	/// m_accumulationBuffer is used in many functions as a temporary buffer
-	/// for scalar values.
-	/// When any particles have the flag b2_tensileParticle,
-	/// m_accumulation2Buffer is first allocated and used in SolveTensile()
-	/// as a temporary buffer for vector values.  It will be reallocated on
-	/// subsequent CreateParticle() calls.
-	bool hasAccumulation2Buf;
-	/// When any particle groups have the flag b2_solidParticleGroup,
-	/// m_depthBuffer is first allocated and populated in ComputeDepth() and
-	/// used in SolveSolid(). It will be reallocated on subsequent
-	/// CreateParticle() calls.
+	ampArray<uint32>	m_ampGroupAliveCnts;
+
+	// of a group, reduced on the device by ReduceGroupStatistics
+	struct GroupStatistics
+	{
+		float32 mass;
+		float32 inertia;
+		float32 angularVelocity;
+		Vec2 center;
+		Vec2 linearVelocity;
+	};
+	/// Statistics of the particles [ranges[2 * k], ranges[2 * k + 1]) for
+	/// k < cnt, one tile per range. Zombies don't count.
+	void ReduceGroupStatistics(const ampArrayView<const int32>& ranges, int32 cnt,
+		const ampArrayView<GroupStatistics>& groupStats) const;
+
+	// rigid groups of SolveRigid, found in slot order
+	vector<int32>		m_rigidGroupIdxs;
+	vector<int32>		m_rigidSlots;	// of each group, INVALID_IDX if not rigid
+	vector<int32>		m_rigidRanges;	// first and last index of each slot
+	vector<GroupStatistics>	m_rigidStats;
+	vector<b2Transform>	m_rigidVelocityTransforms;
+	ampArray<int32>		m_ampRigidRanges;
+	ampArray<int32>		m_ampRigidSlots;
+	ampArray<GroupStatistics>	m_ampRigidStats;
+	ampArray<b2Transform>	m_ampRigidVelocityTransforms;
+
+	// stale groups of UpdateStatistics, reduced together on the first query
+	mutable vector<int32>	m_staleGroupIdxs;
+	mutable vector<int32>	m_staleRanges;
+	mutable vector<GroupStatistics>	m_staleStats;
+	mutable ampArray<int32>	m_ampStaleRanges;
+	mutable ampArray<GroupStatistics>	m_ampStaleStats;
+
 
 	int32 m_bodyContactFixtureCnt = 0;
 
@@ -275,8 +275,44 @@ EXPORT void IncrementIteration() { pPartSys->IncrementIteration(); }
 
 EXPORT void SolveEnd() { pPartSys->SolveEnd(); }
 
+EXPORT bool StepParticles(int32 iterations, int32 timestamp)
+{
+	return pPartSys != nullptr && pPartSys->Step(iterations, timestamp);
+}
+EXPORT void SetParticleStepCallback(ParticleSystem::StepCallback callback)
+{
+	if (pPartSys) pPartSys->m_stepCallback = callback;
+}
+
 
 EXPORT void SetStaticPressureIterations(int32 iterations) { pPartSys->m_def.staticPressureIterations = iterations; }
+EXPORT void SetConcurrentPasses(bool toggle) { pPartSys->m_def.concurrentPasses = toggle; }
+EXPORT void SetFuseIntegration(bool toggle) { pPartSys->m_def.fuseIntegration = toggle; }
+EXPORT void SetFuseContactPasses(bool toggle)
+{
+	pPartSys->m_def.fuseContactPasses = toggle;
+	pPartSys->m_passGraph.Clear();
+}
+EXPORT void SetColorContacts(bool toggle) { pPartSys->m_def.colorContacts = toggle; }
+EXPORT void SetDeterministic(bool toggle)
+{
+	pPartSys->m_def.deterministic = toggle;
+	pPartSys->m_passGraph.Clear();
+}
+EXPORT void SetDeterministicSeed(uint32 seed) { pPartSys->m_def.deterministicSeed = seed; }
+EXPORT void SetThreadCount(int32 cnt) { amp::setThreadCount(cnt); }
+EXPORT int32 GetProxySortPathCount(int32 path) { return pPartSys->GetProxySortPathCount(path); }
+EXPORT void ResetProxySortPathCounts() { pPartSys->ResetProxySortPathCounts(); }
+EXPORT int32 GetScratchAllocationCount() { return amp::scratch().GetAllocationCount(); }
+EXPORT void SetReorderInterval(int32 interval)
+{
+	pPartSys->m_def.reorderInterval = interval;
+	pPartSys->m_passGraph.Clear();
+}
+EXPORT int32 GetContactOverflowCount() { return pPartSys->m_ampContacts.GetOverflowCount(); }
+EXPORT void SetGridContacts(bool toggle) { pPartSys->m_def.gridContacts = toggle; }
+EXPORT void SetNeighbourSkin(float32 skin) { pPartSys->m_def.neighbourSkin = skin; }
+EXPORT void SetZombieCompactionFraction(float32 fraction) { pPartSys->m_def.zombieCompactionFraction = fraction; }
 
 EXPORT void SetDestroyStuck(bool toggle)
 {
@@ -313,6 +349,17 @@ EXPORT void SwirlParticles(Vec3 pos, float32 swirlStrength,
 
 EXPORT int32 GetParticleCapacity() { return pPartSys->m_ampParts.m_capacity; }
 EXPORT int32 GetParticleCount() { return pPartSys->m_ampParts.m_count; }
+/// Particles in a Particle::AmpArrays::Bucket at its last rebuild, next to GetParticleCount().
+EXPORT int32 GetParticleBucketCount(int32 bucket) { return pPartSys->m_ampParts.GetBucketCount(bucket); }
+/// Mask of 1 << Particle::Event::Type, 0 disables the log.
+EXPORT void SetParticleEventTypes(uint32 types) { pPartSys->m_def.eventTypes = types; }
+EXPORT void SetMaxParticleEvents(int32 maxEvents) { pPartSys->m_def.maxEvents = maxEvents; }
+/// Events of the last step, outDropped counts those past maxEvents.
+EXPORT Particle::Event* GetParticleEvents(int32* outCnt, int32* outDropped)
+{
+	*outCnt = (int32)pPartSys->ReadEvents(outDropped).size();
+	return pPartSys->m_eventBuffer.data();
+}
 
 EXPORT void SetParticleBufferResizeCallback(ParticleSystem::ResizeCallback callback)
 {
@@ -0,0 +1,18 @@
+// Stand-in for the Unity plugin header, so Interface.cpp builds in the CPU
+// CMake target. The Windows plugin is built against the real one.
+#pragma once
+
+#ifdef _MSC_VER
+#define UNITY_INTERFACE_EXPORT __declspec(dllexport)
+#define UNITY_INTERFACE_API __stdcall
+#else
+#define UNITY_INTERFACE_EXPORT __attribute__((visibility("default")))
+#define UNITY_INTERFACE_API
+#endif
+
+struct IUnityInterface {};
+
+struct IUnityInterfaces
+{
+	template <typename T> T* Get() { return nullptr; }
+};
@@ -0,0 +1,11 @@
+// Stand-in for the Unity D3D11 plugin header, see IUnityGraphics.h.
+#pragma once
+
+#include "IUnityGraphics.h"
+
+struct ID3D11Device;
+
+struct IUnityGraphicsD3D11 : IUnityInterface
+{
+	ID3D11Device* GetDevice() { return nullptr; }
+};
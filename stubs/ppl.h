@@ -0,0 +1,3 @@
+// Stand-in for the MSVC Parallel Patterns Library header, see IUnityGraphics.h.
+// Interface.cpp uses nothing from it.
+#pragma once